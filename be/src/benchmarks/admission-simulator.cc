@@ -0,0 +1,336 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <boost/foreach.hpp>
+#include <gflags/gflags.h>
+
+#include "scheduling/admission-controller.h"
+#include "util/cpu-info.h"
+#include "util/internal-queue.h"
+#include "util/pretty-printer.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Simulates the admission of a query trace to a cluster under the different admission
+// policies of the AdmissionController and reports the queue wait times, the memory
+// utilization of the backends and how often they were over their memory limit.
+//
+// The trace is read from --trace_file, a CSV file with one query per line:
+//   <arrival ms>,<pool>,<per-host planner memory estimate>,<per-host peak memory>,
+//   <duration ms>
+// Lines starting with '#' are ignored. Without a trace file, a synthetic trace with
+// estimates that are off by up to --synthetic_estimate_error in either direction is
+// generated.
+//
+// The model is deliberately simple: every query runs on all backends and consumes its
+// peak memory on each of them for its entire duration, all queries are coordinated by
+// the same impalad, and the consumption of the running queries becomes visible to
+// admission on the next statestore update.
+
+DEFINE_string(trace_file, "", "Query trace to simulate. If empty, a synthetic trace is "
+    "generated.");
+DEFINE_int32(num_backends, 10, "Number of backends of the simulated cluster.");
+DEFINE_int64(backend_mem_limit, 64L * 1024L * 1024L * 1024L, "Process memory limit of "
+    "each simulated backend, in bytes.");
+DEFINE_int64(pool_max_requests, -1, "Maximum number of running queries of each pool.");
+DEFINE_double(pool_mem_fraction, 0.75, "Memory limit of each pool as a fraction of the "
+    "memory of the cluster.");
+DEFINE_int32(statestore_update_ms, 1000, "Interval at which pool statistics are "
+    "updated.");
+DEFINE_int32(synthetic_num_queries, 2000, "Number of queries of the synthetic trace.");
+DEFINE_int32(synthetic_interarrival_ms, 500, "Mean time between the arrivals of queries "
+    "of the synthetic trace.");
+DEFINE_double(synthetic_estimate_error, 10.0, "Maximum factor by which the estimates of "
+    "the synthetic trace are off.");
+DEFINE_int32(synthetic_seed, 42, "Seed of the synthetic trace.");
+
+DECLARE_bool(admission_control_use_observed_mem);
+DECLARE_int64(admission_mem_reservation_ms);
+
+static const int64_t TICK_MS = 10;
+
+struct TraceQuery {
+  int64_t arrival_ms;
+  string pool;
+  int64_t per_host_mem_estimate;
+  int64_t per_host_peak_mem;
+  int64_t duration_ms;
+};
+
+// A queued query. Has the members that AdmissionController::GetNextQueued() uses.
+struct SimQueueNode : public InternalQueue<SimQueueNode>::Node {
+  const TraceQuery* query;
+  int64_t mem_estimate;
+  int64_t enqueue_time_ms;
+};
+
+struct RunningQuery {
+  const TraceQuery* query;
+  int64_t end_ms;
+  // Memory the query is accounted for in its pool's TPoolStats.mem_estimate.
+  int64_t accounted_mem;
+  // Time at which the reservation expires with observed memory.
+  int64_t reservation_expiration_ms;
+};
+
+struct SimResult {
+  int64_t makespan_ms;
+  // Queries rejected because they can never be admitted.
+  int64_t num_rejected;
+  vector<int64_t> wait_times_ms;
+  double mean_utilization;
+  double over_limit_fraction;
+  int64_t peak_backend_mem;
+};
+
+static bool ReadTrace(const string& path, vector<TraceQuery>* trace) {
+  ifstream file(path.c_str());
+  if (!file.is_open()) {
+    cerr << "Could not open trace file " << path << endl;
+    return false;
+  }
+  string line;
+  while (getline(file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    replace(line.begin(), line.end(), ',', ' ');
+    stringstream ss(line);
+    TraceQuery query;
+    ss >> query.arrival_ms >> query.pool >> query.per_host_mem_estimate
+       >> query.per_host_peak_mem >> query.duration_ms;
+    if (ss.fail()) {
+      cerr << "Invalid trace line: " << line << endl;
+      return false;
+    }
+    trace->push_back(query);
+  }
+  return true;
+}
+
+// Returns a value between 'min' and 'max' with a uniformly distributed logarithm.
+static double LogUniform(double min, double max) {
+  double r = static_cast<double>(rand()) / RAND_MAX;
+  return exp(log(min) + r * (log(max) - log(min)));
+}
+
+static void GenerateTrace(vector<TraceQuery>* trace) {
+  srand(FLAGS_synthetic_seed);
+  int64_t arrival_ms = 0;
+  for (int i = 0; i < FLAGS_synthetic_num_queries; ++i) {
+    TraceQuery query;
+    double r = (rand() + 1.0) / (RAND_MAX + 1.0);
+    arrival_ms += static_cast<int64_t>(-log(r) * FLAGS_synthetic_interarrival_ms);
+    query.arrival_ms = arrival_ms;
+    query.pool = rand() % 2 == 0 ? "a" : "b";
+    query.per_host_peak_mem =
+        static_cast<int64_t>(LogUniform(100L * 1024 * 1024, 8L * 1024 * 1024 * 1024));
+    query.per_host_mem_estimate = static_cast<int64_t>(query.per_host_peak_mem *
+        LogUniform(1.0 / FLAGS_synthetic_estimate_error, FLAGS_synthetic_estimate_error));
+    query.duration_ms = static_cast<int64_t>(LogUniform(1000, 60 * 1000));
+    trace->push_back(query);
+  }
+}
+
+static SimResult Simulate(const vector<TraceQuery>& trace) {
+  const int64_t num_hosts = FLAGS_num_backends;
+  const int64_t pool_mem_limit = static_cast<int64_t>(
+      FLAGS_pool_mem_fraction * num_hosts * FLAGS_backend_mem_limit);
+  map<string, TPoolStats> pool_stats;
+  map<string, InternalQueue<SimQueueNode> > queues;
+  vector<SimQueueNode> nodes(trace.size());
+  vector<RunningQuery> running;
+  // Per-pool consumption, as seen at the last statestore update.
+  map<string, int64_t> observed_mem;
+  int64_t observed_backend_mem = 0;
+
+  SimResult result;
+  result.num_rejected = 0;
+  result.peak_backend_mem = 0;
+  double utilization_sum = 0;
+  int64_t num_ticks = 0;
+  int64_t num_over_limit_ticks = 0;
+  int next_arrival = 0;
+  int64_t now = 0;
+  while (next_arrival < trace.size() || !running.empty() ||
+      result.wait_times_ms.size() + result.num_rejected < trace.size()) {
+    // Completed queries.
+    for (int i = running.size() - 1; i >= 0; --i) {
+      if (running[i].end_ms > now) continue;
+      TPoolStats* stats = &pool_stats[running[i].query->pool];
+      --stats->num_running;
+      stats->mem_estimate -= running[i].accounted_mem;
+      running[i] = running.back();
+      running.pop_back();
+    }
+    // Expired reservations.
+    if (FLAGS_admission_control_use_observed_mem) {
+      BOOST_FOREACH(RunningQuery& query, running) {
+        if (query.accounted_mem == 0 || query.reservation_expiration_ms > now) continue;
+        pool_stats[query.query->pool].mem_estimate -= query.accounted_mem;
+        query.accounted_mem = 0;
+      }
+    }
+    // Statestore updates.
+    if (now % FLAGS_statestore_update_ms == 0) {
+      observed_mem.clear();
+      observed_backend_mem = 0;
+      BOOST_FOREACH(const RunningQuery& query, running) {
+        observed_mem[query.query->pool] += query.query->per_host_peak_mem * num_hosts;
+        observed_backend_mem += query.query->per_host_peak_mem;
+      }
+      for (map<string, TPoolStats>::iterator it = pool_stats.begin();
+          it != pool_stats.end(); ++it) {
+        it->second.mem_usage = observed_mem[it->first];
+      }
+    }
+    // Arrivals.
+    while (next_arrival < trace.size() && trace[next_arrival].arrival_ms <= now) {
+      const int64_t per_host_mem = AdmissionController::GetPerHostAdmissionMem(
+          trace[next_arrival].per_host_mem_estimate, 0);
+      if (per_host_mem * num_hosts >= pool_mem_limit ||
+          (FLAGS_admission_control_use_observed_mem &&
+           per_host_mem >= FLAGS_backend_mem_limit)) {
+        ++result.num_rejected;
+        ++next_arrival;
+        continue;
+      }
+      SimQueueNode* node = &nodes[next_arrival];
+      node->query = &trace[next_arrival];
+      node->mem_estimate = trace[next_arrival].per_host_mem_estimate * num_hosts;
+      node->enqueue_time_ms = now;
+      queues[node->query->pool].Enqueue(node);
+      ++pool_stats[node->query->pool].num_queued;
+      ++next_arrival;
+    }
+
+    // Admission, visiting the pools in order of their share.
+    vector<pair<double, string> > pools;
+    for (map<string, TPoolStats>::iterator it = pool_stats.begin();
+        it != pool_stats.end(); ++it) {
+      if (it->second.num_queued == 0) continue;
+      pools.push_back(make_pair(AdmissionController::GetPoolShare(it->second,
+          FLAGS_pool_max_requests, pool_mem_limit), it->first));
+    }
+    sort(pools.begin(), pools.end());
+    for (int i = 0; i < pools.size(); ++i) {
+      InternalQueue<SimQueueNode>* queue = &queues[pools[i].second];
+      TPoolStats* stats = &pool_stats[pools[i].second];
+      while (!queue->empty()) {
+        SimQueueNode* node = AdmissionController::GetNextQueued(queue, now);
+        const int64_t per_host_mem = AdmissionController::GetPerHostAdmissionMem(
+            node->query->per_host_mem_estimate, 0);
+        if (FLAGS_pool_max_requests >= 0 &&
+            stats->num_running >= FLAGS_pool_max_requests) {
+          break;
+        }
+        if (AdmissionController::GetPoolMem(*stats) + per_host_mem * num_hosts >=
+            pool_mem_limit) {
+          break;
+        }
+        if (FLAGS_admission_control_use_observed_mem) {
+          int64_t reserved = 0;
+          BOOST_FOREACH(const RunningQuery& query, running) {
+            reserved += query.accounted_mem / num_hosts;
+          }
+          if (observed_backend_mem + reserved + per_host_mem >= FLAGS_backend_mem_limit) {
+            break;
+          }
+        }
+        queue->Remove(node);
+        --stats->num_queued;
+        ++stats->num_running;
+        RunningQuery query;
+        query.query = node->query;
+        query.end_ms = now + node->query->duration_ms;
+        query.accounted_mem = per_host_mem * num_hosts;
+        query.reservation_expiration_ms = now + FLAGS_admission_mem_reservation_ms;
+        stats->mem_estimate += query.accounted_mem;
+        running.push_back(query);
+        result.wait_times_ms.push_back(now - node->query->arrival_ms);
+      }
+    }
+
+    // Actual memory of each backend.
+    int64_t backend_mem = 0;
+    BOOST_FOREACH(const RunningQuery& query, running) {
+      backend_mem += query.query->per_host_peak_mem;
+    }
+    result.peak_backend_mem = max(result.peak_backend_mem, backend_mem);
+    utilization_sum += min(1.0,
+        static_cast<double>(backend_mem) / FLAGS_backend_mem_limit);
+    if (backend_mem > FLAGS_backend_mem_limit) ++num_over_limit_ticks;
+    ++num_ticks;
+    now += TICK_MS;
+  }
+  result.makespan_ms = now;
+  result.mean_utilization = utilization_sum / max<int64_t>(num_ticks, 1);
+  result.over_limit_fraction =
+      static_cast<double>(num_over_limit_ticks) / max<int64_t>(num_ticks, 1);
+  return result;
+}
+
+static void PrintResult(const string& name, SimResult* result) {
+  vector<int64_t>& waits = result->wait_times_ms;
+  sort(waits.begin(), waits.end());
+  int64_t total_wait = 0;
+  BOOST_FOREACH(int64_t wait, waits) total_wait += wait;
+  int64_t mean_wait = waits.empty() ? 0 : total_wait / waits.size();
+  int64_t p95_wait = waits.empty() ? 0 : waits[waits.size() * 95 / 100];
+  cout << setw(22) << left << name
+       << setw(12) << PrettyPrinter::Print(result->makespan_ms, TUnit::TIME_MS)
+       << setw(12) << PrettyPrinter::Print(mean_wait, TUnit::TIME_MS)
+       << setw(12) << PrettyPrinter::Print(p95_wait, TUnit::TIME_MS)
+       << setw(12) << setprecision(3) << result->mean_utilization * 100
+       << setw(12) << setprecision(3) << result->over_limit_fraction * 100
+       << setw(12) << PrettyPrinter::Print(result->peak_backend_mem, TUnit::BYTES)
+       << result->num_rejected << endl;
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CpuInfo::Init();
+
+  vector<TraceQuery> trace;
+  if (!FLAGS_trace_file.empty()) {
+    if (!ReadTrace(FLAGS_trace_file, &trace)) return 1;
+  } else {
+    GenerateTrace(&trace);
+  }
+  cout << "Simulating " << trace.size() << " queries on " << FLAGS_num_backends
+       << " backends" << endl << endl;
+  cout << setw(22) << left << "Policy" << setw(12) << "Makespan" << setw(12)
+       << "Mean wait" << setw(12) << "P95 wait" << setw(12) << "Util %" << setw(12)
+       << "Over limit %" << setw(12) << "Peak mem" << "Rejected" << endl;
+
+  const char* policies[] = {"fifo", "sjf"};
+  for (int observed = 0; observed <= 1; ++observed) {
+    for (int p = 0; p < 2; ++p) {
+      FLAGS_admission_control_use_observed_mem = observed;
+      FLAGS_admission_queue_policy = policies[p];
+      SimResult result = Simulate(trace);
+      PrintResult(string(observed ? "observed/" : "estimate/") + policies[p], &result);
+    }
+  }
+  return 0;
+}
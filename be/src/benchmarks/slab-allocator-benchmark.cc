@@ -0,0 +1,156 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include "runtime/slab-allocator.h"
+#include "util/benchmark.h"
+#include "util/bit-util.h"
+#include "util/cpu-info.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Benchmark for allocating and freeing the buffers that back MemPool chunks and io
+// buffers from many threads. Each thread allocates buffers of 8KB to 8MB, holds on to a
+// few of them and frees them again. Compares malloc()/free(), a single free list per
+// buffer size protected by a mutex (like the DiskIoMgr's free buffers) and the
+// SlabAllocator.
+//
+// Run with the number of threads that the machine has cores to see the effect of
+// contention; results depend heavily on the machine and the malloc implementation.
+
+// Number of allocations each thread does per iteration.
+const int ALLOCS_PER_ITER = 100;
+
+// Number of buffers each thread holds on to.
+const int HELD_BUFFERS = 4;
+
+// Smallest and number of buffer sizes.
+const int64_t MIN_BUFFER_SIZE = 8 * 1024;
+const int NUM_BUFFER_SIZES = 11;
+
+struct TestData {
+  int num_threads;
+};
+
+typedef uint8_t* (*AllocateFn)(int64_t len);
+typedef void (*FreeFn)(uint8_t* buffer, int64_t len);
+
+uint8_t* MallocAllocate(int64_t len) { return reinterpret_cast<uint8_t*>(malloc(len)); }
+void MallocFree(uint8_t* buffer, int64_t len) { free(buffer); }
+
+mutex free_lists_lock;
+list<uint8_t*> free_lists[NUM_BUFFER_SIZES];
+
+uint8_t* FreeListAllocate(int64_t len) {
+  int idx = BitUtil::Log2(len / MIN_BUFFER_SIZE);
+  {
+    lock_guard<mutex> l(free_lists_lock);
+    if (!free_lists[idx].empty()) {
+      uint8_t* buffer = free_lists[idx].front();
+      free_lists[idx].pop_front();
+      return buffer;
+    }
+  }
+  return reinterpret_cast<uint8_t*>(malloc(len));
+}
+void FreeListFree(uint8_t* buffer, int64_t len) {
+  int idx = BitUtil::Log2(len / MIN_BUFFER_SIZE);
+  lock_guard<mutex> l(free_lists_lock);
+  free_lists[idx].push_back(buffer);
+}
+
+uint8_t* SlabAllocate(int64_t len) { return SlabAllocator::instance()->Allocate(len); }
+void SlabFree(uint8_t* buffer, int64_t len) {
+  SlabAllocator::instance()->Free(buffer, len);
+}
+
+void AllocThread(AllocateFn allocate_fn, FreeFn free_fn, int thread_id, int64_t n) {
+  vector<pair<uint8_t*, int64_t> > held;
+  uint32_t rand_state = thread_id + 1;
+  for (int64_t i = 0; i < n; ++i) {
+    rand_state = rand_state * 1103515245 + 12345;
+    int size_idx = (rand_state >> 16) % NUM_BUFFER_SIZES;
+    int64_t len = MIN_BUFFER_SIZE << size_idx;
+    uint8_t* buffer = allocate_fn(len);
+    // Touch the buffer like a consumer would.
+    buffer[0] = buffer[len - 1] = i;
+    held.push_back(make_pair(buffer, len));
+    if (held.size() > HELD_BUFFERS) {
+      free_fn(held.front().first, held.front().second);
+      held.erase(held.begin());
+    }
+  }
+  for (int i = 0; i < held.size(); ++i) free_fn(held[i].first, held[i].second);
+}
+
+void LaunchThreads(void* d, AllocateFn allocate_fn, FreeFn free_fn, int batch_size) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  thread_group threads;
+  for (int i = 0; i < data->num_threads; ++i) {
+    threads.add_thread(new thread(AllocThread, allocate_fn, free_fn, i,
+        static_cast<int64_t>(batch_size) * ALLOCS_PER_ITER));
+  }
+  threads.join_all();
+}
+
+void TestMalloc(int batch_size, void* d) {
+  LaunchThreads(d, MallocAllocate, MallocFree, batch_size);
+}
+
+void TestFreeList(int batch_size, void* d) {
+  LaunchThreads(d, FreeListAllocate, FreeListFree, batch_size);
+}
+
+void TestSlab(int batch_size, void* d) {
+  LaunchThreads(d, SlabAllocate, SlabFree, batch_size);
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  const int max_threads = 16;
+  Benchmark suite("buffer allocation");
+  TestData data[max_threads + 1];
+  for (int i = 1; i <= max_threads; i *= 2) {
+    data[i].num_threads = i;
+
+    stringstream suffix;
+    stringstream name;
+    suffix << " " << i << "-Threads";
+
+    name.str("");
+    name << "Malloc" << suffix.str();
+    int baseline = suite.AddBenchmark(name.str(), TestMalloc, &data[i], -1);
+
+    name.str("");
+    name << "FreeList" << suffix.str();
+    suite.AddBenchmark(name.str(), TestFreeList, &data[i], baseline);
+
+    name.str("");
+    name << "SlabAllocator" << suffix.str();
+    suite.AddBenchmark(name.str(), TestSlab, &data[i], baseline);
+  }
+  cout << suite.Measure() << endl;
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+#include "exec/delimited-text-parser.inline.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/string-parser.h"
+
+using namespace impala;
+using namespace std;
+
+// Benchmark for parsing delimited text, i.e. the work the text scanner does on each
+// buffer before writing the tuples. Each iteration parses one buffer of BUFFER_SIZE
+// bytes of a table with NUM_COLS columns, so the throughput in GB/s per core is
+// rate (iters/ms) * BUFFER_SIZE / 10^6, i.e. rate * 0.065.
+//  - scalar: a character by character loop that finds the same field locations, for
+//    comparison with the DelimitedTextParser.
+//  - parser: DelimitedTextParser::ParseFieldLocations() without an escape character.
+//  - parser_escapes: the same data, but with an escape character set on the table. The
+//    data contains no escape characters.
+//  - parser_dense_escapes: data with an escaped delimiter in every other field.
+//  - parser_atoi: parser, plus StringToInt() of every field. This is the whole work
+//    of the scanner for a table of integers except for writing the slots.
+//  - parser_long_ints: the same for 15 digit integers.
+
+const int BUFFER_SIZE = 64 * 1024;
+const int NUM_COLS = 8;
+const int MAX_TUPLES = 1024;
+
+const char TUPLE_DELIM = '\n';
+const char FIELD_DELIM = ',';
+const char COLLECTION_DELIM = ':';
+const char ESCAPE_CHAR = '\\';
+
+struct TestData {
+  string buffer;
+  boost::scoped_ptr<DelimitedTextParser> parser;
+  vector<char*> row_end_locations;
+  vector<FieldLocation> field_locations;
+  bool is_materialized_col[NUM_COLS];
+  int64_t checksum;
+
+  TestData(const string& buffer, bool escapes)
+    : buffer(buffer), row_end_locations(MAX_TUPLES),
+      field_locations(MAX_TUPLES * NUM_COLS), checksum(0) {
+    for (int i = 0; i < NUM_COLS; ++i) is_materialized_col[i] = true;
+    parser.reset(new DelimitedTextParser(NUM_COLS, 0, is_materialized_col,
+        TUPLE_DELIM, FIELD_DELIM, COLLECTION_DELIM, escapes ? ESCAPE_CHAR : '\0'));
+  }
+};
+
+// Returns a buffer of BUFFER_SIZE bytes of rows of NUM_COLS random integers with up to
+// 'max_digits' digits. If 'escapes' is true, every other field ends with an escaped
+// field delimiter.
+string MakeBuffer(int max_digits, bool escapes) {
+  stringstream ss;
+  while (ss.tellp() < BUFFER_SIZE) {
+    for (int i = 0; i < NUM_COLS; ++i) {
+      int num_digits = 1 + rand() % max_digits;
+      for (int j = 0; j < num_digits; ++j) ss << static_cast<char>('0' + rand() % 10);
+      if (escapes && i % 2 == 0) ss << ESCAPE_CHAR << FIELD_DELIM;
+      ss << (i == NUM_COLS - 1 ? TUPLE_DELIM : FIELD_DELIM);
+    }
+  }
+  return ss.str().substr(0, BUFFER_SIZE);
+}
+
+// Parses the whole buffer and calls 'fn' on the fields of each batch of tuples.
+template <typename ProcessFields>
+inline void ParseBuffer(TestData* data, const ProcessFields& fn) {
+  data->parser->ParserReset();
+  char* ptr = const_cast<char*>(data->buffer.data());
+  int64_t remaining_len = data->buffer.size();
+  while (remaining_len > 0) {
+    int num_tuples = 0;
+    int num_fields = 0;
+    char* next_column_start;
+    char* start = ptr;
+    data->parser->ParseFieldLocations(MAX_TUPLES, remaining_len, &ptr,
+        &data->row_end_locations[0], &data->field_locations[0], &num_tuples,
+        &num_fields, &next_column_start);
+    remaining_len -= ptr - start;
+    fn(data, num_fields);
+  }
+}
+
+struct CountFields {
+  void operator()(TestData* data, int num_fields) const {
+    data->checksum += num_fields;
+  }
+};
+
+struct ParseInts {
+  void operator()(TestData* data, int num_fields) const {
+    for (int i = 0; i < num_fields; ++i) {
+      const FieldLocation& field = data->field_locations[i];
+      StringParser::ParseResult result;
+      data->checksum +=
+          StringParser::StringToInt<int64_t>(field.start, field.len, &result);
+    }
+  }
+};
+
+void TestScalar(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    const char* buffer = data->buffer.data();
+    int len = data->buffer.size();
+    int num_fields = 0;
+    const char* column_start = buffer;
+    for (int j = 0; j < len; ++j) {
+      char c = buffer[j];
+      if (c == FIELD_DELIM || c == COLLECTION_DELIM || c == TUPLE_DELIM || c == '\r') {
+        FieldLocation& field = data->field_locations[num_fields];
+        field.start = const_cast<char*>(column_start);
+        field.len = buffer + j - column_start;
+        column_start = buffer + j + 1;
+        if (++num_fields == MAX_TUPLES * NUM_COLS) num_fields = 0;
+      }
+    }
+    data->checksum += num_fields;
+  }
+}
+
+void TestParser(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) ParseBuffer(data, CountFields());
+}
+
+void TestParserAtoi(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) ParseBuffer(data, ParseInts());
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  TestData ints(MakeBuffer(6, false), false);
+  TestData ints_escapes(MakeBuffer(6, false), true);
+  TestData dense_escapes(MakeBuffer(6, true), true);
+  TestData long_ints(MakeBuffer(15, false), false);
+
+  Benchmark suite("text parse");
+  suite.AddBenchmark("scalar", TestScalar, &ints);
+  suite.AddBenchmark("parser", TestParser, &ints);
+  suite.AddBenchmark("parser_escapes", TestParser, &ints_escapes);
+  suite.AddBenchmark("parser_dense_escapes", TestParser, &dense_escapes);
+  suite.AddBenchmark("parser_atoi", TestParserAtoi, &ints);
+  suite.AddBenchmark("parser_long_ints", TestParserAtoi, &long_ints);
+  cout << suite.Measure();
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codegen/codegen-cache.h"
+
+#include <boost/thread/locks.hpp>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include "common/logging.h"
+#include "runtime/mem-tracker.h"
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::shared_ptr;
+
+DEFINE_int64(codegen_cache_capacity, 0,
+    "Estimated memory (in bytes) of JIT compiled modules kept by the process-wide "
+    "codegen cache for reuse by fragment instances that generate the same IR. "
+    "0 disables the cache.");
+
+namespace impala {
+
+CodegenCache::CachedModule::CachedModule() : bytes(0), mem_tracker(NULL) {
+}
+
+CodegenCache::CachedModule::~CachedModule() {
+  if (mem_tracker != NULL) mem_tracker->Release(bytes);
+}
+
+CodegenCache* CodegenCache::instance() {
+  static CodegenCache cache;
+  return &cache;
+}
+
+CodegenCache::CodegenCache() : mem_tracker_(NULL), bytes_(0) {
+}
+
+void CodegenCache::InitMemTracker(MemTracker* process_tracker) {
+  DCHECK(mem_tracker_ == NULL);
+  mem_tracker_ = new MemTracker(-1, -1, "Codegen Cache", process_tracker);
+}
+
+shared_ptr<CodegenCache::CachedModule> CodegenCache::Lookup(
+    const Fingerprint& fingerprint) {
+  lock_guard<mutex> l(lock_);
+  ModuleMap::iterator it = modules_.find(fingerprint);
+  if (it == modules_.end()) return shared_ptr<CachedModule>();
+  // Move to the front of the LRU list.
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->second;
+}
+
+bool CodegenCache::Insert(const Fingerprint& fingerprint,
+    const shared_ptr<CachedModule>& module) {
+  if (module->bytes > FLAGS_codegen_cache_capacity) return false;
+  // Evicted modules are destroyed outside the lock, unless they are still used.
+  LruList evicted;
+  {
+    lock_guard<mutex> l(lock_);
+    if (modules_.find(fingerprint) != modules_.end()) return false;
+    if (mem_tracker_ != NULL) {
+      DCHECK(module->mem_tracker == NULL);
+      module->mem_tracker = mem_tracker_;
+      module->mem_tracker->Consume(module->bytes);
+    }
+    lru_.push_front(std::make_pair(fingerprint, module));
+    modules_[fingerprint] = lru_.begin();
+    bytes_ += module->bytes;
+    while (bytes_ > FLAGS_codegen_cache_capacity) {
+      LruList::iterator last = --lru_.end();
+      bytes_ -= last->second->bytes;
+      modules_.erase(last->first);
+      evicted.splice(evicted.begin(), lru_, last);
+    }
+  }
+  if (!evicted.empty()) {
+    VLOG_QUERY << "Evicted " << evicted.size() << " modules from the codegen cache";
+  }
+  return true;
+}
+
+int64_t CodegenCache::bytes() const {
+  lock_guard<mutex> l(lock_);
+  return bytes_;
+}
+
+int64_t CodegenCache::num_modules() const {
+  lock_guard<mutex> l(lock_);
+  return lru_.size();
+}
+
+void CodegenCache::Clear() {
+  LruList evicted;
+  {
+    lock_guard<mutex> l(lock_);
+    evicted.swap(lru_);
+    modules_.clear();
+    bytes_ = 0;
+  }
+}
+
+}
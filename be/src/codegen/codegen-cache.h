@@ -0,0 +1,129 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_CODEGEN_CODEGEN_CACHE_H
+#define IMPALA_CODEGEN_CODEGEN_CACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace llvm {
+  class ExecutionEngine;
+  class LLVMContext;
+}
+
+namespace impala {
+
+class MemTracker;
+
+// Process-wide cache of JIT compiled modules. A module is keyed by the fingerprint of the
+// IR of the functions that were registered to be JIT'd and everything they reference
+// (see LlvmCodeGen::ComputeFingerprint()). Two modules with the same fingerprint compile
+// to the same machine code, so a fragment instance that generates the same IR as an
+// earlier one can skip optimization and compilation and reuse the cached functions.
+//
+// Only modules whose IR does not embed runtime pointers (see
+// LlvmCodeGen::CastPtrToLlvmPtr()) are cached: such IR differs between fragment instances
+// and its machine code is only valid for the instance that generated it.
+//
+// A cached module owns the llvm context and execution engine it was compiled with, which
+// keeps the machine code alive. Modules are evicted in LRU order once the estimated
+// memory of all modules exceeds --codegen_cache_capacity. Evicted modules are freed
+// once the last LlvmCodeGen using them is destroyed. The estimated memory of a module is
+// charged to the cache's MemTracker for as long as the module is alive.
+// The cache is off by default.
+// Thread-safe.
+class CodegenCache {
+ public:
+  // 128 bit fingerprint of the IR of a module.
+  typedef std::pair<uint64_t, uint64_t> Fingerprint;
+
+  // A JIT compiled module.
+  struct CachedModule {
+    // Declared in this order so that the execution engine (which owns the module and
+    // the machine code) is destroyed before the context.
+    boost::scoped_ptr<llvm::LLVMContext> context;
+    boost::scoped_ptr<llvm::ExecutionEngine> execution_engine;
+
+    // Pointers to the JIT'd functions, in the order they were registered with
+    // LlvmCodeGen::AddFunctionToJit().
+    std::vector<void*> fn_ptrs;
+
+    // Estimated memory held by the module: the size of the machine code and of the IR
+    // of the whole module, including the cross-compiled functions loaded with it.
+    int64_t bytes;
+
+    // Tracker 'bytes' are charged to, once the module is added to the cache. Released
+    // when the module is destroyed.
+    MemTracker* mem_tracker;
+
+    CachedModule();
+    ~CachedModule();
+  };
+
+  // Returns the process-wide cache.
+  static CodegenCache* instance();
+
+  // Creates the tracker cached modules are charged to as a child of 'process_tracker'.
+  // Must be called before the first module is inserted, if at all.
+  void InitMemTracker(MemTracker* process_tracker);
+
+  // Returns the module with 'fingerprint' or NULL if it is not cached.
+  boost::shared_ptr<CachedModule> Lookup(const Fingerprint& fingerprint);
+
+  // Adds 'module' with 'fingerprint' to the cache and evicts the least recently used
+  // modules over the capacity. Returns false if the module is not cached, because the
+  // cache is disabled, the module is larger than the capacity or another module with
+  // the same fingerprint was added first.
+  bool Insert(const Fingerprint& fingerprint,
+      const boost::shared_ptr<CachedModule>& module);
+
+  // Drops all modules from the cache. Used for testing.
+  void Clear();
+
+  int64_t bytes() const;
+  int64_t num_modules() const;
+
+ private:
+  typedef std::list<std::pair<Fingerprint, boost::shared_ptr<CachedModule> > > LruList;
+  typedef std::map<Fingerprint, LruList::iterator> ModuleMap;
+
+  CodegenCache();
+
+  // Tracker cached modules are charged to. NULL if InitMemTracker() was not called.
+  // Never freed, since modules may be released after the cache is destroyed.
+  MemTracker* mem_tracker_;
+
+  // Protects all members below.
+  mutable boost::mutex lock_;
+
+  // Cached modules, the most recently used one first.
+  LruList lru_;
+
+  // Index into lru_.
+  ModuleMap modules_;
+
+  // Sum of CachedModule::bytes of all cached modules.
+  int64_t bytes_;
+};
+
+}
+
+#endif
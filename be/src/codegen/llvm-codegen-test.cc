@@ -27,6 +27,8 @@ using namespace std;
 using namespace boost;
 using namespace llvm;
 
+DECLARE_int64(codegen_cache_capacity);
+
 namespace impala {
 
 class LlvmCodeGenTest : public testing:: Test {
@@ -432,6 +434,104 @@ TEST_F(LlvmCodeGenTest, HashTest) {
   CpuInfo::EnableFeature(CpuInfo::SSE4_2, restore_sse_support);
 }
 
+// Generates a function that returns 'value' and registers it to be JIT'd into 'fn_ptr'.
+static void CodegenReturnConstant(LlvmCodeGen* codegen, int value, void** fn_ptr) {
+  LlvmCodeGen::FnPrototype prototype(codegen, "ReturnConstant",
+      codegen->GetType(TYPE_INT));
+  LlvmCodeGen::LlvmBuilder builder(codegen->context());
+  Function* fn = prototype.GeneratePrototype(&builder, NULL);
+  builder.CreateRet(codegen->GetIntConstant(TYPE_INT, value));
+  fn = codegen->FinalizeFunction(fn);
+  ASSERT_TRUE(fn != NULL);
+  codegen->AddFunctionToJit(fn, fn_ptr);
+}
+
+// Test that a module with the same IR as an earlier one reuses its JIT'd functions and
+// that they stay valid after the first codegen object is gone.
+TEST_F(LlvmCodeGenTest, CodegenCache) {
+  typedef int32_t (*TestFn)();
+  ObjectPool pool;
+  FLAGS_codegen_cache_capacity = 256L * 1024L * 1024L;
+  CodegenCache::instance()->Clear();
+
+  void* fn1 = NULL;
+  {
+    scoped_ptr<LlvmCodeGen> codegen;
+    ASSERT_TRUE(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen).ok());
+    CodegenReturnConstant(codegen.get(), 42, &fn1);
+    ASSERT_TRUE(codegen->FinalizeModule().ok());
+    ASSERT_TRUE(fn1 != NULL);
+    EXPECT_EQ(reinterpret_cast<TestFn>(fn1)(), 42);
+    EXPECT_EQ(CodegenCache::instance()->num_modules(), 1);
+  }
+
+  // Same IR: cache hit.
+  void* fn2 = NULL;
+  scoped_ptr<LlvmCodeGen> codegen2;
+  ASSERT_TRUE(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen2).ok());
+  CodegenReturnConstant(codegen2.get(), 42, &fn2);
+  ASSERT_TRUE(codegen2->FinalizeModule().ok());
+  EXPECT_EQ(fn2, fn1);
+  EXPECT_EQ(reinterpret_cast<TestFn>(fn2)(), 42);
+  EXPECT_EQ(CodegenCache::instance()->num_modules(), 1);
+
+  // Different IR: cache miss.
+  void* fn3 = NULL;
+  scoped_ptr<LlvmCodeGen> codegen3;
+  ASSERT_TRUE(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen3).ok());
+  CodegenReturnConstant(codegen3.get(), 43, &fn3);
+  ASSERT_TRUE(codegen3->FinalizeModule().ok());
+  EXPECT_NE(fn3, fn1);
+  EXPECT_EQ(reinterpret_cast<TestFn>(fn3)(), 43);
+  EXPECT_EQ(CodegenCache::instance()->num_modules(), 2);
+
+  // Functions in use stay valid after the modules are evicted.
+  CodegenCache::instance()->Clear();
+  EXPECT_EQ(CodegenCache::instance()->bytes(), 0);
+  EXPECT_EQ(reinterpret_cast<TestFn>(fn2)(), 42);
+}
+
+// Generates a function that returns the int at 'value', which is embedded in the IR, and
+// registers it to be JIT'd into 'fn_ptr'.
+static void CodegenReturnPointee(LlvmCodeGen* codegen, const int32_t* value,
+    void** fn_ptr) {
+  LlvmCodeGen::FnPrototype prototype(codegen, "ReturnPointee",
+      codegen->GetType(TYPE_INT));
+  LlvmCodeGen::LlvmBuilder builder(codegen->context());
+  Function* fn = prototype.GeneratePrototype(&builder, NULL);
+  Value* ptr = codegen->CastPtrToLlvmPtr(codegen->GetPtrType(TYPE_INT), value);
+  builder.CreateRet(builder.CreateLoad(ptr));
+  fn = codegen->FinalizeFunction(fn);
+  ASSERT_TRUE(fn != NULL);
+  codegen->AddFunctionToJit(fn, fn_ptr);
+}
+
+// Test that modules that embed runtime pointers are not cached, since the machine code
+// is only valid for the instance that generated it.
+TEST_F(LlvmCodeGenTest, CodegenCacheSkipsEmbeddedPointers) {
+  typedef int32_t (*TestFn)();
+  ObjectPool pool;
+  FLAGS_codegen_cache_capacity = 256L * 1024L * 1024L;
+  CodegenCache::instance()->Clear();
+
+  int32_t value1 = 1;
+  int32_t value2 = 2;
+  void* fn1 = NULL;
+  void* fn2 = NULL;
+  scoped_ptr<LlvmCodeGen> codegen1;
+  ASSERT_TRUE(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen1).ok());
+  CodegenReturnPointee(codegen1.get(), &value1, &fn1);
+  ASSERT_TRUE(codegen1->FinalizeModule().ok());
+  scoped_ptr<LlvmCodeGen> codegen2;
+  ASSERT_TRUE(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen2).ok());
+  CodegenReturnPointee(codegen2.get(), &value2, &fn2);
+  ASSERT_TRUE(codegen2->FinalizeModule().ok());
+
+  EXPECT_EQ(CodegenCache::instance()->num_modules(), 0);
+  EXPECT_EQ(reinterpret_cast<TestFn>(fn1)(), 1);
+  EXPECT_EQ(reinterpret_cast<TestFn>(fn2)(), 2);
+}
+
 }
 
 int main(int argc, char **argv) {
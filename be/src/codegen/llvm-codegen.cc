@@ -25,6 +25,7 @@
 #include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/Linker.h>
 #include <llvm/PassManager.h>
@@ -43,6 +44,7 @@
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#include "common/atomic.h"
 #include "common/logging.h"
 #include "codegen/codegen-anyval.h"
 #include "codegen/subexpr-elimination.h"
@@ -50,6 +52,7 @@
 #include "impala-ir/impala-ir-names.h"
 #include "runtime/hdfs-fs-cache.h"
 #include "util/cpu-info.h"
+#include "util/hash-util.h"
 #include "util/hdfs-util.h"
 #include "util/path-builder.h"
 
@@ -68,6 +71,7 @@ DEFINE_string(unopt_module_dir, "",
 DEFINE_string(opt_module_dir, "",
     "if set, saves optimized generated IR modules to the specified directory.");
 DECLARE_string(local_library_dir);
+DECLARE_int64(codegen_cache_capacity);
 
 namespace impala {
 
@@ -101,6 +105,7 @@ LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
   optimizations_enabled_(false),
   is_corrupt_(false),
   is_compiled_(false),
+  needs_sync_finalize_(false),
   context_(new llvm::LLVMContext()),
   module_(NULL),
   execution_engine_(NULL),
@@ -114,6 +119,9 @@ LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
   codegen_timer_ = ADD_TIMER(&profile_, "CodegenTime");
   optimization_timer_ = ADD_TIMER(&profile_, "OptimizationTime");
   compile_timer_ = ADD_TIMER(&profile_, "CompileTime");
+  fingerprint_timer_ = ADD_TIMER(&profile_, "FingerprintTime");
+  cache_hits_counter_ = ADD_COUNTER(&profile_, "NumCacheHits", TUnit::UNIT);
+  cache_misses_counter_ = ADD_COUNTER(&profile_, "NumCacheMisses", TUnit::UNIT);
 
   loaded_functions_.resize(IRFunction::FN_END);
 }
@@ -285,6 +293,8 @@ Status LlvmCodeGen::Init() {
 }
 
 LlvmCodeGen::~LlvmCodeGen() {
+  // If the module was moved to the codegen cache, jitted_functions_ is empty and the
+  // machine code is freed with the cached module.
   for (map<Function*, bool>::iterator iter = jitted_functions_.begin();
       iter != jitted_functions_.end(); ++iter) {
     execution_engine_->freeMachineCodeForFunction(iter->first);
@@ -603,6 +613,82 @@ Function* LlvmCodeGen::FinalizeFunction(Function* function) {
   return function;
 }
 
+namespace {
+
+// Sums up the size of the machine code emitted by the JIT.
+class CodeSizeListener : public JITEventListener {
+ public:
+  CodeSizeListener() : code_size_(0) { }
+
+  virtual void NotifyFunctionEmitted(const Function& fn, void* code, size_t size,
+      const EmittedFunctionDetails& details) {
+    code_size_ += size;
+  }
+
+  int64_t code_size() const { return code_size_; }
+
+ private:
+  int64_t code_size_;
+};
+
+// Stream that only counts the bytes written to it.
+class ByteCountingStream : public raw_ostream {
+ public:
+  ByteCountingStream() : bytes_(0) { }
+  virtual ~ByteCountingStream() { flush(); }
+
+ private:
+  virtual void write_impl(const char* ptr, size_t size) { bytes_ += size; }
+  virtual uint64_t current_pos() const { return bytes_; }
+
+  uint64_t bytes_;
+};
+
+// Returns true if 'value' is a pointer cast from a constant address, i.e. a runtime
+// pointer embedded by LlvmCodeGen::CastPtrToLlvmPtr(). Null pointers are not counted.
+bool IsEmbeddedPointer(const Value* value) {
+  const Value* operand = NULL;
+  if (const ConstantExpr* expr = dyn_cast<ConstantExpr>(value)) {
+    if (expr->getOpcode() == Instruction::IntToPtr) operand = expr->getOperand(0);
+  } else if (const IntToPtrInst* inst = dyn_cast<IntToPtrInst>(value)) {
+    operand = inst->getOperand(0);
+  }
+  if (operand == NULL) return false;
+  const Constant* constant = dyn_cast<Constant>(operand);
+  return constant != NULL && !constant->isNullValue();
+}
+
+// Adds the IR of 'value' to 'stream', if it is a global, and visits the values it
+// references. Functions with a body are added to 'fns' instead, for the caller to add
+// their IR. Values in 'visited' are skipped. Sets 'embeds_ptr' if a runtime pointer is
+// found.
+void AddReferencedIR(const Value* value, set<const Value*>* visited,
+    vector<const Function*>* fns, raw_ostream* stream, bool* embeds_ptr) {
+  if (!visited->insert(value).second) return;
+  if (IsEmbeddedPointer(value)) *embeds_ptr = true;
+  if (const Function* fn = dyn_cast<Function>(value)) {
+    if (fn->isDeclaration()) {
+      fn->print(*stream, NULL);
+    } else {
+      fns->push_back(fn);
+    }
+  } else if (const GlobalVariable* global = dyn_cast<GlobalVariable>(value)) {
+    global->print(*stream, NULL);
+    *stream << "\n";
+    if (global->hasInitializer()) {
+      AddReferencedIR(global->getInitializer(), visited, fns, stream, embeds_ptr);
+    }
+  } else if (const Constant* constant = dyn_cast<Constant>(value)) {
+    // Constant expressions and aggregates, e.g. a GEP into a global string.
+    for (User::const_op_iterator it = constant->op_begin(); it != constant->op_end();
+        ++it) {
+      AddReferencedIR(*it, visited, fns, stream, embeds_ptr);
+    }
+  }
+}
+
+}
+
 Status LlvmCodeGen::FinalizeModule() {
   DCHECK(!is_compiled_);
   is_compiled_ = true;
@@ -621,6 +707,23 @@ Status LlvmCodeGen::FinalizeModule() {
   if (is_corrupt_) return Status("Module is corrupt.");
   SCOPED_TIMER(profile_.total_time_counter());
 
+  // Reuse the machine code of an identical module compiled earlier, if there is one.
+  // Modules that embed runtime pointers are specific to this instance and not cached.
+  CodegenCache::Fingerprint fingerprint;
+  bool use_cache = FLAGS_codegen_cache_capacity > 0 && !fns_to_jit_compile_.empty() &&
+      ComputeFingerprint(&fingerprint);
+  if (use_cache) {
+    cached_module_ = CodegenCache::instance()->Lookup(fingerprint);
+    if (cached_module_.get() != NULL) {
+      PublishJittedFunctions(cached_module_->fn_ptrs);
+      COUNTER_ADD(cache_hits_counter_, 1);
+      // The module was not optimized, since its machine code comes from the cache.
+      DumpOptimizedIR();
+      return Status::OK;
+    }
+    COUNTER_ADD(cache_misses_counter_, 1);
+  }
+
   // Don't waste time optimizing module if there are no functions to JIT. This can happen
   // if the codegen object is created but no functions are successfully codegen'd.
   if (optimizations_enabled_ && !FLAGS_disable_optimization_passes &&
@@ -628,24 +731,101 @@ Status LlvmCodeGen::FinalizeModule() {
     OptimizeModule();
   }
 
-  SCOPED_TIMER(compile_timer_);
-  // JIT compile all codegen'd functions
-  for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
-    *fns_to_jit_compile_[i].second = JitFunction(fns_to_jit_compile_[i].first);
+  {
+    SCOPED_TIMER(compile_timer_);
+    CodeSizeListener code_size_listener;
+    if (use_cache) execution_engine_->RegisterJITEventListener(&code_size_listener);
+    // JIT compile all codegen'd functions
+    vector<void*> fn_ptrs;
+    for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+      fn_ptrs.push_back(JitFunction(fns_to_jit_compile_[i].first));
+    }
+    if (use_cache) {
+      execution_engine_->UnregisterJITEventListener(&code_size_listener);
+
+      // Hand the context and the execution engine, which owns the module and the machine
+      // code, over to the cache. If the cache rejects the module, it is freed along with
+      // this object. The whole module is retained, so its whole IR is counted.
+      ByteCountingStream module_size;
+      module_->print(module_size, NULL);
+      module_size.flush();
+      boost::shared_ptr<CodegenCache::CachedModule> module(
+          new CodegenCache::CachedModule());
+      module->fn_ptrs = fn_ptrs;
+      module->bytes = code_size_listener.code_size() + module_size.tell();
+      module->context.reset(context_.release());
+      module->execution_engine.reset(execution_engine_.release());
+      jitted_functions_.clear();
+      cached_module_ = module;
+      CodegenCache::instance()->Insert(fingerprint, module);
+    }
+    PublishJittedFunctions(fn_ptrs);
   }
 
-  if (FLAGS_opt_module_dir.size() != 0) {
-    string path = FLAGS_opt_module_dir + "/" + id_ + "_opt.ll";
-    fstream f(path.c_str(), fstream::out | fstream::trunc);
-    if (f.fail()) {
-      LOG(ERROR) << "Could not save IR to: " << path;
-    } else {
-      f << GetIR(true);
-      f.close();
+  DumpOptimizedIR();
+  return Status::OK;
+}
+
+void LlvmCodeGen::DumpOptimizedIR() {
+  if (FLAGS_opt_module_dir.size() == 0) return;
+  string path = FLAGS_opt_module_dir + "/" + id_ + "_opt.ll";
+  fstream f(path.c_str(), fstream::out | fstream::trunc);
+  if (f.fail()) {
+    LOG(ERROR) << "Could not save IR to: " << path;
+  } else {
+    f << GetIR(true);
+    f.close();
+  }
+}
+
+void LlvmCodeGen::PublishJittedFunctions(const vector<void*>& fn_ptrs) {
+  DCHECK_EQ(fn_ptrs.size(), fns_to_jit_compile_.size());
+  for (int i = fns_to_jit_compile_.size() - 1; i >= 0; --i) {
+    AtomicUtil::StoreRelease(fns_to_jit_compile_[i].second, fn_ptrs[i]);
+  }
+}
+
+bool LlvmCodeGen::ComputeFingerprint(CodegenCache::Fingerprint* fingerprint) {
+  SCOPED_TIMER(fingerprint_timer_);
+  string ir;
+  raw_string_ostream stream(ir);
+  // Settings that result in different machine code for the same IR.
+  stream << "optimize=" << (optimizations_enabled_ && !FLAGS_disable_optimization_passes)
+         << " triple=" << module_->getTargetTriple()
+         << " layout=" << module_->getDataLayout() << "\n";
+
+  // The functions to JIT, in the order their function pointers are returned, and
+  // everything they reference. Cross-compiled functions are included, since they may
+  // have been modified in place.
+  set<const Value*> visited;
+  vector<const Function*> fns;
+  bool embeds_ptr = false;
+  for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+    stream << "jit " << fns_to_jit_compile_[i].first->getName() << "\n";
+    AddReferencedIR(fns_to_jit_compile_[i].first, &visited, &fns, &stream,
+        &embeds_ptr);
+  }
+  while (!fns.empty() && !embeds_ptr) {
+    const Function* fn = fns.back();
+    fns.pop_back();
+    fn->print(stream, NULL);
+    for (Function::const_iterator bb = fn->begin(); bb != fn->end(); ++bb) {
+      for (BasicBlock::const_iterator inst = bb->begin(); inst != bb->end(); ++inst) {
+        if (IsEmbeddedPointer(inst)) embeds_ptr = true;
+        for (User::const_op_iterator op = inst->op_begin(); op != inst->op_end(); ++op) {
+          if (isa<Constant>(*op)) {
+            AddReferencedIR(*op, &visited, &fns, &stream, &embeds_ptr);
+          }
+        }
+      }
     }
   }
+  if (embeds_ptr) return false;
+  stream.flush();
 
-  return Status::OK;
+  fingerprint->first = HashUtil::MurmurHash2_64(ir.data(), ir.size(), 0);
+  fingerprint->second = HashUtil::FnvHash64(ir.data(), ir.size(), HashUtil::FNV64_SEED);
+  return true;
 }
 
 void LlvmCodeGen::OptimizeModule() {
@@ -33,6 +33,7 @@
 #include <llvm/IR/Module.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include "codegen/codegen-cache.h"
 #include "exprs/expr.h"
 #include "impala-ir/impala-ir-functions.h"
 #include "runtime/types.h"
@@ -93,6 +94,10 @@ class SubExprElimination;
 // Afterward, FinalizeModule() should be called at which point all codegened functions
 // are optimized. After FinalizeModule() returns, all function pointers registered with
 // AddFunctionToJit() will be pointing to the appropriate JIT'd function.
+// FinalizeModule() may also run on a background thread while the fragment is already
+// executing with the interpreted code paths (see --async_codegen). In that case the
+// function pointers are published concurrently; the users check them at batch
+// boundaries and switch to the JIT'd functions once they are set.
 //
 // Currently, each query will create and initialize one of these
 // objects.  This requires loading and parsing the cross compiled modules.
@@ -237,8 +242,21 @@ class LlvmCodeGen {
   // Optimize and compile the module. This should be called after all functions to JIT
   // have been added to the module via AddFunctionToJit(). If optimizations_enabled_ is
   // false, the module will not be optimized before compilation.
+  // If an identical module was compiled before and is still in the CodegenCache, the
+  // function pointers are set to its functions instead. Otherwise the compiled module is
+  // added to the cache; this object then no longer owns its context and execution
+  // engine, and no IR may be generated afterwards.
+  // The function pointers are only set once all functions are compiled (see
+  // PublishJittedFunctions()), so this may run concurrently with code that reads them
+  // with AtomicUtil::LoadAcquire().
   Status FinalizeModule();
 
+  // Called by users of AddFunctionToJit() that have no interpreted fallback, i.e. that
+  // need the JIT'd functions before the fragment starts executing. FinalizeModule() is
+  // then not run in the background.
+  void set_needs_sync_finalize() { needs_sync_finalize_ = true; }
+  bool needs_sync_finalize() const { return needs_sync_finalize_; }
+
   // Replaces all instructions that call 'target_name' with a call instruction
   // to the new_fn.  Returns the modified function.
   // - target_name is the unmangled function name that should be replaced.
@@ -447,6 +465,23 @@ class LlvmCodeGen {
   // Optimizes the module. This includes pruning the module of any unused functions.
   void OptimizeModule();
 
+  // Computes the fingerprint of the module by hashing the IR of the functions in
+  // fns_to_jit_compile_, of all functions and globals they reference (transitively) and
+  // of the settings that change the generated code. Returns false, without setting
+  // 'fingerprint', if the IR embeds runtime pointers (see CastPtrToLlvmPtr()): its
+  // machine code is only valid for this instance and must not be cached.
+  bool ComputeFingerprint(CodegenCache::Fingerprint* fingerprint);
+
+  // Writes the IR of the module to --opt_module_dir, if set.
+  void DumpOptimizedIR();
+
+  // Sets the function pointers registered with AddFunctionToJit() to 'fn_ptrs'. The
+  // pointers are written with release stores and in reverse registration order, so that
+  // a concurrent reader that loads a function with AtomicUtil::LoadAcquire() sees its
+  // machine code and all the functions registered after it (e.g. the level 0 variants
+  // of the hash join functions).
+  void PublishJittedFunctions(const std::vector<void*>& fn_ptrs);
+
   // Clears generated hash fns.  This is only used for testing.
   void ClearHashFns();
 
@@ -473,6 +508,14 @@ class LlvmCodeGen {
 
   RuntimeProfile::Counter* module_file_size_;
 
+  // Time spent computing the fingerprint of the module for the codegen cache.
+  RuntimeProfile::Counter* fingerprint_timer_;
+
+  // Number of modules found in, and not found in, the codegen cache. At most one of them
+  // is set per module.
+  RuntimeProfile::Counter* cache_hits_counter_;
+  RuntimeProfile::Counter* cache_misses_counter_;
+
   // whether or not optimizations are enabled
   bool optimizations_enabled_;
 
@@ -486,6 +529,9 @@ class LlvmCodeGen {
   // functions after this point.
   bool is_compiled_;
 
+  // If true, FinalizeModule() must be called before the fragment executes.
+  bool needs_sync_finalize_;
+
   // Error string that llvm will write to
   std::string error_string_;
 
@@ -500,6 +546,10 @@ class LlvmCodeGen {
   // Execution/Jitting engine.
   boost::scoped_ptr<llvm::ExecutionEngine> execution_engine_;
 
+  // The cached module the JIT'd functions belong to, set by FinalizeModule(). If this
+  // module was added to the cache, context_ and execution_engine_ were moved into it.
+  boost::shared_ptr<CodegenCache::CachedModule> cached_module_;
+
   // Keeps track of all the functions that have been jit compiled and linked into
   // the process. Special care needs to be taken if we need to modify these functions.
   // bool is unused.
@@ -36,6 +36,19 @@ class AtomicUtil {
   static inline void MemoryBarrier() {
     __sync_synchronize();
   }
+
+  // Returns *ptr. If the value was written by StoreRelease(), all writes made before
+  // that store are visible after this load.
+  template<typename T>
+  static inline T LoadAcquire(const T* ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+  }
+
+  // Sets *ptr to 'value', after all preceding writes. See LoadAcquire().
+  template<typename T>
+  static inline void StoreRelease(T* ptr, T value) {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+  }
 };
 
 // Wrapper for atomic integers.  This should be switched to c++ 11 when
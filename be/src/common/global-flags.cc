@@ -32,6 +32,13 @@ DEFINE_string(cache_location, "/var/cache/impalatogo/", "Cache location on curre
 DEFINE_int32(cache_mem_percent_of_available, 85,
 		"percent of available memory which can be consumed by cache. Concerning the cache location arg \"cache_location\". "
 		"Should be the number from 1 to 100, currently everything > 85% will be set to 85%.");
+DEFINE_bool(cache_write_behind, false, "If true, files written by INSERT/CTAS are written "
+    "into the local cache only and uploaded to the remote filesystem in the background. "
+    "Query finalization waits for the uploads to complete.");
+DEFINE_int32(cache_upload_threads, 8, "Number of files uploaded to the remote filesystem in "
+    "parallel in --cache_write_behind mode.");
+DEFINE_int32(cache_upload_part_size_mb, 8, "Size of the part of a file (in MB) accumulated "
+    "locally before it is uploaded in --cache_write_behind mode.");
 
 // Kerberos is enabled if and only if principal is set.
 DEFINE_string(principal, "", "Kerberos principal. If set, both client and backend network"
@@ -106,6 +106,13 @@ bool CacheLayerRegistry::findFile(const char* path, managed_file::File*& file){
 	return file != nullptr;
 }
 
+bool CacheLayerRegistry::isFileResident(const char* path, const FileSystemDescriptor& descriptor){
+	std::string fqp = managed_file::File::constructLocalPath(descriptor, path);
+	if(fqp.empty())
+		return false;
+	return m_cache->resident(fqp);
+}
+
 bool CacheLayerRegistry::addFile(const char* path, const FileSystemDescriptor& descriptor, managed_file::File*& file,
 	managed_file::NatureFlag creationFlag)
 {
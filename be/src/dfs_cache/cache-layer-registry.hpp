@@ -350,6 +350,18 @@ public:
 	 */
 	bool findFile(const char* path, managed_file::File*& file);
 
+	/**
+	 * Check whether the file content is available in the local cache. Unlike findFile(),
+	 * this neither triggers the file load nor holds a reference to the file, so the answer is
+	 * only a hint: the file may be evicted (or become available) right after the call.
+	 *
+	 * @param [in]  path       - file fqp
+	 * @param [in]  descriptor - file system descriptor
+	 *
+	 * @return true if the file is cached locally
+	 */
+	bool isFileResident(const char* path, const FileSystemDescriptor& descriptor);
+
 	/**
 	 * Insert the managed file into the set.
 	 * The key is file fully qualified local path
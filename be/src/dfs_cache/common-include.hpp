@@ -61,6 +61,9 @@ namespace constants
 
     /** limit of history requests archive */
     extern const int HISTORY_ENTRIES_LIMIT;
+
+    /** suffix of the sidecar files kept next to the cached files, see cacheGetSidecarPath() */
+    extern const std::string SIDECAR_FILE_SUFFIX;
 }
 
 /**
@@ -31,6 +31,7 @@
 #include "dfs_cache/cache-layer-registry.hpp"
 #include "dfs_cache/cache-mgr.hpp"
 #include "dfs_cache/filesystem-mgr.hpp"
+#include "dfs_cache/upload-mgr.hpp"
 #include "dfs_cache/utilities.hpp"
 
 namespace impala {
@@ -64,6 +65,9 @@ namespace constants
 
      /** limit of history requests archive */
      const int HISTORY_ENTRIES_LIMIT = 100;
+
+     /** suffix of the sidecar files kept next to the cached files */
+     const std::string SIDECAR_FILE_SUFFIX = ".sidecar";
 }
 
 namespace ph = std::placeholders;
@@ -107,6 +111,14 @@ status::StatusInternal cacheConfigureFileSystem(FileSystemDescriptor& fsDescript
 	return status::StatusInternal::OK;
 }
 
+status::StatusInternal cacheConfigureWriteBehind(int threads, size_t partSize){
+	if(CacheLayerRegistry::instance()->directDFSAccess())
+		return status::StatusInternal::OK;
+
+	UploadManager::init(threads, partSize);
+	return status::StatusInternal::OK;
+}
+
 status::StatusInternal cacheShutdown(bool force, bool updateClients) {
 	if(CacheLayerRegistry::instance()->directDFSAccess())
 		return status::StatusInternal::OK;
@@ -252,8 +264,15 @@ static dfsFile openForWrite(const FileSystemDescriptor & fsDescriptor, const cha
 
 	// pin opened handles in the registry:
 	ret = CacheLayerRegistry::instance()->registerCreateFromSelectScenario(handle, hfile);
-	if(ret)
+	if(ret){
+		// in write-behind mode, the remote file is written by the uploader. If the upload can't be started,
+		// the file is written synchronously:
+		if(UploadManager::instance() != nullptr &&
+				!UploadManager::instance()->add(fsDescriptor, path, handle, hfile)){
+			LOG (WARNING) << "Failed to start write-behind upload for file : \"" << path << "\", falling back to synchronous write." << "\n";
+		}
 		return handle;
+	}
 
     LOG (ERROR)<< "Failed to register CREATE ON SELECT scenario within the registry for file : \"" << path << "\"." << "\n";
 	// cleanup:
@@ -455,6 +474,13 @@ static status::StatusInternal handleCloseFileInWriteMode(const FileSystemDescrip
 
 	LOG (INFO) << "dfsCloseFile() is requested for file write operation." << "\n";
 
+	// in write-behind mode, the uploader finishes the upload and closes the remote file:
+	if(UploadManager::instance() != nullptr && UploadManager::instance()->isUploaded(file)){
+		CacheLayerRegistry::instance()->unregisterCreateFromSelectScenario(file);
+		UploadManager::instance()->closed(file);
+		return status::StatusInternal::OK;
+	}
+
 	// locate the remote filesystem adaptor:
 	boost::shared_ptr<FileSystemDescriptorBound> fsAdaptor = (*CacheLayerRegistry::instance()->getFileSystemDescriptor(fsDescriptor));
 	if (!fsAdaptor) {
@@ -542,6 +568,49 @@ status::StatusInternal dfsCloseFile(const FileSystemDescriptor & fsDescriptor, d
 	return status;
 }
 
+status::StatusInternal dfsWaitForUpload(const FileSystemDescriptor & fsDescriptor, const char *path) {
+	if(UploadManager::instance() == nullptr)
+		return status::StatusInternal::OK;
+	return UploadManager::instance()->wait(path);
+}
+
+status::StatusInternal dfsForgetUpload(const FileSystemDescriptor & fsDescriptor, const char *path) {
+	if(UploadManager::instance() != nullptr)
+		UploadManager::instance()->forget(path);
+	return status::StatusInternal::OK;
+}
+
+bool dfsIsFileCached(const FileSystemDescriptor & fsDescriptor, const char *path) {
+	// nothing is cached when the cache layer is not initialized or dfs is accessed directly:
+	if(CacheLayerRegistry::instance() == nullptr || CacheLayerRegistry::instance()->directDFSAccess())
+		return false;
+
+	// resolve the path the same way dfsOpenFile() does:
+	Uri uri = Uri::Parse(path);
+	std::string fqp = uri.FilePath;
+	if(fsDescriptor.dfs_type == DFS_TYPE::local)
+		fqp = managed_file::File::fileSeparator + uri.Host + fqp;
+
+	return CacheLayerRegistry::instance()->isFileResident(fqp.c_str(), fsDescriptor);
+}
+
+status::StatusInternal cacheGetSidecarPath(const FileSystemDescriptor & fsDescriptor, const char* path,
+		const char* name, std::string& sidecar) {
+	// sidecars only exist for files in the local cache:
+	if(CacheLayerRegistry::instance() == nullptr || CacheLayerRegistry::instance()->directDFSAccess())
+		return status::StatusInternal::NOT_IMPLEMENTED;
+
+	// resolve the path the same way dfsOpenFile() does:
+	Uri uri = Uri::Parse(path);
+	std::string fqp = uri.FilePath;
+	if(fsDescriptor.dfs_type == DFS_TYPE::local)
+		fqp = managed_file::File::fileSeparator + uri.Host + fqp;
+
+	sidecar = managed_file::File::constructLocalPath(fsDescriptor, fqp.c_str()) + "." + name +
+			constants::SIDECAR_FILE_SUFFIX;
+	return status::StatusInternal::OK;
+}
+
 status::StatusInternal dfsExists(const FileSystemDescriptor & fsDescriptor, const char *path, bool* exists) {
 	*exists = false;
 
@@ -673,6 +742,13 @@ tSize dfsPread(const FileSystemDescriptor & fsDescriptor, dfsFile file, tOffset
 	return filemgmt::FileSystemManager::instance()->dfsPread(fsDescriptor, file, position, buffer, length);
 }
 
+int dfsGetLocalFileDescriptor(const FileSystemDescriptor & fsDescriptor, dfsFile file) {
+	// directly opened handles are owned by the remote filesystem adaptor, there is no local file:
+	if(file == NULL || file->direct)
+		return -1;
+	return filemgmt::FileSystemManager::instance()->dfsGetLocalFileDescriptor(fsDescriptor, file);
+}
+
 tSize dfsWrite(const FileSystemDescriptor & fsDescriptor, dfsFile file, const void* buffer, tSize length) {
 	if(file->direct){
 		boost::shared_ptr<FileSystemDescriptorBound> fsAdaptor =
@@ -709,6 +785,17 @@ tSize dfsWrite(const FileSystemDescriptor & fsDescriptor, dfsFile file, const vo
 		return -1;
 	}
 
+	// in write-behind mode, write locally only and let the uploader know there's more data:
+	if(UploadManager::instance() != nullptr && UploadManager::instance()->isUploaded(file)){
+		tSize localbytes_written = filemgmt::FileSystemManager::instance()->dfsWrite(fsDescriptor, file, buffer, length);
+		if(localbytes_written == -1){
+			LOG (ERROR) << "Failed to write into local file. " << "\n";
+			return -1;
+		}
+		UploadManager::instance()->written(file, localbytes_written);
+		return localbytes_written;
+	}
+
 	// locate the remote filesystem adapter:
 	boost::shared_ptr<FileSystemDescriptorBound> fsAdaptor = (*CacheLayerRegistry::instance()->getFileSystemDescriptor(fsDescriptor));
 	if(!fsAdaptor){
@@ -63,6 +63,21 @@ status::StatusInternal cacheInit(int mem_limit_percent = 0, const std::string& r
  */
 status::StatusInternal cacheConfigureFileSystem(FileSystemDescriptor & fs);
 
+/**
+ * @fn status::StatusInternal cacheConfigureWriteBehind(int threads, size_t partSize)
+ * @brief Enable write-behind mode for files opened for write.
+ *
+ * In write-behind mode, dfsWrite() writes into the local cache file only. The data is uploaded
+ * to the remote dfs in parts of @a partSize bytes by a pool of @a threads threads, while the file
+ * is still written. dfsCloseFile() does not wait for the upload, use dfsWaitForUpload() for this.
+ *
+ * @param [In] threads  - number of files uploaded in parallel
+ * @param [In] partSize - bytes accumulated locally before they are uploaded
+ *
+ * @return operation status
+ */
+status::StatusInternal cacheConfigureWriteBehind(int threads, size_t partSize);
+
 /**
  * @fn Status cacheShutdown(bool force = true)
  * @brief Shutdown the cache management layer and all its underlying workers.
@@ -192,6 +207,30 @@ dfsFile dfsOpenFile(const FileSystemDescriptor & fsDesciptor, const char* path,
  */
 status::StatusInternal dfsCloseFile(const FileSystemDescriptor & fsDescriptor, dfsFile file);
 
+/**
+ * @fn status::StatusInternal dfsWaitForUpload(const FileSystemDescriptor & fsDescriptor, const char *path)
+ * @brief Wait until the file @a path, written and closed in write-behind mode, is uploaded
+ * to the remote dfs.
+ *
+ * @param fsDescriptor - filesystem descriptor
+ * @param path         - file path, as it was passed to dfsOpenFile()
+ *
+ * @return the upload status. OK if there's no upload for @a path, i.e. the file was written synchronously
+ */
+status::StatusInternal dfsWaitForUpload(const FileSystemDescriptor & fsDescriptor, const char *path);
+
+/**
+ * @fn status::StatusInternal dfsForgetUpload(const FileSystemDescriptor & fsDescriptor, const char *path)
+ * @brief Tell the upload of the file @a path, written in write-behind mode, won't be waited for,
+ * e.g. because the write was cancelled. The upload is dropped once it is done, whatever its status.
+ *
+ * @param fsDescriptor - filesystem descriptor
+ * @param path         - file path, as it was passed to dfsOpenFile()
+ *
+ * @return operation status
+ */
+status::StatusInternal dfsForgetUpload(const FileSystemDescriptor & fsDescriptor, const char *path);
+
 /**
  * @fn status::StatusInternal dfsExists(const FileSystemDescriptor & fsDescriptor, const char *path)
  * @brief Checks if a given path exists. In past, this check was done on remote dfs,
@@ -207,6 +246,37 @@ status::StatusInternal dfsCloseFile(const FileSystemDescriptor & fsDescriptor, d
  */
 status::StatusInternal dfsExists(const FileSystemDescriptor & fsDescriptor, const char *path, bool* exists);
 
+/**
+ * @fn bool dfsIsFileCached(const FileSystemDescriptor & fsDescriptor, const char *path)
+ * @brief Checks whether the content of a given file is available in the local cache just now,
+ * so that opening it will not go to the remote dfs. The check has no side effects: the file
+ * is neither loaded nor touched, thus the answer is a hint only and may change right after the call.
+ *
+ * @param fsDescriptor  - file's original fsDescriptor
+ * @param path          - The path to look for
+ *
+ * @return true if the file is cached locally, false otherwise (or if direct dfs access is configured)
+ */
+bool dfsIsFileCached(const FileSystemDescriptor & fsDescriptor, const char *path);
+
+/**
+ * @fn status::StatusInternal cacheGetSidecarPath(const FileSystemDescriptor & fsDescriptor, const char* path,
+ *     const char* name, std::string& sidecar)
+ * @brief Get the local path of a sidecar file of @a path. Sidecar files hold data derived from the cached file
+ * (e.g. an index of its content) which is worth keeping across queries. They live next to the cached file,
+ * are never uploaded to the dfs, are not managed as cache entries and are deleted together with the cached file.
+ * Callers read and write the sidecar directly via the local file system.
+ *
+ * @param fsDescriptor  - file's original fsDescriptor
+ * @param path          - the path of the cached file
+ * @param name          - name of the sidecar, distinguishes several sidecars of the same file
+ * @param [out] sidecar - local path of the sidecar file. The file may not exist.
+ *
+ * @return Operation status, NOT_IMPLEMENTED if the cache layer is not initialized or dfs is accessed directly
+ */
+status::StatusInternal cacheGetSidecarPath(const FileSystemDescriptor & fsDescriptor, const char* path,
+		const char* name, std::string& sidecar);
+
 /**
  * @fn status::StatusInternal dfsSeek(const FileSystemDescriptor & namenode, dfsFile file, tOffset desiredPos)
  * @brief Seek to given offset in file. This works only for files opened in read-only mode.
@@ -259,6 +329,19 @@ tSize dfsRead(const FileSystemDescriptor & fsDescriptor, dfsFile file, void* buf
  */
 tSize dfsPread(const FileSystemDescriptor & fsDescriptor, tOffset position, void* buffer, tSize length);
 
+/**
+ * @fn int dfsGetLocalFileDescriptor(const FileSystemDescriptor & fsDescriptor, dfsFile file)
+ * @brief Get the descriptor of the local cached file behind an open handle, so that callers
+ * can issue positional (and asynchronous) reads against it directly.
+ *
+ * @param fsDescriptor - file's original fsDescriptor
+ * @param file         - The file handle, opened for read.
+ *
+ * @return Returns the local file descriptor, or -1 if the handle is not backed by a local
+ * cached file (e.g. it was opened for direct access to the remote filesystem).
+ */
+int dfsGetLocalFileDescriptor(const FileSystemDescriptor & fsDescriptor, dfsFile file);
+
 /**
  * Write data into an open file.
  *
@@ -228,6 +228,9 @@ bool FileSystemLRUCache::reload(const std::string& root){
 	// and populate sorted root content:
     for(; it != result_set.end(); it++){
     	std::string lp = (*it).second.string();
+    	// sidecar files belong to their cached file and are not managed on their own:
+    	if(utilities::endsWith(lp, constants::SIDECAR_FILE_SUFFIX))
+    		continue;
     	// create the managed file instance if there's network path can be successfully restored from its name
     	// so that the file can be managed by Imapla-To-Go:
     	std::string fqnp;
@@ -299,6 +302,15 @@ managed_file::File* FileSystemLRUCache::find(const std::string& path) {
     	return file;
     }
 
+bool FileSystemLRUCache::resident(const std::string& path) {
+    	// files under finalization are about to leave the cache:
+    	std::unique_lock<std::mutex> lock(m_deletionsmux);
+    	if(std::find(m_deletionList.begin(), m_deletionList.end(), path) != m_deletionList.end())
+    		return false;
+
+    	return m_idxFileLocalPath->peek(path, [](managed_file::File* file) { return file->exists(); });
+    }
+
 bool FileSystemLRUCache::add(const std::string& path, managed_file::File*& file, managed_file::NatureFlag creationFlag){
     	bool duplicate = false;
     	bool success   = false;
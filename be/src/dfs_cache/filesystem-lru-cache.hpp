@@ -220,6 +220,16 @@ public:
      */
     managed_file::File* find(const std::string& path);
 
+    /**
+     * Check whether the file is fully available locally, without loading it,
+     * "opening" it or updating its LRU timestamp.
+     *
+     * @param path - file local path
+     *
+     * @return true if the file is in the cache and its content is local
+     */
+    bool resident(const std::string& path);
+
     /** reset the cache */
     void reset() {
  	   this->clear();
@@ -279,6 +279,13 @@ tSize FileSystemManager::dfsPread(const FileSystemDescriptor & fsDescriptor, dfs
 	return bytes_read;
 }
 
+int FileSystemManager::dfsGetLocalFileDescriptor(const FileSystemDescriptor & fsDescriptor, dfsFile file){
+	if (!file || file->type != INPUT || file->file == nullptr)
+		return -1;
+
+	return fileno((FILE *)file->file);
+}
+
 tSize FileSystemManager::dfsWrite(const FileSystemDescriptor & fsDescriptor, dfsFile file, const void* buffer, tSize length){
 	if(file->file == nullptr)
 			return -1;
@@ -155,6 +155,15 @@ public:
 	 */
 	tSize dfsPread(const FileSystemDescriptor & fsDescriptor, dfsFile file, tOffset position, void* buffer, tSize length);
 
+	/**
+	 * Get the local file descriptor of a file opened for read.
+	 *
+	 * @param file - The file handle.
+	 *
+	 * @return Returns the file descriptor; -1 if the handle is not opened for read.
+	 */
+	int dfsGetLocalFileDescriptor(const FileSystemDescriptor & fsDescriptor, dfsFile file);
+
 	/**
 	 * Write data into an open file.
 	 *
@@ -158,6 +158,17 @@ public:
     	 */
     	virtual ItemType_* operator [](const KeyType_ key) = 0;
 
+    	/**
+    	 * index peek, look for item under the specified key without loading it into the cache,
+    	 * pinning or touching it
+    	 *
+    	 * @param key       - key to find
+    	 * @param predicate - predicate to evaluate on the item, if one is found
+    	 *
+    	 * @return true if the item is within the index and satisfies the predicate
+    	 */
+    	virtual bool peek(const KeyType_ key, const boost::function<bool(ItemType_* item)>& predicate) = 0;
+
     	/**
     	 * Delete object that matches key from cache
     	 *
@@ -348,6 +359,20 @@ private:
 			return node->value();
 		}
 
+        /** Index peek
+         *  @param key       - key to find
+         *  @param predicate - predicate to evaluate on the item, if one is found
+         *
+         *  @return true if the item is within the index and satisfies the predicate
+         */
+        bool peek(const KeyType_ key, const boost::function<bool(ItemType_* item)>& predicate){
+        	// the node is held alive while the predicate is evaluated
+        	boost::shared_ptr<INode> node = getNode(key);
+        	if(!node || node->value() == nullptr)
+        		return false;
+        	return predicate(node->value());
+        }
+
         /**
          * Delete object that matches key from cache
          * @param key        - key to remove
@@ -250,12 +250,41 @@ bool File::drop(){
 	}
 	if(!ec){
 		LOG (INFO) << "File \"" << fqp() << "\" is removed from file system." << "\n";
+		dropSidecars();
 		return true;
 	}
 	LOG (ERROR) << "Failed to delete the file \"" << fqp() << "\". Message : \"" << ec.message() << "\".\n";
 	return false;
 }
 
+void File::dropSidecars(){
+	boost::filesystem::path path(fqp());
+	// sidecars are named "<file name>.<sidecar name><sidecar suffix>":
+	std::string prefix = path.filename().string() + ".";
+	boost::system::error_code ec;
+	boost::filesystem::directory_iterator end_iter;
+	boost::filesystem::directory_iterator dir_iter(path.parent_path(), ec);
+	if(ec)
+		return;
+
+	// collect the sidecars first, removing entries invalidates the iterator:
+	std::vector<boost::filesystem::path> sidecars;
+	for(; dir_iter != end_iter; dir_iter.increment(ec)){
+		if(ec)
+			break;
+		std::string name = dir_iter->path().filename().string();
+		if(name.compare(0, prefix.length(), prefix) == 0 &&
+				utilities::endsWith(name, constants::SIDECAR_FILE_SUFFIX))
+			sidecars.push_back(dir_iter->path());
+	}
+	for(auto sidecar : sidecars){
+		boost::filesystem::remove(sidecar, ec);
+		if(ec)
+			LOG (WARNING) << "Failed to delete the sidecar file \"" << sidecar.string() << "\". Message : \"" <<
+					ec.message() << "\".\n";
+	}
+}
+
 status::StatusInternal File::forceDelete(){
 	boost::system::error_code ec;
 	try {
@@ -265,8 +294,10 @@ status::StatusInternal File::forceDelete(){
 		LOG (ERROR) << "Failed to forcibly delete the file \"" << fqp() << "\". Ex : " <<
 		e.what() << "\n";
 	}
-	if(!ec)
+	if(!ec){
+		dropSidecars();
 		return status::StatusInternal::OK;
+	}
 	else{
 		LOG (ERROR) << "Failed to forcibly delete the file \"" << fqp() << "\"." << "\n";
 		return status::StatusInternal::FILE_OBJECT_OPERATION_FAILURE;
@@ -497,6 +497,12 @@ namespace managed_file {
        */
       bool drop();
 
+      /**
+       * Remove the sidecar files of this file (see cacheGetSidecarPath()) from file system.
+       * Sidecars are derived from the file content, so they go away together with the file.
+       */
+      void dropSidecars();
+
 	   /* ***********************   Methods group to fit the intrusive concept (LRU Cache)   ******************************/
 
 	   friend bool operator <  (const File &a, const File &b)
@@ -13,6 +13,7 @@
 
 #include "dfs_cache/gtest-fixtures.hpp"
 #include "dfs_cache/test-utilities.hpp"
+#include "dfs_cache/upload-mgr.hpp"
 
 namespace impala{
 
@@ -781,10 +782,14 @@ TEST_F(CacheLayerTest, OpenNonExistingFile) {
 			boost::posix_time::hours(-1), constants::TEST_CACHE_FIXED_SIZE);
 	cacheConfigureFileSystem(m_dfsIdentitylocalFilesystem);
 
+	// non-existing file is never reported as cached:
+	ASSERT_FALSE(dfsIsFileCached(m_dfsIdentitylocalFilesystem, filename));
+
 	bool available;
 	dfsFile file = dfsOpenFile(m_dfsIdentitylocalFilesystem, filename, O_RDONLY, 0, 0, 0, available);
     // check that the file handle is not available
 	ASSERT_TRUE(!available && (file == NULL));
+	ASSERT_FALSE(dfsIsFileCached(m_dfsIdentitylocalFilesystem, filename));
 }
 
 /**
@@ -1232,6 +1237,72 @@ TEST_F(CacheLayerTest, TestOverloadedCacheAddNewItem){
     fsAdaptor.freeFileInfo(files, entries);
 }
 
+/** Wait up to 10 seconds for the upload manager to track @a uploads uploads */
+static bool waitForTrackedUploads(size_t uploads){
+	for(int i = 0; i < 1000 && UploadManager::instance()->size() != uploads; i++)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	return UploadManager::instance()->size() == uploads;
+}
+
+/**
+ * Write-behind uploads must not be kept by the upload manager once nobody is going to wait for them.
+ *
+ * Scenario :
+ * 1. Files are written and closed in write-behind mode, nobody waits for their uploads.
+ *    Successful uploads are dropped once they are done.
+ * 2. A file is still written when its upload is forgotten, as when an insert is cancelled.
+ *    The upload is kept until the file is closed and the upload is done.
+ */
+TEST_F(CacheLayerTest, WriteBehindUploadsAreDropped){
+	boost::system::error_code ec;
+	std::string target_dir = "/tmp/dfs-cache-write-behind-test/";
+	boost::filesystem::remove_all(target_dir, ec);
+	boost::filesystem::create_directory(target_dir, ec);
+	ASSERT_TRUE(!ec);
+
+	cacheInit(constants::TEST_CACHE_DEFAULT_FREE_SPACE_PERCENT, m_cache_path,
+			boost::posix_time::hours(-1), constants::TEST_CACHE_FIXED_SIZE);
+	cacheConfigureFileSystem(m_dfsIdentitylocalFilesystem);
+	// parts smaller than the written data, so the files are uploaded while they are written:
+	cacheConfigureWriteBehind(2, 1024);
+	ASSERT_TRUE(UploadManager::instance() != nullptr);
+	ASSERT_TRUE(waitForTrackedUploads(0));
+
+	char buffer[BUFFER_SIZE];
+	memset(buffer, 'a', BUFFER_SIZE);
+
+	const int files = 10;
+	std::vector<std::string> filenames;
+	for(int i = 0; i < files; i++){
+		filenames.push_back(constants::TEST_LOCALFS_PROTO_PREFFIX + target_dir + "file-" + std::to_string(i));
+		bool available;
+		dfsFile file = dfsOpenFile(m_dfsIdentitylocalFilesystem, filenames.back().c_str(), O_WRONLY, 0, 0, 0,
+				available);
+		ASSERT_TRUE(file != NULL);
+		ASSERT_EQ(dfsWrite(m_dfsIdentitylocalFilesystem, file, buffer, BUFFER_SIZE), BUFFER_SIZE);
+		ASSERT_TRUE(dfsCloseFile(m_dfsIdentitylocalFilesystem, file) == status::StatusInternal::OK);
+	}
+	ASSERT_TRUE(waitForTrackedUploads(0));
+	// the uploads are complete and are reported as such:
+	for(int i = 0; i < files; i++){
+		ASSERT_TRUE(dfsWaitForUpload(m_dfsIdentitylocalFilesystem, filenames[i].c_str()) == status::StatusInternal::OK);
+		ASSERT_EQ(boost::filesystem::file_size(target_dir + "file-" + std::to_string(i), ec), BUFFER_SIZE);
+	}
+
+	std::string filename = constants::TEST_LOCALFS_PROTO_PREFFIX + target_dir + "forgotten";
+	bool available;
+	dfsFile file = dfsOpenFile(m_dfsIdentitylocalFilesystem, filename.c_str(), O_WRONLY, 0, 0, 0, available);
+	ASSERT_TRUE(file != NULL);
+	ASSERT_EQ(dfsWrite(m_dfsIdentitylocalFilesystem, file, buffer, BUFFER_SIZE), BUFFER_SIZE);
+	ASSERT_TRUE(dfsForgetUpload(m_dfsIdentitylocalFilesystem, filename.c_str()) == status::StatusInternal::OK);
+	// the file is still written, the upload is not done:
+	ASSERT_EQ(UploadManager::instance()->size(), 1);
+	ASSERT_TRUE(dfsCloseFile(m_dfsIdentitylocalFilesystem, file) == status::StatusInternal::OK);
+	ASSERT_TRUE(waitForTrackedUploads(0));
+
+	boost::filesystem::remove_all(target_dir, ec);
+}
+
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,280 @@
+/*
+ * @file upload-mgr.cc
+ * @brief Implementation of write-behind upload of files created locally in "CREATE FROM SELECT" scenario.
+ *
+ * @date   Oct 16, 2015
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "dfs_cache/upload-mgr.hpp"
+#include "dfs_cache/cache-layer-registry.hpp"
+#include "dfs_cache/filesystem-descriptor-bound.hpp"
+
+/**
+ * @namespace impala
+ */
+namespace impala {
+
+namespace constants {
+	/** maximum number of uploads waiting for a free upload thread */
+	const int UPLOAD_QUEUE_SIZE = 1024;
+}
+
+boost::scoped_ptr<UploadManager> UploadManager::instance_;
+
+void UploadManager::init(int threads, size_t partSize) {
+	if(UploadManager::instance_.get() == NULL)
+		UploadManager::instance_.reset(new UploadManager(threads, partSize));
+}
+
+UploadManager::UploadManager(int threads, size_t partSize) : m_partSize(partSize) {
+	m_pool.reset(new dfsUploadThreadPool("CacheManagementUpload", "WriteBehindUploadPool", threads,
+			constants::UPLOAD_QUEUE_SIZE,
+			boost::bind<void>(boost::mem_fn(&UploadManager::uploadProc), this, _1, _2)));
+}
+
+UploadManager::~UploadManager() {
+	// let the uploads in progress complete:
+	m_pool->DrainAndShutdown();
+}
+
+bool UploadManager::add(const FileSystemDescriptor& fsDescriptor, const char* path, dfsFile local,
+		dfsFile remote) {
+	// the writer's handle may be closed before the upload is done, so read the local file via own descriptor:
+	int fd = dup(fileno((FILE *)local->file));
+	if(fd == -1){
+		LOG (ERROR) << "Failed to duplicate the local file descriptor for upload of \"" << path << "\" : "
+				<< strerror(errno) << "\n";
+		return false;
+	}
+
+	boost::shared_ptr<UploadTask> task(new UploadTask());
+	task->fsDescriptor = fsDescriptor;
+	task->path         = path;
+	task->fd           = fd;
+	task->remote       = remote;
+
+	boost::mutex::scoped_lock lock(m_mux);
+	auto it = m_uploads.find(task->path);
+	if(it != m_uploads.end() && !it->second->done){
+		LOG (ERROR) << "Upload of \"" << path << "\" is already in progress." << "\n";
+		close(fd);
+		return false;
+	}
+	m_open[local] = task;
+	m_uploads[task->path] = task;
+	return true;
+}
+
+bool UploadManager::isUploaded(dfsFile local) {
+	boost::mutex::scoped_lock lock(m_mux);
+	return m_open.find(local) != m_open.end();
+}
+
+void UploadManager::written(dfsFile local, tSize length) {
+	boost::shared_ptr<UploadTask> task;
+	{
+		boost::mutex::scoped_lock lock(m_mux);
+		auto it = m_open.find(local);
+		if(it == m_open.end())
+			return;
+		task = it->second;
+		task->written += length;
+		// wait for the full part to be accumulated:
+		if(task->written - task->uploaded < (tOffset)m_partSize || !schedule(task))
+			return;
+	}
+	offer(task);
+}
+
+void UploadManager::closed(dfsFile local) {
+	boost::shared_ptr<UploadTask> task;
+	{
+		boost::mutex::scoped_lock lock(m_mux);
+		auto it = m_open.find(local);
+		if(it == m_open.end())
+			return;
+		task = it->second;
+		m_open.erase(it);
+		task->closed = true;
+		if(!schedule(task))
+			return;
+	}
+	offer(task);
+}
+
+status::StatusInternal UploadManager::wait(const char* path) {
+	boost::mutex::scoped_lock lock(m_mux);
+	auto it = m_uploads.find(path);
+	if(it == m_uploads.end())
+		return status::StatusInternal::OK;
+	boost::shared_ptr<UploadTask> task = it->second;
+	while(!task->done)
+		m_uploadDone.wait(lock);
+
+	// the upload is reported, forget it:
+	it = m_uploads.find(path);
+	if(it != m_uploads.end() && it->second == task)
+		m_uploads.erase(it);
+	return task->status;
+}
+
+void UploadManager::forget(const char* path) {
+	boost::mutex::scoped_lock lock(m_mux);
+	auto it = m_uploads.find(path);
+	if(it == m_uploads.end())
+		return;
+	if(it->second->done)
+		m_uploads.erase(it);
+	else
+		it->second->forgotten = true;
+}
+
+size_t UploadManager::size() {
+	boost::mutex::scoped_lock lock(m_mux);
+	return m_uploads.size();
+}
+
+bool UploadManager::schedule(const boost::shared_ptr<UploadTask>& task) {
+	if(task->scheduled || task->done)
+		return false;
+	task->scheduled = true;
+	return true;
+}
+
+void UploadManager::offer(const boost::shared_ptr<UploadTask>& task) {
+	// the queue may be full, so this blocks until an upload thread takes a task. The upload threads
+	// need m_mux for this, so it must not be held here:
+	if(m_pool->Offer(task))
+		return;
+
+	LOG (ERROR) << "Upload of \"" << task->path << "\" is not scheduled, upload pool is shut down." << "\n";
+	closeRemote(task);
+	boost::mutex::scoped_lock lock(m_mux);
+	if(task->status == status::StatusInternal::OK)
+		task->status = status::StatusInternal::CACHE_IS_NOT_READY;
+	complete(task);
+}
+
+void UploadManager::complete(const boost::shared_ptr<UploadTask>& task) {
+	close(task->fd);
+	task->fd = -1;
+	task->scheduled = false;
+	task->done = true;
+	// nothing to report for a successful upload, wait() returns OK for unknown paths. A failure is
+	// kept until it is reported, unless nobody is going to wait for it:
+	if(task->status == status::StatusInternal::OK || task->forgotten){
+		auto it = m_uploads.find(task->path);
+		if(it != m_uploads.end() && it->second == task)
+			m_uploads.erase(it);
+	}
+	m_uploadDone.notify_all();
+}
+
+void UploadManager::uploadProc(int threadnum, const boost::shared_ptr<UploadTask>& task) {
+	boost::scoped_array<char> buffer(new char[m_partSize]);
+
+	boost::mutex::scoped_lock lock(m_mux);
+	for(;;){
+		tOffset pending = task->written - task->uploaded;
+		if(task->status != status::StatusInternal::OK)
+			pending = 0; // drop the rest of the file, the upload failed anyway
+
+		if(pending == 0 && task->closed)
+			break;
+		// upload only full parts while the file is still written, the tail is uploaded on close:
+		if(pending == 0 || (pending < (tOffset)m_partSize && !task->closed)){
+			task->scheduled = false;
+			return;
+		}
+
+		size_t length = std::min((size_t)pending, m_partSize);
+		tOffset offset = task->uploaded;
+		lock.unlock();
+		status::StatusInternal status = uploadPart(task, offset, length, buffer.get());
+		lock.lock();
+		task->uploaded += length;
+		if(status != status::StatusInternal::OK && task->status == status::StatusInternal::OK)
+			task->status = status;
+	}
+
+	lock.unlock();
+	status::StatusInternal status = closeRemote(task);
+	lock.lock();
+	if(task->status == status::StatusInternal::OK)
+		task->status = status;
+	complete(task);
+}
+
+status::StatusInternal UploadManager::uploadPart(const boost::shared_ptr<UploadTask>& task, tOffset offset,
+		size_t length, char* buffer) {
+	size_t read = 0;
+	while(read < length){
+		ssize_t ret = pread(task->fd, buffer + read, length - read, offset + read);
+		if(ret <= 0){
+			LOG (ERROR) << "Failed to read local file for upload of \"" << task->path << "\" : "
+					<< (ret == 0 ? "unexpected end of file" : strerror(errno)) << "\n";
+			return status::StatusInternal::FILE_OBJECT_OPERATION_FAILURE;
+		}
+		read += ret;
+	}
+
+	boost::shared_ptr<FileSystemDescriptorBound> fsAdaptor =
+			(*CacheLayerRegistry::instance()->getFileSystemDescriptor(task->fsDescriptor));
+	if(!fsAdaptor){
+		LOG (ERROR) << "No filesystem adaptor configured for FileSystem \"" << task->fsDescriptor.dfs_type << ":" <<
+				task->fsDescriptor.host << "\"" << "\n";
+		return status::StatusInternal::DFS_ADAPTOR_IS_NOT_CONFIGURED;
+	}
+
+	raiiDfsConnection connection(fsAdaptor->getFreeConnection());
+	if(!connection.valid()) {
+		LOG (ERROR) << "No connection to dfs available, unable to upload file on FileSystem \"" << task->fsDescriptor.dfs_type << ":" <<
+				task->fsDescriptor.host << "\"" << "\n";
+		return status::StatusInternal::DFS_NAMENODE_IS_NOT_REACHABLE;
+	}
+
+	size_t uploaded = 0;
+	while(uploaded < length){
+		tSize ret = fsAdaptor->fileWrite(connection, task->remote, buffer + uploaded, length - uploaded);
+		if(ret <= 0){
+			LOG (ERROR) << "Failed to write into remote file \"" << task->path << "\"." << "\n";
+			return status::StatusInternal::DFS_OBJECT_OPERATION_FAILURE;
+		}
+		uploaded += ret;
+	}
+	return status::StatusInternal::OK;
+}
+
+status::StatusInternal UploadManager::closeRemote(const boost::shared_ptr<UploadTask>& task) {
+	boost::shared_ptr<FileSystemDescriptorBound> fsAdaptor =
+			(*CacheLayerRegistry::instance()->getFileSystemDescriptor(task->fsDescriptor));
+	if(!fsAdaptor){
+		LOG (ERROR) << "No filesystem adaptor configured for FileSystem \"" << task->fsDescriptor.dfs_type << ":" <<
+				task->fsDescriptor.host << "\"" << "\n";
+		return status::StatusInternal::DFS_ADAPTOR_IS_NOT_CONFIGURED;
+	}
+
+	raiiDfsConnection connection(fsAdaptor->getFreeConnection());
+	if(!connection.valid()) {
+		LOG (ERROR) << "No connection to dfs available, unable to close file for write on FileSystem \"" << task->fsDescriptor.dfs_type << ":" <<
+				task->fsDescriptor.host << "\"" << "\n";
+		return status::StatusInternal::DFS_NAMENODE_IS_NOT_REACHABLE;
+	}
+
+	if(fsAdaptor->fileClose(connection, task->remote) != 0){
+		LOG (ERROR) << "Failed to close file \"" << task->path << "\" for write on FileSystem \"" << task->fsDescriptor.dfs_type << ":" <<
+				task->fsDescriptor.host << "\"" << "\n";
+		return status::StatusInternal::DFS_OBJECT_OPERATION_FAILURE;
+	}
+	LOG (INFO) << "Upload of \"" << task->path << "\" is done, " << task->uploaded << " bytes uploaded." << "\n";
+	return status::StatusInternal::OK;
+}
+
+}
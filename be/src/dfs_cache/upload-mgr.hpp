@@ -0,0 +1,153 @@
+/*
+ * @file upload-mgr.hpp
+ * @brief Define write-behind upload of files created locally in "CREATE FROM SELECT" scenario.
+ *
+ * In write-behind mode dfsWrite() only writes into the local cache file. The UploadManager
+ * streams the written data in parts to the remote dfs file on its own thread pool, so that
+ * the writer runs at local disk speed. Remote streams are sequential, so a single file is
+ * uploaded by at most one thread at a time, but it is uploaded while it is still written;
+ * different files are uploaded in parallel.
+ *
+ * @date   Oct 16, 2015
+ */
+
+#ifndef UPLOAD_MGR_H_
+#define UPLOAD_MGR_H_
+
+#include <string>
+#include <map>
+#include <unordered_map>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "dfs_cache/common-include.hpp"
+#include "util/thread-pool.h"
+
+/**
+ * @namespace impala
+ */
+namespace impala {
+
+/**
+ * Upload of a single file in write-behind mode.
+ * All fields but the immutable ones are protected by UploadManager::m_mux.
+ */
+struct UploadTask {
+	FileSystemDescriptor   fsDescriptor;  /**< remote filesystem the file is uploaded to */
+	std::string            path;          /**< file path, as it was opened for write */
+	int                    fd;            /**< own descriptor to read the local file, survives local file close */
+	dfsFile                remote;        /**< remote file handle, opened for write */
+
+	tOffset                written;       /**< bytes written into the local file */
+	tOffset                uploaded;      /**< bytes uploaded to the remote file */
+	bool                   closed;        /**< the writer closed the local file, no more data will come */
+	bool                   scheduled;     /**< the task is queued or being uploaded by a pool thread */
+	bool                   done;          /**< remote file is closed, the upload is complete */
+	bool                   forgotten;     /**< nobody will wait for the upload, drop it once done */
+	status::StatusInternal status;        /**< first failure met during the upload */
+
+	UploadTask() : fd(-1), remote(NULL), written(0), uploaded(0), closed(false), scheduled(false),
+			done(false), forgotten(false), status(status::StatusInternal::OK) { }
+};
+
+typedef ThreadPool<boost::shared_ptr<UploadTask> > dfsUploadThreadPool;
+
+class UploadManager {
+private:
+	// Singleton instance. Instantiated in init().
+	static boost::scoped_ptr<UploadManager> instance_;
+
+	size_t                                                 m_partSize;  /**< size of the part uploaded in one go */
+	boost::mutex                                           m_mux;       /**< protects uploads and all tasks state */
+	boost::condition_variable                              m_uploadDone;/**< signaled when some upload is done */
+
+	std::unordered_map<dfsFile, boost::shared_ptr<UploadTask> > m_open;    /**< uploads of files still open for write, by local handle */
+	std::map<std::string, boost::shared_ptr<UploadTask> >       m_uploads; /**< uploads in progress and failed uploads nobody waited for yet, by path */
+
+	boost::scoped_ptr<dfsUploadThreadPool>                 m_pool;      /**< upload threads */
+
+	UploadManager(int threads, size_t partSize);
+	UploadManager(UploadManager const& l);            // disable copy constructor
+	UploadManager& operator=(UploadManager const& l); // disable assignment operator
+
+	/** pool's thread function, uploads the pending parts of @a task */
+	void uploadProc(int threadnum, const boost::shared_ptr<UploadTask>& task);
+
+	/** upload @a length bytes at @a offset of @a task's local file. Called without m_mux held */
+	status::StatusInternal uploadPart(const boost::shared_ptr<UploadTask>& task, tOffset offset,
+			size_t length, char* buffer);
+
+	/** close the remote file of @a task. Called without m_mux held */
+	status::StatusInternal closeRemote(const boost::shared_ptr<UploadTask>& task);
+
+	/**
+	 * mark @a task as scheduled unless it is scheduled or done already. Called with m_mux held.
+	 *
+	 * @return true if the caller has to offer() @a task once it released m_mux
+	 */
+	bool schedule(const boost::shared_ptr<UploadTask>& task);
+
+	/**
+	 * queue @a task to the pool. Called without m_mux held, as this blocks while the pool's queue
+	 * is full. If the pool is shut down, the task is completed with an error.
+	 */
+	void offer(const boost::shared_ptr<UploadTask>& task);
+
+	/** close the local descriptor of @a task, mark it done and wake up its waiters. Called with m_mux held */
+	void complete(const boost::shared_ptr<UploadTask>& task);
+
+public:
+	~UploadManager();
+
+	/** Singleton instance, NULL if write-behind mode is not configured */
+	static UploadManager* instance() { return UploadManager::instance_.get(); }
+
+	/**
+	 * Enable write-behind mode.
+	 *
+	 * @param threads  - number of threads uploading files in parallel
+	 * @param partSize - bytes of a file to be accumulated locally before they are uploaded
+	 */
+	static void init(int threads, size_t partSize);
+
+	/**
+	 * Start the upload of the file @a path, opened for write locally as @a local and remotely as @a remote.
+	 *
+	 * @return true if the upload was registered
+	 */
+	bool add(const FileSystemDescriptor& fsDescriptor, const char* path, dfsFile local, dfsFile remote);
+
+	/** true if @a local handle is uploaded in write-behind mode */
+	bool isUploaded(dfsFile local);
+
+	/** Report @a length bytes were appended to the @a local file */
+	void written(dfsFile local, tSize length);
+
+	/**
+	 * Report the @a local file is closed. The rest of the file is uploaded and the remote file
+	 * is closed asynchronously. @a local handle is no longer used by the upload.
+	 */
+	void closed(dfsFile local);
+
+	/**
+	 * Wait until the upload of @a path is done.
+	 * Successful uploads are forgotten once they are done, failed ones are kept until they are
+	 * waited for or forgotten.
+	 *
+	 * @return the upload status, OK if there's no upload for @a path
+	 */
+	status::StatusInternal wait(const char* path);
+
+	/** Nobody will wait for the upload of @a path: drop it now if it is done, or once it is done */
+	void forget(const char* path);
+
+	/** number of uploads tracked by path */
+	size_t size();
+};
+
+}
+
+#endif /* UPLOAD_MGR_H_ */
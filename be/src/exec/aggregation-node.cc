@@ -23,6 +23,7 @@
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "exec/old-hash-table.inline.h"
 #include "exprs/agg-fn-evaluator.h"
 #include "exprs/expr.h"
@@ -200,8 +201,11 @@ Status AggregationNode::Open(RuntimeState* state) {
         VLOG_ROW << "input row: " << PrintRow(row, children_[0]->row_desc());
       }
     }
-    if (process_row_batch_fn_ != NULL) {
-      process_row_batch_fn_(this, &batch);
+    // The codegen'd function may be published concurrently (see --async_codegen).
+    ProcessRowBatchFn process_row_batch_fn =
+        AtomicUtil::LoadAcquire(&process_row_batch_fn_);
+    if (process_row_batch_fn != NULL) {
+      process_row_batch_fn(this, &batch);
     } else if (probe_expr_ctxs_.empty()) {
       ProcessRowBatchNoGrouping(&batch);
     } else {
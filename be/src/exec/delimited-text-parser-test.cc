@@ -138,6 +138,79 @@ TEST(DelimitedTextParser, Fields) {
   Validate(&escape_parser, "a|b,c|d@,e", 2, TUPLE_DELIM, 1, 2);
 }
 
+// Parses 'data' from the start and checks that the lengths of the parsed fields are
+// 'expected_lens' (negative for fields with escape characters).
+void ValidateFieldLens(DelimitedTextParser* parser, const string& data,
+    const vector<int>& expected_lens) {
+  parser->ParserReset();
+  char* data_ptr = const_cast<char*>(data.c_str());
+  char* row_end_locs[100];
+  vector<FieldLocation> field_locations(100);
+  int num_tuples = 0;
+  int num_fields = 0;
+  char* next_column_start;
+  Status status = parser->ParseFieldLocations(100, data.size(), &data_ptr,
+      &row_end_locs[0], &field_locations[0], &num_tuples, &num_fields,
+      &next_column_start);
+  ASSERT_EQ(num_fields, expected_lens.size()) << data;
+  for (int i = 0; i < num_fields; ++i) {
+    EXPECT_EQ(field_locations[i].len, expected_lens[i]) << data << " field " << i;
+  }
+}
+
+// The parser looks at 64 bytes at a time. Test escape characters and delimiters at and
+// across the block boundaries.
+TEST(DelimitedTextParser, BlockBoundaries) {
+  const char TUPLE_DELIM = '|';
+  const char FIELD_DELIM = ',';
+  const char COLLECTION_DELIM = ',';
+  const char ESCAPE_CHAR = '@';
+
+  const int NUM_COLS = 2;
+
+  bool is_materialized_col[NUM_COLS];
+  for (int i = 0; i < NUM_COLS; ++i) is_materialized_col[i] = true;
+
+  DelimitedTextParser escape_parser(NUM_COLS, 0, is_materialized_col,
+                                    TUPLE_DELIM, FIELD_DELIM, COLLECTION_DELIM,
+                                    ESCAPE_CHAR);
+  DelimitedTextParser no_escape_parser(NUM_COLS, 0, is_materialized_col,
+                                       TUPLE_DELIM, FIELD_DELIM, COLLECTION_DELIM);
+
+  // The escape characters end at byte 63, the delimiter is byte 64.
+  for (int num_escapes = 1; num_escapes <= 4; ++num_escapes) {
+    string field(64 - num_escapes, 'a');
+    field += string(num_escapes, ESCAPE_CHAR);
+    string data = field + ",b|";
+    vector<int> lens;
+    if (num_escapes % 2 == 1) {
+      // The delimiter is escaped, the second column is empty.
+      lens.push_back(-(64 + 2));
+      lens.push_back(0);
+    } else {
+      lens.push_back(-64);
+      lens.push_back(1);
+    }
+    ValidateFieldLens(&escape_parser, data, lens);
+
+    lens.clear();
+    lens.push_back(64);
+    lens.push_back(1);
+    ValidateFieldLens(&no_escape_parser, data, lens);
+  }
+
+  // Fields and tuples spanning several blocks, with a delimiter as the last byte of the
+  // buffer.
+  string long_field(150, 'a');
+  string data = long_field + "," + long_field + "|a,@" + long_field + "|";
+  vector<int> lens;
+  lens.push_back(150);
+  lens.push_back(150);
+  lens.push_back(1);
+  lens.push_back(-151);
+  ValidateFieldLens(&escape_parser, data, lens);
+}
+
 // TODO: expand test for other delimited text parser functions/cases.
 // Not all of them work without creating a HdfsScanNode but we can expand
 // these tests quite a bit more.
@@ -23,7 +23,7 @@ using namespace std;
 DelimitedTextParser::DelimitedTextParser(
     int num_cols, int num_partition_keys, const bool* is_materialized_col,
     char tuple_delim, char field_delim, char collection_item_delim, char escape_char)
-    : num_delims_(0),
+    : search_field_delims_(field_delim != '\0' || collection_item_delim != '\0'),
       field_delim_(field_delim),
       process_escapes_(escape_char != '\0'),
       escape_char_(escape_char),
@@ -43,46 +43,22 @@ DelimitedTextParser::DelimitedTextParser(
   DCHECK(escape_char == '\0' || escape_char != field_delim);
   DCHECK(escape_char == '\0' || escape_char != collection_item_delim);
 
+  DCHECK(tuple_delim != '\0' || search_field_delims_);
+
   // Initialize the sse search registers.
+  xmm_tuple_delim_ = _mm_set1_epi8(tuple_delim_);
+  xmm_cr_ = _mm_set1_epi8('\r');
+  xmm_field_delim_ = _mm_set1_epi8(field_delim_);
+  xmm_collection_item_delim_ = _mm_set1_epi8(collection_item_delim_);
+  xmm_escape_char_ = _mm_set1_epi8(escape_char_);
+
   char search_chars[SSEUtil::CHARS_PER_128_BIT_REGISTER];
   memset(search_chars, 0, sizeof(search_chars));
-  if (process_escapes_) {
-    search_chars[0] = escape_char_;
-    xmm_escape_search_ = _mm_loadu_si128(reinterpret_cast<__m128i*>(search_chars));
-
-    // To process escape characters, we need to check if there was an escape
-    // character between (col_start,col_end).  The SSE instructions return
-    // a bit mask for 16 bits so we need to mask off the bits below col_start
-    // and after col_end.
-    low_mask_[0] = 0xffff;
-    high_mask_[15] = 0xffff;
-    for (int i = 1; i < 16; ++i) {
-      low_mask_[i] = low_mask_[i - 1] << 1;
-    }
-    for (int i = 14; i >= 0; --i) {
-      high_mask_[i] = high_mask_[i + 1] >> 1;
-    }
-  } else {
-    memset(high_mask_, 0, sizeof(high_mask_));
-    memset(low_mask_, 0, sizeof(low_mask_));
-  }
-
   if (tuple_delim != '\0') {
-    search_chars[num_delims_++] = tuple_delim_;
-    // Hive will treats \r (^M) as an alternate tuple delimiter, but \r\n is a
-    // single tuple delimiter.
-    if (tuple_delim_ == '\n') search_chars[num_delims_++] = '\r';
+    search_chars[0] = tuple_delim_;
     xmm_tuple_search_ = _mm_loadu_si128(reinterpret_cast<__m128i*>(search_chars));
   }
 
-  if (field_delim != '\0' || collection_item_delim != '\0') {
-    search_chars[num_delims_++] = field_delim_;
-    search_chars[num_delims_++] = collection_item_delim_;
-  }
-
-  DCHECK_GT(num_delims_, 0);
-  xmm_delim_search_ = _mm_loadu_si128(reinterpret_cast<__m128i*>(search_chars));
-
   ParserReset();
 }
 
@@ -108,71 +84,16 @@ Status DelimitedTextParser::ParseFieldLocations(int max_tuples, int64_t remainin
     last_row_delim_offset_ = -1;
   }
 
-  if (CpuInfo::IsSupported(CpuInfo::SSE4_2)) {
-    if (process_escapes_) {
-      ParseSse<true>(max_tuples, &remaining_len, byte_buffer_ptr, row_end_locations,
-          field_locations, num_tuples, num_fields, next_column_start);
-    } else {
-      ParseSse<false>(max_tuples, &remaining_len, byte_buffer_ptr, row_end_locations,
-          field_locations, num_tuples, num_fields, next_column_start);
-    }
+  if (process_escapes_) {
+    ParseBlocks<true>(max_tuples, &remaining_len, byte_buffer_ptr, row_end_locations,
+        field_locations, num_tuples, num_fields, next_column_start);
+  } else {
+    ParseBlocks<false>(max_tuples, &remaining_len, byte_buffer_ptr, row_end_locations,
+        field_locations, num_tuples, num_fields, next_column_start);
   }
 
   if (*num_tuples == max_tuples) return Status::OK;
 
-  // Handle the remaining characters
-  while (remaining_len > 0) {
-    bool new_tuple = false;
-    bool new_col = false;
-    unfinished_tuple_ = true;
-
-    if (!last_char_is_escape_) {
-      if (tuple_delim_ != '\0' && (**byte_buffer_ptr == tuple_delim_ ||
-           (tuple_delim_ == '\n' && **byte_buffer_ptr == '\r'))) {
-        new_tuple = true;
-        new_col = true;
-      } else if (**byte_buffer_ptr == field_delim_
-                 || **byte_buffer_ptr == collection_item_delim_) {
-        new_col = true;
-      }
-    }
-
-    if (process_escapes_ && **byte_buffer_ptr == escape_char_) {
-      current_column_has_escape_ = true;
-      last_char_is_escape_ = !last_char_is_escape_;
-    } else {
-      last_char_is_escape_ = false;
-    }
-
-    if (new_tuple) {
-      if (last_row_delim_offset_ == remaining_len && **byte_buffer_ptr == '\n') {
-        // If the row ended in \r\n then move to the \n
-        ++*next_column_start;
-      } else {
-        AddColumn<true>(*byte_buffer_ptr - *next_column_start,
-            next_column_start, num_fields, field_locations);
-        FillColumns<false>(0, NULL, num_fields, field_locations);
-        column_idx_ = num_partition_keys_;
-        row_end_locations[*num_tuples] = *byte_buffer_ptr;
-        ++(*num_tuples);
-      }
-      unfinished_tuple_ = false;
-      last_row_delim_offset_ = **byte_buffer_ptr == '\r' ? remaining_len - 1 : -1;
-      if (*num_tuples == max_tuples) {
-        ++*byte_buffer_ptr;
-        --remaining_len;
-        if (last_row_delim_offset_ == remaining_len) last_row_delim_offset_ = 0;
-        return Status::OK;
-      }
-    } else if (new_col) {
-      AddColumn<true>(*byte_buffer_ptr - *next_column_start,
-          next_column_start, num_fields, field_locations);
-    }
-
-    --remaining_len;
-    ++*byte_buffer_ptr;
-  }
-
   // For formats that store the length of the row, the row is not delimited:
   // e.g. Sequence files.
   if (tuple_delim_ == '\0') {
@@ -57,11 +57,9 @@ class DelimitedTextParser {
   // Parses a byte buffer for the field and tuple breaks.
   // This function will write the field start & len to field_locations
   // which can then be written out to tuples.
-  // This function uses SSE ("Intel x86 instruction set extension
-  // 'Streaming Simd Extension') if the hardware supports SSE4.2
-  // instructions.  SSE4.2 added string processing instructions that
-  // allow for processing 16 characters at a time.  Otherwise, this
-  // function walks the file_buffer_ character by character.
+  // The buffer is indexed 64 bytes at a time with SSE2 compares (see ParseBlocks()), so
+  // this does not depend on SSE4.2 and handles escape characters without falling back
+  // to a character by character loop.
   // Input Parameters:
   //   max_tuples: The maximum number of tuples that should be parsed.
   //               This is used to control how the batching works.
@@ -138,29 +136,48 @@ class DelimitedTextParser {
   void AddColumn(int len, char** next_column_start, int* num_fields,
                  FieldLocation* field_locations);
 
-  // Helper routine to parse delimited text using SSE instructions.
-  // Identical arguments as ParseFieldLocations.
+  // Number of bytes indexed at a time by ParseBlocks(), one bit per byte of a uint64_t.
+  static const int BLOCK_SIZE = 64;
+
+  // Helper routine to parse delimited text a block of BLOCK_SIZE bytes at a time.
+  // Identical arguments as ParseFieldLocations. Parses the whole buffer, the last block
+  // may be shorter than BLOCK_SIZE.
+  // For each block, FindDelimiters() computes bitmasks of the tuple delimiters, field
+  // delimiters and escape characters, FindEscapedChars() clears the delimiters that
+  // are escaped, and the remaining bits are then walked to write the field locations.
   // If the template argument, 'process_escapes' is true, this function will handle
   // escapes, otherwise, it will assume the text is unescaped.  By using templates,
   // we can special case the un-escaped path for better performance.  The unescaped
   // path is optimized away by the compiler.
   template <bool process_escapes>
-  void ParseSse(int max_tuples, int64_t* remaining_len,
-      char** byte_buffer_ptr, char** row_end_locations_,
+  void ParseBlocks(int max_tuples, int64_t* remaining_len,
+      char** byte_buffer_ptr, char** row_end_locations,
       FieldLocation* field_locations,
       int* num_tuples, int* num_fields, char** next_column_start);
 
+  // Sets the bits of 'tuple_mask', 'field_mask' and 'escape_mask' for the tuple
+  // delimiters (including \r if the tuple delimiter is \n), the field and collection
+  // item delimiters and, if 'process_escapes' is true, the escape characters in
+  // buffer[0, len). Bit i is for buffer[i]. len must be in [1, BLOCK_SIZE].
+  template <bool process_escapes>
+  void FindDelimiters(const char* buffer, int len, uint64_t* tuple_mask,
+      uint64_t* field_mask, uint64_t* escape_mask);
+
   // SSE(xmm) register containing the tuple search character.
+  // Only used by FindFirstInstance().
   __m128i xmm_tuple_search_;
 
-  // SSE(xmm) register containing the delimiter search character.
-  __m128i xmm_delim_search_;
-
-  // The number of delimiters contained in xmm_delim_search_, i.e. its length
-  int num_delims_;
+  // SSE(xmm) registers with all 16 bytes set to the tuple delimiter, '\r', the field
+  // delimiter, the collection item delimiter and the escape character.
+  __m128i xmm_tuple_delim_;
+  __m128i xmm_cr_;
+  __m128i xmm_field_delim_;
+  __m128i xmm_collection_item_delim_;
+  __m128i xmm_escape_char_;
 
-  // SSE(xmm) register containing the escape search character.
-  __m128i xmm_escape_search_;
+  // False if neither a field delimiter nor a collection item delimiter is set, in which
+  // case FindDelimiters() does not look for them.
+  bool search_field_delims_;
 
   // Character delimiting fields (to become slots).
   char field_delim_;
@@ -193,10 +210,6 @@ class DelimitedTextParser {
   // starts with \n it is processed as \r\n.
   int32_t last_row_delim_offset_;
 
-  // Precomputed masks to process escape characters
-  uint16_t low_mask_[16];
-  uint16_t high_mask_[16];
-
   // Number of columns in the table (including partition columns)
   int num_cols_;
 
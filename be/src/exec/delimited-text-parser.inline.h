@@ -16,37 +16,56 @@
 #ifndef IMPALA_EXEC_DELIMITED_TEXT_PARSER_INLINE_H
 #define IMPALA_EXEC_DELIMITED_TEXT_PARSER_INLINE_H
 
+#include <string.h>
+#include <algorithm>
+
 #include "delimited-text-parser.h"
 #include "util/cpu-info.h"
 #include "util/sse-util.h"
 
 namespace impala {
 
-// Updates the values in the field and tuple masks, escaping them if necessary.
-// If the character at n is an escape character, then delimiters(tuple/field/escape
-// characters) at n+1 don't count.
-inline void ProcessEscapeMask(uint16_t escape_mask, bool* last_char_is_escape,
-                              uint16_t* delim_mask) {
-  // Escape characters can escape escape characters.
-  bool first_char_is_escape = *last_char_is_escape;
-  bool escape_next = first_char_is_escape;
-  for (int i = 0; i < SSEUtil::CHARS_PER_128_BIT_REGISTER; ++i) {
-    if (escape_next) {
-      escape_mask &= ~SSEUtil::SSE_BITMASK[i];
-    }
-    escape_next = escape_mask & SSEUtil::SSE_BITMASK[i];
-  }
-
-  // Remember last character for the next iteration
-  *last_char_is_escape = escape_mask &
-    SSEUtil::SSE_BITMASK[SSEUtil::CHARS_PER_128_BIT_REGISTER - 1];
-
-  // Shift escape mask up one so they match at the same bit index as the tuple and
-  // field mask (instead of being the character before) and set the correct first bit
-  escape_mask = escape_mask << 1 | (first_char_is_escape ? 1 : 0);
+// Returns the bitmask of the bytes of 'block', four SSE registers of 16 bytes each, that
+// are equal to the byte in all 16 bytes of 'c'. Bit i is for byte i of the block.
+inline uint64_t CompareBlock(const __m128i* block, __m128i c) {
+  uint64_t mask0 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block[0], c)));
+  uint64_t mask1 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block[1], c)));
+  uint64_t mask2 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block[2], c)));
+  uint64_t mask3 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block[3], c)));
+  return mask0 | (mask1 << 16) | (mask2 << 32) | (mask3 << 48);
+}
 
-  // If escape_mask[n] is true, then tuple/field_mask[n] is escaped
-  *delim_mask &= ~escape_mask;
+// Returns the bitmask of the characters of a block of 'len' bytes that are escaped, given
+// the bitmask of its escape characters. A character is escaped if it follows a run of an
+// odd number of escape characters (escape characters can escape escape characters). The
+// bits of escaped escape characters are not meaningful, the caller only uses the result
+// to mask out delimiters. 'last_char_is_escape' is true on input if the first character
+// of the block is escaped by the previous block, and is set to whether the character
+// after the block is escaped.
+// Instead of walking the runs bit by bit, this adds the start of each run to the mask:
+// the carry ripples through the run and sets the bit of the character after it. Whether
+// the run has an odd length then follows from whether it starts and ends at an even or
+// odd bit.
+inline uint64_t FindEscapedChars(uint64_t escape_mask, int len,
+    bool* last_char_is_escape) {
+  const uint64_t EVEN_BITS = 0x5555555555555555ULL;
+  const uint64_t carry_in = *last_char_is_escape ? 1 : 0;
+  uint64_t run_starts = escape_mask & ~(escape_mask << 1);
+  // A run that continues an escaped run of the previous block starts one character
+  // "later", so flip the parity of the first bit.
+  uint64_t even_start_mask = EVEN_BITS ^ carry_in;
+  uint64_t even_starts = run_starts & even_start_mask;
+  uint64_t odd_starts = run_starts & ~even_start_mask;
+  uint64_t even_carries = escape_mask + even_starts;
+  uint64_t odd_carries = escape_mask + odd_starts;
+  // Only a run starting at an odd bit can end at bit 64 after an odd number of bits.
+  bool carry_out = odd_carries < escape_mask;
+  odd_carries |= carry_in;
+  uint64_t even_ends = even_carries & ~escape_mask;
+  uint64_t odd_ends = odd_carries & ~escape_mask;
+  uint64_t escaped = (even_ends & ~EVEN_BITS) | (odd_ends & EVEN_BITS);
+  *last_char_is_escape = len == 64 ? carry_out : (escaped >> len) & 1;
+  return escaped;
 }
 
 template <bool process_escapes>
@@ -81,219 +100,182 @@ void inline DelimitedTextParser:: FillColumns(int len, char** last_column,
   }
 }
 
-// SSE optimized raw text file parsing.  SSE4_2 added an instruction (with 3 modes) for
-// text processing.  The modes mimic strchr, strstr and strcmp.  For text parsing, we can
-// leverage the strchr functionality.
-//
-// The instruction operates on two sse registers:
-//  - the needle (what you are searching for)
-//  - the haystack (where you are searching in)
-// Both registers can contain up to 16 characters.  The result is a 16-bit mask with a bit
-// set for each character in the haystack that matched any character in the needle.
-// For example:
-//  Needle   = 'abcd000000000000' (we're searching for any a's, b's, c's or d's)
-//  Haystack = 'asdfghjklhjbdwwc' (the raw string)
-//  Result   = '1010000000011001'
 template <bool process_escapes>
-inline void DelimitedTextParser::ParseSse(int max_tuples,
+inline void DelimitedTextParser::FindDelimiters(const char* buffer, int len,
+    uint64_t* tuple_mask, uint64_t* field_mask, uint64_t* escape_mask) {
+  DCHECK_GT(len, 0);
+  DCHECK_LE(len, BLOCK_SIZE);
+  // The last block of a buffer is copied, so that we never read past the end of the
+  // buffer. The bits of the padding are cleared below.
+  char padded_block[BLOCK_SIZE];
+  if (UNLIKELY(len < BLOCK_SIZE)) {
+    memcpy(padded_block, buffer, len);
+    memset(padded_block + len, 0, BLOCK_SIZE - len);
+    buffer = padded_block;
+  }
+  __m128i block[4];
+  for (int i = 0; i < 4; ++i) {
+    block[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        buffer + i * SSEUtil::CHARS_PER_128_BIT_REGISTER));
+  }
+
+  *tuple_mask = 0;
+  if (tuple_delim_ != '\0') {
+    *tuple_mask = CompareBlock(block, xmm_tuple_delim_);
+    // Hive treats \r (^M) as an alternate tuple delimiter.
+    if (tuple_delim_ == '\n') *tuple_mask |= CompareBlock(block, xmm_cr_);
+  }
+  *field_mask = 0;
+  if (search_field_delims_) {
+    *field_mask = CompareBlock(block, xmm_field_delim_) |
+        CompareBlock(block, xmm_collection_item_delim_);
+  }
+  *escape_mask = 0;
+  if (process_escapes) *escape_mask = CompareBlock(block, xmm_escape_char_);
+
+  if (UNLIKELY(len < BLOCK_SIZE)) {
+    uint64_t valid_mask = (1ULL << len) - 1;
+    *tuple_mask &= valid_mask;
+    *field_mask &= valid_mask;
+    *escape_mask &= valid_mask;
+  }
+}
+
+// Raw text file parsing with a structural index of each block of 64 bytes. Instead of
+// looking at the buffer character by character, we:
+//  1. Load 64 bytes into four SSE registers.
+//  2. Compare them with registers holding 16 copies of each character we search for
+//        (tuple delimiter, \r, field delimiter, collection item delimiter and escape
+//        character) and turn the results into one 64 bit mask per kind of character.
+//  3. If there are escape characters, compute the characters they escape with a few
+//        64 bit integer operations (see FindEscapedChars()) and clear those from the
+//        delimiter masks.
+//  4. Go through the set bits of the delimiter masks and write the parsed data.
+// SSE2 is part of x86-64, so unlike the SSE4.2 string instructions this needs no runtime
+// check. It would be faster still with AVX2 (32 bytes per compare), but native code
+// cannot be compiled with -mavx2 (see sse-util.h).
+template <bool process_escapes>
+inline void DelimitedTextParser::ParseBlocks(int max_tuples,
     int64_t* remaining_len, char** byte_buffer_ptr,
     char** row_end_locations,
     FieldLocation* field_locations,
     int* num_tuples, int* num_fields, char** next_column_start) {
-  DCHECK(CpuInfo::IsSupported(CpuInfo::SSE4_2));
-
-  // To parse using SSE, we:
-  //  1. Load into different sse registers the different characters we need to search for
-  //        tuple breaks, field breaks, escape characters
-  //  2. Load 16 characters at a time into the sse register
-  //  3. Use the SSE instruction to do strchr on those 16 chars, the result is a bitmask
-  //  4. Compute the bitmask for tuple breaks, field breaks and escape characters.
-  //  5. If there are escape characters, fix up the matching masked bits in the
-  //        field/tuple mask
-  //  6. Go through the mask bit by bit and write the parsed data.
-
-  // xmm registers:
-  //  - xmm_buffer: the register holding the current (16 chars) we're working on from the
-  //        file
-  //  - xmm_delim_search_: the delim search register.  Contains field delimiter,
-  //        collection_item delim_char and tuple delimiter
-  //  - xmm_escape_search_: the escape search register. Only contains escape char
-  //  - xmm_delim_mask: the result of doing strchr for the delimiters
-  //  - xmm_escape_mask: the result of doing strchr for the escape char
-  __m128i xmm_buffer, xmm_delim_mask, xmm_escape_mask;
-
-  while (LIKELY(*remaining_len >= SSEUtil::CHARS_PER_128_BIT_REGISTER)) {
-    // Load the next 16 bytes into the xmm register
-    xmm_buffer = _mm_loadu_si128(reinterpret_cast<__m128i*>(*byte_buffer_ptr));
-
-    // Do the strchr for tuple and field breaks
-    // The strchr sse instruction returns the result in the lower bits of the sse
-    // register.  Since we only process 16 characters at a time, only the lower 16 bits
-    // can contain non-zero values.
-    // _mm_extract_epi16 will extract 16 bits out of the xmm register.  The second
-    // parameter specifies which 16 bits to extract (0 for the lowest 16 bits).
-    xmm_delim_mask = SSE4_cmpestrm(xmm_delim_search_, num_delims_, xmm_buffer,
-        SSEUtil::CHARS_PER_128_BIT_REGISTER, SSEUtil::STRCHR_MODE);
-    uint16_t delim_mask = _mm_extract_epi16(xmm_delim_mask, 0);
-
-    uint16_t escape_mask = 0;
-    // If the table does not use escape characters, skip processing for it.
+  while (LIKELY(*remaining_len > 0)) {
+    int block_len = std::min<int64_t>(*remaining_len, BLOCK_SIZE);
+    uint64_t tuple_mask, field_mask, escape_mask;
+    FindDelimiters<process_escapes>(*byte_buffer_ptr, block_len, &tuple_mask,
+        &field_mask, &escape_mask);
     if (process_escapes) {
       DCHECK(escape_char_ != '\0');
-      xmm_escape_mask = SSE4_cmpestrm(xmm_escape_search_, 1,
-          xmm_buffer, SSEUtil::CHARS_PER_128_BIT_REGISTER, SSEUtil::STRCHR_MODE);
-      escape_mask = _mm_extract_epi16(xmm_escape_mask, 0);
-      ProcessEscapeMask(escape_mask, &last_char_is_escape_, &delim_mask);
+      uint64_t escaped = FindEscapedChars(escape_mask, block_len, &last_char_is_escape_);
+      tuple_mask &= ~escaped;
+      field_mask &= ~escaped;
     }
-
-    char* last_char = *byte_buffer_ptr + 15;
-    bool last_char_is_unescaped_delim = delim_mask >> 15;
-    unfinished_tuple_ = !(last_char_is_unescaped_delim &&
-        (*last_char == tuple_delim_ || (tuple_delim_ == '\n' && *last_char == '\r')));
-
-    int last_col_idx = 0;
-    // Process all non-zero bits in the delim_mask from lsb->msb.  If a bit
-    // is set, the character in that spot is either a field or tuple delimiter.
+    uint64_t delim_mask = tuple_mask | field_mask;
+    unfinished_tuple_ = (tuple_mask & (1ULL << (block_len - 1))) == 0;
+
+    // The escape characters of the block that are not yet accounted for in
+    // current_column_has_escape_.
+    uint64_t pending_escapes = escape_mask;
+    // Process all set bits in the delim_mask from lsb->msb.  If a bit is set, the
+    // character in that spot is either a field or tuple delimiter.
     while (delim_mask != 0) {
-      // ffs is a libc function that returns the index of the first set bit (1-indexed)
-      int n = ffs(delim_mask) - 1;
-      DCHECK_GE(n, 0);
-      DCHECK_LT(n, 16);
+      int n = __builtin_ctzll(delim_mask);
+      uint64_t delim_bit = 1ULL << n;
       // clear current bit
-      delim_mask &= ~(SSEUtil::SSE_BITMASK[n]);
+      delim_mask &= delim_mask - 1;
 
       if (process_escapes) {
-        // Determine if there was an escape character between [last_col_idx, n]
-        bool escaped = (escape_mask & low_mask_[last_col_idx] & high_mask_[n]) != 0;
-        current_column_has_escape_ |= escaped;
-        last_col_idx = n;
+        // Determine if there was an escape character in the column ending at n.
+        uint64_t column_bits = delim_bit - 1;
+        current_column_has_escape_ |= (pending_escapes & column_bits) != 0;
+        pending_escapes &= ~column_bits;
       }
 
       char* delim_ptr = *byte_buffer_ptr + n;
 
-      if (*delim_ptr == field_delim_ || *delim_ptr == collection_item_delim_) {
+      if (field_mask & delim_bit) {
         AddColumn<process_escapes>(delim_ptr - *next_column_start,
             next_column_start, num_fields, field_locations);
         continue;
       }
 
-      if (*delim_ptr == tuple_delim_ || (tuple_delim_ == '\n' && *delim_ptr == '\r')) {
-        if (UNLIKELY(
-                last_row_delim_offset_ == *remaining_len - n && *delim_ptr == '\n')) {
-          // If the row ended in \r\n then move the next start past the \n
-          ++*next_column_start;
-          last_row_delim_offset_ = -1;
-          continue;
-        }
-        AddColumn<process_escapes>(delim_ptr - *next_column_start,
-            next_column_start, num_fields, field_locations);
-        FillColumns<false>(0, NULL, num_fields, field_locations);
-        column_idx_ = num_partition_keys_;
-        row_end_locations[*num_tuples] = delim_ptr;
-        ++(*num_tuples);
-        // Remember where we saw the last \r.
-        last_row_delim_offset_ = *delim_ptr == '\r' ? *remaining_len - n - 1 : -1;
-        if (UNLIKELY(*num_tuples == max_tuples)) {
-          (*byte_buffer_ptr) += (n + 1);
-          if (process_escapes) last_char_is_escape_ = false;
-          *remaining_len -= (n + 1);
-          // If the last character we processed was \r then set the offset to 0
-          // so that we will use it at the beginning of the next batch.
-          if (last_row_delim_offset_ == *remaining_len) last_row_delim_offset_ = 0;
-          return;
-        }
+      if (UNLIKELY(last_row_delim_offset_ == *remaining_len - n && *delim_ptr == '\n')) {
+        // If the row ended in \r\n then move the next start past the \n
+        ++*next_column_start;
+        last_row_delim_offset_ = -1;
+        continue;
+      }
+      AddColumn<process_escapes>(delim_ptr - *next_column_start,
+          next_column_start, num_fields, field_locations);
+      FillColumns<false>(0, NULL, num_fields, field_locations);
+      column_idx_ = num_partition_keys_;
+      row_end_locations[*num_tuples] = delim_ptr;
+      ++(*num_tuples);
+      // Remember where we saw the last \r.
+      last_row_delim_offset_ = *delim_ptr == '\r' ? *remaining_len - n - 1 : -1;
+      if (UNLIKELY(*num_tuples == max_tuples)) {
+        (*byte_buffer_ptr) += (n + 1);
+        if (process_escapes) last_char_is_escape_ = false;
+        unfinished_tuple_ = false;
+        *remaining_len -= (n + 1);
+        // If the last character we processed was \r then set the offset to 0
+        // so that we will use it at the beginning of the next batch.
+        if (last_row_delim_offset_ == *remaining_len) last_row_delim_offset_ = 0;
+        return;
       }
     }
 
-    if (process_escapes) {
-      // Determine if there was an escape character between (last_col_idx, 15)
-      bool unprocessed_escape = escape_mask & low_mask_[last_col_idx] & high_mask_[15];
-      current_column_has_escape_ |= unprocessed_escape;
-    }
+    // Determine if there was an escape character after the last delimiter.
+    if (process_escapes) current_column_has_escape_ |= pending_escapes != 0;
 
-    *remaining_len -= SSEUtil::CHARS_PER_128_BIT_REGISTER;
-    *byte_buffer_ptr += SSEUtil::CHARS_PER_128_BIT_REGISTER;
+    *remaining_len -= block_len;
+    *byte_buffer_ptr += block_len;
   }
 }
 
-// Simplified version of ParseSSE which does not handle tuple delimiters.
+// Simplified version of ParseBlocks which does not handle tuple delimiters.
 template <bool process_escapes>
 inline void DelimitedTextParser::ParseSingleTuple(int64_t remaining_len, char* buffer,
     FieldLocation* field_locations, int* num_fields) {
   char* next_column_start = buffer;
-  __m128i xmm_buffer, xmm_delim_mask, xmm_escape_mask;
 
   column_idx_ = num_partition_keys_;
   current_column_has_escape_ = false;
-  if (LIKELY(CpuInfo::IsSupported(CpuInfo::SSE4_2))) {
-    while (LIKELY(remaining_len >= SSEUtil::CHARS_PER_128_BIT_REGISTER)) {
-      // Load the next 16 bytes into the xmm register
-      xmm_buffer = _mm_loadu_si128(reinterpret_cast<__m128i*>(buffer));
-
-      xmm_delim_mask = SSE4_cmpestrm(xmm_delim_search_, num_delims_, xmm_buffer,
-          SSEUtil::CHARS_PER_128_BIT_REGISTER, SSEUtil::STRCHR_MODE);
-      uint16_t delim_mask = _mm_extract_epi16(xmm_delim_mask, 0);
-
-      uint16_t escape_mask = 0;
-      // If the table does not use escape characters, skip processing for it.
-      if (process_escapes) {
-        DCHECK(escape_char_ != '\0');
-        xmm_escape_mask = SSE4_cmpestrm(xmm_escape_search_, 1, xmm_buffer,
-            SSEUtil::CHARS_PER_128_BIT_REGISTER, SSEUtil::STRCHR_MODE);
-        escape_mask = _mm_extract_epi16(xmm_escape_mask, 0);
-        ProcessEscapeMask(escape_mask, &last_char_is_escape_, &delim_mask);
-      }
-
-      int last_col_idx = 0;
-      // Process all non-zero bits in the delim_mask from lsb->msb.  If a bit
-      // is set, the character in that spot is a field.
-      while (delim_mask != 0) {
-        // ffs is a libc function that returns the index of the first set bit (1-indexed)
-        int n = ffs(delim_mask) - 1;
-        DCHECK_GE(n, 0);
-        DCHECK_LT(n, 16);
-
-        if (process_escapes) {
-          // Determine if there was an escape character between [last_col_idx, n]
-          bool escaped = (escape_mask & low_mask_[last_col_idx] & high_mask_[n]) != 0;
-          current_column_has_escape_ |= escaped;
-          last_col_idx = n;
-        }
-
-        // clear current bit
-        delim_mask &= ~(SSEUtil::SSE_BITMASK[n]);
+  while (remaining_len > 0) {
+    int block_len = std::min<int64_t>(remaining_len, BLOCK_SIZE);
+    uint64_t tuple_mask, field_mask, escape_mask;
+    FindDelimiters<process_escapes>(buffer, block_len, &tuple_mask, &field_mask,
+        &escape_mask);
+    if (process_escapes) {
+      DCHECK(escape_char_ != '\0');
+      field_mask &= ~FindEscapedChars(escape_mask, block_len, &last_char_is_escape_);
+    }
 
-        AddColumn<process_escapes>(buffer + n - next_column_start,
-            &next_column_start, num_fields, field_locations);
-      }
+    uint64_t pending_escapes = escape_mask;
+    // Process all set bits in the field_mask from lsb->msb.  If a bit is set, the
+    // character in that spot is a field delimiter.
+    while (field_mask != 0) {
+      int n = __builtin_ctzll(field_mask);
+      // clear current bit
+      field_mask &= field_mask - 1;
 
       if (process_escapes) {
-        // Determine if there was an escape character between (last_col_idx, 15)
-        bool unprocessed_escape = escape_mask & low_mask_[last_col_idx] & high_mask_[15];
-        current_column_has_escape_ |= unprocessed_escape;
+        // Determine if there was an escape character in the column ending at n.
+        uint64_t column_bits = (1ULL << n) - 1;
+        current_column_has_escape_ |= (pending_escapes & column_bits) != 0;
+        pending_escapes &= ~column_bits;
       }
 
-      remaining_len -= SSEUtil::CHARS_PER_128_BIT_REGISTER;
-      buffer += SSEUtil::CHARS_PER_128_BIT_REGISTER;
-    }
-  }
-
-  while (remaining_len > 0) {
-    if (*buffer == escape_char_) {
-      current_column_has_escape_ = true;
-      last_char_is_escape_ = !last_char_is_escape_;
-    } else {
-      last_char_is_escape_ = false;
-    }
-
-    if (!last_char_is_escape_ &&
-          (*buffer == field_delim_ || *buffer == collection_item_delim_)) {
-      AddColumn<process_escapes>(buffer - next_column_start,
+      AddColumn<process_escapes>(buffer + n - next_column_start,
           &next_column_start, num_fields, field_locations);
     }
 
-    --remaining_len;
-    ++buffer;
+    // Determine if there was an escape character after the last delimiter.
+    if (process_escapes) current_column_has_escape_ |= pending_escapes != 0;
+
+    remaining_len -= block_len;
+    buffer += block_len;
   }
 
   // Last column does not have a delimiter after it.  Add that column and also
@@ -394,6 +394,14 @@ bool ExecNode::EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* r
   return true;
 }
 
+int ExecNode::EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow** rows,
+    int num_rows) {
+  for (int i = 0; i < num_ctxs && num_rows > 0; ++i) {
+    num_rows = ctxs[i]->EvalPredicate(rows, num_rows);
+  }
+  return num_rows;
+}
+
 Status ExecNode::QueryMaintenance(RuntimeState* state) {
   ExprContext::FreeLocalAllocations(expr_ctxs_to_free_);
   return state->CheckQueryState();
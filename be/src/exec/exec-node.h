@@ -123,6 +123,13 @@ class ExecNode {
   // out how to deal with declaring a templated std:vector type in IR
   static bool EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* row);
 
+  // Evaluates ExprContexts over rows[0, num_rows) and moves the rows for which all exprs
+  // return true to the front of 'rows', in order. Returns the number of those rows.
+  // Each conjunct is evaluated over a batch of rows at a time, and only over the rows
+  // that passed the previous ones (see ExprContext::EvalPredicate()).
+  static int EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow** rows,
+      int num_rows);
+
   // Returns a codegen'd version of EvalConjuncts(), or NULL if the function couldn't be
   // codegen'd. The codegen'd version uses inlined, codegen'd GetBooleanVal() functions.
   static llvm::Function* CodegenEvalConjuncts(
@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "exec/old-hash-table.inline.h"
 #include "exprs/expr.h"
 #include "runtime/row-batch.h"
@@ -167,11 +168,14 @@ Status HashJoinNode::ConstructBuildSide(RuntimeState* state) {
     build_pool_->AcquireData(build_batch.tuple_data_pool(), false);
     RETURN_IF_ERROR(QueryMaintenance(state));
 
-    // Call codegen version if possible
-    if (process_build_batch_fn_ == NULL) {
+    // Call codegen version if possible. It may be published concurrently (see
+    // --async_codegen).
+    ProcessBuildBatchFn process_build_batch_fn =
+        AtomicUtil::LoadAcquire(&process_build_batch_fn_);
+    if (process_build_batch_fn == NULL) {
       ProcessBuildBatch(&build_batch);
     } else {
-      process_build_batch_fn_(this, &build_batch);
+      process_build_batch_fn(this, &build_batch);
     }
     VLOG_ROW << hash_tbl_->DebugString(true, false, &child(1)->row_desc());
 
@@ -381,13 +385,15 @@ Status HashJoinNode::LeftJoinGetNext(RuntimeState* state,
     if (limit() != -1) max_added_rows = min(max_added_rows, limit() - rows_returned());
 
     // Continue processing this row batch
-    if (process_probe_batch_fn_ == NULL) {
+    ProcessProbeBatchFn process_probe_batch_fn =
+        AtomicUtil::LoadAcquire(&process_probe_batch_fn_);
+    if (process_probe_batch_fn == NULL) {
       num_rows_returned_ +=
           ProcessProbeBatch(out_batch, probe_batch_.get(), max_added_rows);
     } else {
       // Use codegen'd function
       num_rows_returned_ +=
-          process_probe_batch_fn_(this, out_batch, probe_batch_.get(), max_added_rows);
+          process_probe_batch_fn(this, out_batch, probe_batch_.get(), max_added_rows);
     }
     COUNTER_SET(rows_returned_counter_, num_rows_returned_);
 
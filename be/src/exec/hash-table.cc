@@ -23,6 +23,7 @@
 #include "runtime/mem-tracker.h"
 #include "runtime/raw-value.h"
 #include "runtime/runtime-state.h"
+#include "runtime/slab-allocator.h"
 #include "runtime/string-value.inline.h"
 #include "util/debug-util.h"
 #include "util/impalad-metrics.h"
@@ -248,7 +249,8 @@ bool HashTable::Init() {
     num_buckets_ = 0;
     return false;
   }
-  buckets_ = reinterpret_cast<Bucket*>(malloc(buckets_byte_size));
+  buckets_ = reinterpret_cast<Bucket*>(
+      SlabAllocator::instance()->Allocate(buckets_byte_size));
   memset(buckets_, 0, buckets_byte_size);
   return GrowNodeArray();
 }
@@ -267,7 +269,8 @@ void HashTable::Close() {
     ImpaladMetrics::HASH_TABLE_TOTAL_BYTES->Increment(-total_data_page_size_);
   }
   data_pages_.clear();
-  if (buckets_ != NULL) free(buckets_);
+  SlabAllocator::instance()->Free(reinterpret_cast<uint8_t*>(buckets_),
+      num_buckets_ * sizeof(Bucket));
   if (block_mgr_client_ != NULL) {
     state_->block_mgr()->ReleaseMemory(block_mgr_client_,
         num_buckets_ * sizeof(Bucket));
@@ -310,7 +313,8 @@ bool HashTable::ResizeBuckets(int64_t num_buckets, HashTableCtx* ht_ctx) {
       !state_->block_mgr()->ConsumeMemory(block_mgr_client_, new_size)) {
     return false;
   }
-  Bucket* new_buckets = reinterpret_cast<Bucket*>(malloc(new_size));
+  Bucket* new_buckets =
+      reinterpret_cast<Bucket*>(SlabAllocator::instance()->Allocate(new_size));
   DCHECK_NOTNULL(new_buckets);
   memset(new_buckets, 0, new_size);
 
@@ -331,7 +335,7 @@ bool HashTable::ResizeBuckets(int64_t num_buckets, HashTableCtx* ht_ctx) {
   }
 
   num_buckets_ = num_buckets;
-  free(buckets_);
+  SlabAllocator::instance()->Free(reinterpret_cast<uint8_t*>(buckets_), old_size);
   buckets_ = new_buckets;
   // TODO: Remove this check, i.e. block_mgr_client_ should always be != NULL,
   // see IMPALA-1656.
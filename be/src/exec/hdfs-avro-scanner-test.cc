@@ -0,0 +1,242 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <avro/schema.h>
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "codegen/llvm-codegen.h"
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "exec/hdfs-avro-scanner.h"
+#include "exec/read-write-util.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple.h"
+#include "testutil/desc-tbl-builder.h"
+
+using namespace boost;
+using namespace llvm;
+using namespace std;
+
+namespace impala {
+
+// Tests the versions of MaterializeTuple() that are codegen'd for the resolved schemas of
+// the files of a scan, see HdfsAvroScanner::GetSchemaCodegenFn(). The table has the
+// columns a INT, b BIGINT and c STRING.
+class HdfsAvroScannerTest : public testing::Test {
+ protected:
+  typedef HdfsAvroScanner::SchemaElement SchemaElement;
+  typedef void (*MaterializeTupleFn)(HdfsAvroScanner*, MemPool*, uint8_t**, Tuple*);
+
+  HdfsAvroScannerTest() : mem_pool_(&tracker_) { }
+
+  virtual void SetUp() {
+    DescriptorTblBuilder builder(&pool_);
+    builder.DeclareTuple() << TYPE_INT << TYPE_BIGINT << TYPE_STRING;
+    tuple_desc_ = builder.Build()->GetTupleDescriptor(0);
+    ASSERT_EQ(tuple_desc_->slots().size(), 3);
+    slot_a_ = tuple_desc_->slots()[0];
+    slot_b_ = tuple_desc_->slots()[1];
+    slot_c_ = tuple_desc_->slots()[2];
+  }
+
+  virtual void TearDown() {
+    mem_pool_.FreeAll();
+  }
+
+  // Returns an element of a resolved schema. 'schema' is a new reference, which the
+  // element takes over.
+  static SchemaElement Element(avro_schema_t schema, int null_union_position,
+      const SlotDescriptor* slot_desc) {
+    SchemaElement element;
+    element.schema = schema;
+    element.null_union_position = null_union_position;
+    element.slot_desc = slot_desc;
+    return element;
+  }
+
+  static string SchemaCodegenKey(const vector<SchemaElement>& schema) {
+    return HdfsAvroScanner::SchemaCodegenKey(schema);
+  }
+
+  // Codegens MaterializeTuple() for 'schema' in a new module, like
+  // HdfsAvroScanner::CodegenSchema() does, and returns the JIT'd function.
+  MaterializeTupleFn CodegenMaterializeTuple(const vector<SchemaElement>& schema) {
+    scoped_ptr<LlvmCodeGen> codegen;
+    EXPECT_TRUE(LlvmCodeGen::LoadImpalaIR(&pool_, "test", &codegen).ok());
+    if (codegen.get() == NULL) return NULL;
+    Function* fn = HdfsAvroScanner::CodegenMaterializeTuple(codegen.get(), schema);
+    EXPECT_TRUE(fn != NULL);
+    if (fn == NULL) return NULL;
+    void* jitted_fn = NULL;
+    codegen->AddFunctionToJit(fn, &jitted_fn);
+    EXPECT_TRUE(codegen->FinalizeModule().ok());
+    pool_.Add(codegen.release());
+    return reinterpret_cast<MaterializeTupleFn>(jitted_fn);
+  }
+
+  // Decodes the record at 'data' with 'fn' into a new tuple and advances 'data' past the
+  // record.
+  Tuple* Decode(MaterializeTupleFn fn, uint8_t** data) {
+    Tuple* tuple = Tuple::Create(tuple_desc_->byte_size(), &mem_pool_);
+    // The Read*() functions called by 'fn' do not use the members of the scanner.
+    fn(reinterpret_cast<HdfsAvroScanner*>(scanner_buffer_), &mem_pool_, data, tuple);
+    return tuple;
+  }
+
+  // Appends the Avro binary encoding of the given values to 'buffer'.
+  static void PutUnionBranch(int branch, vector<uint8_t>* buffer) {
+    PutLong(branch, buffer);
+  }
+
+  static void PutInt(int32_t val, vector<uint8_t>* buffer) {
+    uint8_t bytes[ReadWriteUtil::MAX_ZINT_LEN];
+    int len = ReadWriteUtil::PutZInt(val, bytes);
+    buffer->insert(buffer->end(), bytes, bytes + len);
+  }
+
+  static void PutLong(int64_t val, vector<uint8_t>* buffer) {
+    uint8_t bytes[ReadWriteUtil::MAX_ZLONG_LEN];
+    int len = ReadWriteUtil::PutZLong(val, bytes);
+    buffer->insert(buffer->end(), bytes, bytes + len);
+  }
+
+  static void PutDouble(double val, vector<uint8_t>* buffer) {
+    uint8_t bytes[sizeof(double)];
+    memcpy(bytes, &val, sizeof(double));
+    buffer->insert(buffer->end(), bytes, bytes + sizeof(double));
+  }
+
+  static void PutString(const string& val, vector<uint8_t>* buffer) {
+    PutLong(val.size(), buffer);
+    buffer->insert(buffer->end(), val.begin(), val.end());
+  }
+
+  int32_t GetA(Tuple* tuple) {
+    return *reinterpret_cast<int32_t*>(tuple->GetSlot(slot_a_->tuple_offset()));
+  }
+
+  int64_t GetB(Tuple* tuple) {
+    return *reinterpret_cast<int64_t*>(tuple->GetSlot(slot_b_->tuple_offset()));
+  }
+
+  string GetC(Tuple* tuple) {
+    StringValue* sv = reinterpret_cast<StringValue*>(
+        tuple->GetSlot(slot_c_->tuple_offset()));
+    return string(sv->ptr, sv->len);
+  }
+
+  MemTracker tracker_;
+  ObjectPool pool_;
+  MemPool mem_pool_;
+  TupleDescriptor* tuple_desc_;
+  const SlotDescriptor* slot_a_;
+  const SlotDescriptor* slot_b_;
+  const SlotDescriptor* slot_c_;
+  // Stands in for the scanner passed to the codegen'd functions.
+  uint8_t scanner_buffer_[sizeof(HdfsAvroScanner)];
+};
+
+// Two files of one scan with different schemas get separate functions, each of which
+// decodes the records of its files.
+TEST_F(HdfsAvroScannerTest, ResolvedSchemas) {
+  // Files written with the table schema:
+  // {a: ["int", "null"], b: "long", c: "string"}
+  vector<SchemaElement> table_schema;
+  table_schema.push_back(Element(avro_schema_int(), 1, slot_a_));
+  table_schema.push_back(Element(avro_schema_long(), -1, slot_b_));
+  table_schema.push_back(Element(avro_schema_string(), -1, slot_c_));
+
+  // Files written with an older schema, with the fields in another order, a dropped
+  // column d and b as an int, which is promoted to BIGINT:
+  // {c: "string", d: "double", b: "int", a: ["null", "int"]}
+  vector<SchemaElement> old_schema;
+  old_schema.push_back(Element(avro_schema_string(), -1, slot_c_));
+  old_schema.push_back(Element(avro_schema_double(), -1, NULL));
+  old_schema.push_back(Element(avro_schema_int(), -1, slot_b_));
+  old_schema.push_back(Element(avro_schema_int(), 0, slot_a_));
+
+  // The scanners of the two files claim different functions, and the scanners of files
+  // with the same schema share one.
+  EXPECT_NE(SchemaCodegenKey(table_schema), SchemaCodegenKey(old_schema));
+  vector<SchemaElement> table_schema_copy = table_schema;
+  EXPECT_EQ(SchemaCodegenKey(table_schema), SchemaCodegenKey(table_schema_copy));
+
+  MaterializeTupleFn table_fn = CodegenMaterializeTuple(table_schema);
+  MaterializeTupleFn old_fn = CodegenMaterializeTuple(old_schema);
+  ASSERT_TRUE(table_fn != NULL);
+  ASSERT_TRUE(old_fn != NULL);
+  EXPECT_NE(table_fn, old_fn);
+
+  // Two records of a file with the table schema, the second one with a NULL a.
+  vector<uint8_t> table_data;
+  PutUnionBranch(0, &table_data);
+  PutInt(7, &table_data);
+  PutLong(1LL << 40, &table_data);
+  PutString("abc", &table_data);
+  PutUnionBranch(1, &table_data);
+  PutLong(-5, &table_data);
+  PutString("", &table_data);
+
+  uint8_t* data = &table_data[0];
+  Tuple* tuple = Decode(table_fn, &data);
+  EXPECT_FALSE(tuple->IsNull(slot_a_->null_indicator_offset()));
+  EXPECT_EQ(GetA(tuple), 7);
+  EXPECT_EQ(GetB(tuple), 1LL << 40);
+  EXPECT_EQ(GetC(tuple), "abc");
+  tuple = Decode(table_fn, &data);
+  EXPECT_TRUE(tuple->IsNull(slot_a_->null_indicator_offset()));
+  EXPECT_EQ(GetB(tuple), -5);
+  EXPECT_EQ(GetC(tuple), "");
+  EXPECT_EQ(data, &table_data[0] + table_data.size());
+
+  // Two records of a file with the old schema, the second one with a NULL a.
+  vector<uint8_t> old_data;
+  PutString("xy", &old_data);
+  PutDouble(2.5, &old_data);
+  PutInt(-3, &old_data);
+  PutUnionBranch(1, &old_data);
+  PutInt(42, &old_data);
+  PutString("z", &old_data);
+  PutDouble(-1.0, &old_data);
+  PutInt(1 << 30, &old_data);
+  PutUnionBranch(0, &old_data);
+
+  data = &old_data[0];
+  tuple = Decode(old_fn, &data);
+  EXPECT_FALSE(tuple->IsNull(slot_a_->null_indicator_offset()));
+  EXPECT_EQ(GetA(tuple), 42);
+  EXPECT_EQ(GetB(tuple), -3);
+  EXPECT_EQ(GetC(tuple), "xy");
+  tuple = Decode(old_fn, &data);
+  EXPECT_TRUE(tuple->IsNull(slot_a_->null_indicator_offset()));
+  EXPECT_EQ(GetB(tuple), 1 << 30);
+  EXPECT_EQ(GetC(tuple), "z");
+  EXPECT_EQ(data, &old_data[0] + old_data.size());
+}
+
+}
+
+int main(int argc, char** argv) {
+  impala::InitCommonRuntime(argc, argv, false);
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::LlvmCodeGen::InitializeLlvm();
+  return RUN_ALL_TESTS();
+}
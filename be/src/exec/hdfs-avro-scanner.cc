@@ -26,6 +26,7 @@
 #include "runtime/raw-value.h"
 #include "runtime/runtime-state.h"
 #include "util/codec.h"
+#include "util/debug-util.h"
 #include "util/decompress.h"
 #include "util/runtime-profile.h"
 
@@ -87,7 +88,10 @@ Function* HdfsAvroScanner::Codegen(HdfsScanNode* node,
   if (!node->runtime_state()->GetCodegen(&codegen).ok()) return NULL;
   Function* materialize_tuple_fn = CodegenMaterializeTuple(node, codegen);
   if (materialize_tuple_fn == NULL) return NULL;
-  return CodegenDecodeAvroData(node->runtime_state(), materialize_tuple_fn, conjunct_ctxs);
+  Function* eval_conjuncts_fn =
+      ExecNode::CodegenEvalConjuncts(node->runtime_state(), conjunct_ctxs);
+  if (eval_conjuncts_fn == NULL) return NULL;
+  return CodegenDecodeAvroData(codegen, materialize_tuple_fn, eval_conjuncts_fn);
 }
 
 BaseSequenceScanner::FileHeader* HdfsAvroScanner::AllocateFileHeader() {
@@ -173,9 +177,9 @@ Status HdfsAvroScanner::ParseMetadata() {
         }
         RETURN_IF_ERROR(ResolveSchemas(table_schema.get(), file_schema.get()));
 
-        // We currently codegen a function only for the table schema. If this file's
-        // schema is different from the table schema, don't use the codegen'd function and
-        // use the interpreted path instead.
+        // The function codegen'd with the fragment is for the table schema. If this
+        // file's schema is different from the table schema, a function is codegen'd for
+        // its resolved schema instead.
         avro_header_->use_codegend_decode_avro_data =
             avro_schema_equal(table_schema.get(), file_schema.get());
 
@@ -499,9 +503,12 @@ Status HdfsAvroScanner::InitNewRange() {
     RETURN_IF_ERROR(UpdateDecompressor(header_->compression_type));
   }
 
+  codegend_decode_avro_data_ = NULL;
   if (avro_header_->use_codegend_decode_avro_data) {
     codegend_decode_avro_data_ = reinterpret_cast<DecodeAvroDataFn>(
         scan_node_->GetCodegenFn(THdfsFileFormat::AVRO));
+  } else if (state_->codegen_enabled() && !scan_node_->materialized_slots().empty()) {
+    codegend_decode_avro_data_ = GetSchemaCodegenFn();
   }
   if (codegend_decode_avro_data_ == NULL) {
     scan_node_->IncNumScannersCodegenDisabled();
@@ -644,30 +651,133 @@ void HdfsAvroScanner::MaterializeTuple(MemPool* pool, uint8_t** data, Tuple* tup
   }
 }
 
+HdfsAvroScanner::DecodeAvroDataFn HdfsAvroScanner::GetSchemaCodegenFn() {
+  string key = SchemaCodegenKey(avro_header_->schema);
+  bool claimed;
+  void* fn = scan_node_->GetCodegenFn(key, &claimed);
+  if (claimed) {
+    Status status = CodegenSchema(&fn);
+    if (!status.ok()) {
+      VLOG_QUERY << "Failed to codegen DecodeAvroData() for the schema of "
+                 << stream_->filename() << ": " << status.GetDetail();
+      fn = NULL;
+    }
+    scan_node_->SetCodegenFn(key, fn);
+  }
+  return reinterpret_cast<DecodeAvroDataFn>(fn);
+}
+
+Status HdfsAvroScanner::CodegenSchema(void** fn) {
+  *fn = NULL;
+  boost::scoped_ptr<LlvmCodeGen> codegen;
+  RETURN_IF_ERROR(LlvmCodeGen::LoadImpalaIR(
+      state_->obj_pool(), PrintId(state_->fragment_instance_id()), &codegen));
+  codegen->EnableOptimizations(true);
+  Function* materialize_tuple_fn =
+      CodegenMaterializeTuple(codegen.get(), avro_header_->schema);
+  if (materialize_tuple_fn == NULL) return Status::OK;
+  Function* decode_avro_data_fn =
+      CodegenDecodeAvroData(codegen.get(), materialize_tuple_fn, NULL);
+  if (decode_avro_data_fn == NULL) return Status::OK;
+  codegen->AddFunctionToJit(decode_avro_data_fn, fn);
+  RETURN_IF_ERROR(codegen->FinalizeModule());
+  VLOG_FILE << "Codegen'd DecodeAvroData() for the schema of " << stream_->filename();
+  // The module owns the JIT'd function, which the scan node's scanners use until the
+  // fragment is torn down.
+  state_->obj_pool()->Add(codegen.release());
+  return Status::OK;
+}
+
+string HdfsAvroScanner::SchemaCodegenKey(const vector<SchemaElement>& schema) {
+  stringstream ss;
+  ss << "avro";
+  BOOST_FOREACH(const SchemaElement& element, schema) {
+    ss << " " << element.schema->type << ":" << element.null_union_position << ":"
+       << (element.slot_desc == NULL ? -1 : element.slot_desc->id());
+  }
+  return ss.str();
+}
+
+// Sets the null indicator of 'slot_desc' in 'tuple', which is an i8*. The IR is the
+// same as the one generated by SlotDescriptor::CodegenUpdateNull(), which can't be used
+// here since it caches the function for the fragment's module.
+static void CodegenSetNull(LlvmCodeGen* codegen, LlvmCodeGen::LlvmBuilder* builder,
+    Value* tuple, const SlotDescriptor* slot_desc) {
+  const NullIndicatorOffset& null_indicator = slot_desc->null_indicator_offset();
+  Value* null_byte_ptr =
+      builder->CreateConstGEP1_32(tuple, null_indicator.byte_offset, "null_byte_ptr");
+  Value* null_byte = builder->CreateLoad(null_byte_ptr, "null_byte");
+  Value* mask = codegen->GetIntConstant(TYPE_TINYINT, null_indicator.bit_mask);
+  builder->CreateStore(builder->CreateOr(null_byte, mask, "null_set"), null_byte_ptr);
+}
+
+Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
+                                                   LlvmCodeGen* codegen) {
+  const string& table_schema_str = node->hdfs_table()->avro_schema();
+
+  // HdfsAvroScanner::Codegen() (which calls this function) gets called by HdfsScanNode
+  // regardless of whether the table we're scanning contains Avro files or not. If this
+  // isn't an Avro table, there is no table schema to codegen a function from (and there's
+  // no need to anyway).
+  // TODO: HdfsScanNode shouldn't codegen functions it doesn't need.
+  if (table_schema_str.empty()) return NULL;
+
+  avro_schema_t raw_table_schema;
+  int error = avro_schema_from_json_length(
+      table_schema_str.c_str(), table_schema_str.size(), &raw_table_schema);
+  ScopedAvroSchemaT table_schema(raw_table_schema);
+  if (error != 0) {
+    stringstream ss;
+    ss << "Failed to parse table schema: " << avro_strerror();
+    node->runtime_state()->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
+    return NULL;
+  }
+  int num_fields = avro_schema_record_size(table_schema.get());
+  DCHECK_GT(num_fields, 0);
+
+  // The table schema resolved with itself, i.e. the schema of files with the table
+  // schema.
+  vector<SchemaElement> schema;
+  for (int field_idx = 0; field_idx < num_fields; ++field_idx) {
+    avro_datum_t field =
+        avro_schema_record_field_get_by_index(table_schema.get(), field_idx);
+    schema.push_back(ConvertSchema(field));
+    int col_idx = field_idx + node->num_partition_keys();
+    int slot_idx = node->GetMaterializedSlotIdx(vector<int>(1, col_idx));
+    schema.back().slot_desc = slot_idx == HdfsScanNode::SKIP_COLUMN ?
+        NULL : node->materialized_slots()[slot_idx];
+  }
+  return CodegenMaterializeTuple(codegen, schema);
+}
+
 // This function produces a codegen'd function equivalent to MaterializeTuple() but
-// optimized for the table schema. It eliminates the conditionals necessary when
+// optimized for a resolved schema. It eliminates the conditionals necessary when
 // interpreting the type of each element in the schema, instead generating code to handle
-// each element in a record. Example output:
+// each element in a record. Slots are addressed by their offsets in the tuple, so that
+// the function does not depend on the llvm struct of the tuple, which is generated for
+// the fragment's module only. Example output:
 //
 // define void @MaterializeTuple(%"class.impala::HdfsAvroScanner"* %this,
 //     %"class.impala::MemPool"* %pool, i8** %data, %"class.impala::Tuple"* %tuple) {
 // entry:
-//   %tuple_ptr = bitcast %"class.impala::Tuple"* %tuple to { i8, i32 }*
+//   %tuple_ptr = bitcast %"class.impala::Tuple"* %tuple to i8*
 //   %is_not_null = call i1 @_ZN6impala15HdfsAvroScanner13ReadUnionTypeEiPPh(
 //       %"class.impala::HdfsAvroScanner"* %this, i32 1, i8** %data)
 //   br i1 %is_not_null, label %read_field, label %null_field
 //
 // read_field:                                       ; preds = %entry
-//   %slot = getelementptr inbounds { i8, i32 }* %tuple_ptr, i32 0, i32 1
-//   %opaque_slot = bitcast i32* %slot to i8*
+//   %slot = getelementptr i8* %tuple_ptr, i32 4
 //   call void
 //    @_ZN6impala15HdfsAvroScanner13ReadAvroInt32ENS_13PrimitiveTypeEPPhPvPNS_7MemPoolE(
 //        %"class.impala::HdfsAvroScanner"* %this, i32 5, i8** %data,
-//        i8* %opaque_slot, %"class.impala::MemPool"* %pool)
+//        i8* %slot, %"class.impala::MemPool"* %pool)
 //   br label %endif
 //
 // null_field:                                       ; preds = %entry
-//   call void @SetNull({ i8, i32 }* %tuple_ptr)
+//   %null_byte_ptr = getelementptr i8* %tuple_ptr, i32 0
+//   %null_byte = load i8* %null_byte_ptr
+//   %null_set = or i8 %null_byte, 1
+//   store i8 %null_set, i8* %null_byte_ptr
 //   br label %endif
 //
 // endif:                                            ; preds = %null_field, %read_field
@@ -688,42 +798,8 @@ void HdfsAvroScanner::MaterializeTuple(MemPool* pool, uint8_t** data, Tuple* tup
 // endif3:                                           ; preds = %null_field2, %read_field1
 //   ret void
 // }
-Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
-                                                   LlvmCodeGen* codegen) {
-  const string& table_schema_str = node->hdfs_table()->avro_schema();
-
-  // HdfsAvroScanner::Codegen() (which calls this function) gets called by HdfsScanNode
-  // regardless of whether the table we're scanning contains Avro files or not. If this
-  // isn't an Avro table, there is no table schema to codegen a function from (and there's
-  // no need to anyway).
-  // TODO: HdfsScanNode shouldn't codegen functions it doesn't need.
-  if (table_schema_str.empty()) return NULL;
-
-  avro_schema_t raw_table_schema;
-  int error = avro_schema_from_json_length(
-      table_schema_str.c_str(), table_schema_str.size(), &raw_table_schema);
-  ScopedAvroSchemaT table_schema(raw_table_schema);
-  if (error != 0) {
-    stringstream ss;
-    ss << "Failed to parse table schema: " << avro_strerror();
-    node->runtime_state()->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
-    return NULL;
-  }
-  int num_fields = avro_schema_record_size(table_schema.get());
-  DCHECK_GT(num_fields, 0);
-  // Disable Codegen for TYPE_CHAR
-  for (int field_idx = 0; field_idx < num_fields; ++field_idx) {
-    int col_idx = field_idx + node->num_partition_keys();
-    int slot_idx = node->GetMaterializedSlotIdx(vector<int>(1, col_idx));
-    if (slot_idx != HdfsScanNode::SKIP_COLUMN) {
-      SlotDescriptor* slot_desc = node->materialized_slots()[slot_idx];
-      if (slot_desc->type().type == TYPE_CHAR) {
-        LOG(INFO) << "Avro codegen skipped because CHAR is not supported.";
-        return NULL;
-      }
-    }
-  }
-
+Function* HdfsAvroScanner::CodegenMaterializeTuple(LlvmCodeGen* codegen,
+    const vector<SchemaElement>& schema) {
   LLVMContext& context = codegen->context();
   LlvmCodeGen::LlvmBuilder builder(context);
 
@@ -731,10 +807,6 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
   DCHECK(this_type != NULL);
   PointerType* this_ptr_type = PointerType::get(this_type, 0);
 
-  TupleDescriptor* tuple_desc = const_cast<TupleDescriptor*>(node->tuple_desc());
-  StructType* tuple_type = tuple_desc->GenerateLlvmStruct(codegen);
-  Type* tuple_ptr_type = PointerType::get(tuple_type, 0);
-
   Type* tuple_opaque_type = codegen->GetType(Tuple::LLVM_CLASS_NAME);
   PointerType* tuple_opaque_ptr_type = PointerType::get(tuple_opaque_type, 0);
 
@@ -754,16 +826,14 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
   Value* data_val = args[2];
   Value* opaque_tuple_val = args[3];
 
-  Value* tuple_val = builder.CreateBitCast(opaque_tuple_val, tuple_ptr_type, "tuple_ptr");
+  Value* tuple_val =
+      builder.CreateBitCast(opaque_tuple_val, codegen->ptr_type(), "tuple_ptr");
 
   // Codegen logic for parsing each field and, if necessary, populating a slot with the
   // result.
-  for (int field_idx = 0; field_idx < num_fields; ++field_idx) {
-    avro_datum_t field =
-        avro_schema_record_field_get_by_index(table_schema.get(), field_idx);
-    SchemaElement element = ConvertSchema(field);
-    int col_idx = field_idx + node->num_partition_keys();
-    int slot_idx = node->GetMaterializedSlotIdx(vector<int>(1, col_idx));
+  for (int field_idx = 0; field_idx < schema.size(); ++field_idx) {
+    const SchemaElement& element = schema[field_idx];
+    const SlotDescriptor* slot_desc = element.slot_desc;
 
     // The previous iteration may have left the insert point somewhere else
     builder.SetInsertPoint(&fn->back());
@@ -789,12 +859,7 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
 
       // Write null field IR
       builder.SetInsertPoint(null_block);
-      if (slot_idx != HdfsScanNode::SKIP_COLUMN) {
-        SlotDescriptor* slot_desc = node->materialized_slots()[slot_idx];
-        Function* set_null_fn = slot_desc->CodegenUpdateNull(codegen, tuple_type, true);
-        DCHECK(set_null_fn != NULL);
-        builder.CreateCall(set_null_fn, tuple_val);
-      }
+      if (slot_desc != NULL) CodegenSetNull(codegen, &builder, tuple_val, slot_desc);
       // LLVM requires all basic blocks to end with a terminating instruction
       builder.CreateBr(endif_block);
     } else {
@@ -802,15 +867,14 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
       builder.CreateBr(read_field_block);
     }
 
-    SlotDescriptor* slot_desc = NULL;
-    if (slot_idx != HdfsScanNode::SKIP_COLUMN) {
-      slot_desc = node->materialized_slots()[slot_idx];
-    }
-
     // Write read_field_block IR starting at the beginning of the block
     builder.SetInsertPoint(read_field_block, read_field_block->begin());
     Function* read_field_fn;
     switch (element.schema->type) {
+      case AVRO_NULL:
+        // Field is always null, there is nothing to read.
+        if (slot_desc != NULL) CodegenSetNull(codegen, &builder, tuple_val, slot_desc);
+        continue;
       case AVRO_BOOLEAN:
         read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_BOOLEAN);
         break;
@@ -828,13 +892,17 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
         break;
       case AVRO_STRING:
       case AVRO_BYTES:
-        if ((slot_idx != HdfsScanNode::SKIP_COLUMN) &&
-            (slot_desc->type().type == TYPE_VARCHAR)) {
+        if (slot_desc != NULL && slot_desc->type().type == TYPE_VARCHAR) {
           read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_VARCHAR);
+        } else if (slot_desc != NULL && slot_desc->type().type == TYPE_CHAR) {
+          read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_CHAR);
         } else {
           read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_STRING);
         }
         break;
+      case AVRO_DECIMAL:
+        read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_DECIMAL);
+        break;
       default:
         // Unsupported type, can't codegen
         VLOG(1) << "Failed to codegen MaterializeTuple() due to unsupported type: "
@@ -847,7 +915,7 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
     Value* write_slot_val = builder.getFalse();
     Value* slot_type_val = builder.getInt32(0);
     Value* opaque_slot_val = codegen->null_ptr_value();
-    if (slot_idx != HdfsScanNode::SKIP_COLUMN) {
+    if (slot_desc != NULL) {
       // Field corresponds to a materialized column, fill in relevant arguments
       write_slot_val = builder.getTrue();
       if (slot_desc->type().type == TYPE_DECIMAL) {
@@ -856,14 +924,12 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
       } else {
         slot_type_val = builder.getInt32(slot_desc->type().type);
       }
-      Value* slot_val =
-          builder.CreateStructGEP(tuple_val, slot_desc->field_idx(), "slot");
       opaque_slot_val =
-          builder.CreateBitCast(slot_val, codegen->ptr_type(), "opaque_slot");
+          builder.CreateConstGEP1_32(tuple_val, slot_desc->tuple_offset(), "slot");
     }
 
     // NOTE: ReadAvroVarchar/Char has different signature than rest of read functions
-    if ((slot_idx != HdfsScanNode::SKIP_COLUMN) &&
+    if (slot_desc != NULL &&
         (slot_desc->type().type == TYPE_VARCHAR ||
          slot_desc->type().type == TYPE_CHAR)) {
       // Need to pass an extra argument (the length) to the codegen function
@@ -882,10 +948,8 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
   return codegen->FinalizeFunction(fn);
 }
 
-Function* HdfsAvroScanner::CodegenDecodeAvroData(RuntimeState* state,
-    Function* materialize_tuple_fn, const vector<ExprContext*>& conjunct_ctxs) {
-  LlvmCodeGen* codegen;
-  if (!state->GetCodegen(&codegen).ok()) return NULL;
+Function* HdfsAvroScanner::CodegenDecodeAvroData(LlvmCodeGen* codegen,
+    Function* materialize_tuple_fn, Function* eval_conjuncts_fn) {
   SCOPED_TIMER(codegen->codegen_timer());
   DCHECK(materialize_tuple_fn != NULL);
 
@@ -895,10 +959,11 @@ Function* HdfsAvroScanner::CodegenDecodeAvroData(RuntimeState* state,
       materialize_tuple_fn, "MaterializeTuple", &replaced);
   DCHECK_EQ(replaced, 1);
 
-  Function* eval_conjuncts_fn = ExecNode::CodegenEvalConjuncts(state, conjunct_ctxs);
-  decode_avro_data_fn = codegen->ReplaceCallSites(decode_avro_data_fn, false,
-      eval_conjuncts_fn, "EvalConjuncts", &replaced);
-  DCHECK_EQ(replaced, 1);
+  if (eval_conjuncts_fn != NULL) {
+    decode_avro_data_fn = codegen->ReplaceCallSites(decode_avro_data_fn, false,
+        eval_conjuncts_fn, "EvalConjuncts", &replaced);
+    DCHECK_EQ(replaced, 1);
+  }
   decode_avro_data_fn->setName("DecodeAvroData");
 
   decode_avro_data_fn = codegen->OptimizeFunctionWithExprs(decode_avro_data_fn);
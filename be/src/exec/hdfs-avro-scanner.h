@@ -43,7 +43,11 @@
 // header to decode the serialized objects. If possible, non-materialized columns are
 // skipped without being read. If codegen is enabled, we codegen a function based on the
 // table schema that parses records, materializes them to tuples, and evaluates the
-// conjuncts.
+// conjuncts. Files with other schemas use a function codegen'd for the result of
+// resolving their schema with the table schema. These are codegen'd by the first scanner
+// that needs them, each in a separate module, and are shared by all scanners of the scan
+// node. Since the conjuncts are codegen'd in the fragment's module, these functions
+// evaluate the conjuncts interpreted.
 //
 // The Avro C library is used to parse the file's schema and the table's schema, which are
 // then resolved according to the Avro spec and transformed into our own schema
@@ -61,7 +65,6 @@
 //
 // TODO:
 // - implement SkipComplex()
-// - codegen a function per unique file schema, rather than just the table schema
 // - once Exprs are thread-safe, we can cache the jitted function directly
 // - microbenchmark codegen'd functions (this and other scanners)
 
@@ -102,6 +105,8 @@ class HdfsAvroScanner : public BaseSequenceScanner {
   }
 
  private:
+  friend class HdfsAvroScannerTest;
+
   // Wrapper for avro_schema_t's that handles decrementing the ref count
   struct ScopedAvroSchemaT {
     ScopedAvroSchemaT(avro_schema_t s = NULL) : schema(s) { }
@@ -153,7 +158,8 @@ class HdfsAvroScanner : public BaseSequenceScanner {
     Tuple* template_tuple;
 
     // True if this file can use the codegen'd version of DecodeAvroData() (i.e. its
-    // schema matches the table schema), false otherwise.
+    // schema matches the table schema), false otherwise. Other files use a version
+    // codegen'd for their schema, see GetSchemaCodegenFn().
     bool use_codegend_decode_avro_data;
   };
 
@@ -203,18 +209,35 @@ class HdfsAvroScanner : public BaseSequenceScanner {
   // Materializes a single tuple from serialized record data.
   void MaterializeTuple(MemPool* pool, uint8_t** data, Tuple* tuple);
 
+  // Returns the version of DecodeAvroData() codegen'd for the resolved schema of the
+  // current file, codegen'ing it if no scanner of the scan node did so before. Returns
+  // NULL if the function is being codegen'd by another scanner or cannot be codegen'd.
+  DecodeAvroDataFn GetSchemaCodegenFn();
+
+  // Codegens DecodeAvroData() for the resolved schema of the current file in a new
+  // module and sets 'fn' to the JIT'd function, or to NULL if the schema has types
+  // that are not supported by codegen.
+  Status CodegenSchema(void** fn);
+
+  // Returns a string that is the same for two resolved schemas iff the code codegen'd
+  // for them is the same.
+  static std::string SchemaCodegenKey(const std::vector<SchemaElement>& schema);
+
   // Produces a version of DecodeAvroData that uses codegen'd instead of interpreted
-  // functions.
-  static llvm::Function* CodegenDecodeAvroData(
-      RuntimeState* state, llvm::Function* materialize_tuple_fn,
-      const std::vector<ExprContext*>& conjunct_ctxs);
+  // functions. If 'eval_conjuncts_fn' is NULL, the conjuncts are evaluated interpreted.
+  static llvm::Function* CodegenDecodeAvroData(LlvmCodeGen* codegen,
+      llvm::Function* materialize_tuple_fn, llvm::Function* eval_conjuncts_fn);
 
   // Codegens a version of MaterializeTuple() that reads records based on the table
   // schema.
-  // TODO: Codegen a function for each unique file schema.
   static llvm::Function* CodegenMaterializeTuple(HdfsScanNode* node,
                                                  LlvmCodeGen* codegen);
 
+  // Codegens a version of MaterializeTuple() that reads records with the resolved
+  // schema 'schema'. Returns NULL if 'schema' has a type that is not supported.
+  static llvm::Function* CodegenMaterializeTuple(LlvmCodeGen* codegen,
+      const std::vector<SchemaElement>& schema);
+
   // The following are cross-compiled functions for parsing a serialized Avro primitive
   // type and writing it to a slot. They can also be used for skipping a field without
   // writing it to a slot by setting 'write_slot' to false.
@@ -54,6 +54,10 @@ using namespace strings;
 DEFINE_bool(convert_legacy_hive_parquet_utc_timestamps, false,
     "When true, TIMESTAMPs read from files written by Parquet-MR (used by Hive) will "
     "be converted from UTC to local time. Writes are unaffected.");
+DEFINE_bool(parquet_late_materialization, false,
+    "(Experimental) When true, the Parquet scanner reads the columns referenced by the "
+    "conjuncts first and only reads the other columns of the rows that passed the "
+    "conjuncts.");
 
 // Max data page header size in bytes. This is an estimate and only needs to be an upper
 // bound. It is theoretically possible to have a page header of any size due to string
@@ -185,9 +189,11 @@ class HdfsParquetScanner::BaseColumnReader {
   // are currently dense so we'll need to figure out something there.
   bool ReadValue(MemPool* pool, Tuple* tuple, bool* conjuncts_failed);
 
-  // TODO: Some encodings might benefit a lot from a SkipValues(int num_rows) if
-  // we know this row can be skipped. This could be very useful with stats and big
-  // sections can be skipped. Implement that when we can benefit from it.
+  // Skips the next 'num_values' values of this column, reading data pages as needed.
+  // Only the definition levels are decoded one by one, the values are skipped in bulk
+  // by SkipSlots(). Returns false if there are fewer values left or there was an error
+  // (in which case parent_->parse_status_ is set).
+  bool SkipValues(int num_values);
 
  protected:
   friend class HdfsParquetScanner;
@@ -276,6 +282,11 @@ class HdfsParquetScanner::BaseColumnReader {
   // Subclass must implement this.
   // TODO: we need to remove this with codegen.
   virtual bool ReadSlot(void* slot, MemPool* pool, bool* conjuncts_failed) = 0;
+
+  // Skips the next 'num_values' non-NULL values in the current data page. Returns false
+  // if there was an error.
+  // Subclass must implement this.
+  virtual bool SkipSlots(int num_values) = 0;
 };
 
 // Per column type reader.
@@ -298,6 +309,13 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
         (FLAGS_convert_legacy_hive_parquet_utc_timestamps &&
         slot_desc()->type().type == TYPE_TIMESTAMP &&
         parent->file_version_.application == "parquet-mr");
+    if (slot_desc()->type().IsStringType()) {
+      plain_value_size_ = -1;
+    } else if (slot_desc()->type().type == TYPE_DECIMAL) {
+      plain_value_size_ = fixed_len_size_;
+    } else {
+      plain_value_size_ = ParquetPlainEncoder::ByteSize(T());
+    }
   }
 
  protected:
@@ -347,6 +365,25 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
     return result;
   }
 
+  virtual bool SkipSlots(int num_values) {
+    parquet::Encoding::type page_encoding =
+        current_page_header_.data_page_header.encoding;
+    if (page_encoding == parquet::Encoding::PLAIN_DICTIONARY) {
+      return dict_decoder_->Skip(num_values);
+    }
+    DCHECK(page_encoding == parquet::Encoding::PLAIN);
+    if (plain_value_size_ > 0) {
+      data_ += num_values * plain_value_size_;
+    } else {
+      // The lengths of variable length values need to be decoded to find the next one.
+      T val;
+      for (int i = 0; i < num_values; ++i) {
+        data_ += ParquetPlainEncoder::Decode<T>(data_, fixed_len_size_, &val);
+      }
+    }
+    return true;
+  }
+
  private:
   void CopySlot(T* slot, MemPool* pool) {
     // no-op for non-string columns.
@@ -365,6 +402,9 @@ class HdfsParquetScanner::ColumnReader : public HdfsParquetScanner::BaseColumnRe
   // The size of this column with plain encoding for FIXED_LEN_BYTE_ARRAY, or
   // the max length for VARCHAR columns. Unused otherwise.
   int fixed_len_size_;
+
+  // The size of a plain encoded value, or -1 if values have different sizes.
+  int plain_value_size_;
 };
 
 template<>
@@ -429,6 +469,12 @@ class HdfsParquetScanner::BoolColumnReader : public HdfsParquetScanner::BaseColu
     return valid;
   }
 
+  virtual bool SkipSlots(int num_values) {
+    bool valid = bool_values_.SkipBits(num_values);
+    if (!valid) parent_->parse_status_ = Status("Invalid bool column.");
+    return valid;
+  }
+
  private:
   BitReader bool_values_;
 };
@@ -764,6 +810,33 @@ inline bool HdfsParquetScanner::BaseColumnReader::ReadValue(
   return ReadSlot(tuple->GetSlot(slot_desc()->tuple_offset()), pool, conjuncts_failed);
 }
 
+bool HdfsParquetScanner::BaseColumnReader::SkipValues(int num_values) {
+  DCHECK_GE(num_values, 0);
+  while (num_values > 0) {
+    if (num_buffered_values_ == 0) {
+      parent_->assemble_rows_timer_.Stop();
+      parent_->parse_status_ = ReadDataPage();
+      if (num_buffered_values_ == 0 || !parent_->parse_status_.ok()) return false;
+      parent_->assemble_rows_timer_.Start();
+    }
+
+    int num_skipped = min(num_values, num_buffered_values_);
+    int num_non_null = num_skipped;
+    if (max_def_level() > 0) {
+      num_non_null = 0;
+      for (int i = 0; i < num_skipped; ++i) {
+        int definition_level = ReadDefinitionLevel();
+        if (definition_level < 0) return false;
+        if (definition_level == max_def_level()) ++num_non_null;
+      }
+    }
+    if (num_non_null > 0 && !SkipSlots(num_non_null)) return false;
+    num_buffered_values_ -= num_skipped;
+    num_values -= num_skipped;
+  }
+  return true;
+}
+
 Status HdfsParquetScanner::ProcessSplit() {
   // First process the file metadata in the footer
   bool eosr;
@@ -773,6 +846,7 @@ Status HdfsParquetScanner::ProcessSplit() {
   // We've processed the metadata and there are columns that need to be materialized.
   RETURN_IF_ERROR(CreateColumnReaders());
   COUNTER_SET(num_cols_counter_, static_cast<int64_t>(column_readers_.size()));
+  InitLateMaterialization();
 
   // The scanner-wide stream was used only to read the file footer.  Each column has added
   // its own stream.
@@ -819,44 +893,33 @@ Status HdfsParquetScanner::AssembleRows(int row_group_idx) {
 
     int num_to_commit = 0;
     if (num_column_readers > 0) {
-      for (int i = 0; i < num_rows; ++i) {
-        bool conjuncts_failed = false;
-        InitTuple(template_tuple_, tuple);
-        for (int c = 0; c < num_column_readers; ++c) {
-          if (!column_readers_[c]->ReadValue(pool, tuple, &conjuncts_failed)) {
-            assemble_rows_timer_.Stop();
-            // This column is complete and has no more data.  This indicates
-            // we are done with this row group.
-            // For correctly formed files, this should be the first column we
-            // are reading.
-            DCHECK(c == 0 || !parse_status_.ok())
-              << "c=" << c << " " << parse_status_.GetDetail();;
-            COUNTER_ADD(scan_node_->rows_read_counter(), i);
-            RETURN_IF_ERROR(CommitRows(num_to_commit));
-
-            // If we reach this point, it means that we reached the end of file for
-            // this column. Test if the expected number of rows from metadata matches
-            // the actual number of rows in the file.
-            rows_read += i;
-            if (rows_read != expected_rows_in_group) {
-              HdfsParquetScanner::BaseColumnReader* reader = column_readers_[c];
-              DCHECK_NOTNULL(reader->stream_);
-
-              ErrorMsg msg(TErrorCode::PARQUET_GROUP_ROW_COUNT_ERROR,
-                 reader->stream_->filename(), row_group_idx,
-                 expected_rows_in_group, rows_read);
-              LOG_OR_RETURN_ON_ERROR(msg, scan_node_->runtime_state());
-            }
-            return parse_status_;
-          }
-        }
-        if (conjuncts_failed) continue;
-        row->SetTuple(scan_node_->tuple_idx(), tuple);
-        if (EvalConjuncts(row)) {
-          row = next_row(row);
-          tuple = next_tuple(tuple);
-          ++num_to_commit;
+      int num_rows_read;
+      if (late_column_readers_.empty()) {
+        num_to_commit = MaterializeRows(pool, row, tuple, num_rows, &num_rows_read);
+      } else {
+        num_to_commit = MaterializeRowsLate(pool, row, tuple, num_rows, &num_rows_read);
+      }
+      if (num_rows_read < num_rows) {
+        // A column is complete and has no more data.  This indicates we are done with
+        // this row group.
+        assemble_rows_timer_.Stop();
+        COUNTER_ADD(scan_node_->rows_read_counter(), num_rows_read);
+        RETURN_IF_ERROR(CommitRows(num_to_commit));
+
+        // If we reach this point, it means that we reached the end of file for
+        // this column. Test if the expected number of rows from metadata matches
+        // the actual number of rows in the file.
+        rows_read += num_rows_read;
+        if (rows_read != expected_rows_in_group) {
+          HdfsParquetScanner::BaseColumnReader* reader = column_readers_[0];
+          DCHECK_NOTNULL(reader->stream_);
+
+          ErrorMsg msg(TErrorCode::PARQUET_GROUP_ROW_COUNT_ERROR,
+             reader->stream_->filename(), row_group_idx,
+             expected_rows_in_group, rows_read);
+          LOG_OR_RETURN_ON_ERROR(msg, scan_node_->runtime_state());
         }
+        return parse_status_;
       }
     } else {
       // Special case when there is no data for the accessed column(s) in the file.
@@ -911,6 +974,152 @@ Status HdfsParquetScanner::AssembleRows(int row_group_idx) {
   return parse_status_;
 }
 
+int HdfsParquetScanner::MaterializeRows(MemPool* pool, TupleRow* first_row,
+    Tuple* first_tuple, int num_rows, int* num_rows_read) {
+  // Materialize the rows, then evaluate the conjuncts over all of them at once.
+  // Rows that failed the conjuncts pushed down into the column readers are dropped
+  // right away.
+  TupleRow* row = first_row;
+  Tuple* tuple = first_tuple;
+  int num_column_readers = column_readers_.size();
+  int num_materialized = 0;
+  for (int i = 0; i < num_rows; ++i) {
+    bool conjuncts_failed = false;
+    InitTuple(template_tuple_, tuple);
+    for (int c = 0; c < num_column_readers; ++c) {
+      if (!column_readers_[c]->ReadValue(pool, tuple, &conjuncts_failed)) {
+        // For correctly formed files, this should be the first column we
+        // are reading.
+        DCHECK(c == 0 || !parse_status_.ok())
+          << "c=" << c << " " << parse_status_.GetDetail();
+        *num_rows_read = i;
+        return FilterMaterializedRows(first_row, first_tuple, num_materialized);
+      }
+    }
+    if (conjuncts_failed) continue;
+    row->SetTuple(scan_node_->tuple_idx(), tuple);
+    row = next_row(row);
+    tuple = next_tuple(tuple);
+    ++num_materialized;
+  }
+  *num_rows_read = num_rows;
+  return FilterMaterializedRows(first_row, first_tuple, num_materialized);
+}
+
+int HdfsParquetScanner::MaterializeRowsLate(MemPool* pool, TupleRow* first_row,
+    Tuple* first_tuple, int num_rows, int* num_rows_read) {
+  // Phase one: read the early columns of each row into the row's position in the batch.
+  // The rows that passed the bitmap filters are collected in filtered_rows_ and the
+  // conjuncts are evaluated over them at once.
+  if (filtered_rows_.size() < num_rows) filtered_rows_.resize(num_rows);
+  int tuple_idx = scan_node_->tuple_idx();
+  int num_early_readers = early_column_readers_.size();
+  int num_candidates = 0;
+  TupleRow* row = first_row;
+  Tuple* tuple = first_tuple;
+  *num_rows_read = num_rows;
+  for (int i = 0; i < num_rows && *num_rows_read == num_rows; ++i) {
+    bool conjuncts_failed = false;
+    InitTuple(template_tuple_, tuple);
+    for (int c = 0; c < num_early_readers; ++c) {
+      if (!early_column_readers_[c]->ReadValue(pool, tuple, &conjuncts_failed)) {
+        DCHECK(c == 0 || !parse_status_.ok())
+          << "c=" << c << " " << parse_status_.GetDetail();
+        *num_rows_read = i;
+        break;
+      }
+    }
+    if (*num_rows_read == num_rows && !conjuncts_failed) {
+      row->SetTuple(tuple_idx, tuple);
+      filtered_rows_[num_candidates++] = row;
+    }
+    row = next_row(row);
+    tuple = next_tuple(tuple);
+  }
+  int num_selected = 0;
+  if (num_candidates > 0) {
+    num_selected = ExecNode::EvalConjuncts(
+        &conjunct_ctxs_[0], conjunct_ctxs_.size(), &filtered_rows_[0], num_candidates);
+  }
+
+  // The selected rows are in order, so their positions are increasing.
+  if (selected_rows_.size() < num_selected) selected_rows_.resize(num_selected);
+  uint8_t* first_tuple_mem = reinterpret_cast<uint8_t*>(first_tuple);
+  for (int i = 0; i < num_selected; ++i) {
+    uint8_t* tuple_mem =
+        reinterpret_cast<uint8_t*>(filtered_rows_[i]->GetTuple(tuple_idx));
+    selected_rows_[i] = (tuple_mem - first_tuple_mem) / tuple_byte_size_;
+  }
+
+  // Phase two: read the late columns of the selected rows and skip the values of the
+  // other rows.
+  for (int c = 0; c < late_column_readers_.size(); ++c) {
+    BaseColumnReader* reader = late_column_readers_[c];
+    int next_row_idx = 0;
+    bool valid = true;
+    for (int i = 0; valid && i < num_selected; ++i) {
+      int row_idx = selected_rows_[i];
+      Tuple* selected_tuple =
+          reinterpret_cast<Tuple*>(first_tuple_mem + row_idx * tuple_byte_size_);
+      // Bitmap filters are only applied in phase one.
+      bool conjuncts_failed = false;
+      valid = reader->SkipValues(row_idx - next_row_idx) &&
+          reader->ReadValue(pool, selected_tuple, &conjuncts_failed);
+      next_row_idx = row_idx + 1;
+    }
+    if (valid) valid = reader->SkipValues(*num_rows_read - next_row_idx);
+    if (!valid) {
+      // The early columns had more values than this one.
+      if (parse_status_.ok()) {
+        parse_status_ = Status(Substitute("Column $0 in file $1 has fewer values than "
+            "the other columns.", reader->col_idx(), reader->stream_->filename()));
+      }
+      *num_rows_read = 0;
+      return 0;
+    }
+  }
+
+  // Move the selected tuples down to the front of the batch. The i-th selected tuple is
+  // at or after the i-th position, so this never overwrites one that was not moved yet.
+  row = first_row;
+  tuple = first_tuple;
+  for (int i = 0; i < num_selected; ++i) {
+    Tuple* src = reinterpret_cast<Tuple*>(
+        first_tuple_mem + selected_rows_[i] * tuple_byte_size_);
+    if (src != tuple) memcpy(tuple, src, tuple_byte_size_);
+    row->SetTuple(tuple_idx, tuple);
+    row = next_row(row);
+    tuple = next_tuple(tuple);
+  }
+  return num_selected;
+}
+
+void HdfsParquetScanner::InitLateMaterialization() {
+  early_column_readers_.clear();
+  late_column_readers_.clear();
+  if (!FLAGS_parquet_late_materialization || conjunct_ctxs_.empty()) return;
+
+  vector<SlotId> conjunct_slot_ids;
+  for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+    conjunct_ctxs_[i]->root()->GetSlotIds(&conjunct_slot_ids);
+  }
+  for (int i = 0; i < column_readers_.size(); ++i) {
+    BaseColumnReader* reader = column_readers_[i];
+    bool is_early = reader->bitmap_filter_ != NULL ||
+        find(conjunct_slot_ids.begin(), conjunct_slot_ids.end(),
+            reader->slot_desc()->id()) != conjunct_slot_ids.end();
+    if (is_early) {
+      early_column_readers_.push_back(reader);
+    } else {
+      late_column_readers_.push_back(reader);
+    }
+  }
+  if (early_column_readers_.empty() || late_column_readers_.empty()) {
+    early_column_readers_.clear();
+    late_column_readers_.clear();
+  }
+}
+
 Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   *eosr = false;
   uint8_t* buffer;
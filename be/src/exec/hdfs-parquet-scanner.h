@@ -124,6 +124,17 @@ class HdfsParquetScanner : public HdfsScanner {
   // Column reader for each materialized columns for this file.
   std::vector<BaseColumnReader*> column_readers_;
 
+  // If rows are materialized in two phases (see MaterializeRowsLate()), the readers of
+  // the columns that are read first, i.e. the columns referenced by the conjuncts and
+  // the columns with bitmap filters, and the readers of the other columns. Both are
+  // empty otherwise.
+  std::vector<BaseColumnReader*> early_column_readers_;
+  std::vector<BaseColumnReader*> late_column_readers_;
+
+  // Scratch space for MaterializeRowsLate(): the positions of the rows that passed the
+  // conjuncts in the batch.
+  std::vector<int> selected_rows_;
+
   // File metadata thrift object
   parquet::FileMetaData file_metadata_;
 
@@ -153,6 +164,24 @@ class HdfsParquetScanner : public HdfsScanner {
   // object. Returns when the entire row group is complete or an error occurred.
   Status AssembleRows(int row_group_idx);
 
+  // Materializes up to 'num_rows' rows starting at 'first_row' and 'first_tuple',
+  // evaluates the conjuncts over them and moves the rows that passed to the front.
+  // Returns the number of those rows. Sets *num_rows_read to the number of rows read
+  // from the file, which is less than 'num_rows' if a column has no more values or
+  // there was an error (in which case parse_status_ is set).
+  int MaterializeRows(MemPool* pool, TupleRow* first_row, Tuple* first_tuple,
+      int num_rows, int* num_rows_read);
+
+  // Same as MaterializeRows(), but in two phases. The first phase reads the early
+  // columns of all rows and evaluates the conjuncts. The second phase reads the late
+  // columns only for the rows that passed and skips the other values in bulk.
+  int MaterializeRowsLate(MemPool* pool, TupleRow* first_row, Tuple* first_tuple,
+      int num_rows, int* num_rows_read);
+
+  // Splits column_readers_ into early_column_readers_ and late_column_readers_ if
+  // materializing rows in two phases can skip any values.
+  void InitLateMaterialization();
+
   // Process the file footer and parse file_metadata_.  This should be called with the
   // last FOOTER_SIZE bytes in context_.
   // *eosr is a return value.  If true, the scan range is complete (e.g. select count(*))
@@ -30,6 +30,7 @@
 #include "dfs_cache/dfs-cache.h"
 
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "common/logging.h"
 #include "common/object-pool.h"
 #include "exprs/expr-context.h"
@@ -41,6 +42,7 @@
 #include "runtime/row-batch.h"
 #include "util/bit-util.h"
 #include "util/container-util.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/error-util.h"
@@ -191,7 +193,7 @@ DiskIoMgr::ScanRange* HdfsScanNode::AllocateScanRange(
   DCHECK_GE(len, 0);
   DCHECK_LE(offset + len, GetFileDesc(file)->file_length)
       << "Scan range beyond end of file (offset=" << offset << ", len=" << len << ")";
-  disk_id = runtime_state_->io_mgr()->AssignQueue(file, disk_id, expected_local);
+  disk_id = runtime_state_->io_mgr()->AssignQueue(fs, file, disk_id, expected_local);
 
   ScanRangeMetadata* metadata =
       runtime_state_->obj_pool()->Add(new ScanRangeMetadata(partition_id));
@@ -222,9 +224,27 @@ void* HdfsScanNode::GetFileMetadata(const string& filename) {
 void* HdfsScanNode::GetCodegenFn(THdfsFileFormat::type type) {
   CodegendFnMap::iterator it = codegend_fn_map_.find(type);
   if (it == codegend_fn_map_.end()) return NULL;
+  // The function may be published concurrently (see --async_codegen).
+  return AtomicUtil::LoadAcquire(&it->second);
+}
+
+void* HdfsScanNode::GetCodegenFn(const string& key, bool* claimed) {
+  unique_lock<mutex> l(scanner_codegend_fn_lock_);
+  map<string, void*>::iterator it = scanner_codegend_fn_map_.find(key);
+  *claimed = it == scanner_codegend_fn_map_.end();
+  if (*claimed) {
+    scanner_codegend_fn_map_[key] = NULL;
+    return NULL;
+  }
   return it->second;
 }
 
+void HdfsScanNode::SetCodegenFn(const string& key, void* fn) {
+  unique_lock<mutex> l(scanner_codegend_fn_lock_);
+  DCHECK(scanner_codegend_fn_map_.find(key) != scanner_codegend_fn_map_.end());
+  scanner_codegend_fn_map_[key] = fn;
+}
+
 HdfsScanner* HdfsScanNode::CreateAndPrepareScanner(HdfsPartitionDescriptor* partition,
     ScannerContext* context, Status* status) {
   DCHECK(context != NULL);
@@ -795,6 +815,11 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
 void HdfsScanNode::ScannerThread() {
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
   SCOPED_TIMER(runtime_state_->total_cpu_timer());
+  // Scanner threads can be started from threads of other fragments (when thread tokens
+  // become available), so they don't necessarily inherit the fragment's NUMA node.
+  if (runtime_state_->numa_node() != -1) {
+    CpuInfo::PinCurrentThreadToNumaNode(runtime_state_->numa_node());
+  }
 
   while (!done_) {
     {
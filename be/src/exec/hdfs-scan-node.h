@@ -161,6 +161,18 @@ class HdfsScanNode : public ScanNode {
   // codegen'd function to use.  Returns NULL if codegen should not be used.
   void* GetCodegenFn(THdfsFileFormat::type);
 
+  // Returns the codegen'd function for the files described by 'key', a format specific
+  // description of the files (e.g. the resolved schema of Avro files), or NULL if there
+  // is none. Unlike the per format functions, these are codegen'd by the scanners while
+  // the scan runs, each in its own module, and shared by all scanners of this node.
+  // If no scanner has asked for 'key' before, sets *claimed to true and the caller
+  // must codegen the function and pass it to SetCodegenFn(), even if codegen fails.
+  // Until then, NULL is returned for 'key'.
+  void* GetCodegenFn(const std::string& key, bool* claimed);
+
+  // Sets the function for 'key' claimed with GetCodegenFn(). 'fn' may be NULL.
+  void SetCodegenFn(const std::string& key, void* fn);
+
   inline void IncNumScannersCodegenEnabled() {
     ++num_scanners_codegen_enabled_;
   }
@@ -319,6 +331,11 @@ class HdfsScanNode : public ScanNode {
   typedef std::map<THdfsFileFormat::type, void*> CodegendFnMap;
   CodegendFnMap codegend_fn_map_;
 
+  // Codegen'd fns codegen'd by the scanners, see GetCodegenFn(const string&, bool*).
+  // Protected by scanner_codegend_fn_lock_.
+  boost::mutex scanner_codegend_fn_lock_;
+  std::map<std::string, void*> scanner_codegend_fn_map_;
+
   // Contexts for each conjunct. These are cloned by the scanners so conjuncts can be
   // safely evaluated in parallel.
   std::vector<ExprContext*> conjunct_ctxs_;
@@ -154,6 +154,31 @@ void HdfsScanner::AddFinalRowBatch() {
 //   1. template_tuple_ is the complete tuple.
 //   2. Eval conjuncts against the tuple.
 //   3. If it passes, stamp out 'num_tuples' copies of it into the row_batch.
+int HdfsScanner::FilterMaterializedRows(TupleRow* first_row, Tuple* first_tuple,
+    int num_rows) {
+  if (conjunct_ctxs_.empty() || num_rows == 0) return num_rows;
+  if (filtered_rows_.size() < num_rows) filtered_rows_.resize(num_rows);
+  TupleRow* row = first_row;
+  for (int i = 0; i < num_rows; ++i) {
+    filtered_rows_[i] = row;
+    row = next_row(row);
+  }
+  int num_selected = ExecNode::EvalConjuncts(
+      &conjunct_ctxs_[0], conjunct_ctxs_.size(), &filtered_rows_[0], num_rows);
+
+  // The i-th selected tuple is at or after the i-th position, so moving the selected
+  // tuples down in order never overwrites one that was not moved yet. The i-th row
+  // already points to the i-th position.
+  int tuple_idx = scan_node_->tuple_idx();
+  Tuple* dst = first_tuple;
+  for (int i = 0; i < num_selected; ++i) {
+    Tuple* src = filtered_rows_[i]->GetTuple(tuple_idx);
+    if (src != dst) memcpy(dst, src, tuple_byte_size_);
+    dst = next_tuple(dst);
+  }
+  return num_selected;
+}
+
 int HdfsScanner::WriteEmptyTuples(RowBatch* row_batch, int num_tuples) {
   DCHECK_GT(num_tuples, 0);
 
@@ -153,6 +153,9 @@ class HdfsScanner {
   // conjuncts can be safely evaluated in parallel.
   std::vector<ExprContext*> conjunct_ctxs_;
 
+  // Scratch space for FilterMaterializedRows().
+  std::vector<TupleRow*> filtered_rows_;
+
   // A partially materialized tuple with only partition key slots set.
   // The non-partition key slots are set to NULL.  The template tuple
   // must be copied into tuple_ before any of the other slots are
@@ -267,6 +270,14 @@ class HdfsScanner {
     return ExecNode::EvalConjuncts(&conjunct_ctxs_[0], conjunct_ctxs_.size(), row);
   }
 
+  // Evaluates the conjuncts over a batch of 'num_rows' materialized rows, which must be
+  // the consecutive rows starting at 'first_row', with row i pointing to the i-th
+  // consecutive tuple starting at 'first_tuple'. Moves the tuples of the rows that pass
+  // to the front, so that they can be committed with CommitRows(), and returns their
+  // number. Faster than calling EvalConjuncts() on each row as it is materialized (see
+  // ExecNode::EvalConjuncts()).
+  int FilterMaterializedRows(TupleRow* first_row, Tuple* first_tuple, int num_rows);
+
   // Utility method to write out tuples when there are no materialized
   // fields (e.g. select count(*) or only partition keys).
   //   num_tuples - Total number of tuples to write out.
@@ -575,10 +575,34 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
         ++cur_partition) {
       RETURN_IF_ERROR(FinalizePartitionFile(state, cur_partition->second.first));
     }
+    RETURN_IF_ERROR(WaitForUploads(state));
   }
   return Status::OK;
 }
 
+Status HdfsTableSink::WaitForUploads(RuntimeState* state) {
+  // With --cache_write_behind, the closed files are still being uploaded to the remote
+  // filesystem. The coordinator finalizes the insert once all fragments are done, so the
+  // uploads must be complete by then. Entries with an empty destination are directories.
+  SCOPED_TIMER(ADD_TIMER(profile(), "UploadWaitTimer"));
+  BOOST_FOREACH(const MoveDataSet::value_type& file, *state->hdfs_files_to_move()) {
+    if (file.second.empty()) continue;
+    if (dfsWaitForUpload(hdfs_connection_, file.first.c_str()) != 0) {
+      return Status(GetHdfsErrorMsg("Failed to upload file: ", file.first));
+    }
+  }
+  return Status::OK;
+}
+
+void HdfsTableSink::ForgetUploads(RuntimeState* state) {
+  // The uploads that WaitForUploads() waited for are already forgotten. The others, e.g.
+  // of the files of a cancelled insert, are dropped by the cache layer once they are done.
+  BOOST_FOREACH(const MoveDataSet::value_type& file, *state->hdfs_files_to_move()) {
+    if (file.second.empty()) continue;
+    dfsForgetUpload(hdfs_connection_, file.first.c_str());
+  }
+}
+
 Status HdfsTableSink::FinalizePartitionFile(RuntimeState* state,
                                             OutputPartition* partition) {
   if (partition->tmp_hdfs_file == NULL && !overwrite_) return Status::OK;
@@ -629,6 +653,7 @@ void HdfsTableSink::Close(RuntimeState* state) {
     ClosePartitionFile(state, cur_partition->second.first);
   }
   partition_keys_to_output_partitions_.clear();
+  ForgetUploads(state);
 
   // Close literal partition key exprs
   BOOST_FOREACH(
@@ -206,6 +206,14 @@ class HdfsTableSink : public DataSink {
   // Closes the hdfs file for this partition as well as the writer.
   void ClosePartitionFile(RuntimeState* state, OutputPartition* partition);
 
+  // Waits until the files written by this sink are uploaded to the remote filesystem,
+  // when they are uploaded in write-behind mode by the cache layer.
+  Status WaitForUploads(RuntimeState* state);
+
+  // Tells the cache layer that nobody will wait for the uploads of the files written by
+  // this sink any more, so that it does not keep them once they are done.
+  void ForgetUploads(RuntimeState* state);
+
   // Descriptor of target table. Set in Prepare().
   const HdfsTableDescriptor* table_desc_;
 
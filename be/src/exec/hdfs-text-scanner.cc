@@ -14,7 +14,10 @@
 
 #include "exec/hdfs-text-scanner.h"
 
+#include <unistd.h>
+
 #include "codegen/llvm-codegen.h"
+#include "dfs_cache/dfs-cache.h"
 #include "exec/delimited-text-parser.h"
 #include "exec/delimited-text-parser.inline.h"
 #include "exec/hdfs-lzo-text-scanner.h"
@@ -25,6 +28,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "util/codec.h"
+#include "util/compressed-file-index.h"
 #include "util/decompress.h"
 #include "util/cpu-info.h"
 #include "util/debug-util.h"
@@ -37,12 +41,18 @@ using namespace std;
 
 DEFINE_bool(debug_disable_streaming_gzip, false, "Debug flag, will be removed. Disables "
     "streaming gzip decompression.");
+DEFINE_int64(compressed_text_index_interval, 16L * 1024 * 1024, "Minimum number of "
+    "compressed bytes between two access points in the index of a gzip, snappy or lz4 "
+    "compressed text file, i.e. the size of the splits of indexed files. Files smaller "
+    "than two intervals are not indexed. If 0, no indexes are built.");
 
 const char* HdfsTextScanner::LLVM_CLASS_NAME = "class.impala::HdfsTextScanner";
 
 // Suffix for lzo index file: hdfs-filename.index
 const string HdfsTextScanner::LZO_INDEX_SUFFIX = ".index";
 
+const char* HdfsTextScanner::COMPRESSED_FILE_INDEX_SIDECAR = "index";
+
 // Number of bytes to read when the previous attempt to streaming decompress did not make
 // progress.
 const int64_t GZIP_FIXED_READ_SIZE = 1 * 1024 * 1024;
@@ -57,12 +67,98 @@ HdfsTextScanner::HdfsTextScanner(HdfsScanNode* scan_node, RuntimeState* state)
       boundary_row_(boundary_pool_.get()),
       boundary_column_(boundary_pool_.get()),
       slot_idx_(0),
-      error_in_row_(false) {
+      error_in_row_(false),
+      split_bytes_left_(-1),
+      past_split_ptr_(NULL),
+      past_split_len_(0),
+      decompressor_eos_(false),
+      last_access_point_offset_(0),
+      block_uncompressed_offset_(0),
+      block_buffer_(NULL),
+      block_buffer_len_(0) {
 }
 
 HdfsTextScanner::~HdfsTextScanner() {
 }
 
+// Returns true if text files compressed with 'compression' can be split with a
+// CompressedFileIndex.
+static bool IsIndexable(THdfsCompression::type compression) {
+  switch (compression) {
+    case THdfsCompression::GZIP:
+      return !FLAGS_debug_disable_streaming_gzip;
+    case THdfsCompression::SNAPPY_BLOCKED:
+    case THdfsCompression::LZ4:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Sets 'path' to the local path of the index of 'file'. Returns false if there is no
+// place for the index, i.e. the file system is not cached.
+static bool GetIndexPath(const HdfsFileDesc* file, string* path) {
+  return cacheGetSidecarPath(file->fs, file->filename.c_str(),
+      HdfsTextScanner::COMPRESSED_FILE_INDEX_SIDECAR, *path) == status::OK;
+}
+
+const CompressedFileIndex* HdfsTextScanner::LoadIndex(HdfsScanNode* scan_node,
+    const HdfsFileDesc* file) {
+  if (!IsIndexable(file->file_compression)) return NULL;
+  // The index only exists in this node's cache, so the file can only be split at its
+  // access points if all of the file is scanned here.
+  int64_t assigned_len = 0;
+  for (int i = 0; i < file->splits.size(); ++i) assigned_len += file->splits[i]->len();
+  if (assigned_len != file->file_length) return NULL;
+
+  string path;
+  if (!GetIndexPath(file, &path) || access(path.c_str(), F_OK) != 0) return NULL;
+  scoped_ptr<CompressedFileIndex> index(
+      new CompressedFileIndex(file->file_compression, file->file_length));
+  Status status = index->Load(path);
+  if (!status.ok()) {
+    LOG(WARNING) << "Ignoring the index of " << file->filename << ": "
+                 << status.GetDetail();
+    return NULL;
+  }
+  if (index->access_points().empty()) return NULL;
+  return scan_node->runtime_state()->obj_pool()->Add(index.release());
+}
+
+void HdfsTextScanner::IssueIndexedRanges(HdfsScanNode* scan_node, HdfsFileDesc* file,
+    const CompressedFileIndex* index, vector<DiskIoMgr::ScanRange*>* ranges) {
+  const vector<CompressedFileIndex::AccessPoint>& points = index->access_points();
+  IndexedFileMetadata* file_metadata =
+      scan_node->runtime_state()->obj_pool()->Add(new IndexedFileMetadata());
+  file_metadata->index = index;
+  file_metadata->num_splits = file->splits.size();
+  file_metadata->ranges_left = points.size() + 1;
+
+  // One range from the start of the file to the first access point and one from each
+  // access point to the next one. The ranges take the disk and caching options of the
+  // split they start in.
+  int64_t start = 0;
+  for (int i = 0; i <= points.size(); ++i) {
+    int64_t end = i < points.size() ? points[i].read_offset() : file->file_length;
+    DCHECK_GT(end, start);
+    DiskIoMgr::ScanRange* split = file->splits[0];
+    for (int j = 1; j < file->splits.size(); ++j) {
+      if (file->splits[j]->offset() <= start &&
+          start < file->splits[j]->offset() + file->splits[j]->len()) {
+        split = file->splits[j];
+        break;
+      }
+    }
+    ScanRangeMetadata* metadata =
+        reinterpret_cast<ScanRangeMetadata*>(split->meta_data());
+    ranges->push_back(scan_node->AllocateScanRange(file->fs, file->filename.c_str(),
+        end - start, start, metadata->partition_id, split->disk_id(),
+        split->try_cache(), split->expected_local()));
+    start = end;
+  }
+  scan_node->SetFileMetadata(file->filename, file_metadata);
+}
+
 Status HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node,
     const vector<HdfsFileDesc*>& files) {
   vector<DiskIoMgr::ScanRange*> compressed_text_scan_ranges;
@@ -74,18 +170,25 @@ Status HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node,
     switch (compression) {
       case THdfsCompression::NONE:
         // For uncompressed text we just issue all ranges at once.
-        // TODO: Lz4 is splittable, should be treated similarly.
         RETURN_IF_ERROR(scan_node->AddDiskIoRanges(files[i]));
         break;
 
       case THdfsCompression::GZIP:
       case THdfsCompression::SNAPPY:
       case THdfsCompression::SNAPPY_BLOCKED:
-      case THdfsCompression::BZIP2:
+      case THdfsCompression::LZ4:
+      case THdfsCompression::BZIP2: {
+        // If a previous scan indexed the file, it is split at the access points.
+        const CompressedFileIndex* index = LoadIndex(scan_node, files[i]);
+        if (index != NULL) {
+          IssueIndexedRanges(scan_node, files[i], index, &compressed_text_scan_ranges);
+          break;
+        }
         for (int j = 0; j < files[i]->splits.size(); ++j) {
-          // In order to decompress gzip-, snappy- and bzip2-compressed text files, we
-          // need to read entire files. Only read a file if we're assigned the first split
-          // to avoid reading multi-block files with multiple scanners.
+          // In order to decompress gzip-, snappy-, lz4- and bzip2-compressed text files
+          // without an index, we need to read entire files. Only read a file if we're
+          // assigned the first split to avoid reading multi-block files with multiple
+          // scanners.
           DiskIoMgr::ScanRange* split = files[i]->splits[j];
 
           // We only process the split that starts at offset 0.
@@ -96,8 +199,8 @@ Status HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node,
               // We write a single warning per file per impalad to reduce the number of
               // log warnings.
               stringstream ss;
-              ss << "For better performance, snappy, gzip and bzip-compressed files "
-                 << "should not be split into multiple hdfs-blocks. file="
+              ss << "For better performance, snappy, gzip, lz4 and bzip-compressed "
+                 << "files should not be split into multiple hdfs-blocks. file="
                  << files[i]->filename << " offset " << split->offset();
               scan_node->runtime_state()->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
               warning_written = true;
@@ -120,6 +223,7 @@ Status HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node,
           scan_node->max_compressed_text_file_length()->Set(files[i]->file_length);
         }
         break;
+      }
 
       case THdfsCompression::LZO:
         // lzo-compressed text need to be processed by the specialized HdfsLzoTextScanner.
@@ -155,6 +259,7 @@ Status HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node,
 Status HdfsTextScanner::ProcessSplit() {
   // Reset state for new scan range
   RETURN_IF_ERROR(InitNewRange());
+  RETURN_IF_ERROR(InitDecompressor());
 
   // Find the first tuple.  If tuple_found is false, it means we went through the entire
   // scan range without finding a single tuple.  The bytes will be picked up by the scan
@@ -163,12 +268,6 @@ Status HdfsTextScanner::ProcessSplit() {
   RETURN_IF_ERROR(FindFirstTuple(&tuple_found));
 
   if (tuple_found) {
-    // Update the decompressor depending on the compression type of the file in the
-    // context.
-    DCHECK(stream_->file_desc()->file_compression != THdfsCompression::SNAPPY)
-        << "FE should have generated SNAPPY_BLOCKED instead.";
-    RETURN_IF_ERROR(UpdateDecompressor(stream_->file_desc()->file_compression));
-
     // Process the scan range.
     int dummy_num_tuples;
     RETURN_IF_ERROR(ProcessRange(&dummy_num_tuples, false));
@@ -192,8 +291,18 @@ void HdfsTextScanner::Close() {
   AttachPool(boundary_pool_.get(), false);
   AddFinalRowBatch();
   if (!only_parsing_header_) {
-    scan_node_->RangeComplete(
-        THdfsFileFormat::TEXT, stream_->file_desc()->file_compression);
+    THdfsCompression::type compression = stream_->file_desc()->file_compression;
+    IndexedFileMetadata* metadata = !IsIndexable(compression) ? NULL :
+        reinterpret_cast<IndexedFileMetadata*>(
+            scan_node_->GetFileMetadata(stream_->filename()));
+    if (metadata == NULL) {
+      scan_node_->RangeComplete(THdfsFileFormat::TEXT, compression);
+    } else if (metadata->ranges_left.UpdateAndFetch(-1) == 0) {
+      // The last range of an indexed file completes all of its splits.
+      for (int i = 0; i < metadata->num_splits; ++i) {
+        scan_node_->RangeComplete(THdfsFileFormat::TEXT, compression);
+      }
+    }
   }
   HdfsScanner::Close();
 }
@@ -224,6 +333,81 @@ Status HdfsTextScanner::InitNewRange() {
   return Status::OK;
 }
 
+Status HdfsTextScanner::InitDecompressor() {
+  split_bytes_left_ = -1;
+  past_split_len_ = 0;
+  decompressor_eos_ = false;
+  index_.reset();
+  last_access_point_offset_ = 0;
+  block_uncompressed_offset_ = 0;
+
+  const HdfsFileDesc* file = stream_->file_desc();
+  THdfsCompression::type compression = file->file_compression;
+  DCHECK(compression != THdfsCompression::SNAPPY)
+      << "FE should have generated SNAPPY_BLOCKED instead.";
+  // Snappy blocks are decompressed one at a time, see FillByteBufferBlockFramed().
+  if (compression == THdfsCompression::SNAPPY_BLOCKED) {
+    compression = THdfsCompression::SNAPPY;
+  }
+
+  const DiskIoMgr::ScanRange* range = stream_->scan_range();
+  IndexedFileMetadata* metadata = !IsIndexable(file->file_compression) ? NULL :
+      reinterpret_cast<IndexedFileMetadata*>(
+          scan_node_->GetFileMetadata(stream_->filename()));
+  if (metadata == NULL) {
+    RETURN_IF_ERROR(UpdateDecompressor(compression));
+    // Index the file while decompressing all of it, unless it is too small to be worth
+    // splitting or there is no place to save the index.
+    string index_path;
+    if (IsIndexable(file->file_compression) && FLAGS_compressed_text_index_interval > 0 &&
+        range->offset() == 0 && range->len() == file->file_length &&
+        file->file_length >= 2 * FLAGS_compressed_text_index_interval &&
+        GetIndexPath(file, &index_path)) {
+      index_.reset(new CompressedFileIndex(file->file_compression, file->file_length));
+      if (compression == THdfsCompression::GZIP) {
+        static_cast<GzipDecompressor*>(decompressor_.get())->set_index(
+            index_.get(), FLAGS_compressed_text_index_interval);
+      }
+    }
+    return Status::OK;
+  }
+
+  // This range is a split of an indexed file, it starts and ends at access points (or
+  // the start or end of the file).
+  const CompressedFileIndex* index = metadata->index;
+  const vector<CompressedFileIndex::AccessPoint>& points = index->access_points();
+  int64_t start_offset = 0;
+  int64_t range_end = range->offset() + range->len();
+  int start = range->offset() == 0 ? -1 : index->Find(range->offset());
+  int end = range_end == file->file_length ? -1 : index->Find(range_end);
+  if ((range->offset() != 0 && start == -1) ||
+      (range_end != file->file_length && end == -1)) {
+    stringstream ss;
+    ss << "Scan range does not match the index of " << stream_->filename()
+       << " offset=" << range->offset() << " len=" << range->len();
+    return Status(ss.str());
+  }
+  if (start != -1) {
+    const CompressedFileIndex::AccessPoint& point = points[start];
+    start_offset = point.uncompressed_offset;
+    // Gzip access points are in the middle of the deflate data, which is decompressed
+    // without the gzip header.
+    if (compression == THdfsCompression::GZIP) compression = THdfsCompression::DEFLATE;
+    RETURN_IF_ERROR(UpdateDecompressor(compression));
+    if (compression == THdfsCompression::DEFLATE) {
+      uint8_t* prev_byte = NULL;
+      Status status;
+      if (point.bits != 0 && !stream_->ReadBytes(1, &prev_byte, &status)) return status;
+      RETURN_IF_ERROR(static_cast<GzipDecompressor*>(decompressor_.get())->ResumeAt(
+          point, prev_byte == NULL ? 0 : *prev_byte));
+    }
+  } else {
+    RETURN_IF_ERROR(UpdateDecompressor(compression));
+  }
+  if (end != -1) split_bytes_left_ = points[end].uncompressed_offset - start_offset;
+  return Status::OK;
+}
+
 Status HdfsTextScanner::ResetScanner() {
   error_in_row_ = false;
 
@@ -258,11 +442,14 @@ Status HdfsTextScanner::FinishScanRange() {
     Status status = Status::OK;
     byte_buffer_read_size_ = 0;
 
-    // If compressed text, then there is nothing more to be read.
+    // If compressed text, then there is nothing more to be read unless this is a split
+    // of an indexed file.
     // TODO: calling FillByteBuffer() at eof() can cause
     // ScannerContext::Stream::GetNextBuffer to DCHECK. Fix this.
     if (decompressor_.get() == NULL && !stream_->eof()) {
       status = FillByteBuffer(&eosr, NEXT_BLOCK_READ_SIZE);
+    } else if (decompressor_.get() != NULL && split_bytes_left_ == 0) {
+      status = FillByteBuffer(&eosr);
     }
 
     if (!status.ok() || byte_buffer_read_size_ == 0) {
@@ -416,25 +603,74 @@ Status HdfsTextScanner::FillByteBuffer(bool* eosr, int num_bytes) {
                                   &byte_buffer_read_size_);
     }
     *eosr = stream_->eosr();
-  } else if (!FLAGS_debug_disable_streaming_gzip &&
-      decompression_type_ == THdfsCompression::GZIP) {
+  } else if (past_split_len_ > 0) {
     DCHECK_EQ(num_bytes, 0);
-    RETURN_IF_ERROR(FillByteBufferGzip(eosr));
+    // Return the bytes that were decompressed past the end of the split.
+    byte_buffer_ptr_ = past_split_ptr_;
+    byte_buffer_read_size_ = past_split_len_;
+    past_split_len_ = 0;
+    *eosr = true;
   } else {
     DCHECK_EQ(num_bytes, 0);
-    RETURN_IF_ERROR(FillByteBufferCompressedFile(eosr));
+    if (!FLAGS_debug_disable_streaming_gzip &&
+        (decompression_type_ == THdfsCompression::GZIP ||
+         decompression_type_ == THdfsCompression::DEFLATE)) {
+      RETURN_IF_ERROR(FillByteBufferGzip(eosr));
+    } else if (decompression_type_ == THdfsCompression::SNAPPY ||
+        decompression_type_ == THdfsCompression::LZ4) {
+      RETURN_IF_ERROR(FillByteBufferBlockFramed(eosr));
+    } else {
+      RETURN_IF_ERROR(FillByteBufferCompressedFile(eosr));
+    }
+    if (split_bytes_left_ != -1) ClipToSplitEnd(eosr);
   }
 
   byte_buffer_end_ = byte_buffer_ptr_ + byte_buffer_read_size_;
   return status;
 }
 
+void HdfsTextScanner::ClipToSplitEnd(bool* eosr) {
+  if (split_bytes_left_ == 0) {
+    // Reading past the end of the split.
+    *eosr = true;
+  } else if (byte_buffer_read_size_ >= split_bytes_left_) {
+    past_split_ptr_ = byte_buffer_ptr_ + split_bytes_left_;
+    past_split_len_ = byte_buffer_read_size_ - split_bytes_left_;
+    byte_buffer_read_size_ = split_bytes_left_;
+    split_bytes_left_ = 0;
+    *eosr = true;
+  } else {
+    split_bytes_left_ -= byte_buffer_read_size_;
+  }
+}
+
+void HdfsTextScanner::SaveIndex() {
+  if (index_.get() == NULL) return;
+  string path;
+  if (!index_->access_points().empty() && GetIndexPath(stream_->file_desc(), &path)) {
+    Status status = index_->Save(path);
+    if (status.ok()) {
+      VLOG_FILE << "Saved the index of " << stream_->filename() << " with "
+                << index_->access_points().size() << " access points to " << path;
+    } else {
+      LOG(WARNING) << status.GetDetail();
+    }
+  }
+  index_.reset();
+}
+
 Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
   // Attach any previously decompressed buffers to the row batch before decompressing
   // any more data.
   if (!decompressor_->reuse_output_buffer()) {
     AttachPool(data_buffer_pool_.get(), false);
   }
+  if (decompressor_eos_) {
+    // Only happens when reading past the end of the last split of an indexed file.
+    byte_buffer_read_size_ = 0;
+    *eosr = true;
+    return Status::OK;
+  }
 
   // Gzip compressed text is decompressed as buffers are read from stream_ (unlike
   // other codecs which decompress the entire file in a single call). A compressed
@@ -449,8 +685,9 @@ Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
     uint8_t* gzip_buffer_ptr = NULL;
     int64_t gzip_buffer_size = 0;
     // We don't know how many bytes ProcessBlockStreaming() will consume so we set
-    // peak=true and then later advance the stream using SkipBytes().
-    if (!try_read_fixed_size) {
+    // peak=true and then later advance the stream using SkipBytes(). Splits of indexed
+    // files read past the end of the scan range, which GetBuffer() does not.
+    if (!try_read_fixed_size && !stream_->eosr()) {
       RETURN_IF_ERROR(stream_->GetBuffer(true, &gzip_buffer_ptr, &gzip_buffer_size));
     } else {
       Status status;
@@ -505,8 +742,13 @@ Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
   byte_buffer_read_size_ = decompressed_len;
 
   if (*eosr) {
-    if (!stream_->eosr()) {
+    decompressor_eos_ = true;
+    // The deflate data of splits of indexed files ends before the gzip trailer.
+    if (decompression_type_ == THdfsCompression::GZIP && !stream_->eosr()) {
       // TODO: Add a test case that exercises this path.
+      // The index only covers the first gzip member, splitting the file at its access
+      // points would lose the data after it.
+      index_.reset();
       stringstream ss;
       ss << "Unexpected end of gzip stream before end of file: ";
       ss << stream_->filename();
@@ -518,10 +760,83 @@ Status HdfsTextScanner::FillByteBufferGzip(bool* eosr) {
     }
 
     context_->ReleaseCompletedResources(NULL, true);
+    SaveIndex();
   }
   return Status::OK;
 }
 
+Status HdfsTextScanner::FillByteBufferBlockFramed(bool* eosr) {
+  // Attach any previously decompressed blocks to the row batch before decompressing
+  // the next one.
+  if (!decompressor_->reuse_output_buffer()) {
+    AttachPool(data_buffer_pool_.get(), false);
+    block_buffer_ = NULL;
+    block_buffer_len_ = 0;
+  }
+  byte_buffer_read_size_ = 0;
+  if (stream_->eof()) {
+    *eosr = true;
+    return Status::OK;
+  }
+
+  if (index_.get() != NULL &&
+      stream_->file_offset() - last_access_point_offset_ >=
+          FLAGS_compressed_text_index_interval) {
+    last_access_point_offset_ = stream_->file_offset();
+    index_->AddAccessPoint(last_access_point_offset_, block_uncompressed_offset_);
+  }
+
+  Status status;
+  int32_t block_len;
+  if (!stream_->ReadInt(&block_len, &status)) return status;
+  if (block_len < 0) {
+    stringstream ss;
+    ss << "Invalid block length " << block_len << " decompressing "
+       << stream_->filename() << " at offset " << stream_->file_offset();
+    return Status(ss.str());
+  }
+  if (block_buffer_len_ < block_len) {
+    block_buffer_ = data_buffer_pool_->Allocate(block_len);
+    block_buffer_len_ = block_len;
+  }
+
+  // Decompress the chunks of the block until the block is complete.
+  int64_t decompressed_len = 0;
+  while (decompressed_len < block_len) {
+    int32_t compressed_len;
+    uint8_t* compressed_data;
+    if (!stream_->ReadInt(&compressed_len, &status)) return status;
+    if (compressed_len <= 0 ||
+        !stream_->ReadBytes(compressed_len, &compressed_data, &status)) {
+      stringstream ss;
+      ss << "Invalid compressed chunk decompressing " << stream_->filename()
+         << " at offset " << stream_->file_offset() << " " << status.GetDetail();
+      return Status(ss.str());
+    }
+    uint8_t* output = block_buffer_ + decompressed_len;
+    int64_t output_len = block_len - decompressed_len;
+    {
+      SCOPED_TIMER(decompress_timer_);
+      RETURN_IF_ERROR(decompressor_->ProcessBlock(true, compressed_len, compressed_data,
+          &output_len, &output));
+    }
+    if (output_len == 0) {
+      stringstream ss;
+      ss << "Empty compressed chunk decompressing " << stream_->filename()
+         << " at offset " << stream_->file_offset();
+      return Status(ss.str());
+    }
+    decompressed_len += output_len;
+  }
+
+  block_uncompressed_offset_ += block_len;
+  byte_buffer_ptr_ = reinterpret_cast<char*>(block_buffer_);
+  byte_buffer_read_size_ = block_len;
+  *eosr = stream_->eosr();
+  if (stream_->eof()) SaveIndex();
+  return Status::OK;
+}
+
 Status HdfsTextScanner::FillByteBufferCompressedFile(bool* eosr) {
   // For other compressed text: attempt to read and decompress the entire file, point
   // to the decompressed buffer, and then continue normal processing.
@@ -16,11 +16,13 @@
 #ifndef IMPALA_EXEC_HDFS_TEXT_SCANNER_H
 #define IMPALA_EXEC_HDFS_TEXT_SCANNER_H
 
+#include "common/atomic.h"
 #include "exec/hdfs-scanner.h"
 #include "runtime/string-buffer.h"
 
 namespace impala {
 
+class CompressedFileIndex;
 class DelimitedTextParser;
 class ScannerContext;
 struct HdfsFileDesc;
@@ -48,6 +50,10 @@ class HdfsTextScanner : public HdfsScanner {
   // Suffix for lzo index files.
   const static std::string LZO_INDEX_SUFFIX;
 
+  // Name of the sidecar file in the dfs cache that holds the index of a compressed text
+  // file (see cacheGetSidecarPath()).
+  const static char* COMPRESSED_FILE_INDEX_SIDECAR;
+
   static const char* LLVM_CLASS_NAME;
 
  protected:
@@ -70,10 +76,48 @@ class HdfsTextScanner : public HdfsScanner {
  private:
   const static int NEXT_BLOCK_READ_SIZE = 1024; //bytes
 
+  // Compressed text files are not splittable by themselves. The first scan of a gzip,
+  // snappy or lz4 compressed file decompresses the whole file and records the access
+  // points of the file in a CompressedFileIndex, which is saved next to the file in the
+  // dfs cache. Later scans split the file at the access points and decompress the
+  // splits in parallel. Splits are issued only if this node is assigned all the byte
+  // ranges of the file, because the index is local to this node. The splits end at
+  // the uncompressed offset of the next access point and are processed like splits of
+  // uncompressed text, i.e. the scanner skips the partial first tuple and reads past
+  // the end of the split to finish the last one.
+  // This is the file metadata (see HdfsScanNode::GetFileMetadata()) of such files.
+  struct IndexedFileMetadata {
+    const CompressedFileIndex* index;
+
+    // Number of splits of the file. The ranges at the access points replace them, so
+    // they are reported complete when the last range is done.
+    int num_splits;
+
+    // Number of ranges of the file that are not done yet.
+    AtomicInt<int> ranges_left;
+  };
+
+  // Returns the index of 'file' saved by a previous scan, or NULL if there is none or
+  // if the file is not splittable with an index. The index is owned by the object pool
+  // of the runtime state.
+  static const CompressedFileIndex* LoadIndex(HdfsScanNode* scan_node,
+      const HdfsFileDesc* file);
+
+  // Issues ranges for 'file' that start at the access points of 'index' and adds them
+  // to 'ranges'.
+  static void IssueIndexedRanges(HdfsScanNode* scan_node, HdfsFileDesc* file,
+      const CompressedFileIndex* index, std::vector<DiskIoMgr::ScanRange*>* ranges);
+
   // Initializes this scanner for this context.  The context maps to a single
   // scan range.
   virtual Status InitNewRange();
 
+  // Creates the decompressor for the file of the scan range and, if the range is a
+  // split of an indexed compressed file, positions it at the access point the range
+  // starts at. If the range covers the whole file and the file can be indexed, sets up
+  // index_ to record the access points while decompressing.
+  Status InitDecompressor();
+
   // Finds the start of the first tuple in this scan range and initializes
   // byte_buffer_ptr to be the next character (the start of the first tuple).  If
   // there are no tuples starts in the entire range, *tuple_found is set to false
@@ -107,6 +151,20 @@ class HdfsTextScanner : public HdfsScanner {
   // to available decompressed data.
   Status FillByteBufferGzip(bool* eosr);
 
+  // Fills the next byte buffer with the next block of snappy or lz4 compressed data in
+  // Hadoop's block compression framing: each block is the 4 byte uncompressed length of
+  // the block followed by chunks of compressed data, each prefixed by its 4 byte
+  // compressed length.
+  Status FillByteBufferBlockFramed(bool* eosr);
+
+  // If this range is a split of an indexed file, ends the byte buffer at the end of the
+  // split and sets *eosr. The remaining decompressed bytes are returned by the next
+  // FillByteBuffer() call, when reading past the end of the split.
+  void ClipToSplitEnd(bool* eosr);
+
+  // Saves index_ in the dfs cache if the whole file was decompressed.
+  void SaveIndex();
+
   // Prepends field data that was from the previous file buffer (This field straddled two
   // file buffers).  'data' already contains the pointer/len from the current file buffer,
   // boundary_column_ contains the beginning of the data from the previous file
@@ -178,6 +236,31 @@ class HdfsTextScanner : public HdfsScanner {
 
   // Time parsing text files
   RuntimeProfile::Counter* parse_delimiter_timer_;
+
+  // If this range is a split of an indexed compressed file, the number of decompressed
+  // bytes until the end of the split, -1 otherwise (the range ends at the end of the
+  // file).
+  int64_t split_bytes_left_;
+
+  // Decompressed bytes past the end of the split.
+  char* past_split_ptr_;
+  int64_t past_split_len_;
+
+  // True if the decompressor reached the end of the compressed data.
+  bool decompressor_eos_;
+
+  // The index that is built while decompressing the whole file, NULL if no index is
+  // built.
+  boost::scoped_ptr<CompressedFileIndex> index_;
+
+  // Snappy and lz4 only: offset of the last access point added to index_ and the
+  // uncompressed offset of the next block.
+  int64_t last_access_point_offset_;
+  int64_t block_uncompressed_offset_;
+
+  // Snappy and lz4 only: the buffer for the decompressed block.
+  uint8_t* block_buffer_;
+  int64_t block_buffer_len_;
 };
 
 }
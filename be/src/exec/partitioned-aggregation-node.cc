@@ -21,6 +21,7 @@
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "exec/hash-table.inline.h"
 #include "exprs/agg-fn-evaluator.h"
 #include "exprs/expr.h"
@@ -242,8 +243,11 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
     }
 
     SCOPED_TIMER(build_timer_);
-    if (process_row_batch_fn_ != NULL) {
-      RETURN_IF_ERROR(process_row_batch_fn_(this, &batch, ht_ctx_.get()));
+    // The codegen'd function may be published concurrently (see --async_codegen).
+    ProcessRowBatchFn process_row_batch_fn =
+        AtomicUtil::LoadAcquire(&process_row_batch_fn_);
+    if (process_row_batch_fn != NULL) {
+      RETURN_IF_ERROR(process_row_batch_fn(this, &batch, ht_ctx_.get()));
     } else if (probe_expr_ctxs_.empty()) {
       RETURN_IF_ERROR(ProcessBatchNoGrouping(&batch));
     } else {
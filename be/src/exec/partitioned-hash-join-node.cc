@@ -18,6 +18,7 @@
 #include <gutil/strings/substitute.h>
 
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "exec/hash-table.inline.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
@@ -545,14 +546,21 @@ Status PartitionedHashJoinNode::ProcessBuildInput(RuntimeState* state, int level
     total_build_rows += build_batch.num_rows();
 
     SCOPED_TIMER(partition_build_timer_);
-    if (process_build_batch_fn_ == NULL || ht_ctx_->level() != 0) {
+    // The codegen'd functions may be published concurrently (see --async_codegen).
+    // process_build_batch_fn_ is published last, so once it is set so is the level 0
+    // variant.
+    ProcessBuildBatchFn process_build_batch_fn =
+        AtomicUtil::LoadAcquire(&process_build_batch_fn_);
+    if (process_build_batch_fn == NULL || ht_ctx_->level() != 0) {
       RETURN_IF_ERROR(ProcessBuildBatch(&build_batch));
     } else {
-      DCHECK_NOTNULL(process_build_batch_fn_level0_);
+      ProcessBuildBatchFn process_build_batch_fn_level0 =
+          AtomicUtil::LoadAcquire(&process_build_batch_fn_level0_);
+      DCHECK_NOTNULL(process_build_batch_fn_level0);
       if (ht_ctx_->level() == 0) {
-        RETURN_IF_ERROR(process_build_batch_fn_level0_(this, &build_batch));
+        RETURN_IF_ERROR(process_build_batch_fn_level0(this, &build_batch));
       } else {
-        RETURN_IF_ERROR(process_build_batch_fn_(this, &build_batch));
+        RETURN_IF_ERROR(process_build_batch_fn(this, &build_batch));
       }
     }
     build_batch.Reset();
@@ -791,14 +799,19 @@ Status PartitionedHashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch
       // the xcompiled function, so call it here instead.
       int rows_added = 0;
       SCOPED_TIMER(probe_timer_);
-      if (process_probe_batch_fn_ == NULL || ht_ctx_->level() != 0) {
+      // See the build side for the loads of the codegen'd functions.
+      ProcessProbeBatchFn process_probe_batch_fn =
+          AtomicUtil::LoadAcquire(&process_probe_batch_fn_);
+      if (process_probe_batch_fn == NULL || ht_ctx_->level() != 0) {
         rows_added = ProcessProbeBatch(join_op_, out_batch, ht_ctx_.get());
       } else {
-        DCHECK_NOTNULL(process_probe_batch_fn_level0_);
+        ProcessProbeBatchFn process_probe_batch_fn_level0 =
+            AtomicUtil::LoadAcquire(&process_probe_batch_fn_level0_);
+        DCHECK_NOTNULL(process_probe_batch_fn_level0);
         if (ht_ctx_->level() == 0) {
-          rows_added = process_probe_batch_fn_level0_(this, out_batch, ht_ctx_.get());
+          rows_added = process_probe_batch_fn_level0(this, out_batch, ht_ctx_.get());
         } else {
-          rows_added = process_probe_batch_fn_(this, out_batch, ht_ctx_.get());
+          rows_added = process_probe_batch_fn(this, out_batch, ht_ctx_.get());
         }
       }
       if (UNLIKELY(rows_added < 0)) {
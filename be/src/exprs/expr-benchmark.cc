@@ -7,6 +7,10 @@
 
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "exprs/literal.h"
+#include "exprs/slot-ref.h"
+#include "runtime/runtime-state.h"
+#include "runtime/tuple-row.h"
 #include "util/benchmark.h"
 #include "util/cpu-info.h"
 #include "util/debug-util.h"
@@ -497,6 +501,112 @@ Benchmark* BenchmarkTimestampFunctions() {
   return suite;
 }
 
+// Rows evaluated per iteration of the predicate benchmarks. Multiply the rates by this
+// to get the number of rows per ms.
+const int NUM_PREDICATE_ROWS = 1024;
+
+struct PredicateTestData {
+  ExprContext* ctx;
+  // Rows of one tuple with an INT at offset 0 and a DOUBLE at offset 8.
+  vector<int64_t> tuple_mem;
+  vector<Tuple*> row_mem;
+  vector<TupleRow*> rows;
+  // Copy of 'rows' filtered by EvalPredicate().
+  vector<TupleRow*> selected_rows;
+  int64_t dummy_result;
+};
+
+// Returns a builtin function call of 'symbol' over 'child0' and 'child1'.
+static Expr* CreateBuiltinCall(const string& symbol, PrimitiveType type, Expr* child0,
+    Expr* child1) {
+  TExprNode node;
+  node.node_type = TExprNodeType::FUNCTION_CALL;
+  node.type = ColumnType(type).ToThrift();
+  node.num_children = 0;
+  node.__isset.fn = true;
+  node.fn.binary_type = TFunctionBinaryType::BUILTIN;
+  node.fn.__isset.scalar_fn = true;
+  node.fn.scalar_fn.symbol = symbol;
+  TExpr texpr;
+  texpr.nodes.push_back(node);
+  ExprContext* ctx;
+  EXIT_IF_ERROR(Expr::CreateExprTree(&pool, texpr, &ctx));
+  ctx->root()->AddChild(child0);
+  ctx->root()->AddChild(child1);
+  return ctx->root();
+}
+
+// Returns the test data for 'predicate' over rows with increasing values.
+static PredicateTestData* GeneratePredicateData(RuntimeState* state, Expr* predicate) {
+  PredicateTestData* data = new PredicateTestData;
+  data->ctx = pool.Add(new ExprContext(predicate));
+  EXIT_IF_ERROR(data->ctx->Prepare(state, RowDescriptor(), &tracker));
+  EXIT_IF_ERROR(data->ctx->Open(state));
+  data->tuple_mem.resize(NUM_PREDICATE_ROWS * 2);
+  data->row_mem.resize(NUM_PREDICATE_ROWS);
+  data->rows.resize(NUM_PREDICATE_ROWS);
+  for (int i = 0; i < NUM_PREDICATE_ROWS; ++i) {
+    int64_t* tuple = &data->tuple_mem[i * 2];
+    *reinterpret_cast<int32_t*>(tuple) = i;
+    *reinterpret_cast<double*>(tuple + 1) = i * 0.5;
+    data->row_mem[i] = reinterpret_cast<Tuple*>(tuple);
+    data->rows[i] = reinterpret_cast<TupleRow*>(&data->row_mem[i]);
+  }
+  data->dummy_result = 0;
+  return data;
+}
+
+// Evaluates the predicate on each row.
+void BenchmarkRowPredicateFn(int batch_size, void* d) {
+  PredicateTestData* data = reinterpret_cast<PredicateTestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < NUM_PREDICATE_ROWS; ++j) {
+      BooleanVal v = data->ctx->GetBooleanVal(data->rows[j]);
+      data->dummy_result += !v.is_null && v.val;
+    }
+  }
+}
+
+// Evaluates the predicate over all rows at once.
+void BenchmarkBatchPredicateFn(int batch_size, void* d) {
+  PredicateTestData* data = reinterpret_cast<PredicateTestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    data->selected_rows = data->rows;
+    data->dummy_result +=
+        data->ctx->EvalPredicate(&data->selected_rows[0], NUM_PREDICATE_ROWS);
+  }
+}
+
+// Compares the row at a time and the batch evaluation of predicates on slots of a
+// tuple with 1024 rows per iteration (see ExprContext::EvalPredicate()).
+Benchmark* BenchmarkPredicates(RuntimeState* state) {
+  const string LT_INT = "_ZN6impala9Operators16Lt_IntVal_IntValEPN10impala_udf15"
+      "FunctionContextERKNS1_6IntValES6_";
+  const string GT_DOUBLE = "_ZN6impala9Operators22Gt_DoubleVal_DoubleValEPN10impala_udf"
+      "15FunctionContextERKNS1_9DoubleValES6_";
+  const string ADD_DOUBLE = "_ZN6impala9Operators23Add_DoubleVal_DoubleValEPN10"
+      "impala_udf15FunctionContextERKNS1_9DoubleValES6_";
+
+  Benchmark* suite = new Benchmark("Predicates");
+  // int_col < 500
+  Expr* lt_int = CreateBuiltinCall(LT_INT, TYPE_BOOLEAN,
+      pool.Add(new SlotRef(TYPE_INT, 0)), pool.Add(new Literal(TYPE_INT, 500)));
+  suite->AddBenchmark("int lt, row", BenchmarkRowPredicateFn,
+      GeneratePredicateData(state, lt_int));
+  suite->AddBenchmark("int lt, batch", BenchmarkBatchPredicateFn,
+      GeneratePredicateData(state, lt_int));
+  // double_col + 1.5 > 100
+  Expr* gt_double = CreateBuiltinCall(GT_DOUBLE, TYPE_BOOLEAN,
+      CreateBuiltinCall(ADD_DOUBLE, TYPE_DOUBLE, pool.Add(new SlotRef(TYPE_DOUBLE, 8)),
+          pool.Add(new Literal(TYPE_DOUBLE, 1.5))),
+      pool.Add(new Literal(TYPE_DOUBLE, 100.0)));
+  suite->AddBenchmark("double add gt, row", BenchmarkRowPredicateFn,
+      GeneratePredicateData(state, gt_double));
+  suite->AddBenchmark("double add gt, batch", BenchmarkBatchPredicateFn,
+      GeneratePredicateData(state, gt_double));
+  return suite;
+}
+
 int main(int argc, char** argv) {
   CpuInfo::Init();
 
@@ -510,6 +620,8 @@ int main(int argc, char** argv) {
   Benchmark* url_fns = BenchmarkUrlFunctions();
   Benchmark* math_fns = BenchmarkMathFunctions();
   Benchmark* timestamp_fns = BenchmarkTimestampFunctions();
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", NULL);
+  Benchmark* predicates = BenchmarkPredicates(&state);
 
   cout << Benchmark::GetMachineInfo() << endl;
   cout << literals->Measure() << endl;
@@ -521,6 +633,7 @@ int main(int argc, char** argv) {
   cout << url_fns->Measure() << endl;
   cout << math_fns->Measure() << endl;
   cout << timestamp_fns->Measure() << endl;
+  cout << predicates->Measure() << endl;
 
   return 0;
 }
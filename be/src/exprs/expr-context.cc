@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "exprs/expr.h"
+#include "exprs/vectorized-expr.h"
 #include "runtime/mem-pool.h"
 #include "runtime/runtime-state.h"
 #include "udf/udf-internal.h"
@@ -33,7 +34,8 @@ ExprContext::ExprContext(Expr* root)
     is_clone_(false),
     prepared_(false),
     opened_(false),
-    closed_(false) {
+    closed_(false),
+    vectorized_root_created_(false) {
 }
 
 ExprContext::~ExprContext() {
@@ -68,6 +70,7 @@ void ExprContext::Close(RuntimeState* state) {
   FunctionContext::FunctionStateScope scope =
       is_clone_? FunctionContext::THREAD_LOCAL : FunctionContext::FRAGMENT_LOCAL;
   root_->Close(state, this, scope);
+  vectorized_root_.reset();
 
   for (int i = 0; i < fn_contexts_.size(); ++i) {
     fn_contexts_[i]->impl()->Close();
@@ -336,3 +339,65 @@ TimestampVal ExprContext::GetTimestampVal(TupleRow* row) {
 DecimalVal ExprContext::GetDecimalVal(TupleRow* row) {
   return root_->GetDecimalVal(this, row);
 }
+
+VectorizedExpr* ExprContext::GetVectorizedRoot() {
+  if (!vectorized_root_created_) {
+    DCHECK(prepared_);
+    DCHECK(!closed_);
+    vectorized_root_.reset(VectorizedExpr::Create(this));
+    vectorized_root_created_ = true;
+  }
+  return vectorized_root_.get();
+}
+
+int ExprContext::EvalPredicate(TupleRow** rows, int num_rows) {
+  DCHECK_EQ(root_->type_.type, TYPE_BOOLEAN);
+  VectorizedExpr* vectorized_root = GetVectorizedRoot();
+  int num_selected = 0;
+  if (vectorized_root == NULL) {
+    for (int i = 0; i < num_rows; ++i) {
+      BooleanVal v = root_->GetBooleanVal(this, rows[i]);
+      if (!v.is_null && v.val) rows[num_selected++] = rows[i];
+    }
+    return num_selected;
+  }
+
+  for (int start = 0; start < num_rows; start += VectorizedExpr::CHUNK_SIZE) {
+    int n = min(num_rows - start, VectorizedExpr::CHUNK_SIZE);
+    const void* values;
+    const uint8_t* nulls;
+    vectorized_root->Eval(rows + start, n, &values, &nulls);
+    const bool* results = reinterpret_cast<const bool*>(values);
+    // Compact without branching on the result: num_selected <= start + i, so this only
+    // overwrites rows that were already evaluated.
+    for (int i = 0; i < n; ++i) {
+      rows[num_selected] = rows[start + i];
+      num_selected += results[i] & !nulls[i];
+    }
+  }
+  return num_selected;
+}
+
+void ExprContext::EvalBatch(TupleRow** rows, int num_rows, void* values, uint8_t* nulls) {
+  int byte_size = root_->type_.GetByteSize();
+  DCHECK_GT(byte_size, 0);
+  uint8_t* out = reinterpret_cast<uint8_t*>(values);
+  VectorizedExpr* vectorized_root = GetVectorizedRoot();
+  if (vectorized_root == NULL) {
+    for (int i = 0; i < num_rows; ++i) {
+      void* value = GetValue(root_, rows[i]);
+      nulls[i] = value == NULL;
+      if (value != NULL) memcpy(out + i * byte_size, value, byte_size);
+    }
+    return;
+  }
+
+  for (int start = 0; start < num_rows; start += VectorizedExpr::CHUNK_SIZE) {
+    int n = min(num_rows - start, VectorizedExpr::CHUNK_SIZE);
+    const void* chunk_values;
+    const uint8_t* chunk_nulls;
+    vectorized_root->Eval(rows + start, n, &chunk_values, &chunk_nulls);
+    memcpy(out + start * byte_size, chunk_values, n * byte_size);
+    memcpy(nulls + start, chunk_nulls, n);
+  }
+}
@@ -32,6 +32,7 @@ class RuntimeState;
 class RowDescriptor;
 class TColumnValue;
 class TupleRow;
+class VectorizedExpr;
 
 // An ExprContext contains the state for the execution of a tree of Exprs, in particular
 // the FunctionContexts necessary for the expr tree. This allows for multi-threaded
@@ -117,6 +118,19 @@ class ExprContext {
   TimestampVal GetTimestampVal(TupleRow* row);
   DecimalVal GetDecimalVal(TupleRow* row);
 
+  // Evaluates the root, which must be a predicate, over rows[0, num_rows) and moves the
+  // rows for which it returns true to the front of 'rows', in order. Returns the number
+  // of those rows. Same as calling GetBooleanVal() on each row, but trees of numeric
+  // slot refs, constants, arithmetic, casts, comparisons, IS [NOT] NULL and AND/OR are
+  // evaluated a chunk of rows at a time (see VectorizedExpr).
+  int EvalPredicate(TupleRow** rows, int num_rows);
+
+  // Evaluates the root over rows[0, num_rows). Writes the values into 'values', an array
+  // of num_rows slots of the root's type (e.g. int32_t for INT), and sets nulls[i] to 1
+  // if the value of row i is NULL, in which case values[i] is undefined. The root must be
+  // of a fixed-size type.
+  void EvalBatch(TupleRow** rows, int num_rows, void* values, uint8_t* nulls);
+
   // Frees all local allocations made by fn_contexts_. This can be called when result data
   // from this context is no longer needed.
   void FreeLocalAllocations();
@@ -130,6 +144,7 @@ class ExprContext {
   // Users of private GetValue()
   friend class HiveUdfCall;
   friend class ScalarFnCall;
+  friend class VectorizedExpr;
 
   // FunctionContexts for each registered expression. The FunctionContexts are created and
   // owned by this ExprContext.
@@ -156,6 +171,14 @@ class ExprContext {
   bool opened_;
   bool closed_;
 
+  // Vectorized version of root_, created on the first EvalPredicate() or EvalBatch()
+  // call. NULL if root_ cannot be vectorized.
+  boost::scoped_ptr<VectorizedExpr> vectorized_root_;
+  bool vectorized_root_created_;
+
+  // Creates vectorized_root_ if it was not created yet and returns it.
+  VectorizedExpr* GetVectorizedRoot();
+
   // Calls the appropriate Get*Val() function on 'e' and stores the result in result_.
   // This is used by Exprs to call GetValue() on a child expr, rather than root_.
   void* GetValue(Expr* e, TupleRow* row);
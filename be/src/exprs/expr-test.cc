@@ -26,6 +26,7 @@
 #include <gtest/gtest.h>
 
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "common/init.h"
 #include "common/object-pool.h"
 #include "exprs/expr-context.h"
@@ -33,6 +34,8 @@
 #include "exprs/like-predicate.h"
 #include "exprs/literal.h"
 #include "exprs/null-literal.h"
+#include "exprs/scalar-fn-call.h"
+#include "exprs/slot-ref.h"
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/hive_metastore_types.h"
 #include "rpc/thrift-client.h"
@@ -40,6 +43,7 @@
 #include "runtime/raw-value.h"
 #include "runtime/string-value.h"
 #include "runtime/timestamp-value.h"
+#include "runtime/tuple-row.h"
 #include "service/fe-support.h"
 #include "service/impala-server.h"
 #include "testutil/impalad-query-executor.h"
@@ -54,6 +58,7 @@ DECLARE_string(impalad);
 DECLARE_bool(abort_on_config_error);
 DECLARE_bool(disable_optimization_passes);
 DECLARE_bool(use_utc_for_unix_timestamp_conversions);
+DECLARE_bool(async_codegen);
 
 using namespace impala;
 using namespace llvm;
@@ -167,6 +172,11 @@ class ExprTest : public testing::Test {
   // This is used to hold the return values from the query executor.
   ExprValue expr_value_;
 
+  // Returns the JIT'd wrapper of 'fn_call', NULL until its module is compiled.
+  static void* GetScalarFnWrapper(ScalarFnCall* fn_call) {
+    return AtomicUtil::LoadAcquire(&fn_call->scalar_fn_wrapper_);
+  }
+
   virtual void SetUp() {
     min_int_values_[TYPE_TINYINT] = 1;
     min_int_values_[TYPE_SMALLINT] =
@@ -1529,6 +1539,31 @@ TEST_F(ExprTest, InPredicate) {
               TYPE_BOOLEAN, true);
   }
 
+  // Test long lists, which are looked up in a hash set, and lists of every length that
+  // is compared with SSE.
+  for (int n = 1; n <= 70; ++n) {
+    stringstream list;
+    for (int i = 0; i < n; ++i) list << (i == 0 ? "" : ", ") << i * 3;
+    TestValue("0 in (" + list.str() + ")", TYPE_BOOLEAN, true);
+    TestValue(lexical_cast<string>((n - 1) * 3) + " in (" + list.str() + ")",
+        TYPE_BOOLEAN, true);
+    TestValue("1 in (" + list.str() + ")", TYPE_BOOLEAN, false);
+    TestValue("cast(-3 as bigint) in (" + list.str() + ")", TYPE_BOOLEAN, false);
+    TestValue("cast(3 as tinyint) not in (" + list.str() + ")", TYPE_BOOLEAN, n == 1);
+    TestIsNull("1 in (" + list.str() + ", NULL)", TYPE_BOOLEAN);
+  }
+  stringstream timestamps;
+  for (int i = 0; i < 100; ++i) {
+    timestamps << (i == 0 ? "" : ", ") << "cast('2011-11-" << 10 + i % 20 << " 09:10:"
+               << 10 + i / 20 << "' as timestamp)";
+  }
+  TestValue("cast('2011-11-15 09:10:13' as timestamp) in (" + timestamps.str() + ")",
+      TYPE_BOOLEAN, true);
+  TestValue("cast('2011-11-15 09:10:15' as timestamp) in (" + timestamps.str() + ")",
+      TYPE_BOOLEAN, false);
+  TestValue("cast(-0.0 as double) in (1.5, 2.5, 0.0, 3.5, 4.5, 5.5, 6.5, 7.5)",
+      TYPE_BOOLEAN, true);
+
   // Test operator precedence.
   TestValue("5+1 in (3, 6, 10)", TYPE_BOOLEAN, true);
   TestValue("5+1 not in (3, 6, 10)", TYPE_BOOLEAN, false);
@@ -3983,6 +4018,281 @@ void ValidateLayout(const vector<Expr*>& exprs, int expected_byte_size,
   }
 }
 
+// Test SlotRef over tuple 0 whose null indicator is 'null_bit' of the byte at
+// 'null_byte_offset'.
+class NullableSlotRef : public SlotRef {
+ public:
+  NullableSlotRef(const ColumnType& type, int offset, int null_byte_offset, int null_bit)
+    : SlotRef(type, offset) {
+    null_indicator_offset_ = NullIndicatorOffset(null_byte_offset, null_bit);
+  }
+};
+
+// Boolean expr that is not vectorized: returns whether its INT child is odd and counts
+// the rows it is evaluated over.
+class CountingPredicate : public Expr {
+ public:
+  CountingPredicate(Expr* child) : Expr(TYPE_BOOLEAN), num_calls_(0) { AddChild(child); }
+
+  virtual BooleanVal GetBooleanVal(ExprContext* context, TupleRow* row) {
+    ++num_calls_;
+    IntVal v = children_[0]->GetIntVal(context, row);
+    if (v.is_null) return BooleanVal::null();
+    return BooleanVal(v.val % 2 != 0);
+  }
+
+  virtual bool IsConstant() const { return false; }
+
+  virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
+    return Status("Not implemented");
+  }
+
+  int num_calls_;
+};
+
+// Returns a builtin expr of 'node_type' that calls 'symbol' over the given children.
+Expr* CreateBuiltinExpr(ObjectPool* pool, TExprNodeType::type node_type,
+    const string& fn_name, const string& symbol, PrimitiveType type, Expr* child0,
+    Expr* child1 = NULL) {
+  TExprNode node;
+  node.node_type = node_type;
+  node.type = ColumnType(type).ToThrift();
+  node.num_children = 0;
+  node.__isset.fn = true;
+  node.fn.name.function_name = fn_name;
+  node.fn.binary_type = TFunctionBinaryType::BUILTIN;
+  node.fn.__isset.scalar_fn = true;
+  node.fn.scalar_fn.symbol = symbol;
+  TExpr texpr;
+  texpr.nodes.push_back(node);
+  ExprContext* ctx;
+  EXPECT_TRUE(Expr::CreateExprTree(pool, texpr, &ctx).ok());
+  ctx->root()->AddChild(child0);
+  if (child1 != NULL) ctx->root()->AddChild(child1);
+  return ctx->root();
+}
+
+// Checks that the batch evaluation of exprs (ExprContext::EvalPredicate() and
+// EvalBatch()) returns the same results as evaluating each row.
+TEST_F(ExprTest, VectorizedEval) {
+  const string LT_INT = "_ZN6impala9Operators16Lt_IntVal_IntValEPN10impala_udf15"
+      "FunctionContextERKNS1_6IntValES6_";
+  const string GE_INT = "_ZN6impala9Operators16Ge_IntVal_IntValEPN10impala_udf15"
+      "FunctionContextERKNS1_6IntValES6_";
+  const string NE_INT = "_ZN6impala9Operators16Ne_IntVal_IntValEPN10impala_udf15"
+      "FunctionContextERKNS1_6IntValES6_";
+  const string GT_DOUBLE = "_ZN6impala9Operators22Gt_DoubleVal_DoubleValEPN10impala_udf"
+      "15FunctionContextERKNS1_9DoubleValES6_";
+  const string ADD_BIGINT = "_ZN6impala9Operators23Add_BigIntVal_BigIntValEPN10"
+      "impala_udf15FunctionContextERKNS1_9BigIntValES6_";
+  const string LT_BIGINT = "_ZN6impala9Operators22Lt_BigIntVal_BigIntValEPN10impala_udf"
+      "15FunctionContextERKNS1_9BigIntValES6_";
+  const string CAST_INT_TO_BIGINT = "_ZN6impala13CastFunctions15CastToBigIntValEPN10"
+      "impala_udf15FunctionContextERKNS1_6IntValE";
+  const string IS_NULL_INT = "_ZN6impala15IsNullPredicate6IsNullIN10impala_udf6IntValEEE"
+      "NS2_10BooleanValEPNS2_15FunctionContextERKT_";
+
+  // Tuples of an INT at offset 0, a BIGINT at offset 8 and a DOUBLE at offset 16, with
+  // their null indicators in byte 24. Every 7th row has a NULL tuple. The number of rows
+  // is not a multiple of the chunk or SSE sizes.
+  const int NUM_ROWS = 2500;
+  const int TUPLE_SIZE = 32;
+  vector<int64_t> tuple_mem(NUM_ROWS * TUPLE_SIZE / sizeof(int64_t));
+  vector<Tuple*> row_mem(NUM_ROWS);
+  vector<TupleRow*> rows(NUM_ROWS);
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    uint8_t* tuple = reinterpret_cast<uint8_t*>(&tuple_mem[0]) + i * TUPLE_SIZE;
+    *reinterpret_cast<int32_t*>(tuple) = i % 100 - 50;
+    *reinterpret_cast<int64_t*>(tuple + 8) = i * 3;
+    *reinterpret_cast<double*>(tuple + 16) = i * 0.5;
+    tuple[24] = (i % 5 == 0 ? 1 : 0) | (i % 11 == 0 ? 2 : 0);
+    row_mem[i] = i % 7 == 0 ? NULL : reinterpret_cast<Tuple*>(tuple);
+    rows[i] = reinterpret_cast<TupleRow*>(&row_mem[i]);
+  }
+
+  ObjectPool pool;
+#define INT_SLOT pool.Add(new NullableSlotRef(TYPE_INT, 0, 24, 0))
+#define BIGINT_SLOT pool.Add(new NullableSlotRef(TYPE_BIGINT, 8, 24, 1))
+#define DOUBLE_SLOT pool.Add(new SlotRef(TYPE_DOUBLE, 16))
+#define CALL(name, symbol, type, ...) \
+  CreateBuiltinExpr(&pool, TExprNodeType::FUNCTION_CALL, name, symbol, type, __VA_ARGS__)
+#define COMPOUND(name, child0, child1) \
+  CreateBuiltinExpr(&pool, TExprNodeType::COMPOUND_PRED, name, "", TYPE_BOOLEAN, \
+      child0, child1)
+// int_col < 10
+#define INT_LT_10 CALL("lt", LT_INT, TYPE_BOOLEAN, INT_SLOT, \
+    pool.Add(new Literal(TYPE_INT, 10)))
+// 10 >= int_col
+#define INT_GE_10 CALL("ge", GE_INT, TYPE_BOOLEAN, pool.Add(new Literal(TYPE_INT, 10)), \
+    INT_SLOT)
+// double_col > 600
+#define DOUBLE_GT_600 CALL("gt", GT_DOUBLE, TYPE_BOOLEAN, DOUBLE_SLOT, \
+    pool.Add(new Literal(TYPE_DOUBLE, 600.0)))
+// bigint_col + 3
+#define BIGINT_PLUS_3 CALL("add", ADD_BIGINT, TYPE_BIGINT, BIGINT_SLOT, \
+    pool.Add(new Literal(TYPE_BIGINT, 3L)))
+// bigint_col + 3 < cast(int_col as bigint) + 1000
+#define BIGINT_LT_INT CALL("lt", LT_BIGINT, TYPE_BOOLEAN, BIGINT_PLUS_3, \
+    CALL("add", ADD_BIGINT, TYPE_BIGINT, \
+        CALL("casttobigint", CAST_INT_TO_BIGINT, TYPE_BIGINT, INT_SLOT), \
+        pool.Add(new Literal(TYPE_BIGINT, 1000L))))
+  vector<Expr*> predicates;
+  predicates.push_back(INT_LT_10);
+  predicates.push_back(INT_GE_10);
+  predicates.push_back(DOUBLE_GT_600);
+  predicates.push_back(CALL("ne", NE_INT, TYPE_BOOLEAN, INT_SLOT,
+      pool.Add(new NullLiteral(TYPE_INT))));
+  predicates.push_back(CALL("isnull", IS_NULL_INT, TYPE_BOOLEAN, INT_SLOT));
+  predicates.push_back(BIGINT_LT_INT);
+  // Both AND and OR with NULLs on either side.
+  predicates.push_back(COMPOUND("and", INT_LT_10, DOUBLE_GT_600));
+  predicates.push_back(COMPOUND("or", INT_GE_10, BIGINT_LT_INT));
+  Expr* bigint_expr = BIGINT_PLUS_3;
+#undef INT_SLOT
+#undef BIGINT_SLOT
+#undef DOUBLE_SLOT
+#undef CALL
+#undef COMPOUND
+#undef INT_LT_10
+#undef INT_GE_10
+#undef DOUBLE_GT_600
+#undef BIGINT_PLUS_3
+#undef BIGINT_LT_INT
+
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", NULL);
+  MemTracker tracker;
+  for (int p = 0; p < predicates.size(); ++p) {
+    ExprContext ctx(predicates[p]);
+    ASSERT_TRUE(ctx.Prepare(&state, RowDescriptor(), &tracker).ok());
+    ASSERT_TRUE(ctx.Open(&state).ok());
+    vector<TupleRow*> expected;
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      BooleanVal v = ctx.GetBooleanVal(rows[i]);
+      if (!v.is_null && v.val) expected.push_back(rows[i]);
+    }
+    vector<TupleRow*> selected(rows);
+    int num_selected = ctx.EvalPredicate(&selected[0], NUM_ROWS);
+    selected.resize(num_selected);
+    EXPECT_TRUE(expected == selected) << "predicate " << p;
+
+    bool values[NUM_ROWS];
+    uint8_t nulls[NUM_ROWS];
+    ctx.EvalBatch(&rows[0], NUM_ROWS, values, nulls);
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      BooleanVal v = ctx.GetBooleanVal(rows[i]);
+      ASSERT_EQ(v.is_null, nulls[i] == 1) << "predicate " << p << " row " << i;
+      if (!v.is_null) ASSERT_EQ(v.val, values[i]) << "predicate " << p;
+    }
+    ctx.Close(&state);
+  }
+
+  // Non-boolean exprs.
+  ExprContext ctx(bigint_expr);
+  ASSERT_TRUE(ctx.Prepare(&state, RowDescriptor(), &tracker).ok());
+  ASSERT_TRUE(ctx.Open(&state).ok());
+  vector<int64_t> values(NUM_ROWS);
+  vector<uint8_t> nulls(NUM_ROWS);
+  ctx.EvalBatch(&rows[0], NUM_ROWS, &values[0], &nulls[0]);
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    BigIntVal v = ctx.GetBigIntVal(rows[i]);
+    ASSERT_EQ(v.is_null, nulls[i] == 1) << "row " << i;
+    if (!v.is_null) ASSERT_EQ(v.val, values[i]) << "row " << i;
+  }
+  ctx.Close(&state);
+
+  // AND and OR with a right child that is evaluated row by row only evaluate it over
+  // the rows the left child does not decide, like the row by row evaluation.
+  const char* compound_names[] = {"and", "or"};
+  for (int c = 0; c < 2; ++c) {
+    CountingPredicate* counting = pool.Add(new CountingPredicate(
+        pool.Add(new NullableSlotRef(TYPE_INT, 0, 24, 0))));
+    Expr* int_lt_10 = CreateBuiltinExpr(&pool, TExprNodeType::FUNCTION_CALL, "lt",
+        LT_INT, TYPE_BOOLEAN, pool.Add(new NullableSlotRef(TYPE_INT, 0, 24, 0)),
+        pool.Add(new Literal(TYPE_INT, 10)));
+    ExprContext compound_ctx(CreateBuiltinExpr(&pool, TExprNodeType::COMPOUND_PRED,
+        compound_names[c], "", TYPE_BOOLEAN, int_lt_10, counting));
+    ASSERT_TRUE(compound_ctx.Prepare(&state, RowDescriptor(), &tracker).ok());
+    ASSERT_TRUE(compound_ctx.Open(&state).ok());
+    vector<BooleanVal> expected;
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      expected.push_back(compound_ctx.GetBooleanVal(rows[i]));
+    }
+    int expected_calls = counting->num_calls_;
+    EXPECT_GT(expected_calls, 0);
+    EXPECT_LT(expected_calls, NUM_ROWS);
+
+    counting->num_calls_ = 0;
+    bool compound_values[NUM_ROWS];
+    uint8_t compound_nulls[NUM_ROWS];
+    compound_ctx.EvalBatch(&rows[0], NUM_ROWS, compound_values, compound_nulls);
+    EXPECT_EQ(counting->num_calls_, expected_calls) << compound_names[c];
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      ASSERT_EQ(expected[i].is_null, compound_nulls[i] == 1)
+          << compound_names[c] << " row " << i;
+      if (!expected[i].is_null) {
+        ASSERT_EQ(expected[i].val, compound_values[i])
+            << compound_names[c] << " row " << i;
+      }
+    }
+    compound_ctx.Close(&state);
+  }
+}
+
+// Checks that with --async_codegen a ScalarFnCall is interpreted until its module is
+// compiled and then switches to the JIT'd wrapper, with the same results.
+TEST_F(ExprTest, AsyncCodegen) {
+  const string LT_INT = "_ZN6impala9Operators16Lt_IntVal_IntValEPN10impala_udf15"
+      "FunctionContextERKNS1_6IntValES6_";
+  // Tuples of an INT at offset 0, with its null indicator in byte 4.
+  const int NUM_ROWS = 100;
+  const int TUPLE_SIZE = 8;
+  vector<int64_t> tuple_mem(NUM_ROWS * TUPLE_SIZE / sizeof(int64_t));
+  vector<Tuple*> row_mem(NUM_ROWS);
+  vector<TupleRow*> rows(NUM_ROWS);
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    uint8_t* tuple = reinterpret_cast<uint8_t*>(&tuple_mem[0]) + i * TUPLE_SIZE;
+    *reinterpret_cast<int32_t*>(tuple) = i - 50;
+    tuple[4] = i % 9 == 0 ? 1 : 0;
+    row_mem[i] = reinterpret_cast<Tuple*>(tuple);
+    rows[i] = reinterpret_cast<TupleRow*>(&row_mem[i]);
+  }
+
+  bool async_codegen = FLAGS_async_codegen;
+  FLAGS_async_codegen = true;
+  ObjectPool pool;
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", NULL);
+  LlvmCodeGen* codegen;
+  ASSERT_TRUE(state.GetCodegen(&codegen).ok());
+  MemTracker tracker;
+  // int_col < 10
+  Expr* lt = CreateBuiltinExpr(&pool, TExprNodeType::FUNCTION_CALL, "lt", LT_INT,
+      TYPE_BOOLEAN, pool.Add(new NullableSlotRef(TYPE_INT, 0, 4, 0)),
+      pool.Add(new Literal(TYPE_INT, 10)));
+  ExprContext ctx(lt);
+  ASSERT_TRUE(ctx.Prepare(&state, RowDescriptor(), &tracker).ok());
+  ASSERT_TRUE(ctx.Open(&state).ok());
+
+  // Interpreted, the module is not compiled yet.
+  ASSERT_TRUE(GetScalarFnWrapper(static_cast<ScalarFnCall*>(lt)) == NULL);
+  vector<BooleanVal> interpreted;
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    BooleanVal v = ctx.GetBooleanVal(rows[i]);
+    EXPECT_EQ(v.is_null, i % 9 == 0) << "row " << i;
+    if (!v.is_null) EXPECT_EQ(v.val, i - 50 < 10) << "row " << i;
+    interpreted.push_back(v);
+  }
+
+  // JIT'd after the module is compiled.
+  ASSERT_TRUE(codegen->FinalizeModule().ok());
+  ASSERT_TRUE(GetScalarFnWrapper(static_cast<ScalarFnCall*>(lt)) != NULL);
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    BooleanVal v = ctx.GetBooleanVal(rows[i]);
+    EXPECT_TRUE(v == interpreted[i]) << "row " << i;
+  }
+  ctx.Close(&state);
+  FLAGS_async_codegen = async_codegen;
+}
+
 TEST_F(ExprTest, ResultsLayoutTest) {
   ObjectPool pool;
 
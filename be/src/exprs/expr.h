@@ -247,6 +247,7 @@ class Expr {
   friend class InPredicate;
   friend class FunctionCall;
   friend class ScalarFnCall;
+  friend class VectorizedExpr;
 
   Expr(const ColumnType& type, bool is_slotref = false);
   Expr(const TExprNode& node, bool is_slotref = false);
@@ -16,148 +16,19 @@
 // Note: The results do not include the pre-processing in the prepare function that is
 // necessary for SetLookup but not Iterate. None of the values searched for are in the
 // fabricated IN list (i.e. hit rate is 0).
-
-// Machine Info: Intel(R) Core(TM) i7-2600 CPU @ 3.40GHz
-// int n=1:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=1               902.4                  1X
-//                    Iterate n=1               938.3               1.04X
-
-// int n=2:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=2               888.6                  1X
-//                    Iterate n=2               805.6             0.9066X
-
-// int n=3:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=3               806.5                  1X
-//                    Iterate n=3               744.1             0.9227X
-
-// int n=4:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=4               784.1                  1X
-//                    Iterate n=4                 661              0.843X
-
-// int n=5:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=5               801.6                  1X
-//                    Iterate n=5               594.4             0.7415X
-
-// int n=6:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=6               746.6                  1X
-//                    Iterate n=6                 539              0.722X
-
-// int n=7:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=7               683.4                  1X
-//                    Iterate n=7               493.9             0.7226X
-
-// int n=8:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=8                 772                  1X
-//                    Iterate n=8               455.5               0.59X
-
-// int n=9:              Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=9               702.9                  1X
-//                    Iterate n=9               420.1             0.5976X
-
-// int n=10:             Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                 SetLookup n=10               710.7                  1X
-//                   Iterate n=10               392.4             0.5521X
-
-// int n=400:            Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                SetLookup n=400               422.3                  1X
-//                  Iterate n=400               14.01            0.03318X
-
-
-// string n=1:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=1               250.8                  1X
-//                    Iterate n=1               540.4              2.154X
-
-// string n=2:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=2                 205                  1X
-//                    Iterate n=2               297.7              1.453X
-
-// string n=3:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=3               166.8                  1X
-//                    Iterate n=3               240.3              1.441X
-
-// string n=4:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=4               146.2                  1X
-//                    Iterate n=4               177.8              1.216X
-
-// string n=5:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=5               149.9                  1X
-//                    Iterate n=5               144.8             0.9662X
-
-// string n=6:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=6               135.9                  1X
-//                    Iterate n=6               127.4             0.9372X
-
-// string n=7:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=7               143.4                  1X
-//                    Iterate n=7               112.8             0.7866X
-
-// string n=8:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=8               123.7                  1X
-//                    Iterate n=8               117.1             0.9467X
-
-// string n=9:           Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=9                 117                  1X
-//                    Iterate n=9               89.19              0.762X
-
-// string n=10:          Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                 SetLookup n=10               125.4                  1X
-//                   Iterate n=10               81.63             0.6508X
-
-// string n=400:         Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                SetLookup n=400               55.77                  1X
-//                  Iterate n=400               1.936            0.03471X
-
-// decimal(4,0) n=1:     Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=1               587.9                  1X
-//                    Iterate n=1               658.3               1.12X
-
-// decimal(4,0) n=2:     Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=2               521.5                  1X
-//                    Iterate n=2               478.5             0.9175X
-
-// decimal(4,0) n=3:     Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=3                 524                  1X
-//                    Iterate n=3               373.7             0.7132X
-
-// decimal(4,0) n=4:     Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                  SetLookup n=4               486.6                  1X
-//                    Iterate n=4               308.9             0.6348X
-
-// decimal(4,0) n=400:   Function     Rate (iters/ms)          Comparison
-// ----------------------------------------------------------------------
-//                SetLookup n=400               258.2                  1X
-//                  Iterate n=400               4.272            0.01655X
+//
+// SetLookup is what InSetLookup() does: for integer lists of up to 64 bytes it compares
+// the value to the whole list with SSE, otherwise it looks the value up in the hash set.
+// HashLookup always uses the hash set and Iterate compares to each value in turn. The
+// suites for growing n show where the SSE compare stops paying off against the hash set
+// (the SSE path is cut off at 64 bytes, i.e. 16 ints or 8 bigints) and where the hash
+// set starts to beat Iterate for each type.
 
 #include <boost/lexical_cast.hpp>
 #include <gutil/strings/substitute.h>
 
 #include "exprs/in-predicate.h"
+#include "runtime/timestamp-value.h"
 
 #include "udf/udf-test-harness.h"
 #include "util/benchmark.h"
@@ -175,6 +46,12 @@ template<typename T> T MakeAnyVal(int v) {
   return T(v);
 }
 
+template<> TimestampVal MakeAnyVal(int v) {
+  TimestampVal tv;
+  TimestampValue(static_cast<int64_t>(v)).ToTimestampVal(&tv);
+  return tv;
+}
+
 template<> StringVal MakeAnyVal(int v) {
   // Leak these strings so we don't have to worry about them going out of scope
   string* s = new string();
@@ -189,6 +66,8 @@ class InPredicateBenchmark {
     vector<T> anyvals;
     vector<AnyVal*> anyval_ptrs;
     InPredicate::SetLookupState<SetType> state;
+    // Copy of 'state' that always uses the hash set.
+    InPredicate::SetLookupState<SetType> hash_state;
 
     vector<T> search_vals;
 
@@ -224,6 +103,8 @@ class InPredicateBenchmark {
     InPredicate::SetLookupPrepare<T, SetType>(ctx, FunctionContext::FRAGMENT_LOCAL);
     data.state = *reinterpret_cast<InPredicate::SetLookupState<SetType>*>(
         ctx->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+    data.hash_state = data.state;
+    data.hash_state.num_simd_vectors = 0;
 
     data.total_found_set = data.total_set = data.total_found_iter = data.total_iter = 0;
     return data;
@@ -241,6 +122,18 @@ class InPredicateBenchmark {
     }
   }
 
+  template<typename T, typename SetType>
+  static void TestHashLookup(int batch_size, void* d) {
+    TestData<T, SetType>* data = reinterpret_cast<TestData<T, SetType>*>(d);
+    for (int i = 0; i < batch_size; ++i) {
+      BOOST_FOREACH(const T& search_val, data->search_vals) {
+        BooleanVal found = InPredicate::SetLookup(&data->hash_state, search_val);
+        if (found.val) ++data->total_found_set;
+        ++data->total_set;
+      }
+    }
+  }
+
   template<typename T, typename SetType>
   static void TestIterate(int batch_size, void* d) {
     TestData<T, SetType>* data = reinterpret_cast<TestData<T, SetType>*>(d);
@@ -262,6 +155,8 @@ class InPredicateBenchmark {
         InPredicateBenchmark::CreateTestData<IntVal, int32_t>(n, type);
     suite.AddBenchmark(Substitute("SetLookup n=$0", n),
                        InPredicateBenchmark::TestSetLookup<IntVal, int32_t>, &data);
+    suite.AddBenchmark(Substitute("HashLookup n=$0", n),
+                       InPredicateBenchmark::TestHashLookup<IntVal, int32_t>, &data);
     suite.AddBenchmark(Substitute("Iterate n=$0", n),
                        InPredicateBenchmark::TestIterate<IntVal, int32_t>, &data);
     cout << suite.Measure() << endl;
@@ -284,6 +179,34 @@ class InPredicateBenchmark {
     // cout << "Found iter: " << (double)data.total_found_iter / data.total_iter << endl;
   }
 
+  static void RunBigIntBenchmark(int n) {
+    Benchmark suite(Substitute("bigint n=$0", n));
+    FunctionContext::TypeDesc type;
+    type.type = FunctionContext::TYPE_BIGINT;
+    TestData<BigIntVal, int64_t> data =
+        InPredicateBenchmark::CreateTestData<BigIntVal, int64_t>(n, type);
+    suite.AddBenchmark(Substitute("SetLookup n=$0", n),
+                       InPredicateBenchmark::TestSetLookup<BigIntVal, int64_t>, &data);
+    suite.AddBenchmark(Substitute("HashLookup n=$0", n),
+                       InPredicateBenchmark::TestHashLookup<BigIntVal, int64_t>, &data);
+    suite.AddBenchmark(Substitute("Iterate n=$0", n),
+                       InPredicateBenchmark::TestIterate<BigIntVal, int64_t>, &data);
+    cout << suite.Measure() << endl;
+  }
+
+  static void RunTimestampBenchmark(int n) {
+    Benchmark suite(Substitute("timestamp n=$0", n));
+    FunctionContext::TypeDesc type;
+    type.type = FunctionContext::TYPE_TIMESTAMP;
+    TestData<TimestampVal, TimestampValue> data =
+        InPredicateBenchmark::CreateTestData<TimestampVal, TimestampValue>(n, type);
+    suite.AddBenchmark(Substitute("SetLookup n=$0", n),
+        InPredicateBenchmark::TestSetLookup<TimestampVal, TimestampValue>, &data);
+    suite.AddBenchmark(Substitute("Iterate n=$0", n),
+        InPredicateBenchmark::TestIterate<TimestampVal, TimestampValue>, &data);
+    cout << suite.Measure() << endl;
+  }
+
   static void RunDecimalBenchmark(int n) {
     Benchmark suite(Substitute("decimal(4,0) n=$0", n));
     FunctionContext::TypeDesc type;
@@ -316,16 +239,27 @@ int main(int argc, char **argv) {
   CpuInfo::Init();
   cout << Benchmark::GetMachineInfo() << endl;
 
-  for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunIntBenchmark(i);
+  for (int i = 1; i <= 20; ++i) InPredicateBenchmark::RunIntBenchmark(i);
   InPredicateBenchmark::RunIntBenchmark(400);
+  InPredicateBenchmark::RunIntBenchmark(5000);
+
+  cout << endl;
+
+  for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunBigIntBenchmark(i);
+  InPredicateBenchmark::RunBigIntBenchmark(400);
 
   cout << endl;
 
   for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunStringBenchmark(i);
   InPredicateBenchmark::RunStringBenchmark(400);
 
-  for (int i = 1; i <= 4; ++i) InPredicateBenchmark::RunDecimalBenchmark(i);
+  for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunTimestampBenchmark(i);
+  InPredicateBenchmark::RunTimestampBenchmark(400);
+  InPredicateBenchmark::RunTimestampBenchmark(5000);
+
+  for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunDecimalBenchmark(i);
   InPredicateBenchmark::RunDecimalBenchmark(400);
+  InPredicateBenchmark::RunDecimalBenchmark(5000);
 
   return 0;
 }
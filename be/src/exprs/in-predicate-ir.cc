@@ -12,10 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <emmintrin.h>
+#include <string.h>
 #include <sstream>
 
 #include "exprs/in-predicate.h"
 #include "runtime/string-value.inline.h"
+#include "util/hash-util.h"
 
 using namespace impala_udf;
 using namespace std;
@@ -90,6 +93,93 @@ template<> Decimal16Value GetVal(
   }
 }
 
+// Templated hash functions for the values in the hash set. Values that are equal must
+// have the same hash.
+template<typename SetType>
+uint32_t HashSetValue(const SetType& v) {
+  return HashUtil::Hash(&v, sizeof(v), 0);
+}
+
+template<> uint32_t HashSetValue(const float& v) {
+  // 0.0 == -0.0
+  float f = v == 0 ? 0 : v;
+  return HashUtil::Hash(&f, sizeof(f), 0);
+}
+
+template<> uint32_t HashSetValue(const double& v) {
+  double d = v == 0 ? 0 : v;
+  return HashUtil::Hash(&d, sizeof(d), 0);
+}
+
+template<> uint32_t HashSetValue(const StringValue& v) {
+  return HashUtil::Hash(v.ptr, v.len, 0);
+}
+
+template<> uint32_t HashSetValue(const TimestampValue& v) {
+  return v.Hash();
+}
+
+template<> uint32_t HashSetValue(const Decimal16Value& v) {
+  return v.Hash();
+}
+
+// Compares a value to a list of values with SSE2, 16 bytes at a time. Only implemented
+// for integer types.
+template<typename SetType>
+struct SimdList {
+  static const bool ENABLED = false;
+  static bool Contains(const uint8_t* values, int num_vectors, SetType val) {
+    DCHECK(false);
+    return false;
+  }
+};
+
+// Implements SimdList for an integer type. 'Ops' provides Broadcast(), which returns a
+// register with all lanes set to a value, and CmpEq(), which sets the lanes that are
+// equal to all ones.
+template<typename SetType, typename Ops>
+struct SseSimdList {
+  static const bool ENABLED = true;
+  static bool Contains(const uint8_t* values, int num_vectors, SetType val) {
+    __m128i v = Ops::Broadcast(val);
+    __m128i found = _mm_setzero_si128();
+    for (int i = 0; i < num_vectors; ++i) {
+      __m128i list = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values) + i);
+      found = _mm_or_si128(found, Ops::CmpEq(v, list));
+    }
+    return _mm_movemask_epi8(found) != 0;
+  }
+};
+
+struct Int8Ops {
+  static __m128i Broadcast(int8_t v) { return _mm_set1_epi8(v); }
+  static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+};
+
+struct Int16Ops {
+  static __m128i Broadcast(int16_t v) { return _mm_set1_epi16(v); }
+  static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+};
+
+struct Int32Ops {
+  static __m128i Broadcast(int32_t v) { return _mm_set1_epi32(v); }
+  static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+};
+
+struct Int64Ops {
+  static __m128i Broadcast(int64_t v) { return _mm_set1_epi64x(v); }
+  // SSE2 has no 64 bit compare: both 32 bit halves must be equal.
+  static __m128i CmpEq(__m128i a, __m128i b) {
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+  }
+};
+
+template<> struct SimdList<int8_t> : SseSimdList<int8_t, Int8Ops> { };
+template<> struct SimdList<int16_t> : SseSimdList<int16_t, Int16Ops> { };
+template<> struct SimdList<int32_t> : SseSimdList<int32_t, Int32Ops> { };
+template<> struct SimdList<int64_t> : SseSimdList<int64_t, Int64Ops> { };
+
 template<typename T, typename SetType>
 void InPredicate::SetLookupPrepare(
     FunctionContext* ctx, FunctionContext::FunctionStateScope scope) {
@@ -98,13 +188,41 @@ void InPredicate::SetLookupPrepare(
   SetLookupState<SetType>* state = new SetLookupState<SetType>;
   state->type = ctx->GetArgType(0);
   state->contains_null = false;
+  vector<SetType> values;
   for (int i = 1; i < ctx->GetNumArgs(); ++i) {
     DCHECK(ctx->IsArgConstant(i));
     T* arg = reinterpret_cast<T*>(ctx->GetConstantArg(i));
     if (arg->is_null) {
       state->contains_null = true;
     } else {
-      state->val_set.insert(GetVal<T, SetType>(state->type, *arg));
+      values.push_back(GetVal<T, SetType>(state->type, *arg));
+    }
+  }
+
+  int num_buckets = 2;
+  while (num_buckets < 2 * static_cast<int>(values.size())) num_buckets *= 2;
+  state->buckets.resize(num_buckets);
+  state->occupied.resize(num_buckets);
+  state->bucket_mask = num_buckets - 1;
+  for (int i = 0; i < values.size(); ++i) {
+    uint32_t bucket = HashSetValue(values[i]) & state->bucket_mask;
+    while (state->occupied[bucket] && !(state->buckets[bucket] == values[i])) {
+      bucket = (bucket + 1) & state->bucket_mask;
+    }
+    state->buckets[bucket] = values[i];
+    state->occupied[bucket] = 1;
+  }
+
+  state->num_simd_vectors = 0;
+  if (SimdList<SetType>::ENABLED && !values.empty() &&
+      values.size() * sizeof(SetType) <= SIMD_LIST_BYTES) {
+    const int VALUES_PER_VECTOR = sizeof(__m128i) / sizeof(SetType);
+    state->num_simd_vectors =
+        (values.size() + VALUES_PER_VECTOR - 1) / VALUES_PER_VECTOR;
+    // Pad the last register with a value from the list, which doesn't change the result.
+    for (int i = 0; i < state->num_simd_vectors * VALUES_PER_VECTOR; ++i) {
+      const SetType& v = i < values.size() ? values[i] : values[0];
+      memcpy(state->simd_values + i * sizeof(SetType), &v, sizeof(SetType));
     }
   }
   ctx->SetFunctionState(scope, state);
@@ -143,12 +261,26 @@ BooleanVal InPredicate::SetLookup(
     SetLookupState<SetType>* state, const T& v) {
   DCHECK_NOTNULL(state);
   SetType val = GetVal<T, SetType>(state->type, v);
-  bool found = state->val_set.find(val) != state->val_set.end();
+  bool found = state->num_simd_vectors > 0 ?
+      SimdList<SetType>::Contains(state->simd_values, state->num_simd_vectors, val) :
+      HashSetContains(state, val);
   if (found) return BooleanVal(true);
   if (state->contains_null) return BooleanVal::null();
   return BooleanVal(false);
 }
 
+template<typename SetType>
+bool InPredicate::HashSetContains(
+    const SetLookupState<SetType>* state, const SetType& val) {
+  uint32_t bucket = HashSetValue(val) & state->bucket_mask;
+  // There is always an empty bucket, which ends the probing.
+  while (state->occupied[bucket]) {
+    if (state->buckets[bucket] == val) return true;
+    bucket = (bucket + 1) & state->bucket_mask;
+  }
+  return false;
+}
+
 template<typename T>
 BooleanVal InPredicate::Iterate(
     const FunctionContext::TypeDesc* type, const T& val, int num_args, const T* args) {
@@ -217,5 +349,9 @@ IN_FUNCTIONS(DecimalVal, Decimal16Value, decimal)
 // Needed for in-predicate-benchmark to build
 template BooleanVal InPredicate::Iterate<IntVal>(
     const FunctionContext::TypeDesc*, const IntVal&, int, const IntVal*);
+template BooleanVal InPredicate::Iterate<BigIntVal>(
+    const FunctionContext::TypeDesc*, const BigIntVal&, int, const BigIntVal*);
+template BooleanVal InPredicate::Iterate<TimestampVal>(
+    const FunctionContext::TypeDesc*, const TimestampVal&, int, const TimestampVal*);
 
 }
@@ -17,6 +17,7 @@
 #define IMPALA_EXPRS_IN_PREDICATE_H_
 
 #include <string>
+#include <vector>
 #include "exprs/predicate.h"
 #include "udf/udf.h"
 
@@ -27,8 +28,9 @@ namespace impala {
 // There are two strategies for evaluating the IN predicate:
 //
 // 1) SET_LOOKUP: This strategy is for when all the values in the IN list are constant. In
-//    the prepare function, we create a set of the constant values from the IN list, and
-//    use this set to lookup a given 'val'.
+//    the prepare function, we create a hash set of the constant values from the IN list,
+//    and use this set to lookup a given 'val'. If the values are integers that fit into a
+//    few SSE registers, 'val' is instead compared to all of them at once.
 //
 // 2) ITERATE: This is the fallback strategy for when their are non-constant IN list
 //    values, or very few values in the IN list. We simply iterate through every
@@ -37,8 +39,6 @@ namespace impala {
 // The FE chooses which strategy we should use by choosing the appropriate function (e.g.,
 // InIterate() or InSetLookup()). If it chooses SET_LOOKUP, it also sets the appropriate
 // SetLookupPrepare and SetLookupClose functions.
-//
-// TODO: the set lookup logic is not yet implemented for TimestampVals or DecimalVals
 class InPredicate : public Predicate {
  public:
   // Functions for every type
@@ -272,15 +272,29 @@ class InPredicate : public Predicate {
     ITERATE
   };
 
+  // Maximum size in bytes of the IN list values that are compared with SSE instead of
+  // looked up in the hash set.
+  static const int SIMD_LIST_BYTES = 64;
+
   template<typename SetType>
   struct SetLookupState {
     // If true, there is at least one NULL constant in the IN list.
     bool contains_null;
 
-    // The set of all non-NULL constant values in the IN list.
-    // Note: boost::unordered_set and std::binary_search performed worse based on the
-    // in-predicate-benchmark
-    std::set<SetType> val_set;
+    // Open addressing hash set with linear probing of all non-NULL constant values in
+    // the IN list. The number of buckets is a power of two and at least twice the number
+    // of values. Note: std::set, boost::unordered_set and std::binary_search performed
+    // worse based on the in-predicate-benchmark.
+    std::vector<SetType> buckets;
+    // 1 if the bucket contains a value.
+    std::vector<uint8_t> occupied;
+    uint32_t bucket_mask;
+
+    // If SetType is an integer type and all values fit into SIMD_LIST_BYTES, the
+    // values, padded to full SSE registers with copies of the first value. Otherwise
+    // num_simd_vectors is 0.
+    uint8_t simd_values[SIMD_LIST_BYTES];
+    int num_simd_vectors;
 
     // The type of the arguments
     const FunctionContext::TypeDesc* type;
@@ -301,10 +315,14 @@ class InPredicate : public Predicate {
   static void SetLookupClose(
       FunctionContext* ctx, FunctionContext::FunctionStateScope scope);
 
-  // Looks up v in state->val_set.
+  // Looks up v in the values of 'state'.
   template<typename T, typename SetType>
   static BooleanVal SetLookup(SetLookupState<SetType>* state, const T& v);
 
+  // Returns true if 'val' is in the hash set of 'state'.
+  template<typename SetType>
+  static bool HashSetContains(const SetLookupState<SetType>* state, const SetType& val);
+
   // Iterates through each vararg looking for val. 'type' is the type of 'val' and 'args'.
   template<typename T>
   static BooleanVal Iterate(
@@ -21,6 +21,7 @@
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
+#include "common/atomic.h"
 #include "exprs/anyval-util.h"
 #include "exprs/expr-context.h"
 #include "runtime/hdfs-fs-cache.h"
@@ -37,6 +38,8 @@ using namespace impala_udf;
 using namespace std;
 using namespace strings;
 
+DECLARE_bool(async_codegen);
+
 ScalarFnCall::ScalarFnCall(const TExprNode& node)
   : Expr(node),
     vararg_start_idx_(node.__isset.vararg_start_idx ?
@@ -96,26 +99,22 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
     if (char_arg) {
       DCHECK(NumFixedArgs() <= 8 && fn_.binary_type == TFunctionBinaryType::BUILTIN);
     }
-    Status status = LibCache::instance()->GetSoFunctionPtr(
-        fn_.hdfs_location, fn_.scalar_fn.symbol, &scalar_fn_, &cache_entry_);
-    if (!status.ok()) {
-      if (fn_.binary_type == TFunctionBinaryType::BUILTIN) {
-        // Builtins symbols should exist unless there is a version mismatch.
-        status.SetErrorMsg(ErrorMsg(TErrorCode::MISSING_BUILTIN,
-            fn_.name.function_name, fn_.scalar_fn.symbol));
-        return status;
-      } else {
-        DCHECK_EQ(fn_.binary_type, TFunctionBinaryType::NATIVE);
-        return Status(Substitute("Problem loading UDF '$0':\n$1",
-            fn_.name.function_name, status.GetDetail()));
-        return status;
-      }
-    }
+    RETURN_IF_ERROR(LoadScalarFn());
   } else {
     // If we got here, either codegen is enabled or we need codegen to run this function.
     LlvmCodeGen* codegen;
     RETURN_IF_ERROR(state->GetCodegen(&codegen));
 
+    if (FLAGS_async_codegen && NumFixedArgs() <= 8 &&
+        (fn_.binary_type == TFunctionBinaryType::BUILTIN ||
+         fn_.binary_type == TFunctionBinaryType::NATIVE)) {
+      // The module may be compiled while the fragment is already executing. Also load the
+      // function itself, so that it is interpreted until the wrapper is JIT'd.
+      RETURN_IF_ERROR(LoadScalarFn());
+    } else {
+      codegen->set_needs_sync_finalize();
+    }
+
     if (fn_.binary_type == TFunctionBinaryType::IR) {
       string local_path;
       RETURN_IF_ERROR(LibCache::instance()->GetLocalLibPath(
@@ -144,6 +143,22 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
   return Status::OK;
 }
 
+Status ScalarFnCall::LoadScalarFn() {
+  DCHECK(fn_.binary_type == TFunctionBinaryType::BUILTIN ||
+      fn_.binary_type == TFunctionBinaryType::NATIVE);
+  Status status = LibCache::instance()->GetSoFunctionPtr(
+      fn_.hdfs_location, fn_.scalar_fn.symbol, &scalar_fn_, &cache_entry_);
+  if (status.ok()) return status;
+  if (fn_.binary_type == TFunctionBinaryType::BUILTIN) {
+    // Builtins symbols should exist unless there is a version mismatch.
+    status.SetErrorMsg(ErrorMsg(TErrorCode::MISSING_BUILTIN,
+        fn_.name.function_name, fn_.scalar_fn.symbol));
+    return status;
+  }
+  return Status(Substitute("Problem loading UDF '$0':\n$1",
+      fn_.name.function_name, status.GetDetail()));
+}
+
 Status ScalarFnCall::Open(RuntimeState* state, ExprContext* ctx,
                           FunctionContext::FunctionStateScope scope) {
   // Opens and inits children
@@ -151,9 +166,10 @@ Status ScalarFnCall::Open(RuntimeState* state, ExprContext* ctx,
   FunctionContext* fn_ctx = ctx->fn_context(context_index_);
 
   if (scalar_fn_ != NULL) {
-    // We're in the interpreted path (i.e. no JIT). Populate our FunctionContext's
+    // We're in the interpreted path (i.e. no JIT), or the wrapper is JIT'd in the
+    // background and we're interpreting until it is ready. Populate our FunctionContext's
     // staging_input_vals, which will be reused across calls to scalar_fn_.
-    DCHECK(scalar_fn_wrapper_ == NULL);
+    DCHECK(scalar_fn_wrapper_ == NULL || FLAGS_async_codegen);
     ObjectPool* obj_pool = state->obj_pool();
     vector<AnyVal*>* input_vals = fn_ctx->impl()->staging_input_vals();
     for (int i = 0; i < NumFixedArgs(); ++i) {
@@ -484,6 +500,8 @@ Status ScalarFnCall::GetFunction(RuntimeState* state, const string& symbol, void
          << " from LLVM module " << fn_.hdfs_location;
       return Status(ss.str());
     }
+    // Needed in Open(), before a module compiled in the background would be ready.
+    codegen->set_needs_sync_finalize();
     codegen->AddFunctionToJit(ir_fn, fn);
     return Status::OK;
   }
@@ -652,80 +670,90 @@ typedef DecimalVal (*DecimalWrapper)(ExprContext*, TupleRow*);
 BooleanVal ScalarFnCall::GetBooleanVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_BOOLEAN);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<BooleanVal>(context, row);
-  BooleanWrapper fn = reinterpret_cast<BooleanWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<BooleanVal>(context, row);
+  BooleanWrapper fn = reinterpret_cast<BooleanWrapper>(wrapper);
   return fn(context, row);
 }
 
 TinyIntVal ScalarFnCall::GetTinyIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_TINYINT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<TinyIntVal>(context, row);
-  TinyIntWrapper fn = reinterpret_cast<TinyIntWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<TinyIntVal>(context, row);
+  TinyIntWrapper fn = reinterpret_cast<TinyIntWrapper>(wrapper);
   return fn(context, row);
 }
 
 SmallIntVal ScalarFnCall::GetSmallIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_SMALLINT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<SmallIntVal>(context, row);
-  SmallIntWrapper fn = reinterpret_cast<SmallIntWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<SmallIntVal>(context, row);
+  SmallIntWrapper fn = reinterpret_cast<SmallIntWrapper>(wrapper);
   return fn(context, row);
 }
 
 IntVal ScalarFnCall::GetIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_INT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<IntVal>(context, row);
-  IntWrapper fn = reinterpret_cast<IntWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<IntVal>(context, row);
+  IntWrapper fn = reinterpret_cast<IntWrapper>(wrapper);
   return fn(context, row);
 }
 
 BigIntVal ScalarFnCall::GetBigIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_BIGINT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<BigIntVal>(context, row);
-  BigIntWrapper fn = reinterpret_cast<BigIntWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<BigIntVal>(context, row);
+  BigIntWrapper fn = reinterpret_cast<BigIntWrapper>(wrapper);
   return fn(context, row);
 }
 
 FloatVal ScalarFnCall::GetFloatVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_FLOAT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<FloatVal>(context, row);
-  FloatWrapper fn = reinterpret_cast<FloatWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<FloatVal>(context, row);
+  FloatWrapper fn = reinterpret_cast<FloatWrapper>(wrapper);
   return fn(context, row);
 }
 
 DoubleVal ScalarFnCall::GetDoubleVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_DOUBLE);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<DoubleVal>(context, row);
-  DoubleWrapper fn = reinterpret_cast<DoubleWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<DoubleVal>(context, row);
+  DoubleWrapper fn = reinterpret_cast<DoubleWrapper>(wrapper);
   return fn(context, row);
 }
 
 StringVal ScalarFnCall::GetStringVal(ExprContext* context, TupleRow* row) {
   DCHECK(type_.IsStringType());
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<StringVal>(context, row);
-  StringWrapper fn = reinterpret_cast<StringWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<StringVal>(context, row);
+  StringWrapper fn = reinterpret_cast<StringWrapper>(wrapper);
   return fn(context, row);
 }
 
 TimestampVal ScalarFnCall::GetTimestampVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_TIMESTAMP);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<TimestampVal>(context, row);
-  TimestampWrapper fn = reinterpret_cast<TimestampWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<TimestampVal>(context, row);
+  TimestampWrapper fn = reinterpret_cast<TimestampWrapper>(wrapper);
   return fn(context, row);
 }
 
 DecimalVal ScalarFnCall::GetDecimalVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_DECIMAL);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<DecimalVal>(context, row);
-  DecimalWrapper fn = reinterpret_cast<DecimalWrapper>(scalar_fn_wrapper_);
+  void* wrapper = AtomicUtil::LoadAcquire(&scalar_fn_wrapper_);
+  if (wrapper == NULL) return InterpretEval<DecimalVal>(context, row);
+  DecimalWrapper fn = reinterpret_cast<DecimalWrapper>(wrapper);
   return fn(context, row);
 }
 
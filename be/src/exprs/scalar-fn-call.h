@@ -51,6 +51,7 @@ class ScalarFnCall: public Expr {
 
  protected:
   friend class Expr;
+  friend class ExprTest;
 
   ScalarFnCall(const TExprNode& node);
   virtual Status Prepare(RuntimeState* state, const RowDescriptor& desc,
@@ -95,7 +96,8 @@ class ScalarFnCall: public Expr {
   UdfClose close_fn_;
 
   // If running with codegen disabled, scalar_fn_ will be a pointer to the non-JIT'd
-  // scalar function.
+  // scalar function. With --async_codegen it is also set when scalar_fn_wrapper_ is
+  // JIT'd, and used until the wrapper is ready.
   void* scalar_fn_;
 
   // Returns the number of non-vararg arguments
@@ -106,6 +108,10 @@ class ScalarFnCall: public Expr {
   // Loads the native or IR function from HDFS and puts the result in *udf.
   Status GetUdf(RuntimeState* state, llvm::Function** udf);
 
+  // Loads the builtin or native UDF into scalar_fn_, for the interpreted path. Returns
+  // an error naming the function if it cannot be loaded.
+  Status LoadScalarFn();
+
   // Loads the native or IR function 'symbol' from HDFS and puts the result in *fn.
   // If the function is loaded from an IR module, it cannot be called until the module
   // has been JIT'd (i.e. after Prepare() has completed).
@@ -0,0 +1,649 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exprs/vectorized-expr.h"
+
+#include <emmintrin.h>
+#include <string.h>
+#include <gflags/gflags.h>
+
+#include "common/logging.h"
+#include "exprs/compound-predicates.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/scalar-fn-call.h"
+#include "exprs/slot-ref.h"
+#include "runtime/tuple-row.h"
+
+using namespace impala;
+using namespace std;
+
+DEFINE_bool(enable_vectorized_exprs, true, "If true, predicates on numeric values are "
+    "evaluated over a batch of rows at a time (see ExprContext::EvalPredicate()).");
+
+// Calls M(primitive type, C++ type) for every type that can be vectorized.
+#define FOR_EACH_VECTORIZED_TYPE(M) \
+  M(TYPE_BOOLEAN, bool) \
+  M(TYPE_TINYINT, int8_t) \
+  M(TYPE_SMALLINT, int16_t) \
+  M(TYPE_INT, int32_t) \
+  M(TYPE_BIGINT, int64_t) \
+  M(TYPE_FLOAT, float) \
+  M(TYPE_DOUBLE, double)
+
+namespace impala {
+
+struct VectorizedExpr::Node {
+  enum Op {
+    // Gathers the values of a slot.
+    SLOT,
+    // Constant subtree, evaluated once.
+    CONSTANT,
+    // Any subtree that is not vectorized, evaluated row by row.
+    ROW,
+    CAST,
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    IS_NULL,
+    IS_NOT_NULL,
+    AND,
+    OR,
+    NOT
+  };
+
+  Op op;
+  Expr* expr;
+  PrimitiveType type;
+  vector<Node*> children;
+
+  // Only set for AND and OR: true if the right child is evaluated only over the rows
+  // the left child does not decide, like the row by row evaluation does. Set if the
+  // right subtree evaluates exprs row by row, which may be expensive or have side
+  // effects (e.g. UDFs). 'selection' and 'selected_rows' are the indices and rows of
+  // those rows.
+  bool short_circuit;
+  vector<int> selection;
+  vector<TupleRow*> selected_rows;
+
+  // Only set for SLOT.
+  int tuple_idx;
+  int slot_offset;
+  NullIndicatorOffset null_indicator_offset;
+
+  // The results of the last Eval(), an array of the C++ type of 'type'. int64_t is
+  // the widest type, so the buffer is large and aligned enough for all of them.
+  vector<int64_t> values_buffer;
+  // 1 if the result is NULL. The value of a NULL result is undefined.
+  vector<uint8_t> nulls;
+
+  Node(Op op, Expr* expr)
+    : op(op), expr(expr), type(expr->type().type), short_circuit(false), tuple_idx(-1),
+      slot_offset(-1),
+      null_indicator_offset(0, -1),
+      values_buffer(VectorizedExpr::CHUNK_SIZE), nulls(VectorizedExpr::CHUNK_SIZE) {
+  }
+
+  template<typename T> T* values() { return reinterpret_cast<T*>(&values_buffer[0]); }
+
+  // Returns true if this node or any node below it is evaluated row by row.
+  bool ContainsRowOp() const {
+    if (op == ROW) return true;
+    for (int i = 0; i < children.size(); ++i) {
+      if (children[i]->ContainsRowOp()) return true;
+    }
+    return false;
+  }
+};
+
+}
+
+namespace {
+
+bool IsVectorizedType(PrimitiveType type) {
+  switch (type) {
+#define CASE(primitive_type, T) case primitive_type:
+    FOR_EACH_VECTORIZED_TYPE(CASE)
+#undef CASE
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if 'symbol' starts with 'prefix'.
+bool HasPrefix(const string& symbol, const char* prefix) {
+  return symbol.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Returns the name of the function in the mangled 'symbol' of a member of
+// impala::Operators, e.g. "Lt" for "_ZN6impala9Operators16Lt_IntVal_IntValE...", or an
+// empty string.
+string OperatorName(const string& symbol) {
+  const char* PREFIX = "_ZN6impala9Operators";
+  if (!HasPrefix(symbol, PREFIX)) return "";
+  size_t start = symbol.find_first_not_of("0123456789", strlen(PREFIX));
+  if (start == string::npos) return "";
+  size_t end = symbol.find('_', start);
+  if (end == string::npos) return "";
+  return symbol.substr(start, end - start);
+}
+
+// Scalar comparison ops and their SSE2 versions, which return all ones in the lanes
+// where the comparison is true.
+struct EqOp {
+  template<typename T> static bool Apply(T a, T b) { return a == b; }
+  static __m128i SseInt(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+  static __m128 SseFloat(__m128 a, __m128 b) { return _mm_cmpeq_ps(a, b); }
+  static __m128d SseDouble(__m128d a, __m128d b) { return _mm_cmpeq_pd(a, b); }
+};
+
+struct NeOp {
+  template<typename T> static bool Apply(T a, T b) { return a != b; }
+  static __m128i SseInt(__m128i a, __m128i b) {
+    return _mm_xor_si128(_mm_cmpeq_epi32(a, b), _mm_set1_epi32(-1));
+  }
+  static __m128 SseFloat(__m128 a, __m128 b) { return _mm_cmpneq_ps(a, b); }
+  static __m128d SseDouble(__m128d a, __m128d b) { return _mm_cmpneq_pd(a, b); }
+};
+
+struct LtOp {
+  template<typename T> static bool Apply(T a, T b) { return a < b; }
+  static __m128i SseInt(__m128i a, __m128i b) { return _mm_cmplt_epi32(a, b); }
+  static __m128 SseFloat(__m128 a, __m128 b) { return _mm_cmplt_ps(a, b); }
+  static __m128d SseDouble(__m128d a, __m128d b) { return _mm_cmplt_pd(a, b); }
+};
+
+struct LeOp {
+  template<typename T> static bool Apply(T a, T b) { return a <= b; }
+  static __m128i SseInt(__m128i a, __m128i b) {
+    return _mm_xor_si128(_mm_cmpgt_epi32(a, b), _mm_set1_epi32(-1));
+  }
+  static __m128 SseFloat(__m128 a, __m128 b) { return _mm_cmple_ps(a, b); }
+  static __m128d SseDouble(__m128d a, __m128d b) { return _mm_cmple_pd(a, b); }
+};
+
+struct GtOp {
+  template<typename T> static bool Apply(T a, T b) { return a > b; }
+  static __m128i SseInt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+  static __m128 SseFloat(__m128 a, __m128 b) { return _mm_cmpgt_ps(a, b); }
+  static __m128d SseDouble(__m128d a, __m128d b) { return _mm_cmpgt_pd(a, b); }
+};
+
+struct GeOp {
+  template<typename T> static bool Apply(T a, T b) { return a >= b; }
+  static __m128i SseInt(__m128i a, __m128i b) {
+    return _mm_xor_si128(_mm_cmplt_epi32(a, b), _mm_set1_epi32(-1));
+  }
+  static __m128 SseFloat(__m128 a, __m128 b) { return _mm_cmpge_ps(a, b); }
+  static __m128d SseDouble(__m128d a, __m128d b) { return _mm_cmpge_pd(a, b); }
+};
+
+// Packs the 16 32-bit masks in 'r0' to 'r3' into 16 bools in 'out'.
+inline void StoreMasks(__m128i r0, __m128i r1, __m128i r2, __m128i r3, bool* out) {
+  // The masks are 0 or -1, which the saturating packs keep as 0 or -1.
+  __m128i masks = _mm_packs_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+      _mm_and_si128(masks, _mm_set1_epi8(1)));
+}
+
+// out[i] = Op::Apply(a[i], b[i]) for i in [0, n).
+template<typename T, typename Op>
+struct CompareKernel {
+  static void Eval(const T* a, const T* b, bool* out, int n) {
+    for (int i = 0; i < n; ++i) out[i] = Op::Apply(a[i], b[i]);
+  }
+};
+
+template<typename Op>
+struct CompareKernel<int32_t, Op> {
+  static void Eval(const int32_t* a, const int32_t* b, bool* out, int n) {
+    const __m128i* va = reinterpret_cast<const __m128i*>(a);
+    const __m128i* vb = reinterpret_cast<const __m128i*>(b);
+    int i = 0;
+    for (; i + 16 <= n; i += 16, va += 4, vb += 4) {
+      StoreMasks(Op::SseInt(_mm_loadu_si128(va), _mm_loadu_si128(vb)),
+          Op::SseInt(_mm_loadu_si128(va + 1), _mm_loadu_si128(vb + 1)),
+          Op::SseInt(_mm_loadu_si128(va + 2), _mm_loadu_si128(vb + 2)),
+          Op::SseInt(_mm_loadu_si128(va + 3), _mm_loadu_si128(vb + 3)), out + i);
+    }
+    for (; i < n; ++i) out[i] = Op::Apply(a[i], b[i]);
+  }
+};
+
+template<typename Op>
+struct CompareKernel<float, Op> {
+  static void Eval(const float* a, const float* b, bool* out, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m128i r[4];
+      for (int j = 0; j < 4; ++j) {
+        r[j] = _mm_castps_si128(Op::SseFloat(
+            _mm_loadu_ps(a + i + 4 * j), _mm_loadu_ps(b + i + 4 * j)));
+      }
+      StoreMasks(r[0], r[1], r[2], r[3], out + i);
+    }
+    for (; i < n; ++i) out[i] = Op::Apply(a[i], b[i]);
+  }
+};
+
+template<typename Op>
+struct CompareKernel<double, Op> {
+  static void Eval(const double* a, const double* b, bool* out, int n) {
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+      int mask = _mm_movemask_pd(Op::SseDouble(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+      out[i] = mask & 1;
+      out[i + 1] = mask >> 1;
+    }
+    for (; i < n; ++i) out[i] = Op::Apply(a[i], b[i]);
+  }
+};
+
+struct AddOp {
+  template<typename T> static T Apply(T a, T b) { return a + b; }
+};
+
+struct SubtractOp {
+  template<typename T> static T Apply(T a, T b) { return a - b; }
+};
+
+struct MultiplyOp {
+  template<typename T> static T Apply(T a, T b) { return a * b; }
+};
+
+// The loops below have no branches or calls, so they are vectorized by the compiler.
+
+// out[i] = a[i] | b[i].
+void MergeNulls(const uint8_t* a, const uint8_t* b, uint8_t* out, int n) {
+  for (int i = 0; i < n; ++i) out[i] = a[i] | b[i];
+}
+
+template<typename T, typename Op>
+void Arithmetic(const T* a, const T* b, T* out, int n) {
+  for (int i = 0; i < n; ++i) out[i] = static_cast<T>(Op::template Apply<T>(a[i], b[i]));
+}
+
+template<typename From, typename To>
+void Cast(const From* in, To* out, int n) {
+  for (int i = 0; i < n; ++i) out[i] = static_cast<To>(in[i]);
+}
+
+// Casts 'in' to 'to_type' into 'out'.
+template<typename From>
+void CastFrom(const From* in, PrimitiveType to_type, void* out, int n) {
+  switch (to_type) {
+#define CASE(primitive_type, To) \
+    case primitive_type: \
+      Cast(in, reinterpret_cast<To*>(out), n); \
+      break;
+    FOR_EACH_VECTORIZED_TYPE(CASE)
+#undef CASE
+    default:
+      DCHECK(false);
+  }
+}
+
+// Same as SlotRef::Get*Val() for all rows.
+template<typename T>
+void Gather(int tuple_idx, int slot_offset, const NullIndicatorOffset& null_offset,
+    TupleRow** rows, int n, T* values, uint8_t* nulls) {
+  for (int i = 0; i < n; ++i) {
+    Tuple* t = rows[i]->GetTuple(tuple_idx);
+    if (t == NULL || t->IsNull(null_offset)) {
+      values[i] = T();
+      nulls[i] = 1;
+    } else {
+      values[i] = *reinterpret_cast<T*>(t->GetSlot(slot_offset));
+      nulls[i] = 0;
+    }
+  }
+}
+
+}
+
+VectorizedExpr* VectorizedExpr::Create(ExprContext* ctx) {
+  if (!FLAGS_enable_vectorized_exprs) return NULL;
+  VectorizedExpr* vectorized = new VectorizedExpr(ctx);
+  Node* root = vectorized->CreateNode(ctx->root());
+  // Evaluating the whole tree row by row into a column is not faster than the row by
+  // row evaluation of the caller.
+  if (root == NULL || root->op == Node::ROW) {
+    delete vectorized;
+    return NULL;
+  }
+  return vectorized;
+}
+
+VectorizedExpr::~VectorizedExpr() {
+  for (int i = 0; i < nodes_.size(); ++i) delete nodes_[i];
+}
+
+VectorizedExpr::Node* VectorizedExpr::CreateNode(Expr* expr) {
+  PrimitiveType type = expr->type().type;
+  if (!IsVectorizedType(type)) return NULL;
+
+  if (expr->IsConstant()) {
+    Node* node = new Node(Node::CONSTANT, expr);
+    nodes_.push_back(node);
+    void* value = ctx_->GetValue(expr, NULL);
+    int byte_size = expr->type().GetByteSize();
+    uint8_t* values = reinterpret_cast<uint8_t*>(node->values<int64_t>());
+    for (int i = 0; i < CHUNK_SIZE; ++i) {
+      node->nulls[i] = value == NULL;
+      if (value != NULL) memcpy(values + i * byte_size, value, byte_size);
+    }
+    return node;
+  }
+
+  if (expr->is_slotref()) {
+    SlotRef* slot_ref = static_cast<SlotRef*>(expr);
+    Node* node = new Node(Node::SLOT, expr);
+    nodes_.push_back(node);
+    node->tuple_idx = slot_ref->tuple_idx();
+    node->slot_offset = slot_ref->slot_offset();
+    node->null_indicator_offset = slot_ref->null_indicator_offset();
+    return node;
+  }
+
+  // Find the vectorized op of 'expr', if any, and check the types of its children.
+  Node::Op op = Node::ROW;
+  const vector<Expr*>& children = expr->children();
+  if (dynamic_cast<AndPredicate*>(expr) != NULL) {
+    op = Node::AND;
+  } else if (dynamic_cast<OrPredicate*>(expr) != NULL) {
+    op = Node::OR;
+  } else if (dynamic_cast<ScalarFnCall*>(expr) != NULL &&
+      expr->fn_.binary_type == TFunctionBinaryType::BUILTIN) {
+    const string& symbol = expr->fn_.scalar_fn.symbol;
+    string name = OperatorName(symbol);
+    if (name == "Add") {
+      op = Node::ADD;
+    } else if (name == "Subtract") {
+      op = Node::SUBTRACT;
+    } else if (name == "Multiply") {
+      op = Node::MULTIPLY;
+    } else if (name == "Eq") {
+      op = Node::EQ;
+    } else if (name == "Ne") {
+      op = Node::NE;
+    } else if (name == "Lt") {
+      op = Node::LT;
+    } else if (name == "Le") {
+      op = Node::LE;
+    } else if (name == "Gt") {
+      op = Node::GT;
+    } else if (name == "Ge") {
+      op = Node::GE;
+    } else if (HasPrefix(symbol, "_ZN6impala13CastFunctions")) {
+      op = Node::CAST;
+    } else if (HasPrefix(symbol, "_ZN6impala15IsNullPredicate6IsNull")) {
+      op = Node::IS_NULL;
+    } else if (HasPrefix(symbol, "_ZN6impala15IsNullPredicate9IsNotNull")) {
+      op = Node::IS_NOT_NULL;
+    } else if (HasPrefix(symbol, "_ZN6impala17CompoundPredicate3Not")) {
+      op = Node::NOT;
+    }
+  }
+
+  switch (op) {
+    case Node::ADD:
+    case Node::SUBTRACT:
+    case Node::MULTIPLY:
+      if (children.size() != 2 || type == TYPE_BOOLEAN ||
+          children[0]->type().type != type || children[1]->type().type != type) {
+        op = Node::ROW;
+      }
+      break;
+    case Node::EQ:
+    case Node::NE:
+    case Node::LT:
+    case Node::LE:
+    case Node::GT:
+    case Node::GE:
+      if (children.size() != 2 || type != TYPE_BOOLEAN ||
+          children[0]->type().type != children[1]->type().type) {
+        op = Node::ROW;
+      }
+      break;
+    case Node::AND:
+    case Node::OR:
+      if (children.size() != 2) op = Node::ROW;
+      break;
+    case Node::CAST:
+    case Node::IS_NULL:
+    case Node::IS_NOT_NULL:
+    case Node::NOT:
+      if (children.size() != 1) op = Node::ROW;
+      break;
+    default:
+      break;
+  }
+
+  vector<Node*> child_nodes;
+  if (op != Node::ROW) {
+    for (int i = 0; i < children.size(); ++i) {
+      Node* child = CreateNode(children[i]);
+      if (child == NULL) {
+        op = Node::ROW;
+        break;
+      }
+      child_nodes.push_back(child);
+    }
+  }
+  // Children created before a child that is not vectorized are left unused in nodes_.
+  if (op == Node::ROW) child_nodes.clear();
+
+  Node* node = new Node(op, expr);
+  node->children = child_nodes;
+  if ((op == Node::AND || op == Node::OR) && child_nodes[1]->ContainsRowOp()) {
+    node->short_circuit = true;
+    node->selection.resize(CHUNK_SIZE);
+    node->selected_rows.resize(CHUNK_SIZE);
+  }
+  nodes_.push_back(node);
+  return node;
+}
+
+void VectorizedExpr::Eval(TupleRow** rows, int num_rows, const void** values,
+    const uint8_t** nulls) {
+  DCHECK_LE(num_rows, CHUNK_SIZE);
+  Node* root = nodes_.back();
+  EvalNode(root, rows, num_rows);
+  *values = root->values<int64_t>();
+  *nulls = &root->nulls[0];
+}
+
+void VectorizedExpr::EvalNode(Node* node, TupleRow** rows, int n) {
+  // The right child of a short-circuiting AND or OR is evaluated below.
+  int num_children = node->short_circuit ? 1 : node->children.size();
+  for (int i = 0; i < num_children; ++i) EvalNode(node->children[i], rows, n);
+  Node* a = node->children.size() > 0 ? node->children[0] : NULL;
+  Node* b = node->children.size() > 1 ? node->children[1] : NULL;
+  uint8_t* nulls = &node->nulls[0];
+
+  switch (node->op) {
+    case Node::CONSTANT:
+      break;
+
+    case Node::SLOT:
+      switch (node->type) {
+#define CASE(primitive_type, T) \
+        case primitive_type: \
+          Gather<T>(node->tuple_idx, node->slot_offset, node->null_indicator_offset, \
+              rows, n, node->values<T>(), nulls); \
+          break;
+        FOR_EACH_VECTORIZED_TYPE(CASE)
+#undef CASE
+        default:
+          DCHECK(false);
+      }
+      break;
+
+    case Node::ROW: {
+      int byte_size = node->expr->type().GetByteSize();
+      uint8_t* values = reinterpret_cast<uint8_t*>(node->values<int64_t>());
+      for (int i = 0; i < n; ++i) {
+        void* value = ctx_->GetValue(node->expr, rows[i]);
+        nulls[i] = value == NULL;
+        if (value != NULL) memcpy(values + i * byte_size, value, byte_size);
+      }
+      break;
+    }
+
+    case Node::CAST:
+      memcpy(nulls, &a->nulls[0], n);
+      switch (a->type) {
+#define CASE(primitive_type, T) \
+        case primitive_type: \
+          CastFrom(a->values<T>(), node->type, node->values<int64_t>(), n); \
+          break;
+        FOR_EACH_VECTORIZED_TYPE(CASE)
+#undef CASE
+        default:
+          DCHECK(false);
+      }
+      break;
+
+    case Node::ADD:
+    case Node::SUBTRACT:
+    case Node::MULTIPLY:
+      MergeNulls(&a->nulls[0], &b->nulls[0], nulls, n);
+      switch (node->type) {
+#define CASE(primitive_type, T) \
+        case primitive_type: \
+          if (node->op == Node::ADD) { \
+            Arithmetic<T, AddOp>(a->values<T>(), b->values<T>(), node->values<T>(), n); \
+          } else if (node->op == Node::SUBTRACT) { \
+            Arithmetic<T, SubtractOp>( \
+                a->values<T>(), b->values<T>(), node->values<T>(), n); \
+          } else { \
+            Arithmetic<T, MultiplyOp>( \
+                a->values<T>(), b->values<T>(), node->values<T>(), n); \
+          } \
+          break;
+        FOR_EACH_VECTORIZED_TYPE(CASE)
+#undef CASE
+        default:
+          DCHECK(false);
+      }
+      break;
+
+    case Node::EQ:
+    case Node::NE:
+    case Node::LT:
+    case Node::LE:
+    case Node::GT:
+    case Node::GE:
+      MergeNulls(&a->nulls[0], &b->nulls[0], nulls, n);
+      switch (a->type) {
+#define COMPARE(T, OpType) \
+        CompareKernel<T, OpType>::Eval(a->values<T>(), b->values<T>(), \
+            node->values<bool>(), n)
+#define CASE(primitive_type, T) \
+        case primitive_type: \
+          switch (node->op) { \
+            case Node::EQ: COMPARE(T, EqOp); break; \
+            case Node::NE: COMPARE(T, NeOp); break; \
+            case Node::LT: COMPARE(T, LtOp); break; \
+            case Node::LE: COMPARE(T, LeOp); break; \
+            case Node::GT: COMPARE(T, GtOp); break; \
+            default: COMPARE(T, GeOp); break; \
+          } \
+          break;
+        FOR_EACH_VECTORIZED_TYPE(CASE)
+#undef CASE
+#undef COMPARE
+        default:
+          DCHECK(false);
+      }
+      break;
+
+    case Node::IS_NULL:
+    case Node::IS_NOT_NULL: {
+      bool* values = node->values<bool>();
+      const uint8_t* child_nulls = &a->nulls[0];
+      uint8_t is_null = node->op == Node::IS_NULL;
+      for (int i = 0; i < n; ++i) values[i] = child_nulls[i] == is_null;
+      memset(nulls, 0, n);
+      break;
+    }
+
+    case Node::AND:
+    case Node::OR: {
+      // Three-valued logic: the result is NULL if either child is NULL, unless the other
+      // child decides the result on its own (false for AND, true for OR).
+      bool* values = node->values<bool>();
+      const bool* a_values = a->values<bool>();
+      const bool* b_values = b->values<bool>();
+      const uint8_t* a_nulls = &a->nulls[0];
+      const uint8_t* b_nulls = &b->nulls[0];
+      bool is_and = node->op == Node::AND;
+      if (node->short_circuit) {
+        // Evaluate the right child over the rows the left child does not decide, i.e.
+        // where it is NULL or true for AND (false for OR). The results of the right
+        // child are dense: b_values[j] is the result of row selection[j].
+        int* selection = &node->selection[0];
+        TupleRow** selected_rows = &node->selected_rows[0];
+        int num_selected = 0;
+        for (int i = 0; i < n; ++i) {
+          if (a_nulls[i] || a_values[i] == is_and) {
+            selection[num_selected] = i;
+            selected_rows[num_selected] = rows[i];
+            ++num_selected;
+          } else {
+            values[i] = !is_and;
+            nulls[i] = 0;
+          }
+        }
+        if (num_selected > 0) EvalNode(b, selected_rows, num_selected);
+        for (int j = 0; j < num_selected; ++j) {
+          int i = selection[j];
+          uint8_t b_decides = !b_nulls[j] & (b_values[j] != is_and);
+          values[i] = b_decides != is_and;
+          nulls[i] = (a_nulls[i] | b_nulls[j]) & !b_decides;
+        }
+      } else if (is_and) {
+        for (int i = 0; i < n; ++i) {
+          uint8_t a_false = !a_nulls[i] & !a_values[i];
+          uint8_t b_false = !b_nulls[i] & !b_values[i];
+          values[i] = !(a_false | b_false);
+          nulls[i] = (a_nulls[i] | b_nulls[i]) & !(a_false | b_false);
+        }
+      } else {
+        for (int i = 0; i < n; ++i) {
+          uint8_t a_true = !a_nulls[i] & a_values[i];
+          uint8_t b_true = !b_nulls[i] & b_values[i];
+          values[i] = a_true | b_true;
+          nulls[i] = (a_nulls[i] | b_nulls[i]) & !(a_true | b_true);
+        }
+      }
+      break;
+    }
+
+    case Node::NOT: {
+      bool* values = node->values<bool>();
+      const bool* child_values = a->values<bool>();
+      for (int i = 0; i < n; ++i) values[i] = !child_values[i];
+      memcpy(nulls, &a->nulls[0], n);
+      break;
+    }
+  }
+}
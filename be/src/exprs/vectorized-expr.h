@@ -0,0 +1,87 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXPRS_VECTORIZED_EXPR_H
+#define IMPALA_EXPRS_VECTORIZED_EXPR_H
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+namespace impala {
+
+class Expr;
+class ExprContext;
+class TupleRow;
+
+// Evaluates an expr tree over a chunk of rows at a time, instead of calling Get*Val() on
+// every node of the tree once per row. The tree is evaluated bottom-up, one node over the
+// whole chunk at a time, into a column of values and a column of null flags per node:
+//  - slot refs gather the slot of each row into a dense column,
+//  - constant subtrees are evaluated once, into a full column,
+//  - casts, +, -, * and the comparison operators on BOOLEAN, integer, FLOAT and DOUBLE
+//    values run loops over the columns of their children. The comparisons of INT, FLOAT
+//    and DOUBLE values are SSE2 kernels; the other loops are simple enough to be
+//    vectorized by the compiler,
+//  - IS [NOT] NULL reads the null column of its child,
+//  - AND and OR combine the columns of their children. If the right child evaluates
+//    anything row by row, it is only evaluated over the rows the left child does not
+//    decide, which keeps the short-circuiting of the row by row evaluation,
+//  - any other subtree of one of these types is evaluated row by row into a column.
+// This replaces the virtual call, the AnyVal return value and the null checks of every
+// node for every row with one call per node per chunk.
+//
+// Created and owned by an ExprContext, see ExprContext::EvalPredicate(). Like the
+// ExprContext, not thread-safe.
+class VectorizedExpr {
+ public:
+  // Maximum number of rows evaluated by one call to Eval(). Bounds the memory of the
+  // columns, 9 bytes per row per node.
+  static const int CHUNK_SIZE = 1024;
+
+  // Returns the vectorized version of the expr tree of 'ctx', or NULL if the root of the
+  // tree is not vectorized (which includes all trees not of one of the types above).
+  // 'ctx' must be opened; it is used to evaluate constant and row by row subtrees.
+  // The caller owns the returned object.
+  static VectorizedExpr* Create(ExprContext* ctx);
+
+  ~VectorizedExpr();
+
+  // Evaluates the tree over rows[0, num_rows), num_rows <= CHUNK_SIZE. Sets 'values' to
+  // the results, an array of the C++ type of the root's type (e.g. bool for predicates),
+  // and 'nulls' to their null flags (1 if the result is NULL). Both are valid until the
+  // next call.
+  void Eval(TupleRow** rows, int num_rows, const void** values, const uint8_t** nulls);
+
+ private:
+  struct Node;
+
+  VectorizedExpr(ExprContext* ctx) : ctx_(ctx) { }
+
+  // Creates the node for 'expr' and, recursively, for its children. Returns NULL if
+  // 'expr' is not of a supported type.
+  Node* CreateNode(Expr* expr);
+
+  // Evaluates the children of 'node' and then 'node' over rows[0, num_rows).
+  void EvalNode(Node* node, TupleRow** rows, int num_rows);
+
+  ExprContext* ctx_;
+
+  // All nodes of the tree, owned. The root is the last one.
+  std::vector<Node*> nodes_;
+};
+
+}
+
+#endif
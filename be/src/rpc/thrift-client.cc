@@ -17,6 +17,7 @@
 #include <boost/assign.hpp>
 #include <boost/lexical_cast.hpp>
 #include <ostream>
+#include <poll.h>
 #include <thrift/Thrift.h>
 #include <gutil/strings/substitute.h>
 
@@ -83,6 +84,16 @@ void ThriftClientImpl::Close() {
   }
 }
 
+bool ThriftClientImpl::IsIdleConnectionOpen() {
+  if (transport_.get() == NULL || !transport_->isOpen()) return false;
+  pollfd fd;
+  fd.fd = socket_->getSocketFD();
+  fd.events = POLLIN;
+  fd.revents = 0;
+  // There is nothing to read from an idle connection, unless the server closed it.
+  return poll(&fd, 1, 0) == 0;
+}
+
 Status ThriftClientImpl::CreateSocket() {
   if (!ssl_) {
     socket_.reset(new TSocket(address_.hostname, address_.port));
@@ -58,6 +58,11 @@ class ThriftClientImpl {
   // Close the connection with the remote server. May be called repeatedly.
   void Close();
 
+  // Returns true if the connection is open and has nothing to read, which is the state
+  // of a healthy connection between rpcs. Returns false if the connection was closed
+  // locally or by the server. Does not block.
+  bool IsIdleConnectionOpen();
+
   // Set receive timeout on the underlying TSocket.
   void setRecvTimeout(int32_t ms) { socket_->setRecvTimeout(ms); }
 
@@ -106,9 +111,11 @@ class ThriftClient : public ThriftClientImpl {
   //  - auth_provider: Authentication scheme to use. If NULL, use the global default
   //    client<->demon authentication scheme.
   //  - ssl: if true, SSL is enabled on this connection
+  //  - framed: if true, use framed instead of buffered transport, as required by
+  //    servers of type ThriftServer::Nonblocking
   ThriftClient(const std::string& ipaddress, int port,
       const std::string& service_name = "", AuthProvider* auth_provider = NULL,
-      bool ssl = false);
+      bool ssl = false, bool framed = false);
 
   // Returns the object used to actually make RPCs against the remote server
   InterfaceType* iface() { return iface_.get(); }
@@ -122,12 +129,16 @@ class ThriftClient : public ThriftClientImpl {
 template <class InterfaceType>
 ThriftClient<InterfaceType>::ThriftClient(const std::string& ipaddress, int port,
     const std::string& service_name,
-    AuthProvider* auth_provider, bool ssl)
+    AuthProvider* auth_provider, bool ssl, bool framed)
     : ThriftClientImpl(ipaddress, port, ssl),
       iface_(new InterfaceType(protocol_)),
       auth_provider_(auth_provider) {
 
-  transport_.reset(new apache::thrift::transport::TBufferedTransport(socket_));
+  if (framed) {
+    transport_.reset(new apache::thrift::transport::TFramedTransport(socket_));
+  } else {
+    transport_.reset(new apache::thrift::transport::TBufferedTransport(socket_));
+  }
 
   if (auth_provider_ == NULL) {
     auth_provider_ = AuthManager::GetInstance()->GetInternalAuthProvider();
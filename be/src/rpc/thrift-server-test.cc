@@ -14,14 +14,21 @@
 
 #include "testutil/in-process-servers.h"
 #include "rpc/thrift-client.h"
+#include "rpc/thrift-server.h"
+#include "runtime/client-cache.h"
 #include "service/impala-server.h"
 #include <string>
+#include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 #include "common/init.h"
 #include "service/fe-support.h"
+#include "util/metrics.h"
+#include "util/thread.h"
+#include "util/time.h"
 
 using namespace impala;
 using namespace std;
+using boost::scoped_ptr;
 
 DECLARE_string(ssl_server_certificate);
 DECLARE_string(ssl_private_key);
@@ -30,6 +37,11 @@ DECLARE_string(ssl_client_ca_certificate);
 DECLARE_int32(be_port);
 DECLARE_int32(beeswax_port);
 
+DECLARE_int32(client_cache_max_clients_per_host);
+DECLARE_int32(client_cache_max_idle_clients_per_host);
+DECLARE_int32(client_cache_idle_timeout_s);
+DECLARE_int32(client_cache_wait_timeout_ms);
+
 TEST(SslTest, Connectivity) {
   // Start a server using SSL and confirm that an SSL client can connect, while a non-SSL
   // client cannot.
@@ -63,6 +75,197 @@ TEST(SslTest, Connectivity) {
   EXPECT_THROW(non_ssl_client.iface()->PingImpalaService(resp), TTransportException);
 }
 
+// Processor that fails every rpc, so that the server closes the connection.
+class NullProcessor : public apache::thrift::TProcessor {
+ public:
+  virtual bool process(boost::shared_ptr<apache::thrift::protocol::TProtocol> in,
+      boost::shared_ptr<apache::thrift::protocol::TProtocol> out,
+      void* connection_context) {
+    return false;
+  }
+};
+
+TEST(NonblockingServerTest, MaxBlockingRpcs) {
+  // A non-blocking server must have more workers than rpcs that may block at once.
+  const int PORT = 30200;
+  boost::shared_ptr<apache::thrift::TProcessor> processor(new NullProcessor());
+  ThriftServer too_few("too-few-workers", processor, PORT, NULL, NULL, 4,
+      ThriftServer::Nonblocking);
+  too_few.SetMaxBlockingRpcs(4);
+  EXPECT_FALSE(too_few.Start().ok());
+
+  ThriftServer enough("enough-workers", processor, PORT, NULL, NULL, 5,
+      ThriftServer::Nonblocking);
+  enough.SetMaxBlockingRpcs(4);
+  ASSERT_TRUE(enough.Start().ok());
+  enough.StopForTesting();
+}
+
+// Runs a server that accepts connections, and a client cache with metrics, to test how
+// the cache bounds, reaps and replaces clients.
+class ClientCacheTest : public testing::Test {
+ protected:
+  static const int PORT = 30201;
+
+  virtual void SetUp() {
+    saved_max_clients_ = FLAGS_client_cache_max_clients_per_host;
+    saved_max_idle_clients_ = FLAGS_client_cache_max_idle_clients_per_host;
+    saved_idle_timeout_s_ = FLAGS_client_cache_idle_timeout_s;
+    saved_wait_timeout_ms_ = FLAGS_client_cache_wait_timeout_ms;
+
+    boost::shared_ptr<apache::thrift::TProcessor> processor(new NullProcessor());
+    server_.reset(new ThriftServer("client-cache-test", processor, PORT));
+    ASSERT_TRUE(server_->Start().ok());
+    address_ = MakeNetworkAddress("localhost", PORT);
+    metrics_.reset(new MetricGroup("client-cache-test"));
+  }
+
+  virtual void TearDown() {
+    cache_.reset();
+    server_->StopForTesting();
+    FLAGS_client_cache_max_clients_per_host = saved_max_clients_;
+    FLAGS_client_cache_max_idle_clients_per_host = saved_max_idle_clients_;
+    FLAGS_client_cache_idle_timeout_s = saved_idle_timeout_s_;
+    FLAGS_client_cache_wait_timeout_ms = saved_wait_timeout_ms_;
+  }
+
+  // Creates the cache. Must be called after setting the client cache flags.
+  void CreateCache() {
+    cache_.reset(new ImpalaInternalServiceClientCache());
+    cache_->InitMetrics(metrics_.get(), "test");
+  }
+
+  // Returns a new connection from the cache, NULL if there was an error.
+  ImpalaInternalServiceConnection* GetConnection(Status* status) {
+    scoped_ptr<ImpalaInternalServiceConnection> connection(
+        new ImpalaInternalServiceConnection(cache_.get(), address_, status));
+    return status->ok() ? connection.release() : NULL;
+  }
+
+  int64_t MetricValue(const string& name) {
+    const string key = "test.client-cache." + name;
+    if (name == "total-clients" || name == "clients-in-use") {
+      return metrics_->FindMetricForTesting<IntGauge>(key)->value();
+    }
+    return metrics_->FindMetricForTesting<IntCounter>(key)->value();
+  }
+
+  scoped_ptr<ThriftServer> server_;
+  TNetworkAddress address_;
+  scoped_ptr<MetricGroup> metrics_;
+  scoped_ptr<ImpalaInternalServiceClientCache> cache_;
+
+  int32_t saved_max_clients_;
+  int32_t saved_max_idle_clients_;
+  int32_t saved_idle_timeout_s_;
+  int32_t saved_wait_timeout_ms_;
+};
+
+// Releases 'connection' back to its cache after 'delay_ms'.
+static void ReleaseAfter(scoped_ptr<ImpalaInternalServiceConnection>* connection,
+    int64_t delay_ms) {
+  SleepForMs(delay_ms);
+  connection->reset();
+}
+
+TEST_F(ClientCacheTest, MaxClientsPerHost) {
+  FLAGS_client_cache_max_clients_per_host = 2;
+  FLAGS_client_cache_wait_timeout_ms = 500;
+  CreateCache();
+
+  Status status;
+  scoped_ptr<ImpalaInternalServiceConnection> first(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  scoped_ptr<ImpalaInternalServiceConnection> second(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+
+  // A third client blocks until the wait times out.
+  int64_t start_ms = MonotonicMillis();
+  scoped_ptr<ImpalaInternalServiceConnection> third(GetConnection(&status));
+  EXPECT_FALSE(status.ok());
+  EXPECT_TRUE(third.get() == NULL);
+  EXPECT_GE(MonotonicMillis() - start_ms, FLAGS_client_cache_wait_timeout_ms);
+  EXPECT_EQ(MetricValue("total-clients"), 2);
+
+  // A waiting request gets the client that is released while it waits.
+  FLAGS_client_cache_wait_timeout_ms = 60000;
+  Thread releaser("client-cache-test", "releaser", &ReleaseAfter, &first, 100L);
+  third.reset(GetConnection(&status));
+  releaser.Join();
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  EXPECT_EQ(MetricValue("total-clients"), 2);
+  EXPECT_EQ(MetricValue("hits"), 1);
+  EXPECT_EQ(MetricValue("misses"), 2);
+}
+
+TEST_F(ClientCacheTest, MaxIdleClientsPerHost) {
+  FLAGS_client_cache_max_idle_clients_per_host = 1;
+  CreateCache();
+
+  Status status;
+  scoped_ptr<ImpalaInternalServiceConnection> connections[3];
+  for (int i = 0; i < 3; ++i) {
+    connections[i].reset(GetConnection(&status));
+    ASSERT_TRUE(status.ok()) << status.GetDetail();
+  }
+  EXPECT_EQ(MetricValue("total-clients"), 3);
+
+  // Only the first released client is kept, the others are closed.
+  for (int i = 0; i < 3; ++i) connections[i].reset();
+  EXPECT_EQ(MetricValue("clients-in-use"), 0);
+  EXPECT_EQ(MetricValue("total-clients"), 1);
+  EXPECT_EQ(MetricValue("evictions"), 2);
+
+  connections[0].reset(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  EXPECT_EQ(MetricValue("hits"), 1);
+}
+
+TEST_F(ClientCacheTest, IdleTimeout) {
+  FLAGS_client_cache_idle_timeout_s = 1;
+  CreateCache();
+
+  Status status;
+  scoped_ptr<ImpalaInternalServiceConnection> connection(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  connection.reset();
+  EXPECT_EQ(MetricValue("total-clients"), 1);
+
+  // The reaper runs every second, so the client is closed at most two seconds after it
+  // was released.
+  for (int i = 0; i < 50 && MetricValue("total-clients") > 0; ++i) SleepForMs(100);
+  EXPECT_EQ(MetricValue("total-clients"), 0);
+  EXPECT_EQ(MetricValue("evictions"), 1);
+
+  connection.reset(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  EXPECT_EQ(MetricValue("misses"), 2);
+}
+
+TEST_F(ClientCacheTest, ClosedConnectionIsReplaced) {
+  CreateCache();
+
+  Status status;
+  scoped_ptr<ImpalaInternalServiceConnection> connection(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  // NullProcessor fails the rpc, so the server closes the connection.
+  TCancelPlanFragmentParams params;
+  TCancelPlanFragmentResult result;
+  EXPECT_THROW((*connection)->CancelPlanFragment(result, params),
+      apache::thrift::TException);
+  connection.reset();
+  EXPECT_EQ(MetricValue("total-clients"), 1);
+
+  // The closed client is not handed out again, a new one is opened instead.
+  connection.reset(GetConnection(&status));
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  EXPECT_EQ(MetricValue("hits"), 0);
+  EXPECT_EQ(MetricValue("misses"), 2);
+  EXPECT_EQ(MetricValue("opens"), 2);
+  EXPECT_EQ(MetricValue("evictions"), 1);
+  EXPECT_EQ(MetricValue("total-clients"), 1);
+}
+
 int main(int argc, char** argv) {
   InitCommonRuntime(argc, argv, true);
   InitFeSupport();
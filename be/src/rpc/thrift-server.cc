@@ -21,6 +21,7 @@
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/ThreadManager.h>
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/server/TNonblockingServer.h>
 #include <thrift/server/TThreadPoolServer.h>
 #include <thrift/server/TThreadedServer.h>
 #include <thrift/transport/TSocket.h>
@@ -205,11 +206,16 @@ void* ThriftServer::ThriftServerEventProcessor::createContext(shared_ptr<TProtoc
   TTransport* transport = input->getTransport().get();
   shared_ptr<ConnectionContext> connection_ptr =
       shared_ptr<ConnectionContext>(new ConnectionContext);
-  TTransport* underlying_transport =
-      (static_cast<TBufferedTransport*>(transport))->getUnderlyingTransport().get();
-  if (!thrift_server_->auth_provider_->is_sasl()) {
+  if (thrift_server_->server_type_ == Nonblocking) {
+    // The protocols of a TNonblockingServer read from and write to memory buffers, and
+    // the socket of the connection is not accessible here.
+  } else if (!thrift_server_->auth_provider_->is_sasl()) {
+    TTransport* underlying_transport =
+        (static_cast<TBufferedTransport*>(transport))->getUnderlyingTransport().get();
     socket = static_cast<TSocket*>(underlying_transport);
   } else {
+    TTransport* underlying_transport =
+        (static_cast<TBufferedTransport*>(transport))->getUnderlyingTransport().get();
     TSaslServerTransport* sasl_transport = static_cast<TSaslServerTransport*>(
         underlying_transport);
 
@@ -220,8 +226,10 @@ void* ThriftServer::ThriftServerEventProcessor::createContext(shared_ptr<TProtoc
 
   {
     connection_ptr->server_name = thrift_server_->name_;
-    connection_ptr->network_address =
-        MakeNetworkAddress(socket->getPeerAddress(), socket->getPeerPort());
+    if (socket != NULL) {
+      connection_ptr->network_address =
+          MakeNetworkAddress(socket->getPeerAddress(), socket->getPeerPort());
+    }
 
     lock_guard<mutex> l(thrift_server_->connection_contexts_lock_);
     uuid connection_uuid = thrift_server_->uuid_generator_();
@@ -250,6 +258,17 @@ void* ThriftServer::ThriftServerEventProcessor::createContext(shared_ptr<TProtoc
 void ThriftServer::ThriftServerEventProcessor::processContext(void* context,
     shared_ptr<TTransport> transport) {
   __connection_context__ = reinterpret_cast<ConnectionContext*>(context);
+  // A TNonblockingServer calls this on the worker thread that runs the rpc, right before
+  // the rpc, which sets the thread-local connection context for it. It passes the
+  // connection's socket, which createContext() could not access.
+  if (thrift_server_->server_type_ == Nonblocking &&
+      __connection_context__->network_address.hostname.empty()) {
+    TSocket* socket = dynamic_cast<TSocket*>(transport.get());
+    if (socket != NULL) {
+      __connection_context__->network_address =
+          MakeNetworkAddress(socket->getPeerAddress(), socket->getPeerPort());
+    }
+  }
 }
 
 void ThriftServer::ThriftServerEventProcessor::deleteContext(void* serverContext,
@@ -277,6 +296,7 @@ ThriftServer::ThriftServer(const string& name, const shared_ptr<TProcessor>& pro
       port_(port),
       ssl_enabled_(false),
       num_worker_threads_(num_worker_threads),
+      max_blocking_rpcs_(0),
       server_type_(server_type),
       name_(name),
       server_thread_(NULL),
@@ -358,6 +378,34 @@ Status ThriftServer::Start() {
   RETURN_IF_ERROR(CreateSocket(&server_socket));
   RETURN_IF_ERROR(auth_provider_->GetServerTransportFactory(&transport_factory));
   switch (server_type_) {
+    case Nonblocking:
+      {
+        if (ssl_enabled() || auth_provider_->is_sasl()) {
+          stringstream error_msg;
+          error_msg << "ThriftServer '" << name_ << "' cannot use SSL or SASL with a "
+                    << "non-blocking server";
+          LOG(ERROR) << error_msg.str();
+          return Status(error_msg.str());
+        }
+        if (num_worker_threads_ <= max_blocking_rpcs_) {
+          stringstream error_msg;
+          error_msg << "ThriftServer '" << name_ << "' has " << num_worker_threads_
+                    << " worker threads, but up to " << max_blocking_rpcs_ << " rpcs "
+                    << "may block at once. A non-blocking server needs more workers than "
+                    << "blocked rpcs.";
+          LOG(ERROR) << error_msg.str();
+          return Status(error_msg.str());
+        }
+        shared_ptr<ThreadManager> thread_mgr(
+            ThreadManager::newSimpleThreadManager(num_worker_threads_));
+        thread_mgr->threadFactory(thread_factory);
+        thread_mgr->start();
+        // TNonblockingServer creates its own listening socket and expects framed
+        // transport, so server_socket and transport_factory are not used.
+        server_.reset(new TNonblockingServer(processor_, protocol_factory, port_,
+                thread_mgr));
+      }
+      break;
     case ThreadPool:
       {
         shared_ptr<ThreadManager> thread_mgr(
@@ -399,7 +447,7 @@ void ThriftServer::Join() {
 void ThriftServer::StopForTesting() {
   DCHECK(server_thread_ != NULL);
   DCHECK(server_);
-  DCHECK_EQ(server_type_, Threaded);
+  DCHECK(server_type_ == Threaded || server_type_ == Nonblocking);
   server_->stop();
   if (started_) Join();
 }
@@ -32,9 +32,10 @@
 namespace impala {
 
 // Utility class for all Thrift servers. Runs a threaded server by default, or a
-// TThreadPoolServer with, by default, 2 worker threads, that exposes the interface
-// described by a user-supplied TProcessor object.
-// If TThreadPoolServer is used, client must use TSocket as transport.
+// TThreadPoolServer or TNonblockingServer with, by default, 2 worker threads, that
+// exposes the interface described by a user-supplied TProcessor object.
+// If TThreadPoolServer is used, client must use TSocket as transport. If
+// TNonblockingServer is used, clients must use TFramedTransport.
 // TODO: Need a builder to help with the unwieldy constructor
 class ThriftServer {
  public:
@@ -63,11 +64,20 @@ class ThriftServer {
 
   static const int DEFAULT_WORKER_THREADS = 2;
 
-  // There are 2 servers supported by Thrift with different threading models.
+  // There are 3 servers supported by Thrift with different threading models.
   // ThreadPool  -- Allocates a fixed number of threads. A thread is used by a
   //                connection until it closes.
   // Threaded    -- Allocates 1 thread per connection, as needed.
-  enum ServerType { ThreadPool = 0, Threaded };
+  // Nonblocking -- Serves all connections from a single libevent loop, and runs rpcs in a
+  //                fixed number of worker threads, so idle connections don't use
+  //                threads. Rpcs that block hold a worker thread, and rpcs are queued
+  //                while all workers are busy (see SetMaxBlockingRpcs()). Requires framed
+  //                transport on the clients, and supports neither SSL nor SASL. The
+  //                connection context is set on the worker thread before each rpc, so
+  //                GetThreadConnectionContext() works as for the other servers, but the
+  //                ConnectionContext passed to ConnectionStart() has no network address
+  //                yet.
+  enum ServerType { ThreadPool = 0, Threaded, Nonblocking };
 
   // Creates, but does not start, a new server on the specified port
   // that exports the supplied interface.
@@ -89,6 +99,18 @@ class ThriftServer {
   // file does not exist, an error is returned.
   Status EnableSsl(const std::string& certificate, const std::string& private_key);
 
+  // Sets the number of rpcs that may block at once, e.g. TransmitData() calls waiting
+  // for a full stream. Must be called before Start(). The server does not enforce this
+  // number, the service must keep its rpcs from blocking beyond it (see
+  // DataStreamMgr::SetMaxBlockedSenders()). A Nonblocking server needs more worker
+  // threads than that, or the blocked rpcs may hold all of them while the rpcs that
+  // would unblock them are queued; Start() fails in that case. Ignored by the other
+  // server types, which run every connection on its own thread.
+  void SetMaxBlockingRpcs(int max_blocking_rpcs) {
+    DCHECK(!started_);
+    max_blocking_rpcs_ = max_blocking_rpcs;
+  }
+
   int port() const { return port_; }
 
   bool ssl_enabled() const { return ssl_enabled_; }
@@ -97,7 +119,7 @@ class ThriftServer {
   void Join();
 
   // FOR TESTING ONLY; stop the server and block until the server is stopped; use it
-  // only if it is a Threaded server.
+  // only if it is a Threaded or Nonblocking server.
   void StopForTesting();
 
   // Starts the main server thread. Once this call returns, clients
@@ -155,6 +177,9 @@ class ThriftServer {
   // (requests are queued if no thread is immediately available)
   int num_worker_threads_;
 
+  // See SetMaxBlockingRpcs(). 0 if not set.
+  int max_blocking_rpcs_;
+
   // ThreadPool or Threaded server
   ServerType server_type_;
 
@@ -16,6 +16,7 @@
 #include "runtime/mem-tracker.h"
 #include "runtime/mem-pool.h"
 #include "runtime/buffered-block-mgr.h"
+#include "runtime/slab-allocator.h"
 #include "runtime/tmp-file-mgr.h"
 #include "util/runtime-profile.h"
 #include "util/disk-info.h"
@@ -318,7 +319,7 @@ bool BufferedBlockMgr::ConsumeMemory(Client* client, int64_t size) {
     if (buffer_desc == NULL) break;
     all_io_buffers_.erase(buffer_desc->all_buffers_it);
     if (buffer_desc->block != NULL) buffer_desc->block->buffer_desc_ = NULL;
-    delete[] buffer_desc->buffer;
+    SlabAllocator::instance()->Free(buffer_desc->buffer, buffer_desc->len);
     ++buffers_acquired;
   } while (buffers_acquired != buffers_needed);
 
@@ -399,7 +400,7 @@ Status BufferedBlockMgr::GetNewBlock(Client* client, Block* unpin_block, Block**
       DCHECK(unpin_block == NULL);
       if (client->tracker_->TryConsume(len)) {
         // TODO: Have a cache of unused blocks of size 'len' (0, max_block_size_)
-        uint8_t* buffer = new uint8_t[len];
+        uint8_t* buffer = SlabAllocator::instance()->Allocate(len);
         new_block->buffer_desc_ = obj_pool_.Add(new BufferDescriptor(buffer, len));
         new_block->buffer_desc_->block = new_block;
         new_block->is_pinned_ = true;
@@ -502,7 +503,7 @@ BufferedBlockMgr::~BufferedBlockMgr() {
   // Free memory resources.
   BOOST_FOREACH(BufferDescriptor* buffer, all_io_buffers_) {
     mem_tracker_->Release(buffer->len);
-    delete[] buffer->buffer;
+    SlabAllocator::instance()->Free(buffer->buffer, buffer->len);
   }
   DCHECK_EQ(mem_tracker_->consumption(), 0);
   mem_tracker_->UnregisterFromParent();
@@ -811,7 +812,8 @@ Status BufferedBlockMgr::DeleteBlock(Block* block) {
   if (block->buffer_desc_ != NULL) {
     if (block->buffer_desc_->len != max_block_size_) {
       // Just delete the block for now.
-      delete[] block->buffer_desc_->buffer;
+      SlabAllocator::instance()->Free(block->buffer_desc_->buffer,
+          block->buffer_desc_->len);
       block->client_->tracker_->Release(block->buffer_desc_->len);
     } else if (!free_io_buffers_.Contains(block->buffer_desc_)) {
       free_io_buffers_.Enqueue(block->buffer_desc_);
@@ -941,7 +943,7 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
   // First, try to allocate a new buffer.
   if (free_io_buffers_.size() < block_write_threshold_ &&
       mem_tracker_->TryConsume(max_block_size_)) {
-    uint8_t* new_buffer = new uint8_t[max_block_size_];
+    uint8_t* new_buffer = SlabAllocator::instance()->Allocate(max_block_size_);
     *buffer_desc = obj_pool_.Add(new BufferDescriptor(new_buffer, max_block_size_));
     (*buffer_desc)->all_buffers_it = all_io_buffers_.insert(
         all_io_buffers_.end(), *buffer_desc);
@@ -22,10 +22,13 @@
 #include <memory>
 
 #include <boost/foreach.hpp>
+#include <gflags/gflags.h>
 
 #include "common/logging.h"
 #include "util/container-util.h"
 #include "util/network-util.h"
+#include "util/thread.h"
+#include "util/time.h"
 #include "rpc/thrift-util.h"
 #include "gen-cpp/ImpalaInternalService.h"
 
@@ -36,40 +39,138 @@ using namespace apache::thrift::server;
 using namespace apache::thrift::transport;
 using namespace apache::thrift::protocol;
 
-namespace impala {
+DEFINE_int32(client_cache_max_clients_per_host, 0, "Maximum number of clients, in use "
+    "or not, that a client cache keeps to a single host. Requests for more clients wait "
+    "until a client is released. If <= 0, the number of clients is not limited.");
+DEFINE_int32(client_cache_max_idle_clients_per_host, 64, "Maximum number of unused "
+    "clients that a client cache keeps to a single host. Clients that are released "
+    "while this many clients are idle are closed. If <= 0, idle clients are not "
+    "limited.");
+DEFINE_int32(client_cache_idle_timeout_s, 300, "Clients in a client cache that have not "
+    "been used for this many seconds are closed. If <= 0, idle clients are kept open.");
+DEFINE_int32(client_cache_wait_timeout_ms, 60000, "Maximum time to wait for a client if "
+    "--client_cache_max_clients_per_host clients to the host are in use.");
 
-Status ClientCacheHelper::GetClient(const TNetworkAddress& address,
-    ClientFactory factory_method, ClientKey* client_key) {
-  boost::shared_ptr<PerHostCache> host_cache;
+ClientCacheHelper::ClientCacheHelper(uint32_t num_tries, uint64_t wait_ms,
+    int32_t send_timeout_ms, int32_t recv_timeout_ms)
+  : num_tries_(num_tries),
+    wait_ms_(wait_ms),
+    send_timeout_ms_(send_timeout_ms),
+    recv_timeout_ms_(recv_timeout_ms),
+    metrics_enabled_(false),
+    shut_down_(false) {
+}
+
+ClientCacheHelper::~ClientCacheHelper() {
   {
-    lock_guard<mutex> lock(cache_lock_);
-    VLOG(2) << "GetClient(" << address << ")";
-    boost::shared_ptr<PerHostCache>* ptr = &per_host_caches_[address];
-    if (ptr->get() == NULL) ptr->reset(new PerHostCache());
-    host_cache = *ptr;
+    lock_guard<mutex> lock(idle_reaper_lock_);
+    shut_down_ = true;
+  }
+  shut_down_cv_.notify_all();
+  if (idle_reaper_thread_.get() != NULL) idle_reaper_thread_->Join();
+}
+
+boost::shared_ptr<ClientCacheHelper::PerHostCache> ClientCacheHelper::GetHostCache(
+    const TNetworkAddress& address) {
+  if (FLAGS_client_cache_idle_timeout_s > 0) {
+    lock_guard<mutex> lock(idle_reaper_lock_);
+    if (idle_reaper_thread_.get() == NULL && !shut_down_) {
+      idle_reaper_thread_.reset(new Thread("client-cache", "idle-client-reaper",
+          &ClientCacheHelper::IdleReaperLoop, this));
+    }
   }
+  lock_guard<mutex> lock(cache_lock_);
+  boost::shared_ptr<PerHostCache>* ptr = &per_host_caches_[address];
+  if (ptr->get() == NULL) ptr->reset(new PerHostCache());
+  return *ptr;
+}
+
+Status ClientCacheHelper::GetClient(const TNetworkAddress& address,
+    ClientFactory factory_method, ClientKey* client_key) {
+  VLOG(2) << "GetClient(" << address << ")";
+  boost::shared_ptr<PerHostCache> host_cache = GetHostCache(address);
 
+  // Clients that were found to be broken. They are closed after the lock is released.
+  vector<boost::shared_ptr<ThriftClientImpl> > broken_clients;
   {
-    lock_guard<mutex> lock(host_cache->lock);
-    if (!host_cache->clients.empty()) {
-      *client_key = host_cache->clients.front();
-      VLOG(2) << "GetClient(): returning cached client for " << address;
-      host_cache->clients.pop_front();
-      if (metrics_enabled_) clients_in_use_metric_->Increment(1);
-      return Status::OK;
+    unique_lock<mutex> lock(host_cache->lock);
+    system_time deadline =
+        get_system_time() + posix_time::milliseconds(FLAGS_client_cache_wait_timeout_ms);
+    while (true) {
+      while (!host_cache->clients.empty()) {
+        ClientKey cached_key = host_cache->clients.back().client_key;
+        host_cache->clients.pop_back();
+        boost::shared_ptr<ThriftClientImpl> client_impl;
+        {
+          lock_guard<mutex> map_lock(client_map_lock_);
+          ClientMap::iterator client = client_map_.find(cached_key);
+          DCHECK(client != client_map_.end());
+          client_impl = client->second;
+        }
+        if (client_impl->IsIdleConnectionOpen()) {
+          VLOG(2) << "GetClient(): returning cached client for " << address;
+          *client_key = cached_key;
+          if (metrics_enabled_) {
+            hits_metric_->Increment(1);
+            clients_in_use_metric_->Increment(1);
+          }
+          return Status::OK;
+        }
+        VLOG(1) << "GetClient(): discarding closed client for " << address;
+        broken_clients.push_back(RemoveClient(host_cache.get(), cached_key));
+      }
+      if (FLAGS_client_cache_max_clients_per_host <= 0 ||
+          host_cache->num_clients < FLAGS_client_cache_max_clients_per_host) {
+        // Reserve a slot for the new client.
+        ++host_cache->num_clients;
+        break;
+      }
+      if (!host_cache->client_released_cv.timed_wait(lock, deadline)) {
+        stringstream ss;
+        ss << "Timed out after " << FLAGS_client_cache_wait_timeout_ms << "ms waiting "
+           << "for one of " << host_cache->num_clients << " clients to " << address;
+        return Status(ss.str());
+      }
     }
   }
 
   // Only get here if host_cache->clients.empty(). No need for the lock.
-  RETURN_IF_ERROR(CreateClient(address, factory_method, client_key));
+  if (metrics_enabled_) misses_metric_->Increment(1);
+  Status status = CreateClient(address, factory_method, client_key);
+  if (!status.ok()) {
+    lock_guard<mutex> lock(host_cache->lock);
+    --host_cache->num_clients;
+    host_cache->client_released_cv.notify_one();
+    return status;
+  }
   if (metrics_enabled_) clients_in_use_metric_->Increment(1);
   return Status::OK;
 }
 
+boost::shared_ptr<ThriftClientImpl> ClientCacheHelper::RemoveClient(
+    PerHostCache* host_cache, ClientKey client_key) {
+  boost::shared_ptr<ThriftClientImpl> client_impl;
+  {
+    lock_guard<mutex> map_lock(client_map_lock_);
+    ClientMap::iterator client = client_map_.find(client_key);
+    DCHECK(client != client_map_.end());
+    client_impl = client->second;
+    client_map_.erase(client);
+  }
+  --host_cache->num_clients;
+  DCHECK_GE(host_cache->num_clients, 0);
+  host_cache->client_released_cv.notify_one();
+  if (metrics_enabled_) {
+    total_clients_metric_->Increment(-1);
+    evictions_metric_->Increment(1);
+  }
+  return client_impl;
+}
+
 Status ClientCacheHelper::ReopenClient(ClientFactory factory_method,
     ClientKey* client_key) {
-  // Clients are not ordinarily removed from the cache completely (in the future, they may
-  // be); this is the only method where a client may be deleted and replaced with another.
+  // Apart from the eviction of idle and closed clients, this is the only method where a
+  // client may be deleted, and the only one where it is replaced with another.
   boost::shared_ptr<ThriftClientImpl> client_impl;
   ClientMap::iterator client;
   {
@@ -121,7 +222,10 @@ Status ClientCacheHelper::CreateClient(const TNetworkAddress& address,
     client_map_[*client_key] = client_impl;
   }
 
-  if (metrics_enabled_) total_clients_metric_->Increment(1);
+  if (metrics_enabled_) {
+    total_clients_metric_->Increment(1);
+    opens_metric_->Increment(1);
+  }
   return Status::OK;
 }
 
@@ -135,17 +239,66 @@ void ClientCacheHelper::ReleaseClient(ClientKey* client_key) {
     client_impl = client->second;
   }
   VLOG(2) << "Releasing client for " << client_impl->address() << " back to cache";
+  boost::shared_ptr<ThriftClientImpl> evicted_client;
   {
     lock_guard<mutex> lock(cache_lock_);
     PerHostCacheMap::iterator cache = per_host_caches_.find(client_impl->address());
     DCHECK(cache != per_host_caches_.end());
-    lock_guard<mutex> entry_lock(cache->second->lock);
-    cache->second->clients.push_back(*client_key);
+    PerHostCache* host_cache = cache->second.get();
+    lock_guard<mutex> entry_lock(host_cache->lock);
+    if (FLAGS_client_cache_max_idle_clients_per_host > 0 &&
+        host_cache->clients.size() >= FLAGS_client_cache_max_idle_clients_per_host) {
+      VLOG(2) << "Closing released client for " << client_impl->address()
+              << ", too many idle clients";
+      evicted_client = RemoveClient(host_cache, *client_key);
+    } else {
+      host_cache->clients.push_back(
+          PerHostCache::IdleClient(*client_key, MonotonicMillis()));
+      host_cache->client_released_cv.notify_one();
+    }
   }
   if (metrics_enabled_) clients_in_use_metric_->Increment(-1);
   *client_key = NULL;
 }
 
+void ClientCacheHelper::EvictIdleClients(int64_t min_release_time_ms) {
+  vector<boost::shared_ptr<PerHostCache> > host_caches;
+  {
+    lock_guard<mutex> lock(cache_lock_);
+    BOOST_FOREACH(const PerHostCacheMap::value_type& cache_entry, per_host_caches_) {
+      host_caches.push_back(cache_entry.second);
+    }
+  }
+  vector<boost::shared_ptr<ThriftClientImpl> > evicted_clients;
+  BOOST_FOREACH(const boost::shared_ptr<PerHostCache>& host_cache, host_caches) {
+    lock_guard<mutex> entry_lock(host_cache->lock);
+    // The least recently released clients are at the front.
+    while (!host_cache->clients.empty() &&
+        host_cache->clients.front().release_time_ms < min_release_time_ms) {
+      evicted_clients.push_back(
+          RemoveClient(host_cache.get(), host_cache->clients.front().client_key));
+      host_cache->clients.pop_front();
+    }
+  }
+  if (!evicted_clients.empty()) {
+    VLOG(1) << "Closed " << evicted_clients.size() << " idle clients";
+  }
+}
+
+void ClientCacheHelper::IdleReaperLoop() {
+  int64_t idle_timeout_ms = FLAGS_client_cache_idle_timeout_s * 1000L;
+  // Check often enough that clients are closed at most 10% later than the timeout.
+  int64_t check_interval_ms = max(idle_timeout_ms / 10, 1000L);
+  unique_lock<mutex> lock(idle_reaper_lock_);
+  while (!shut_down_) {
+    shut_down_cv_.timed_wait(lock, posix_time::milliseconds(check_interval_ms));
+    if (shut_down_) break;
+    lock.unlock();
+    EvictIdleClients(MonotonicMillis() - idle_timeout_ms);
+    lock.lock();
+  }
+}
+
 void ClientCacheHelper::CloseConnections(const TNetworkAddress& address) {
   PerHostCache* cache;
   {
@@ -160,8 +313,8 @@ void ClientCacheHelper::CloseConnections(const TNetworkAddress& address) {
             << address;
     lock_guard<mutex> entry_lock(cache->lock);
     lock_guard<mutex> map_lock(client_map_lock_);
-    BOOST_FOREACH(ClientKey client_key, cache->clients) {
-      ClientMap::iterator client_map_entry = client_map_.find(client_key);
+    BOOST_FOREACH(const PerHostCache::IdleClient& idle_client, cache->clients) {
+      ClientMap::iterator client_map_entry = client_map_.find(idle_client.client_key);
       DCHECK(client_map_entry != client_map_.end());
       client_map_entry->second->Close();
     }
@@ -209,6 +362,11 @@ void ClientCacheHelper::InitMetrics(MetricGroup* metrics, const string& key_pref
   stringstream max_ss;
   max_ss << key_prefix << ".client-cache.total-clients";
   total_clients_metric_ = metrics->AddGauge(max_ss.str(), 0L);
+
+  hits_metric_ = metrics->AddCounter(key_prefix + ".client-cache.hits", 0L);
+  misses_metric_ = metrics->AddCounter(key_prefix + ".client-cache.misses", 0L);
+  opens_metric_ = metrics->AddCounter(key_prefix + ".client-cache.opens", 0L);
+  evictions_metric_ = metrics->AddCounter(key_prefix + ".client-cache.evictions", 0L);
   metrics_enabled_ = true;
 }
 
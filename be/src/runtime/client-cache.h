@@ -19,6 +19,8 @@
 #include <list>
 #include <string>
 #include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/bind.hpp>
 
@@ -30,6 +32,8 @@
 
 namespace impala {
 
+class Thread;
+
 // Opaque pointer type which allows users of ClientCache to refer to particular client
 // instances without requiring that we parameterise ClientCacheHelper by type.
 typedef void* ClientKey;
@@ -52,12 +56,15 @@ typedef void* ClientKey;
 // we deliberately avoid using it so that we don't have to parameterise this class by
 // type, and thus this entire class doesn't get inlined every time it gets used.
 //
+// The number of clients per host can be limited (--client_cache_max_clients_per_host),
+// in which case GetClient() waits for another client to the same host to be released.
+// Released clients beyond --client_cache_max_idle_clients_per_host are closed
+// immediately, and a background thread closes clients that have not been used for
+// --client_cache_idle_timeout_s. Cached clients are checked before they are handed out
+// again, and clients whose connection was closed are replaced by new ones.
+//
 // This class is thread-safe.
 //
-// TODO: shut down clients in the background if they don't get used for a period of time
-// TODO: More graceful handling of clients that have failed (maybe better
-// handled by a smart-wrapper of the interface object).
-// TODO: limits on total number of clients, and clients per-backend
 // TODO: move this to a separate header file, so that the public interface is more
 // prominent in this file
 class ClientCacheHelper {
@@ -97,20 +104,19 @@ class ClientCacheHelper {
   // Closes every connection in the cache. Used only for testing.
   void TestShutdown();
 
-  // Creates two metrics for this cache measuring the number of clients currently used,
-  // and the total number in the cache.
+  // Creates metrics for this cache measuring the number of clients currently used, the
+  // total number in the cache, and the number of cache hits, misses, opened connections
+  // and evicted clients.
   void InitMetrics(MetricGroup* metrics, const std::string& key_prefix);
 
+  // Stops the idle client eviction thread.
+  ~ClientCacheHelper();
+
  private:
   template <class T> friend class ClientCache;
   // Private constructor so that only ClientCache can instantiate this class.
   ClientCacheHelper(uint32_t num_tries, uint64_t wait_ms, int32_t send_timeout_ms,
-      int32_t recv_timeout_ms)
-      : num_tries_(num_tries),
-        wait_ms_(wait_ms),
-        send_timeout_ms_(send_timeout_ms),
-        recv_timeout_ms_(recv_timeout_ms),
-        metrics_enabled_(false) { }
+      int32_t recv_timeout_ms);
 
   // There are three lock categories - the cache-wide lock (cache_lock_), the locks for a
   // specific cache (PerHostCache::lock) and the lock for the set of all clients
@@ -129,11 +135,31 @@ class ClientCacheHelper {
   // are considered to be immediately in use, and so don't exist in their PerHostCache
   // until they are released for the first time.
   struct PerHostCache {
-    // Protects clients.
+    // Protects all members.
     boost::mutex lock;
 
-    // List of client keys for this entry's host.
-    std::list<ClientKey> clients;
+    // A client that is not in use, and the time at which it was released.
+    struct IdleClient {
+      ClientKey client_key;
+      int64_t release_time_ms;
+
+      IdleClient(ClientKey client_key, int64_t release_time_ms)
+        : client_key(client_key), release_time_ms(release_time_ms) {}
+    };
+
+    // List of idle clients for this entry's host, ordered by release time. Clients are
+    // reused from the back, so that the clients at the front stay idle and can be
+    // evicted once the demand for clients drops.
+    std::list<IdleClient> clients;
+
+    // Number of clients for this host, in use or not, including clients that are being
+    // created.
+    int num_clients;
+
+    // Signalled when a client for this host is released or destroyed.
+    boost::condition_variable client_released_cv;
+
+    PerHostCache() : num_clients(0) {}
   };
 
   // Protects per_host_caches_
@@ -178,9 +204,51 @@ class ClientCacheHelper {
   // Total clients in the cache, including those in use
   IntGauge* total_clients_metric_;
 
+  // Number of GetClient() calls that reused a cached client.
+  IntCounter* hits_metric_;
+
+  // Number of GetClient() calls that had to create a new client.
+  IntCounter* misses_metric_;
+
+  // Number of connections opened, including reopened ones.
+  IntCounter* opens_metric_;
+
+  // Number of cached clients that were closed because they were idle for too long, too
+  // many clients were idle, or their connection was found to be closed.
+  IntCounter* evictions_metric_;
+
+  // Protects idle_reaper_thread_ and shut_down_. Not taken together with other locks.
+  boost::mutex idle_reaper_lock_;
+
+  // Signalled on shut down.
+  boost::condition_variable shut_down_cv_;
+
+  // True once the destructor was called.
+  bool shut_down_;
+
+  // Thread running IdleReaperLoop(). Started with the first call to GetClient(), so that
+  // caches that are never used don't create threads.
+  boost::scoped_ptr<Thread> idle_reaper_thread_;
+
+  // Returns the PerHostCache for 'address', creating it if necessary.
+  boost::shared_ptr<PerHostCache> GetHostCache(const TNetworkAddress& address);
+
   // Create a new client for specific address in 'client' and put it in client_map_
   Status CreateClient(const TNetworkAddress& address, ClientFactory factory_method,
       ClientKey* client_key);
+
+  // Removes the idle client 'client_key' of 'host_cache' from client_map_. The caller
+  // must hold host_cache->lock. Returns the client, which is closed when the last
+  // reference goes away, so callers can hold on to it until they released their locks.
+  boost::shared_ptr<ThriftClientImpl> RemoveClient(PerHostCache* host_cache,
+      ClientKey client_key);
+
+  // Closes clients that have been idle since before 'min_release_time_ms'.
+  void EvictIdleClients(int64_t min_release_time_ms);
+
+  // Periodically evicts clients that have been idle for longer than
+  // --client_cache_idle_timeout_s, until shut_down_ is set.
+  void IdleReaperLoop();
 };
 
 template<class T>
@@ -270,19 +338,21 @@ class ClientCache {
 
   ClientCache(const std::string& service_name = "") : client_cache_helper_(1, 0, 0, 0) {
     client_factory_ = boost::bind<ThriftClientImpl*>(
-        boost::mem_fn(&ClientCache::MakeClient), this, _1, _2, service_name);
+        boost::mem_fn(&ClientCache::MakeClient), this, _1, _2, service_name, false);
   }
 
   // Create a ClientCache where connections are tried num_tries times, with a pause of
   // wait_ms between attempts. The underlying TSocket's send and receive timeouts of
   // each connection can also be set. If num_tries == 0, retry connections indefinitely.
-  // A send/receive timeout of 0 means there is no timeout.
+  // A send/receive timeout of 0 means there is no timeout. If framed_transport is true,
+  // clients use framed transport, as required by non-blocking servers.
   ClientCache(uint32_t num_tries, uint64_t wait_ms, int32_t send_timeout_ms = 0,
-      int32_t recv_timeout_ms = 0, const std::string& service_name = "")
+      int32_t recv_timeout_ms = 0, const std::string& service_name = "",
+      bool framed_transport = false)
       : client_cache_helper_(num_tries, wait_ms, send_timeout_ms, recv_timeout_ms) {
     client_factory_ =
-        boost::bind<ThriftClientImpl*>(
-            boost::mem_fn(&ClientCache::MakeClient), this, _1, _2, service_name);
+        boost::bind<ThriftClientImpl*>(boost::mem_fn(&ClientCache::MakeClient), this,
+            _1, _2, service_name, framed_transport);
   }
 
   // Close all clients connected to the supplied address, (e.g., in
@@ -345,8 +415,9 @@ class ClientCache {
 
   // Factory method to produce a new ThriftClient<T> for the wrapped cache
   ThriftClientImpl* MakeClient(const TNetworkAddress& address, ClientKey* client_key,
-      const std::string service_name) {
-    Client* client = new Client(address.hostname, address.port, service_name);
+      const std::string service_name, bool framed_transport) {
+    Client* client = new Client(address.hostname, address.port, service_name, NULL,
+        false, framed_transport);
     *client_key = reinterpret_cast<ClientKey>(client->iface());
     return client;
   }
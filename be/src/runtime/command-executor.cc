@@ -73,12 +73,23 @@ Status CommandExecutor::validateInternal(const TExecRemoteCommandParams& request
 }
 
 Status CommandExecutor::runInternal(){
-	SCOPED_TIMER(profile()->total_time_counter());
-	command_->run();
+	Status status;
+	{
+		SCOPED_TIMER(profile()->total_time_counter());
+		// the command operations are run as a batch on the backend's dfs worker pool, which
+		// bounds the number of operations executed in parallel (--num_hdfs_worker_threads):
+		status = command_->run(exec_env_->hdfs_op_thread_pool(), profile());
+	}
+
+	// the final report sent on completion must carry the failure, if any:
+	if (!status.ok()) {
+		boost::lock_guard<boost::mutex> l(status_lock_);
+		status_ = status;
+	}
 
 	// go to completion for profile collection
 	complete();
-	return Status::OK;
+	return status;
 }
 
 Status CommandExecutor::run() {
@@ -14,6 +14,7 @@
 
 #include "runtime/coordinator.h"
 
+#include <algorithm>
 #include <limits>
 #include <map>
 #include <string>
@@ -79,6 +80,10 @@ DECLARE_string(hostname);
 
 DEFINE_bool(insert_inherit_permissions, false, "If true, new directories created by "
     "INSERTs will inherit the permissions of their parent directories");
+DEFINE_int32(coordinator_exec_rpc_threads, 64, "Maximum number of threads a "
+    "coordinator uses to issue the ExecPlanFragment() rpcs of a query in parallel. Each "
+    "thread starts the fragment instances of one backend at a time. If 0, one thread "
+    "is used per backend.");
 
 namespace impala {
 
@@ -245,6 +250,13 @@ class Coordinator::BackendCommandState {
   }
 };
 
+// The fragment instances of one launch wave (see Exec()) that run on the same backend.
+// They are started one after the other over a single connection.
+struct Coordinator::BackendExecGroup {
+  TNetworkAddress backend_address;
+  vector<BackendExecState*> exec_states;
+};
+
 void Coordinator::BackendExecState::ComputeTotalSplitSize() {
   const PerNodeScanRanges& per_node_scan_ranges = rpc_params.params.per_node_scan_ranges;
   total_split_size = 0;
@@ -379,6 +391,9 @@ Status Coordinator::Exec(QuerySchedule& schedule,
   query_profile_.reset(
       new RuntimeProfile(obj_pool(), "Execution Profile " + PrintId(query_id_)));
   finalization_timer_ = ADD_TIMER(query_profile_, "FinalizationTimer");
+  exec_rpc_client_wait_timer_ = ADD_TIMER(query_profile_, "ExecRpcClientWaitTime");
+  fragment_params_setup_timer_ = ADD_TIMER(query_profile_, "FragmentParamsSetupTime");
+  fragment_start_timer_ = ADD_TIMER(query_profile_, "FragmentStartTime");
 
   SCOPED_TIMER(query_profile_->total_time_counter());
 
@@ -445,9 +460,6 @@ Status Coordinator::Exec(QuerySchedule& schedule,
   DebugOptions debug_options;
   ProcessQueryOptions(schedule.query_options(), &debug_options);
 
-  // start fragment instances from left to right, so that receivers have
-  // Prepare()'d before senders start sending
-
   // remember number of scheduled backends:
   num_backends_initial = schedule.num_backends();
   backend_exec_states_.resize(schedule.num_backends());
@@ -456,39 +468,99 @@ Status Coordinator::Exec(QuerySchedule& schedule,
              << " backends for query " << query_id_;
 
   query_events_->MarkEvent("Ready to start remote fragments");
-  int backend_num = 0;
-  StatsMetric<double> latencies("fragment-latencies", TUnit::TIME_NS);
-  for (int fragment_idx = (has_coordinator_fragment ? 1 : 0);
+  int first_remote_fragment_idx = has_coordinator_fragment ? 1 : 0;
+  {
+    SCOPED_TIMER(fragment_params_setup_timer_);
+    int backend_num = 0;
+    for (int fragment_idx = first_remote_fragment_idx;
+         fragment_idx < request.fragments.size(); ++fragment_idx) {
+      const FragmentExecParams& params = (fragment_exec_params)[fragment_idx];
+
+      // set up exec states
+      int num_hosts = params.hosts.size();
+      DCHECK_GT(num_hosts, 0);
+      for (int instance_idx = 0; instance_idx < num_hosts; ++instance_idx) {
+        DebugOptions* backend_debug_options =
+            (debug_options.phase != TExecNodePhase::INVALID
+              && (debug_options.backend_num == -1
+                  || debug_options.backend_num == backend_num)
+              ? &debug_options
+              : NULL);
+        // TODO: pool of pre-formatted BackendExecStates?
+        BackendExecState* exec_state =
+            obj_pool()->Add(new BackendExecState(schedule, this, coord, backend_num,
+                request.fragments[fragment_idx], fragment_idx,
+                params, instance_idx, backend_debug_options, obj_pool()));
+        backend_exec_states_[backend_num] = exec_state;
+        ++backend_num;
+      }
+      fragment_profiles_[fragment_idx].num_instances = num_hosts;
+    }
+    DCHECK_EQ(backend_num, schedule.num_backends());
+  }
+
+  // A fragment instance may only be started once the instances of the fragment it
+  // sends its output to have been started (and hence Prepare()'d), otherwise its data
+  // would arrive before the receiving exchange node registered with the stream mgr.
+  // Fragments are therefore started in waves: the fragments sending to the coordinator
+  // fragment (or the root fragment, if there is no coordinator fragment) go first, then
+  // the fragments sending to those, and so on. All instances of a wave are started in
+  // parallel, which needs as many waves as the plan tree is deep rather than one round
+  // of rpcs per fragment.
+  vector<int> fragment_wave(request.fragments.size(), 0);
+  int num_waves = 0;
+  for (int fragment_idx = first_remote_fragment_idx;
        fragment_idx < request.fragments.size(); ++fragment_idx) {
-    const FragmentExecParams& params = (fragment_exec_params)[fragment_idx];
-
-    // set up exec states
-    int num_hosts = params.hosts.size();
-    DCHECK_GT(num_hosts, 0);
-    for (int instance_idx = 0; instance_idx < num_hosts; ++instance_idx) {
-      DebugOptions* backend_debug_options =
-          (debug_options.phase != TExecNodePhase::INVALID
-            && (debug_options.backend_num == -1
-                || debug_options.backend_num == backend_num)
-            ? &debug_options
-            : NULL);
-      // TODO: pool of pre-formatted BackendExecStates?
-      BackendExecState* exec_state =
-          obj_pool()->Add(new BackendExecState(schedule, this, coord, backend_num,
-              request.fragments[fragment_idx], fragment_idx,
-              params, instance_idx, backend_debug_options, obj_pool()));
-      backend_exec_states_[backend_num] = exec_state;
-      ++backend_num;
-      VLOG(2) << "Exec(): starting instance: fragment_idx=" << fragment_idx
-              << " instance_id=" << params.instance_ids[instance_idx];
+    int wave = 0;
+    if (fragment_idx > 0) {
+      DCHECK_EQ(request.dest_fragment_idx.size(), request.fragments.size() - 1);
+      int dest_fragment_idx = request.dest_fragment_idx[fragment_idx - 1];
+      DCHECK_LT(dest_fragment_idx, fragment_idx);
+      // The coordinator fragment has been prepared above.
+      if (dest_fragment_idx >= first_remote_fragment_idx) {
+        wave = fragment_wave[dest_fragment_idx] + 1;
+      }
     }
-    fragment_profiles_[fragment_idx].num_instances = num_hosts;
+    fragment_wave[fragment_idx] = wave;
+    num_waves = max(num_waves, wave + 1);
+  }
 
-    // Issue all rpcs in parallel
+  StatsMetric<double> latencies("fragment-latencies", TUnit::TIME_NS);
+  stringstream wave_info;
+  MonotonicStopWatch fragment_start_sw;
+  fragment_start_sw.Start();
+  for (int wave = 0; wave < num_waves; ++wave) {
+    // Group the instances of this wave by backend.
+    vector<BackendExecGroup> exec_groups;
+    map<TNetworkAddress, int> exec_group_idx;
+    int num_instances = 0;
+    BOOST_FOREACH(BackendExecState* exec_state, backend_exec_states_) {
+      if (fragment_wave[exec_state->fragment_idx] != wave) continue;
+      map<TNetworkAddress, int>::iterator it =
+          exec_group_idx.find(exec_state->backend_address);
+      if (it == exec_group_idx.end()) {
+        it = exec_group_idx.insert(
+            make_pair(exec_state->backend_address, exec_groups.size())).first;
+        exec_groups.push_back(BackendExecGroup());
+        exec_groups.back().backend_address = exec_state->backend_address;
+      }
+      exec_groups[it->second].exec_states.push_back(exec_state);
+      VLOG(2) << "Exec(): starting instance: fragment_idx=" << exec_state->fragment_idx
+              << " instance_id=" << exec_state->fragment_instance_id;
+      ++num_instances;
+    }
+    vector<BackendExecGroup*> exec_group_args;
+    for (int i = 0; i < exec_groups.size(); ++i) {
+      exec_group_args.push_back(&exec_groups[i]);
+    }
+
+    // Issue the rpcs of all backends in parallel
+    MonotonicStopWatch wave_sw;
+    wave_sw.Start();
     Status fragments_exec_status = ParallelExecutor::Exec(
-        bind<Status>(mem_fn(&Coordinator::ExecRemoteFragment), this, _1),
-        reinterpret_cast<void**>(&backend_exec_states_[backend_num - num_hosts]),
-        num_hosts, &latencies);
+        bind<Status>(mem_fn(&Coordinator::ExecRemoteFragments), this, _1),
+        reinterpret_cast<void**>(&exec_group_args[0]), exec_group_args.size(),
+        &latencies, FLAGS_coordinator_exec_rpc_threads);
 
     if (!fragments_exec_status.ok()) {
       DCHECK(query_status_.ok());  // nobody should have been able to cancel
@@ -497,9 +569,17 @@ Status Coordinator::Exec(QuerySchedule& schedule,
       CancelInternal();
       return fragments_exec_status;
     }
+
+    if (wave > 0) wave_info << ", ";
+    wave_info << num_instances << " instances on " << exec_groups.size()
+              << " backends in " << PrettyPrinter::Print(wave_sw.ElapsedTime(),
+                  TUnit::TIME_NS);
   }
+  COUNTER_SET(fragment_start_timer_,
+      static_cast<int64_t>(fragment_start_sw.ElapsedTime()));
 
   query_events_->MarkEvent("Remote fragments started");
+  query_profile_->AddInfoString("Fragment start waves", wave_info.str());
   query_profile_->AddInfoString("Fragment start latencies",
       latencies.ToHumanReadable());
 
@@ -742,7 +822,8 @@ Status Coordinator::FinalizeSuccessfulInsert() {
 	  // Empty destination means delete, so this is a directory. These get deleted in a
 	  // separate pass to ensure that we have moved all the contents of the directory first.
 	  // For each backend specified in the move map, construct the command per operation.
-	  // Currently remote commands are not being run as a batch (TODO in the proto)
+	  // The backend runs the operations of a command as a batch, in parallel on its dfs
+	  // worker pool.
 
 	  BOOST_FOREACH(const MoveDataSet::value_type& item, move.second){
 		  if (item.second.empty()) {
@@ -1226,22 +1307,33 @@ int64_t Coordinator::ComputeTotalScanRangesComplete(int node_id) {
   return value;
 }
 
-Status Coordinator::ExecRemoteFragment(void* exec_state_arg) {
-  BackendExecState* exec_state = reinterpret_cast<BackendExecState*>(exec_state_arg);
+Status Coordinator::ExecRemoteFragments(void* exec_group_arg) {
+  BackendExecGroup* exec_group = reinterpret_cast<BackendExecGroup*>(exec_group_arg);
+  Status status;
+  MonotonicStopWatch client_wait_sw;
+  client_wait_sw.Start();
+  ImpalaInternalServiceConnection backend_client(
+      exec_env_->impalad_client_cache(), exec_group->backend_address, &status);
+  COUNTER_ADD(exec_rpc_client_wait_timer_, client_wait_sw.ElapsedTime());
+  RETURN_IF_ERROR(status);
+
+  BOOST_FOREACH(BackendExecState* exec_state, exec_group->exec_states) {
+    RETURN_IF_ERROR(ExecRemoteFragment(exec_state, &backend_client));
+  }
+  return Status::OK;
+}
+
+Status Coordinator::ExecRemoteFragment(BackendExecState* exec_state,
+    ImpalaInternalServiceConnection* backend_client) {
   VLOG_FILE << "making rpc: ExecPlanFragment query_id=" << query_id_
             << " instance_id=" << exec_state->fragment_instance_id
             << " host=" << exec_state->backend_address;
   lock_guard<mutex> l(exec_state->lock);
 
-  Status status;
-  ImpalaInternalServiceConnection backend_client(
-      exec_env_->impalad_client_cache(), exec_state->backend_address, &status);
-  RETURN_IF_ERROR(status);
-
   TExecPlanFragmentResult thrift_result;
   try {
     try {
-      backend_client->ExecPlanFragment(thrift_result, exec_state->rpc_params);
+      (*backend_client)->ExecPlanFragment(thrift_result, exec_state->rpc_params);
     } catch (const TException& e) {
       // If a backend has stopped and restarted (without the failure detector
       // picking it up) an existing backend client may still think it is
@@ -1249,12 +1341,12 @@ Status Coordinator::ExecRemoteFragment(void* exec_state_arg) {
       // the first failure and force a reopen of the transport.
       // TODO: Improve client-cache so that we don't need to do this.
       VLOG_RPC << "Retrying ExecPlanFragment: " << e.what();
-      Status status = backend_client.Reopen();
+      Status status = backend_client->Reopen();
       if (!status.ok()) {
         exec_state->status = status;
         return status;
       }
-      backend_client->ExecPlanFragment(thrift_result, exec_state->rpc_params);
+      (*backend_client)->ExecPlanFragment(thrift_result, exec_state->rpc_params);
     }
   } catch (const TException& e) {
     stringstream msg;
@@ -1693,9 +1785,12 @@ void Coordinator::ComputeFragmentSummaryStats(BackendExecState* backend_exec_sta
   PerFragmentProfileData& data = fragment_profiles_[fragment_idx];
 
   int64_t completion_time = backend_exec_state->stopwatch.ElapsedTime();
+  double rate = backend_exec_state->total_split_size / (completion_time / 1000.0
+    / 1000.0 / 1000.0);
   data.completion_times(completion_time);
-  data.rates(backend_exec_state->total_split_size / (completion_time / 1000.0
-    / 1000.0 / 1000.0));
+  data.rates(rate);
+  data.completion_time_samples.push_back(completion_time);
+  data.rate_samples.push_back(rate);
 
   // Add the child in case it has not been added previously
   // via UpdateAverageProfile(). AddChild() will do nothing if the child
@@ -1734,12 +1829,27 @@ void Coordinator::UpdateExecSummary(int fragment_idx, int instance_idx,
   VLOG(2) << PrintExecSummary(exec_summary_);
 }
 
+// Returns the 50th, 90th and 99th percentiles (nearest rank) of 'samples', printed in
+// 'unit'. Sorts 'samples'.
+template <typename T>
+static string PrintPercentiles(vector<T>* samples, TUnit::type unit) {
+  if (samples->empty()) return "";
+  sort(samples->begin(), samples->end());
+  const int percentiles[] = {50, 90, 99};
+  stringstream ss;
+  for (int i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+    int rank = (percentiles[i] * samples->size() + 99) / 100;
+    ss << "  p" << percentiles[i] << ":"
+       << PrettyPrinter::Print((*samples)[max(rank, 1) - 1], unit);
+  }
+  return ss.str();
+}
+
 // This function appends summary information to the query_profile_ before
 // outputting it to VLOG.  It adds:
 //   1. Averaged remote fragment profiles (TODO: add outliers)
-//   2. Summary of remote fragment durations (min, max, mean, stddev)
-//   3. Summary of remote fragment rates (min, max, mean, stddev)
-// TODO: add histogram/percentile
+//   2. Summary of remote fragment durations (min, max, mean, stddev, percentiles)
+//   3. Summary of remote fragment rates (min, max, mean, stddev, percentiles)
 void Coordinator::ReportQuerySummary() {
   // In this case, the query did not even get to start on all the remote nodes,
   // some of the state that is used below might be uninitialized.  In this case,
@@ -1779,7 +1889,9 @@ void Coordinator::ReportQuerySummary() {
         << "  mean: " << PrettyPrinter::Print(
             accumulators::mean(completion_times), TUnit::TIME_NS)
         << "  stddev:" << PrettyPrinter::Print(
-            sqrt(accumulators::variance(completion_times)), TUnit::TIME_NS);
+            sqrt(accumulators::variance(completion_times)), TUnit::TIME_NS)
+        << PrintPercentiles(&fragment_profiles_[i].completion_time_samples,
+            TUnit::TIME_NS);
 
       stringstream rates_label;
       rates_label
@@ -1790,7 +1902,9 @@ void Coordinator::ReportQuerySummary() {
         << "  mean:" << PrettyPrinter::Print(
             accumulators::mean(rates), TUnit::BYTES_PER_SECOND)
         << "  stddev:" << PrettyPrinter::Print(
-            sqrt(accumulators::variance(rates)), TUnit::BYTES_PER_SECOND);
+            sqrt(accumulators::variance(rates)), TUnit::BYTES_PER_SECOND)
+        << PrintPercentiles(&fragment_profiles_[i].rate_samples,
+            TUnit::BYTES_PER_SECOND);
 
       fragment_profiles_[i].averaged_profile->AddInfoString(
           "completion times", times_label.str());
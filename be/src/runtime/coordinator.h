@@ -51,6 +51,7 @@ class PlanFragmentExecutor;
 class ObjectPool;
 class RuntimeState;
 class ImpalaInternalServiceClient;
+template <class T> class ClientConnection;
 class Expr;
 class ExprContext;
 class ExecEnv;
@@ -190,6 +191,8 @@ class Coordinator {
   class BackendExecState;
   /** depicts the command execution state on particular backend */
   class BackendCommandState;
+  /** fragment instances of one launch wave that run on the same backend */
+  struct BackendExecGroup;
 
   // Typedef for boost utility to compute averaged stats
   // TODO: including the median doesn't compile, looks like some includes are missing
@@ -353,6 +356,11 @@ class Coordinator {
 
     // Execution rates for instances of this fragment
     SummaryStats rates;
+
+    // The individual completion times and execution rates summarized above, to compute
+    // their percentiles.
+    std::vector<int64_t> completion_time_samples;
+    std::vector<double> rate_samples;
   };
 
   // This is indexed by fragment_idx.
@@ -369,6 +377,18 @@ class Coordinator {
   // Total time spent in finalization (typically 0 except for INSERT into hdfs tables)
   RuntimeProfile::Counter* finalization_timer_;
 
+  // Total time ExecPlanFragment() rpcs spent getting a client from the client cache,
+  // including waiting for a client if the per-host limit was reached and opening new
+  // connections. Summed across the rpcs, which are issued in parallel.
+  RuntimeProfile::Counter* exec_rpc_client_wait_timer_;
+
+  // Time spent in Exec() building the BackendExecStates and their ExecPlanFragment()
+  // rpc params, before the first rpc is issued.
+  RuntimeProfile::Counter* fragment_params_setup_timer_;
+
+  // Wall clock time spent in Exec() issuing the ExecPlanFragment() rpcs of all waves.
+  RuntimeProfile::Counter* fragment_start_timer_;
+
   /** Fill in Fragment Execution RPC_params based on parameters. */
   void SetExecPlanFragmentParams(QuerySchedule& schedule,
       int backend_num, const TPlanFragment& fragment,
@@ -380,14 +400,20 @@ class Coordinator {
       int fragment_idx, const FragmentExecParams& params, int instance_idx,
       const TNetworkAddress& coord, TExecRemoteCommandParams* rpc_params);
 
-  // Wrapper for ExecPlanFragment() rpc.  This function will be called in parallel
-  // from multiple threads.
+  // Issues the ExecPlanFragment() rpcs for all fragment instances of 'exec_group', one
+  // after the other over a single connection to the group's backend. This function
+  // will be called in parallel from multiple threads, one call per backend.
+  // 'exec_group' will always be an instance of BackendExecGroup.
+  // Returns the status of the first instance that could not be started; the remaining
+  // instances of the group are not started.
+  Status ExecRemoteFragments(void* exec_group);
+
+  // Wrapper for ExecPlanFragment() rpc, issued over 'backend_client'.
   // Obtains exec_state->lock prior to making rpc, so that it serializes
   // correctly with UpdateFragmentExecStatus().
   // exec_state contains all information needed to issue the rpc.
-  // 'coordinator' will always be an instance to this class and 'exec_state' will
-  // always be an instance of BackendExecState.
-  Status ExecRemoteFragment(void* exec_state);
+  Status ExecRemoteFragment(BackendExecState* exec_state,
+      ClientConnection<ImpalaInternalServiceClient>* backend_client);
 
   /** Executes remote command as specified, will be called in parallel from multiple threads */
   Status ExecRemoteCommand(void* exec_command);
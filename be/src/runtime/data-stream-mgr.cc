@@ -104,6 +104,19 @@ Status DataStreamMgr::AddData(
   return Status::OK;
 }
 
+bool DataStreamMgr::TryBlockSender() {
+  if (max_blocked_senders_ < 0) return true;
+  if (num_blocked_senders_.UpdateAndFetch(1) <= max_blocked_senders_) return true;
+  num_blocked_senders_.UpdateAndFetch(-1);
+  return false;
+}
+
+void DataStreamMgr::UnblockSender() {
+  if (max_blocked_senders_ < 0) return;
+  DCHECK_GT(num_blocked_senders_, 0);
+  num_blocked_senders_.UpdateAndFetch(-1);
+}
+
 Status DataStreamMgr::CloseSender(const TUniqueId& fragment_instance_id,
     PlanNodeId dest_node_id, int sender_id) {
   VLOG_FILE << "CloseSender(): fragment_instance_id=" << fragment_instance_id
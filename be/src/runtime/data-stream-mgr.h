@@ -23,6 +23,7 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/unordered_map.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "common/object-pool.h"
 #include "runtime/descriptors.h"  // for PlanNodeId
@@ -51,11 +52,11 @@ class TRowBatch;
 // which unblocks all DataStreamRecvr::GetBatch() calls that are made on behalf
 // of the cancelled fragment id.
 //
-// TODO: The recv buffers used in DataStreamRecvr should count against
-// per-query memory limits.
+// The recv buffers used in DataStreamRecvr count against per-query memory limits and
+// each sender gets a credit of 200% of buffer_size/#senders (see DataStreamRecvr).
 class DataStreamMgr {
  public:
-  DataStreamMgr() {}
+  DataStreamMgr() : max_blocked_senders_(-1), num_blocked_senders_(0) {}
 
   // Create a receiver for a specific fragment_instance_id/node_id destination;
   // If is_merging is true, the receiver maintains a separate queue of incoming row
@@ -72,11 +73,10 @@ class DataStreamMgr {
   // Adds a row batch to the recvr identified by fragment_instance_id/dest_node_id
   // if the recvr has not been cancelled. sender_id identifies the sender instance
   // from which the data came.
-  // The call blocks if this ends up pushing the stream over its buffering limit;
-  // it unblocks when the consumer removed enough data to make space for
-  // row_batch.
-  // TODO: enforce per-sender quotas (something like 200% of buffer_size/#senders),
-  // so that a single sender can't flood the buffer and stall everybody else.
+  // The call blocks if this ends up pushing the stream over its buffering limit, the
+  // sender over its credit or the query over its memory limit; it unblocks when the
+  // consumer removed enough data to make space for row_batch. Blocking the rpc is what
+  // keeps the sender from sending more data.
   // Returns OK if successful, error status otherwise.
   Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
                  const TRowBatch& thrift_batch, int sender_id);
@@ -90,6 +90,22 @@ class DataStreamMgr {
   // Closes all receivers registered for fragment_instance_id immediately.
   void Cancel(const TUniqueId& fragment_instance_id);
 
+  // Limits the number of AddData() calls that may block at once. Once the limit is
+  // reached, further AddData() calls do not wait for space, and add their batch beyond
+  // the stream's buffer limit and the sender's credit. This keeps blocked rpcs from
+  // holding all threads of a server with a fixed number of workers. Unbounded if
+  // negative, which is the default.
+  void SetMaxBlockedSenders(int max_blocked_senders) {
+    max_blocked_senders_ = max_blocked_senders;
+  }
+
+  // Reserves one of the AddData() calls that may block at once. Returns false if the
+  // limit is reached. Called by DataStreamRecvr before an AddData() call waits.
+  bool TryBlockSender();
+
+  // Releases a call reserved by TryBlockSender() once it stopped waiting.
+  void UnblockSender();
+
  private:
   friend class DataStreamRecvr;
 
@@ -137,6 +153,12 @@ class DataStreamMgr {
   Status DeregisterRecvr(const TUniqueId& fragment_instance_id, PlanNodeId node_id);
 
   inline uint32_t GetHashValue(const TUniqueId& fragment_instance_id, PlanNodeId node_id);
+
+  // See SetMaxBlockedSenders().
+  int max_blocked_senders_;
+
+  // Number of AddData() calls that are blocked, see TryBlockSender().
+  AtomicInt<int> num_blocked_senders_;
 };
 
 }
@@ -17,6 +17,7 @@
 
 #include "runtime/data-stream-recvr.h"
 #include "runtime/data-stream-mgr.h"
+#include "runtime/mem-tracker.h"
 #include "runtime/row-batch.h"
 #include "runtime/sorted-run-merger.h"
 #include "util/runtime-profile.h"
@@ -42,11 +43,11 @@ class DataStreamRecvr::SenderQueue {
   // must acquire data from the returned batch before the next call to GetBatch().
   Status GetBatch(RowBatch** next_batch);
 
-  // Adds a row batch to this sender queue if this stream has not been cancelled;
-  // blocks if this will make the stream exceed its buffer limit.
-  // If the total size of the batches in this queue would exceed the allowed buffer size,
-  // the queue is considered full and the call blocks until a batch is dequeued.
-  void AddBatch(const TRowBatch& batch);
+  // Adds a row batch from 'sender_id' to this sender queue if this stream has not been
+  // cancelled. Blocks until the batch fits into both the total buffer limit of the
+  // receiver and the credit of the sender, and until the receiver's memory limits are
+  // no longer exceeded. The call never blocks if the queue is empty.
+  void AddBatch(const TRowBatch& batch, int sender_id);
 
   // Decrement the number of remaining senders for this queue and signal eos ("new data")
   // if the count drops to 0. The number of senders will be 1 for a merging
@@ -83,9 +84,28 @@ class DataStreamRecvr::SenderQueue {
   // signal removal of data by stream consumer
   condition_variable data_removal__cv_;
 
-  // queue of (batch length, batch) pairs.  The SenderQueue block owns memory to
-  // these batches. They are handed off to the caller via GetBatch.
-  typedef list<pair<int, RowBatch*> > RowBatchQueue;
+  // Returns true if the sender can add a batch of 'batch_size' bytes without exceeding
+  // its credit. A sender without buffered batches always has credit for one batch, so
+  // that batches larger than the credit don't stall the stream.
+  bool HasCredit(int sender_id, int batch_size) const {
+    int64_t buffered_bytes = recvr_->sender_buffered_bytes_[sender_id];
+    return buffered_bytes == 0 || buffered_bytes + batch_size <= recvr_->sender_credit_;
+  }
+
+  // A batch waiting to be consumed, along with its serialized size and the sender it
+  // came from, which get the size back as credit once it is consumed.
+  struct QueuedBatch {
+    int sender_id;
+    int batch_size;
+    RowBatch* batch;
+
+    QueuedBatch(int sender_id, int batch_size, RowBatch* batch)
+      : sender_id(sender_id), batch_size(batch_size), batch(batch) {}
+  };
+
+  // The SenderQueue block owns memory to these batches. They are handed off to the
+  // caller via GetBatch.
+  typedef list<QueuedBatch> RowBatchQueue;
   RowBatchQueue batch_queue_;
 
   // The batch that was most recently returned via GetBatch(), i.e. the current batch
@@ -130,35 +150,62 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   received_first_batch_ = true;
 
   DCHECK(!batch_queue_.empty());
-  RowBatch* result = batch_queue_.front().second;
-  recvr_->num_buffered_bytes_ -= batch_queue_.front().first;
+  const QueuedBatch& front = batch_queue_.front();
+  RowBatch* result = front.batch;
+  recvr_->num_buffered_bytes_ -= front.batch_size;
+  recvr_->sender_buffered_bytes_[front.sender_id] -= front.batch_size;
   VLOG_ROW << "fetched #rows=" << result->num_rows();
   batch_queue_.pop_front();
-  data_removal__cv_.notify_one();
+  // Blocked senders wait for different conditions (their own credit or the total
+  // limit), so all of them need to re-check.
+  data_removal__cv_.notify_all();
   current_batch_.reset(result);
   *next_batch = current_batch_.get();
   return Status::OK;
 }
 
-void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
+void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch,
+    int sender_id) {
   unique_lock<mutex> l(lock_);
   if (is_cancelled_) return;
 
+  DCHECK_GE(sender_id, 0);
+  DCHECK_LT(sender_id, recvr_->sender_buffered_bytes_.size());
   int batch_size = RowBatch::GetBatchSize(thrift_batch);
   COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
   DCHECK_GT(num_remaining_senders_, 0);
 
-  // if there's something in the queue and this batch will push us over the
-  // buffer limit we need to wait until the batch gets drained.
+  // The serialized batch is held by the rpc thread until it is deserialized, so it is
+  // counted against the query's memory while the sender waits.
+  recvr_->mem_tracker_->Consume(batch_size);
+
+  // if there's something in the queue and this batch will push us over the buffer
+  // limit or the sender's credit, or memory limits are exceeded, we need to wait until
+  // batches get drained. The sender's rpc stays blocked until then, which keeps it from
+  // sending more data. If too many rpcs are blocked already (see
+  // DataStreamMgr::SetMaxBlockedSenders()), the batch is added without waiting.
   // Note: It's important that we enqueue thrift_batch regardless of buffer limit if
   // the queue is currently empty. In the case of a merging receiver, batches are
   // received from a specific queue based on data order, and the pipeline will stall
   // if the merger is waiting for data from an empty queue that cannot be filled because
   // the limit has been reached.
-  while (!batch_queue_.empty() && recvr_->ExceedsLimit(batch_size) && !is_cancelled_) {
+  bool blocked = false;
+  while (!batch_queue_.empty() && !is_cancelled_ &&
+      (recvr_->ExceedsLimit(batch_size) || !HasCredit(sender_id, batch_size) ||
+       recvr_->mem_tracker_->AnyLimitExceeded())) {
+    if (!blocked) {
+      blocked = recvr_->mgr_->TryBlockSender();
+      if (!blocked) {
+        COUNTER_ADD(recvr_->blocked_senders_limit_counter_, 1);
+        break;
+      }
+    }
     SCOPED_TIMER(recvr_->buffer_full_total_timer_);
+    if (!HasCredit(sender_id, batch_size)) COUNTER_ADD(recvr_->credit_waits_counter_, 1);
     VLOG_ROW << " wait removal: empty=" << (batch_queue_.empty() ? 1 : 0)
              << " #buffered=" << recvr_->num_buffered_bytes_
+             << " sender_id=" << sender_id
+             << " #sender_buffered=" << recvr_->sender_buffered_bytes_[sender_id]
              << " batch_size=" << batch_size << "\n";
 
     // We only want one thread running the timer at any one time. Only
@@ -193,6 +240,7 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
     // practice, this time is small relative to the total wait time.
     if (got_timer_lock) data_removal__cv_.notify_one();
   }
+  if (blocked) recvr_->mgr_->UnblockSender();
 
   if (!is_cancelled_) {
     RowBatch* batch = NULL;
@@ -205,10 +253,13 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
     }
     VLOG_ROW << "added #rows=" << batch->num_rows()
              << " batch_size=" << batch_size << "\n";
-    batch_queue_.push_back(make_pair(batch_size, batch));
+    batch_queue_.push_back(QueuedBatch(sender_id, batch_size, batch));
     recvr_->num_buffered_bytes_ += batch_size;
+    recvr_->sender_buffered_bytes_[sender_id] += batch_size;
     data_arrival_cv_.notify_one();
   }
+  // The deserialized batch is tracked by its own mem pool from here on.
+  recvr_->mem_tracker_->Release(batch_size);
 }
 
 void DataStreamRecvr::SenderQueue::DecrementSenders() {
@@ -243,8 +294,9 @@ void DataStreamRecvr::SenderQueue::Close() {
   // Delete any batches queued in batch_queue_
   for (RowBatchQueue::iterator it = batch_queue_.begin();
       it != batch_queue_.end(); ++it) {
-    delete it->second;
+    delete it->batch;
   }
+  batch_queue_.clear();
 
   current_batch_.reset();
 }
@@ -284,7 +336,14 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
     row_desc_(row_desc),
     is_merging_(is_merging),
     num_buffered_bytes_(0),
+    sender_buffered_bytes_(num_senders, 0),
     profile_(profile) {
+  DCHECK_GT(num_senders, 0);
+  // Grant each sender twice its fair share of the buffer, so that a single sender can't
+  // flood the buffer and stall everybody else, while senders that are temporarily
+  // faster than the others can still get ahead.
+  sender_credit_ = max(static_cast<int64_t>(2) * total_buffer_limit_ / num_senders,
+      static_cast<int64_t>(1));
   mem_tracker_.reset(new MemTracker(-1, -1, "DataStreamRecvr", parent_tracker));
   // Create one queue per sender if is_merging is true.
   int num_queues = is_merging ? num_senders : 1;
@@ -305,6 +364,9 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
       ADD_TIMER(profile_, "DeserializeRowBatchTimer");
   buffer_full_wall_timer_ = ADD_TIMER(profile_, "SendersBlockedTimer");
   buffer_full_total_timer_ = ADD_TIMER(profile_, "SendersBlockedTotalTimer(*)");
+  credit_waits_counter_ = ADD_COUNTER(profile_, "SenderCreditWaits", TUnit::UNIT);
+  blocked_senders_limit_counter_ =
+      ADD_COUNTER(profile_, "BlockedSendersLimitReached", TUnit::UNIT);
   data_arrival_timer_ = profile_->inactive_timer();
   first_batch_wait_total_timer_ = ADD_TIMER(profile_, "FirstBatchArrivalWaitTime");
 }
@@ -317,7 +379,7 @@ Status DataStreamRecvr::GetNext(RowBatch* output_batch, bool* eos) {
 void DataStreamRecvr::AddBatch(const TRowBatch& thrift_batch, int sender_id) {
   int use_sender_id = is_merging_ ? sender_id : 0;
   // Add all batches to the same queue if is_merging_ is false.
-  sender_queues_[use_sender_id]->AddBatch(thrift_batch);
+  sender_queues_[use_sender_id]->AddBatch(thrift_batch, sender_id);
 }
 
 void DataStreamRecvr::RemoveSender(int sender_id) {
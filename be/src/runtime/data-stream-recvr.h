@@ -100,7 +100,8 @@ class DataStreamRecvr {
       RuntimeProfile* profile);
 
   // Add a new batch of rows to the appropriate sender queue, blocking if the queue is
-  // full. Called from DataStreamMgr.
+  // full, the sender used up its credit or memory limits are exceeded. Called from
+  // DataStreamMgr.
   void AddBatch(const TRowBatch& thrift_batch, int sender_id);
 
   // Indicate that a particular sender is done. Delegated to the appropriate
@@ -138,7 +139,18 @@ class DataStreamRecvr {
   // total number of bytes held across all sender queues.
   AtomicInt<int> num_buffered_bytes_;
 
-  // Memtracker for batches in the sender queue(s).
+  // Number of bytes each sender may have buffered in the sender queues at any time:
+  // twice its share of total_buffer_limit_. A sender that used up its credit is blocked
+  // until the consumer removes some of its batches.
+  int64_t sender_credit_;
+
+  // Number of bytes buffered per sender, indexed by sender id. An entry is protected by
+  // the lock of the sender queue that the sender's batches are added to.
+  std::vector<int> sender_buffered_bytes_;
+
+  // Memtracker for batches in the sender queue(s), including batches waiting to be
+  // added. Its parent is the fragment instance's tracker, so buffered data counts
+  // against the query's memory limit.
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
   // One or more queues of row batches received from senders. If is_merging_ is true,
@@ -184,6 +196,13 @@ class DataStreamRecvr {
   // Wall time senders spend waiting for the recv buffer to have capacity.
   RuntimeProfile::Counter* buffer_full_wall_timer_;
 
+  // Number of times a sender had to wait because it used up its credit.
+  RuntimeProfile::Counter* credit_waits_counter_;
+
+  // Number of batches added without waiting for space, because the maximum number of
+  // blocked senders was reached (see DataStreamMgr::SetMaxBlockedSenders()).
+  RuntimeProfile::Counter* blocked_senders_limit_counter_;
+
   // Total time spent waiting for data to arrive in the recv buffer
   RuntimeProfile::Counter* data_arrival_timer_;
 };
@@ -34,6 +34,7 @@
 #include "util/cpu-info.h"
 #include "util/disk-info.h"
 #include "util/debug-util.h"
+#include "util/stopwatch.h"
 #include "util/thread.h"
 #include "util/time.h"
 #include "util/mem-info.h"
@@ -45,6 +46,7 @@
 #include "gen-cpp/Descriptors_types.h"
 #include "service/fe-support.h"
 
+#include <fstream>
 #include <iostream>
 
 using namespace std;
@@ -57,6 +59,8 @@ using namespace apache::thrift::protocol;
 
 DEFINE_int32(port, 20001, "port on which to run Impala test backend");
 DECLARE_string(principal);
+DECLARE_bool(be_service_nonblocking);
+DECLARE_int32(be_service_threads);
 
 namespace impala {
 
@@ -101,7 +105,8 @@ class DataStreamTest : public testing::Test {
  protected:
   DataStreamTest()
     : runtime_state_(TPlanFragmentInstanceCtx(), "", &exec_env_),
-      next_val_(0) {
+      next_val_(0),
+      receiver_delay_ms_(100) {
     // Initialize Mem trackers for use by the data stream receiver.
     exec_env_.InitForFeTests();
     runtime_state_.InitMemTrackers(TUniqueId(), NULL, -1);
@@ -195,6 +200,9 @@ class DataStreamTest : public testing::Test {
   int next_val_;
   int64_t* tuple_mem_;
 
+  // Time non-merging receivers sleep after each batch, to exercise the buffering logic.
+  int receiver_delay_ms_;
+
   // receiving node
   DataStreamMgr* stream_mgr_;
   ThriftServer* server_;
@@ -363,7 +371,7 @@ class DataStreamTest : public testing::Test {
         TupleRow* row = batch->GetRow(i);
         info->data_values.insert(*static_cast<int64_t*>(row->GetTuple(0)->GetSlot(0)));
       }
-      SleepForMs(100);  // slow down receiver to exercise buffering logic
+      if (receiver_delay_ms_ > 0) SleepForMs(receiver_delay_ms_);
     }
     if (info->status.IsCancelled()) VLOG_QUERY << "reader is cancelled";
     VLOG_QUERY << "done reading";
@@ -446,8 +454,11 @@ class DataStreamTest : public testing::Test {
   void StartBackend() {
     boost::shared_ptr<ImpalaTestBackend> handler(new ImpalaTestBackend(stream_mgr_));
     boost::shared_ptr<TProcessor> processor(new ImpalaInternalServiceProcessor(handler));
-    server_ = new ThriftServer("DataStreamTest backend", processor, FLAGS_port, NULL);
-    server_->Start();
+    ThriftServer::ServerType server_type = FLAGS_be_service_nonblocking ?
+        ThriftServer::Nonblocking : ThriftServer::Threaded;
+    server_ = new ThriftServer("DataStreamTest backend", processor, FLAGS_port, NULL,
+        NULL, FLAGS_be_service_threads, server_type);
+    EXPECT_TRUE(server_->Start().ok());
   }
 
   void StopBackend() {
@@ -520,6 +531,49 @@ class DataStreamTest : public testing::Test {
     CheckReceivers(stream_type, num_senders);
   }
 
+  // Returns the number of threads of this process.
+  static int GetNumThreads() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+      if (line.compare(0, 8, "Threads:") == 0) return atoi(line.c_str() + 8);
+    }
+    return -1;
+  }
+
+  // Streams data from MAX_SENDERS senders to MAX_RECEIVERS hash-partitioned receivers
+  // without slowing down the receivers, and reports the throughput and the number of
+  // threads left behind by the connections, which stay open in the client cache.
+  void BenchmarkConcurrentStreams() {
+    receiver_delay_ms_ = 0;
+    Reset();
+    int num_threads_before = GetNumThreads();
+    MonotonicStopWatch sw;
+    sw.Start();
+    for (int i = 0; i < MAX_RECEIVERS; ++i) {
+      StartReceiver(TPartitionType::HASH_PARTITIONED, MAX_SENDERS, i, 1024 * 1024, false);
+    }
+    for (int i = 0; i < MAX_SENDERS; ++i) {
+      StartSender(TPartitionType::HASH_PARTITIONED, 1024);
+    }
+    JoinSenders();
+    CheckSenders();
+    JoinReceivers();
+    CheckReceivers(TPartitionType::HASH_PARTITIONED, MAX_SENDERS);
+    sw.Stop();
+    int64_t num_bytes_sent = 0;
+    for (int i = 0; i < sender_info_.size(); ++i) {
+      num_bytes_sent += sender_info_[i].num_bytes_sent;
+    }
+    double elapsed_s = sw.ElapsedTime() / 1000000000.0;
+    cout << (FLAGS_be_service_nonblocking ? "Non-blocking" : "Threaded") << " server: "
+         << MAX_SENDERS << " senders, " << MAX_RECEIVERS << " receivers, "
+         << num_bytes_sent << " bytes in " << elapsed_s << "s ("
+         << num_bytes_sent / elapsed_s / (1024 * 1024) << " MB/s), "
+         << GetNumThreads() - num_threads_before << " threads for idle connections"
+         << endl;
+  }
+
  private:
   ExprContext* lhs_slot_ctx_;
   ExprContext* rhs_slot_ctx_;
@@ -582,6 +636,58 @@ TEST_F(DataStreamTest, BasicTest) {
   }
 }
 
+TEST_F(DataStreamTest, ManySenders) {
+  // With many senders and a small buffer, each sender's credit is smaller than a single
+  // batch, so senders must take turns without stalling the stream.
+  TestStream(TPartitionType::UNPARTITIONED, MAX_SENDERS / 2, 1, 1024, false);
+  TestStream(TPartitionType::UNPARTITIONED, MAX_SENDERS, 1, 1024, true);
+}
+
+TEST_F(DataStreamTest, MaxBlockedSenders) {
+  DataStreamMgr mgr;
+  // Unbounded by default.
+  for (int i = 0; i < 3; ++i) EXPECT_TRUE(mgr.TryBlockSender());
+  for (int i = 0; i < 3; ++i) mgr.UnblockSender();
+  mgr.SetMaxBlockedSenders(2);
+  EXPECT_TRUE(mgr.TryBlockSender());
+  EXPECT_TRUE(mgr.TryBlockSender());
+  EXPECT_FALSE(mgr.TryBlockSender());
+  mgr.UnblockSender();
+  EXPECT_TRUE(mgr.TryBlockSender());
+  mgr.UnblockSender();
+  mgr.UnblockSender();
+
+  // Senders that may not block add their batches beyond the buffer limit, and the
+  // streams still deliver all rows.
+  stream_mgr_->SetMaxBlockedSenders(1);
+  TestStream(TPartitionType::UNPARTITIONED, MAX_SENDERS, 1, 1024, false);
+  TestStream(TPartitionType::UNPARTITIONED, MAX_SENDERS, 1, 1024, true);
+}
+
+TEST_F(DataStreamTest, ConcurrentStreamsBenchmark) {
+  BenchmarkConcurrentStreams();
+}
+
+// Sets --be_service_nonblocking before the fixture creates its ExecEnv, whose client
+// cache must match the server type.
+class NonblockingServerFlag {
+ protected:
+  NonblockingServerFlag() { FLAGS_be_service_nonblocking = true; }
+  ~NonblockingServerFlag() { FLAGS_be_service_nonblocking = false; }
+};
+
+class DataStreamNonblockingTest : private NonblockingServerFlag, public DataStreamTest {
+};
+
+TEST_F(DataStreamNonblockingTest, BasicTest) {
+  TestStream(TPartitionType::HASH_PARTITIONED, 4, 4, 1024, false);
+  TestStream(TPartitionType::HASH_PARTITIONED, 4, 4, 1024, true);
+}
+
+TEST_F(DataStreamNonblockingTest, ConcurrentStreamsBenchmark) {
+  BenchmarkConcurrentStreams();
+}
+
 // TODO: more tests:
 // - test case for transmission error in last batch
 // - receivers getting created concurrently
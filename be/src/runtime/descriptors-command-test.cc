@@ -0,0 +1,161 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "dfs_cache/dfs-cache.h"
+#include "runtime/descriptors-command.h"
+#include "util/hdfs-bulk-ops.h"
+#include "util/runtime-profile.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+// Runs the INSERT finalize commands (RenameCmdDescriptor, DeleteCmdDescriptor) on the
+// local filesystem, as batches on a dfs worker pool.
+class DescriptorsCommandTest : public testing::Test {
+ protected:
+  static const int NUM_FILES = 50;
+
+  virtual void SetUp() {
+    test_dir_ = "/tmp/descriptors-command-test";
+    filesystem::remove_all(test_dir_);
+    filesystem::create_directories(test_dir_);
+    // Fewer workers than operations, so that the batch is queued on the pool.
+    pool_.reset(CreateHdfsOpThreadPool("descriptors-command-test", 4, NUM_FILES));
+  }
+
+  virtual void TearDown() {
+    pool_.reset();
+    filesystem::remove_all(test_dir_);
+  }
+
+  // Returns the path of file 'i', creating the file if 'create' is true.
+  string FilePath(int i, bool create) {
+    stringstream path;
+    path << test_dir_ << "/file-" << i;
+    if (create) {
+      ofstream f(path.str().c_str());
+      f << i;
+    }
+    return path.str();
+  }
+
+  TRemoteShortCommand Command(TRemoteShortCommandType::type type) {
+    TRemoteShortCommand command;
+    command.__set_display_name(
+        type == TRemoteShortCommandType::RENAME ? "move" : "delete");
+    command.__set_type(type);
+    command.__set_dfs_path("file://" + test_dir_);
+    return command;
+  }
+
+  int64_t CounterValue(const string& name) {
+    RuntimeProfile::Counter* counter = profile_->GetCounter(name);
+    EXPECT_TRUE(counter != NULL) << name;
+    return counter == NULL ? -1 : counter->value();
+  }
+
+  string test_dir_;
+  scoped_ptr<HdfsOpThreadPool> pool_;
+  ObjectPool obj_pool_;
+  RuntimeProfile* profile_;
+};
+
+TEST_F(DescriptorsCommandTest, RenameBatch) {
+  map<string, string> rename_set;
+  for (int i = 0; i < NUM_FILES; ++i) {
+    rename_set[FilePath(i, true)] = FilePath(i, false) + ".moved";
+  }
+  TRemoteShortCommand command = Command(TRemoteShortCommandType::RENAME);
+  command.__set_rename_set(rename_set);
+  RenameCmdDescriptor descriptor(command);
+  ASSERT_TRUE(descriptor.validate(command));
+
+  profile_ = obj_pool_.Add(new RuntimeProfile(&obj_pool_, "RenameBatch"));
+  Status status = descriptor.run(pool_.get(), profile_);
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  for (map<string, string>::iterator it = rename_set.begin(); it != rename_set.end();
+      ++it) {
+    EXPECT_FALSE(filesystem::exists(it->first)) << it->first;
+    EXPECT_TRUE(filesystem::exists(it->second)) << it->second;
+  }
+  EXPECT_EQ(CounterValue("NumOperations"), NUM_FILES);
+  EXPECT_EQ(CounterValue("NumFailedOperations"), 0);
+  EXPECT_GE(CounterValue("TotalOperationTime"), CounterValue("MaxOperationTime"));
+}
+
+TEST_F(DescriptorsCommandTest, DeleteBatch) {
+  vector<string> delete_set;
+  for (int i = 0; i < NUM_FILES; ++i) delete_set.push_back(FilePath(i, true));
+  TRemoteShortCommand command = Command(TRemoteShortCommandType::DELETE);
+  command.__set_delete_set(delete_set);
+  DeleteCmdDescriptor descriptor(command);
+  ASSERT_TRUE(descriptor.validate(command));
+
+  profile_ = obj_pool_.Add(new RuntimeProfile(&obj_pool_, "DeleteBatch"));
+  Status status = descriptor.run(pool_.get(), profile_);
+  ASSERT_TRUE(status.ok()) << status.GetDetail();
+  for (int i = 0; i < delete_set.size(); ++i) {
+    EXPECT_FALSE(filesystem::exists(delete_set[i])) << delete_set[i];
+  }
+  EXPECT_EQ(CounterValue("NumOperations"), NUM_FILES);
+  EXPECT_EQ(CounterValue("NumFailedOperations"), 0);
+}
+
+// Failed operations fail the command, and do not stop the other operations of the
+// batch.
+TEST_F(DescriptorsCommandTest, RenameErrors) {
+  const int NUM_MISSING = 3;
+  map<string, string> rename_set;
+  for (int i = 0; i < NUM_FILES; ++i) {
+    // The first files do not exist.
+    rename_set[FilePath(i, i >= NUM_MISSING)] = FilePath(i, false) + ".moved";
+  }
+  TRemoteShortCommand command = Command(TRemoteShortCommandType::RENAME);
+  command.__set_rename_set(rename_set);
+  RenameCmdDescriptor descriptor(command);
+  ASSERT_TRUE(descriptor.validate(command));
+
+  profile_ = obj_pool_.Add(new RuntimeProfile(&obj_pool_, "RenameErrors"));
+  Status status = descriptor.run(pool_.get(), profile_);
+  ASSERT_FALSE(status.ok());
+  EXPECT_NE(status.GetDetail().find("Error(s) running command \"move\""), string::npos)
+      << status.GetDetail();
+  EXPECT_EQ(CounterValue("NumOperations"), NUM_FILES);
+  EXPECT_EQ(CounterValue("NumFailedOperations"), NUM_MISSING);
+  for (int i = NUM_MISSING; i < NUM_FILES; ++i) {
+    EXPECT_TRUE(filesystem::exists(FilePath(i, false) + ".moved")) << i;
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  impala::InitCommonRuntime(argc, argv, true);
+  // No cache capacity: the dfs calls go directly to the filesystem.
+  impala::cacheInit(0, "/tmp/descriptors-command-test-cache");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
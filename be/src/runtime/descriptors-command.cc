@@ -7,8 +7,48 @@
 
 #include "runtime/descriptors-command.h"
 
+#include <boost/foreach.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "util/runtime-profile.h"
+
+using namespace strings;
+
 namespace impala{
 
+Status CommandDescriptor::run(HdfsOpThreadPool* pool, RuntimeProfile* profile) {
+	HdfsOperationSet ops(&dfs_connection_);
+	addOperations(&ops);
+	LOG(INFO) << "Command \"" << display_name_ << "\" : " << ops.size() << " operations to run.\n";
+
+	RuntimeProfile::Counter* num_ops_counter =
+	    ADD_COUNTER(profile, "NumOperations", TUnit::UNIT);
+	RuntimeProfile::Counter* num_failed_ops_counter =
+	    ADD_COUNTER(profile, "NumFailedOperations", TUnit::UNIT);
+	RuntimeProfile::Counter* op_time_counter =
+	    ADD_COUNTER(profile, "TotalOperationTime", TUnit::TIME_NS);
+	RuntimeProfile::Counter* max_op_time_counter =
+	    ADD_COUNTER(profile, "MaxOperationTime", TUnit::TIME_NS);
+	RuntimeProfile::Counter* batch_timer = ADD_TIMER(profile, "BatchExecutionTime");
+
+	bool ok;
+	{
+		SCOPED_TIMER(batch_timer);
+		ok = ops.Execute(pool, false);
+	}
+	COUNTER_SET(num_ops_counter, ops.size());
+	COUNTER_SET(num_failed_ops_counter, static_cast<int64_t>(ops.errors().size()));
+	COUNTER_SET(op_time_counter, ops.total_op_time());
+	COUNTER_SET(max_op_time_counter, ops.max_op_time());
+	if (ok) return Status::OK;
+
+	BOOST_FOREACH(const HdfsOperationSet::Error& err, ops.errors()) {
+		LOG(ERROR) << "Command \"" << display_name_ << "\" : " << err.second << "\n";
+	}
+	return Status(Substitute("Error(s) running command \"$0\". First error (of $1) was: $2",
+	    display_name_, ops.errors().size(), ops.errors()[0].second));
+}
+
 bool RenameCmdDescriptor::validate(const TRemoteShortCommand& cdesc){
 	// check there's the path is specified:
     DCHECK(cdesc.__isset.dfs_path);
@@ -22,23 +62,20 @@ bool RenameCmdDescriptor::validate(const TRemoteShortCommand& cdesc){
     return true;
 }
 
-bool RenameCmdDescriptor::run() {
-	LOG(INFO) << "RenameCmdDescriptor.run(): rename set size = " << m_rename_set.size() << ".\n";
+void RenameCmdDescriptor::addOperations(HdfsOperationSet* ops) {
+	LOG(INFO) << "RenameCmdDescriptor.addOperations(): rename set size = " << m_rename_set.size() << ".\n";
 	std::map<std::string, std::string>::iterator iter;
 	for (iter = m_rename_set.begin(); iter != m_rename_set.end(); iter++) {
-		DCHECK(	dfsRename(dfs_connection_, iter->first.c_str(),
-				iter->second.c_str()) == 0);
+		ops->Add(RENAME, iter->first, iter->second);
 	}
-	return true;
 }
 
-bool DeleteCmdDescriptor::run() {
-	LOG(INFO) << "RenameCmdDescriptor.run(): delete set size = " << m_deletion_set.size() << ".\n";
+void DeleteCmdDescriptor::addOperations(HdfsOperationSet* ops) {
+	LOG(INFO) << "DeleteCmdDescriptor.addOperations(): delete set size = " << m_deletion_set.size() << ".\n";
 	std::vector<std::string>::iterator iter;
 	for (iter = m_deletion_set.begin(); iter != m_deletion_set.end(); iter++) {
-		DCHECK(dfsDelete(dfs_connection_, (*iter).c_str()) == 0);
+		ops->Add(DELETE, *iter);
 	}
-	return true;
 }
 
 bool DeleteCmdDescriptor::validate(const TRemoteShortCommand& cdesc){
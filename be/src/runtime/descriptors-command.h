@@ -11,11 +11,15 @@
 #include <map>
 #include <vector>
 
+#include "common/status.h"
 #include "runtime/hdfs-fs-cache.h"
+#include "util/hdfs-bulk-ops.h"
 #include "gen-cpp/ImpalaInternalService_types.h"
 
 namespace impala {
 
+class RuntimeProfile;
+
 /** Command descriptor, thrift to c++ transition */
 class CommandDescriptor {
  public:
@@ -26,8 +30,11 @@ class CommandDescriptor {
 
   virtual ~CommandDescriptor() {}
 
-  /** executes command */
-  virtual bool run() = 0;
+  /** executes command operations in parallel on @a pool and reports the timings to @a profile */
+  Status run(HdfsOpThreadPool* pool, RuntimeProfile* profile);
+
+  /** adds the command operations to the batch @a ops */
+  virtual void addOperations(HdfsOperationSet* ops) = 0;
 
   /**< validates command */
   virtual bool validate(const TRemoteShortCommand& cdesc) = 0;
@@ -50,7 +57,7 @@ public:
 
 	virtual ~RenameCmdDescriptor() {}
 
-	virtual bool run();
+	virtual void addOperations(HdfsOperationSet* ops);
 	virtual bool validate(const TRemoteShortCommand& cdesc);
 
 private:
@@ -67,7 +74,7 @@ public:
 
 	virtual ~DeleteCmdDescriptor() {}
 
-	virtual bool run();
+	virtual void addOperations(HdfsOperationSet* ops);
 	virtual bool validate(const TRemoteShortCommand& cdesc);
 
 private:
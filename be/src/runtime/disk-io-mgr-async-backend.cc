@@ -0,0 +1,403 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/disk-io-mgr-async-backend.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+#include <gutil/strings/substitute.h>
+
+#include "common/logging.h"
+#include "util/error-util.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+using namespace strings;
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+#define IMPALA_HAVE_IO_URING 1
+#endif
+
+void AsyncIoBackend::InitSlots() {
+  slots_.resize(queue_depth_);
+  free_slots_.reserve(queue_depth_);
+  for (int i = queue_depth_ - 1; i >= 0; --i) free_slots_.push_back(&slots_[i]);
+}
+
+AsyncIoBackend::Slot* AsyncIoBackend::AllocateSlot(void* cookie, const char* buffer,
+    int64_t len) {
+  DCHECK(!free_slots_.empty());
+  DCHECK_LT(num_in_flight_, queue_depth_);
+  Slot* slot = free_slots_.back();
+  free_slots_.pop_back();
+  slot->cookie = cookie;
+  slot->iov.iov_base = const_cast<char*>(buffer);
+  slot->iov.iov_len = len;
+  ++num_in_flight_;
+  return slot;
+}
+
+void AsyncIoBackend::FreeSlot(Slot* slot) {
+  DCHECK_GT(num_in_flight_, 0);
+  --num_in_flight_;
+  free_slots_.push_back(slot);
+}
+
+void AsyncIoBackend::FailSlot(Slot* slot, int error) {
+  Completion completion;
+  completion.cookie = slot->cookie;
+  completion.result = -error;
+  failed_completions_.push_back(completion);
+  FreeSlot(slot);
+}
+
+int AsyncIoBackend::ReapFailed(vector<Completion>* completions) {
+  int num_failed = failed_completions_.size();
+  completions->insert(completions->end(), failed_completions_.begin(),
+      failed_completions_.end());
+  failed_completions_.clear();
+  return num_failed;
+}
+
+namespace impala {
+
+#ifdef IMPALA_HAVE_IO_URING
+
+// io_uring backend. Requests are written into the submission queue ring that is shared
+// with the kernel and completions are read from the completion queue ring, so apart
+// from io_uring_enter() there are no system calls per request.
+class IoUringBackend : public AsyncIoBackend {
+ public:
+  IoUringBackend(int queue_depth)
+    : AsyncIoBackend(queue_depth),
+      ring_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      cq_ring_(MAP_FAILED),
+      sqes_(reinterpret_cast<io_uring_sqe*>(MAP_FAILED)),
+      num_unsubmitted_(0) {
+  }
+
+  virtual ~IoUringBackend() {
+    DCHECK_EQ(num_in_flight_, 0);
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0) close(ring_fd_);
+  }
+
+  virtual const char* name() const { return "io_uring"; }
+
+  Status Init() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd_ = syscall(__NR_io_uring_setup, queue_depth_, &params);
+    if (ring_fd_ < 0) {
+      return Status(Substitute("io_uring_setup($0) failed: $1", queue_depth_,
+          GetStrErrMsg()));
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    sqes_ = reinterpret_cast<io_uring_sqe*>(mmap(NULL, sqes_size_,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+      return Status(Substitute("Could not map io_uring rings: $0", GetStrErrMsg()));
+    }
+
+    uint8_t* sq = reinterpret_cast<uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    uint8_t* cq = reinterpret_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    InitSlots();
+    return Status::OK;
+  }
+
+  virtual void PrepareRead(int fd, char* buffer, int64_t len, int64_t offset,
+      void* cookie) {
+    PrepareRequest(IORING_OP_READV, fd, buffer, len, offset, cookie);
+  }
+
+  virtual void PrepareWrite(int fd, const char* buffer, int64_t len, int64_t offset,
+      void* cookie) {
+    PrepareRequest(IORING_OP_WRITEV, fd, buffer, len, offset, cookie);
+  }
+
+  virtual void Submit() {
+    while (num_unsubmitted_ > 0) {
+      int ret = syscall(__NR_io_uring_enter, ring_fd_, num_unsubmitted_, 0, 0, NULL, 0);
+      if (ret >= 0) {
+        num_unsubmitted_ -= ret;
+        if (ret == 0) break;
+        continue;
+      }
+      // The kernel is out of resources. The requests stay in the ring and are sent
+      // again with the next io_uring_enter() call in Reap().
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EBUSY) break;
+      FailUnsubmitted(errno);
+    }
+  }
+
+  virtual Status Reap(int min_completions, vector<Completion>* completions) {
+    DCHECK_LE(min_completions, num_in_flight_);
+    int num_reaped = ReapFailed(completions);
+    while (true) {
+      num_reaped += ReapCompleted(completions);
+      if (num_reaped >= min_completions) break;
+      int ret = syscall(__NR_io_uring_enter, ring_fd_, num_unsubmitted_,
+          min_completions - num_reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (ret >= 0) {
+        num_unsubmitted_ -= ret;
+      } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        return Status(Substitute("io_uring_enter() failed: $0", GetStrErrMsg()));
+      }
+    }
+    return Status::OK;
+  }
+
+ private:
+  void PrepareRequest(uint8_t opcode, int fd, const char* buffer, int64_t len,
+      int64_t offset, void* cookie) {
+    Slot* slot = AllocateSlot(cookie, buffer, len);
+    // Only this thread produces submission queue entries, the kernel only advances
+    // the head.
+    uint32_t tail = *sq_tail_;
+    uint32_t index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot->iov);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<uint64_t>(slot);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++num_unsubmitted_;
+  }
+
+  // Drains the completion queue ring. Returns the number of completions appended.
+  int ReapCompleted(vector<Completion>* completions) {
+    uint32_t head = *cq_head_;
+    uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    int num_reaped = 0;
+    for (; head != tail; ++head) {
+      io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+      Slot* slot = reinterpret_cast<Slot*>(cqe->user_data);
+      Completion completion;
+      completion.cookie = slot->cookie;
+      completion.result = cqe->res;
+      completions->push_back(completion);
+      FreeSlot(slot);
+      ++num_reaped;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return num_reaped;
+  }
+
+  // Takes back the entries that the kernel has not consumed yet and fails them with
+  // 'error'.
+  void FailUnsubmitted(int error) {
+    LOG(WARNING) << "io_uring_enter() failed to submit " << num_unsubmitted_
+                 << " requests: " << GetStrErrMsg();
+    uint32_t head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    uint32_t tail = *sq_tail_;
+    for (uint32_t i = head; i != tail; ++i) {
+      io_uring_sqe* sqe = &sqes_[sq_array_[i & sq_mask_]];
+      FailSlot(reinterpret_cast<Slot*>(sqe->user_data), error);
+    }
+    __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+    num_unsubmitted_ = 0;
+  }
+
+  int ring_fd_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  uint32_t* sq_head_;
+  uint32_t* sq_tail_;
+  uint32_t sq_mask_;
+  uint32_t* sq_array_;
+  uint32_t* cq_head_;
+  uint32_t* cq_tail_;
+  uint32_t cq_mask_;
+  io_uring_cqe* cqes_;
+
+  // Number of entries written to the submission ring but not yet consumed by the
+  // kernel.
+  int num_unsubmitted_;
+};
+
+#endif
+
+// Linux native AIO backend (the interface wrapped by libaio).
+class NativeAioBackend : public AsyncIoBackend {
+ public:
+  NativeAioBackend(int queue_depth) : AsyncIoBackend(queue_depth), context_(0) { }
+
+  virtual ~NativeAioBackend() {
+    DCHECK_EQ(num_in_flight_, 0);
+    if (context_ != 0) syscall(__NR_io_destroy, context_);
+  }
+
+  virtual const char* name() const { return "libaio"; }
+
+  Status Init() {
+    if (syscall(__NR_io_setup, queue_depth_, &context_) < 0) {
+      context_ = 0;
+      return Status(Substitute("io_setup($0) failed: $1", queue_depth_,
+          GetStrErrMsg()));
+    }
+    iocbs_.resize(queue_depth_);
+    pending_.reserve(queue_depth_);
+    events_.resize(queue_depth_);
+    InitSlots();
+    return Status::OK;
+  }
+
+  virtual void PrepareRead(int fd, char* buffer, int64_t len, int64_t offset,
+      void* cookie) {
+    PrepareRequest(IOCB_CMD_PREAD, fd, buffer, len, offset, cookie);
+  }
+
+  virtual void PrepareWrite(int fd, const char* buffer, int64_t len, int64_t offset,
+      void* cookie) {
+    PrepareRequest(IOCB_CMD_PWRITE, fd, buffer, len, offset, cookie);
+  }
+
+  virtual void Submit() {
+    int submitted = 0;
+    while (submitted < pending_.size()) {
+      int ret = syscall(__NR_io_submit, context_, pending_.size() - submitted,
+          &pending_[submitted]);
+      if (ret > 0) {
+        submitted += ret;
+      } else if (ret < 0 && errno == EINTR) {
+        continue;
+      } else {
+        // io_submit() reports the error of the first request it could not queue. Fail
+        // that request and try the remaining ones.
+        int error = ret < 0 ? errno : EAGAIN;
+        FailSlot(SlotForIocb(pending_[submitted]), error);
+        ++submitted;
+      }
+    }
+    pending_.clear();
+  }
+
+  virtual Status Reap(int min_completions, vector<Completion>* completions) {
+    DCHECK(pending_.empty()) << "Submit() must be called before Reap()";
+    DCHECK_LE(min_completions, num_in_flight_);
+    int num_reaped = ReapFailed(completions);
+    int min_events = max(0, min_completions - num_reaped);
+    // Always poll once so that completions that are already available are returned.
+    do {
+      int ret = syscall(__NR_io_getevents, context_, min_events, events_.size(),
+          &events_[0], NULL);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        return Status(Substitute("io_getevents() failed: $0", GetStrErrMsg()));
+      }
+      for (int i = 0; i < ret; ++i) {
+        Slot* slot = reinterpret_cast<Slot*>(events_[i].data);
+        Completion completion;
+        completion.cookie = slot->cookie;
+        completion.result = events_[i].res;
+        completions->push_back(completion);
+        FreeSlot(slot);
+      }
+      num_reaped += ret;
+      min_events = max(0, min_completions - num_reaped);
+    } while (min_events > 0);
+    return Status::OK;
+  }
+
+ private:
+  void PrepareRequest(uint16_t opcode, int fd, const char* buffer, int64_t len,
+      int64_t offset, void* cookie) {
+    Slot* slot = AllocateSlot(cookie, buffer, len);
+    iocb* cb = &iocbs_[slot - &slots_[0]];
+    memset(cb, 0, sizeof(*cb));
+    cb->aio_data = reinterpret_cast<uint64_t>(slot);
+    cb->aio_lio_opcode = opcode;
+    cb->aio_fildes = fd;
+    cb->aio_buf = reinterpret_cast<uint64_t>(buffer);
+    cb->aio_nbytes = len;
+    cb->aio_offset = offset;
+    pending_.push_back(cb);
+  }
+
+  Slot* SlotForIocb(iocb* cb) { return reinterpret_cast<Slot*>(cb->aio_data); }
+
+  aio_context_t context_;
+
+  // Control blocks, one per slot (same index).
+  vector<iocb> iocbs_;
+
+  // Prepared requests that have not been passed to io_submit() yet.
+  vector<iocb*> pending_;
+
+  // Buffer for io_getevents().
+  vector<io_event> events_;
+};
+
+}
+
+Status AsyncIoBackend::Create(DiskIoMgr::IoBackend::type type, int queue_depth,
+    scoped_ptr<AsyncIoBackend>* backend) {
+  DCHECK_GT(queue_depth, 0);
+  DCHECK_NE(type, DiskIoMgr::IoBackend::THREADS);
+  Status status;
+  if (type == DiskIoMgr::IoBackend::ASYNC_AUTO || type == DiskIoMgr::IoBackend::IO_URING) {
+#ifdef IMPALA_HAVE_IO_URING
+    IoUringBackend* io_uring = new IoUringBackend(queue_depth);
+    backend->reset(io_uring);
+    status = io_uring->Init();
+    if (status.ok()) return status;
+    backend->reset();
+#else
+    status = Status("io_uring is not supported by this build");
+#endif
+    if (type == DiskIoMgr::IoBackend::IO_URING) return status;
+    VLOG_FILE << status.GetDetail() << ". Falling back to native AIO.";
+  }
+  NativeAioBackend* aio = new NativeAioBackend(queue_depth);
+  backend->reset(aio);
+  status = aio->Init();
+  if (!status.ok()) backend->reset();
+  return status;
+}
@@ -0,0 +1,131 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_DISK_IO_MGR_ASYNC_BACKEND_H
+#define IMPALA_RUNTIME_DISK_IO_MGR_ASYNC_BACKEND_H
+
+#include <deque>
+#include <sys/uio.h>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+#include "common/status.h"
+#include "runtime/disk-io-mgr.h"
+
+namespace impala {
+
+// Asynchronous submission interface to the kernel used by the DiskIoMgr for local
+// disks. Instead of blocking one thread per outstanding request, a single disk thread
+// prepares a batch of reads and writes, submits them with one system call and later
+// reaps their completions. The DiskIoMgr keeps all of its scheduling (RequestContexts,
+// ScanRanges, per disk queues); a backend only replaces the pread()/pwrite() calls.
+//
+// Two implementations are provided:
+//  - io_uring (Linux 5.1+): shared submission/completion rings. Buffered reads that
+//    miss the page cache are executed asynchronously by the kernel.
+//  - Linux native AIO (io_setup()/io_submit()): available on all supported kernels.
+//    Note that without O_DIRECT the kernel completes buffered IO inside io_submit(),
+//    so this mostly saves context switches rather than adding queue depth.
+// Both are driven directly through the system calls so there is no dependency on
+// liburing or libaio.
+//
+// A backend object is not thread safe; it is owned and driven by a single disk thread.
+class AsyncIoBackend {
+ public:
+  // Result of a finished request. 'result' is the number of bytes transferred or
+  // -errno if the request failed.
+  struct Completion {
+    void* cookie;
+    int64_t result;
+  };
+
+  virtual ~AsyncIoBackend() { }
+
+  // Creates and initializes a backend of 'type' that can have up to 'queue_depth'
+  // requests outstanding. ASYNC_AUTO tries io_uring first and falls back to native AIO.
+  // Returns an error if the requested backend is not supported by this kernel/build.
+  static Status Create(DiskIoMgr::IoBackend::type type, int queue_depth,
+      boost::scoped_ptr<AsyncIoBackend>* backend);
+
+  // Name of the backend, used for logging.
+  virtual const char* name() const = 0;
+
+  // Queues a read of 'len' bytes at 'offset' of 'fd' into 'buffer'. The request is
+  // only sent to the kernel on the next Submit(). The caller must ensure that
+  // num_in_flight() < queue_depth().
+  virtual void PrepareRead(int fd, char* buffer, int64_t len, int64_t offset,
+      void* cookie) = 0;
+
+  // Same as PrepareRead() for a write of 'len' bytes from 'buffer'.
+  virtual void PrepareWrite(int fd, const char* buffer, int64_t len, int64_t offset,
+      void* cookie) = 0;
+
+  // Submits all prepared requests with as few system calls as possible. Requests that
+  // the kernel rejects are not lost, they are returned by the next Reap() with the
+  // error code as result.
+  virtual void Submit() = 0;
+
+  // Waits until at least 'min_completions' requests have finished (or returns
+  // immediately if 'min_completions' is 0) and appends all finished requests to
+  // 'completions'. 'min_completions' must not exceed num_in_flight().
+  virtual Status Reap(int min_completions, std::vector<Completion>* completions) = 0;
+
+  // Maximum number of requests that can be outstanding.
+  int queue_depth() const { return queue_depth_; }
+
+  // Number of requests that have been prepared but not yet reaped.
+  int num_in_flight() const { return num_in_flight_; }
+
+ protected:
+  AsyncIoBackend(int queue_depth) : queue_depth_(queue_depth), num_in_flight_(0) { }
+
+  // Per request bookkeeping. Slots are recycled through 'free_slots_' so there is no
+  // allocation on the IO path. The iovec is kept here (rather than on the stack)
+  // because older kernels read it again when the request is punted to a worker.
+  struct Slot {
+    void* cookie;
+    struct iovec iov;
+  };
+
+  // Initializes the slots. Called by the subclasses' Init().
+  void InitSlots();
+
+  // Returns a free slot for a new request and updates num_in_flight_.
+  Slot* AllocateSlot(void* cookie, const char* buffer, int64_t len);
+
+  // Returns a slot to the free list once the request's completion has been reaped.
+  void FreeSlot(Slot* slot);
+
+  // Completes a request that the kernel refused to accept with 'error'. It is handed
+  // back by the next Reap().
+  void FailSlot(Slot* slot, int error);
+
+  // Moves the completions of failed submissions to 'completions'. Returns the number
+  // of completions moved.
+  int ReapFailed(std::vector<Completion>* completions);
+
+  const int queue_depth_;
+  int num_in_flight_;
+
+  std::vector<Slot> slots_;
+  std::vector<Slot*> free_slots_;
+
+  // Completions for requests that could not be submitted.
+  std::deque<Completion> failed_completions_;
+};
+
+}
+
+#endif
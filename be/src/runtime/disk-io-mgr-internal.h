@@ -30,6 +30,7 @@
 #include "util/hdfs-util.h"
 #include "util/filesystem-util.h"
 #include "util/impalad-metrics.h"
+#include "util/stopwatch.h"
 
 // This file contains internal structures to the IoMgr. Users of the IoMgr do
 // not need to include this file.
@@ -67,6 +68,25 @@ struct DiskIoMgr::DiskQueue {
   DiskQueue(int id) : disk_id(id) { }
 };
 
+// Bookkeeping for a read or write that has been submitted to an AsyncIoBackend. Used
+// as the backend cookie. The disk state for the range's context stays referenced
+// (num_threads_in_op) until the request completes, exactly like a blocking disk
+// thread holds it for the duration of its read/write.
+struct DiskIoMgr::AsyncRequest {
+  DiskQueue* disk_queue;
+  RequestContext* context;
+  RequestRange* range;
+
+  // Buffer being read into. Only used for reads.
+  BufferDescriptor* buffer_desc;
+
+  // File descriptor opened for the write. Only used for writes.
+  int write_fd;
+
+  // Measures the time from submission to completion.
+  MonotonicStopWatch timer;
+};
+
 // Internal per request-context state. This object maintains a lot of state that is
 // carefully synchronized. The context maintains state across all disks as well as
 // per disk state.
@@ -414,6 +414,53 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
   return Status::OK;
 }
 
+int DiskIoMgr::ScanRange::GetAsyncReadFd() {
+  unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  if (fs_.valid) {
+    if (hdfs_file_ == NULL) return -1;
+    // Only files that are served from the local dfs cache have a local descriptor.
+    return dfsGetLocalFileDescriptor(fs_, hdfs_file_);
+  }
+  if (local_file_ == NULL) return -1;
+  return fileno(local_file_);
+}
+
+Status DiskIoMgr::ScanRange::PrepareAsyncRead(int64_t* file_offset,
+    int64_t* bytes_to_read) {
+  unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  if (is_cancelled_) return Status::CANCELLED;
+  *file_offset = offset_ + bytes_read_;
+  *bytes_to_read =
+      min(static_cast<int64_t>(io_mgr_->max_buffer_size_), len_ - bytes_read_);
+  DCHECK_GT(*bytes_to_read, 0);
+  return Status::OK;
+}
+
+Status DiskIoMgr::ScanRange::FinishAsyncRead(int64_t result, int64_t* bytes_read,
+    bool* eosr) {
+  unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  if (is_cancelled_) return Status::CANCELLED;
+
+  *eosr = false;
+  *bytes_read = 0;
+  if (result < 0) {
+    errno = -result;
+    string error_msg = GetStrErrMsg();
+    stringstream ss;
+    ss << "Could not read from " << file_ << " at byte offset: "
+       << bytes_read_ << ": " << error_msg;
+    return Status(ss.str());
+  } else if (result == 0) {
+    // No more bytes in the file. The scan range went past the end.
+    *eosr = true;
+  }
+  *bytes_read = result;
+  bytes_read_ += *bytes_read;
+  DCHECK_LE(bytes_read_, len_);
+  if (bytes_read_ == len_) *eosr = true;
+  return Status::OK;
+}
+
 Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
   DCHECK(try_cache_);
   DCHECK_EQ(bytes_read_, 0);
@@ -21,6 +21,9 @@ using namespace std;
 
 // Simple utility to run the disk io stress test.  A optional second parameter
 // can be passed to control how long to run this test (0 for forever).
+// If a third parameter "compare" is passed, the test is run once with the threaded
+// io backend and once with the async backend (without cancellation) and the throughput
+// and CPU cost of the two are printed.
 
 // TODO: make these configurable once we decide how to run BE tests with args
 const int DEFAULT_DURATION_SEC = 1;
@@ -35,7 +38,15 @@ int main(int argc, char** argv) {
   impala::InitThreading();
   int duration_sec = DEFAULT_DURATION_SEC;
 
-  if (argc == 2) {
+  bool compare_backends = false;
+  if (argc == 3) {
+    if (strcmp(argv[2], "compare") != 0) {
+      printf("Invalid arg: %s\n", argv[2]);
+      return 1;
+    }
+    compare_backends = true;
+  }
+  if (argc >= 2) {
     StringParser::ParseResult status;
     duration_sec = StringParser::StringToInt<int>(argv[1], strlen(argv[1]), &status);
     if (status != StringParser::PARSE_SUCCESS) {
@@ -48,6 +59,24 @@ int main(int argc, char** argv) {
   } else {
     printf("Running stress test indefinitely.\n");
   }
+  if (compare_backends) {
+    if (duration_sec == 0) {
+      printf("Comparing io backends requires a fixed duration.\n");
+      return 1;
+    }
+    DiskIoMgrStress threads_test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS, false,
+        DiskIoMgr::IoBackend::THREADS);
+    threads_test.Run(duration_sec);
+    DiskIoMgrStress async_test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS, false,
+        DiskIoMgr::IoBackend::ASYNC_AUTO);
+    async_test.Run(duration_sec);
+    printf("%-10s %15s %15s\n", "Backend", "Reads/s", "CPU ms/GB");
+    printf("%-10s %15.0f %15.0f\n", "threads", threads_test.reads_per_sec(),
+        threads_test.cpu_ms_per_gb());
+    printf("%-10s %15.0f %15.0f\n", "async", async_test.reads_per_sec(),
+        async_test.cpu_ms_per_gb());
+    return 0;
+  }
   DiskIoMgrStress test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS, TEST_CANCELLATION);
   test.Run(duration_sec);
 
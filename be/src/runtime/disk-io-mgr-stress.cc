@@ -14,6 +14,9 @@
 
 #include "runtime/disk-io-mgr-stress.h"
 
+#include <sys/resource.h>
+
+#include "util/stopwatch.h"
 #include "util/time.h"
 
 using namespace boost;
@@ -52,6 +55,14 @@ string GenerateRandomData() {
   return ss.str();
 }
 
+// Returns the user + system CPU time used by this process, in ms.
+static int64_t ProcessCpuMs() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000L +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000L;
+}
+
 struct DiskIoMgrStress::Client {
   boost::mutex lock;
   DiskIoMgr::RequestContext* reader;
@@ -62,16 +73,18 @@ struct DiskIoMgrStress::Client {
 };
 
 DiskIoMgrStress::DiskIoMgrStress(int num_disks, int num_threads_per_disk,
-     int num_clients, bool includes_cancellation) :
+     int num_clients, bool includes_cancellation, DiskIoMgr::IoBackend::type io_backend) :
     num_clients_(num_clients),
-    includes_cancellation_(includes_cancellation) {
+    includes_cancellation_(includes_cancellation),
+    reads_per_sec_(0),
+    cpu_ms_per_gb_(0) {
 
   time_t rand_seed = time(NULL);
   LOG(INFO) << "Running with rand seed: " << rand_seed;
   srand(rand_seed);
 
-  io_mgr_.reset(new DiskIoMgr(
-      num_disks, num_threads_per_disk, MIN_READ_BUFFER_SIZE, MAX_READ_BUFFER_SIZE));
+  io_mgr_.reset(new DiskIoMgr(num_disks, num_threads_per_disk, MIN_READ_BUFFER_SIZE,
+      MAX_READ_BUFFER_SIZE, io_backend));
   Status status = io_mgr_->Init(&dummy_tracker_);
   CHECK(status.ok());
 
@@ -133,6 +146,8 @@ void DiskIoMgrStress::ClientThread(int client_id) {
         buffer->Return();
         buffer = NULL;
         bytes_read += len;
+        num_reads_.UpdateAndFetch(1);
+        bytes_read_.UpdateAndFetch(len);
 
         CHECK_GE(bytes_read, 0);
         CHECK_LE(bytes_read, expected.size());
@@ -173,6 +188,11 @@ void DiskIoMgrStress::CancelRandomReader() {
 
 void DiskIoMgrStress::Run(int sec) {
   shutdown_ = false;
+  num_reads_ = 0;
+  bytes_read_ = 0;
+  int64_t start_cpu_ms = ProcessCpuMs();
+  MonotonicStopWatch timer;
+  timer.Start();
   for (int i = 0; i < num_clients_; ++i) {
     readers_.add_thread(
         new thread(&DiskIoMgrStress::ClientThread, this, i));
@@ -197,6 +217,14 @@ void DiskIoMgrStress::Run(int sec) {
   }
 
   readers_.join_all();
+
+  double elapsed_sec = timer.ElapsedTime() / 1000000000.0;
+  double gb_read = bytes_read_ / (1024.0 * 1024.0 * 1024.0);
+  reads_per_sec_ = num_reads_ / elapsed_sec;
+  cpu_ms_per_gb_ = gb_read > 0 ? (ProcessCpuMs() - start_cpu_ms) / gb_read : 0;
+  LOG(INFO) << "Read " << num_reads_ << " buffers (" << bytes_read_ << " bytes) in "
+            << elapsed_sec << "s: " << reads_per_sec_ << " reads/s, "
+            << cpu_ms_per_gb_ << " CPU ms/GB";
 }
 
 // Initialize a client to read one of the files at random.  The scan ranges are
@@ -23,6 +23,7 @@
 #include <boost/thread/thread.hpp>
 #include <boost/unordered_map.hpp>
 
+#include "common/atomic.h"
 #include "runtime/disk-io-mgr.h"
 #include "runtime/mem-tracker.h"
 #include "runtime/thread-resource-mgr.h"
@@ -33,14 +34,21 @@ namespace impala {
 // number of clients.  The clients continuously issue work to the io mgr and
 // asynchronously get cancelled.  The stress test can be run forever or for
 // a fixed duration.  The unit test runs this for a fixed duration.
+// At the end of a run, the number of reads per second and the process CPU time per GB
+// read are reported so that the io backends (see DiskIoMgr::IoBackend) can be compared.
 class DiskIoMgrStress {
  public:
   DiskIoMgrStress(int num_disks, int num_threads_per_disk, int num_clients,
-      bool includes_cancellation);
+      bool includes_cancellation,
+      DiskIoMgr::IoBackend::type io_backend = DiskIoMgr::IoBackend::THREADS);
 
   // Run the test for 'sec'.  If 0, run forever
   void Run(int sec);
 
+  // Results of the last Run().
+  double reads_per_sec() const { return reads_per_sec_; }
+  double cpu_ms_per_gb() const { return cpu_ms_per_gb_; }
+
  private:
   struct Client;
 
@@ -73,6 +81,13 @@ class DiskIoMgrStress {
   // Flag to signal that client reader threads should exit
   volatile bool shutdown_;
 
+  // Number of buffers and bytes returned by the io mgr during the current Run().
+  AtomicInt<int64_t> num_reads_;
+  AtomicInt<int64_t> bytes_read_;
+
+  double reads_per_sec_;
+  double cpu_ms_per_gb_;
+
   // Helper to initialize a new reader client, registering a new reader with the
   // io mgr and initializing the scan ranges
   void NewClient(int i);
@@ -13,12 +13,15 @@
 // limitations under the License.
 
 #include <sched.h>
+#include <fstream>
 #include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp>
 
 #include <gtest/gtest.h>
 
 #include "codegen/llvm-codegen.h"
+#include "dfs_cache/dfs-cache.h"
 #include "runtime/disk-io-mgr.h"
 #include "runtime/disk-io-mgr-stress.h"
 #include "runtime/mem-tracker.h"
@@ -34,6 +37,10 @@ const int MIN_BUFFER_SIZE = 512;
 const int MAX_BUFFER_SIZE = 1024;
 const int LARGE_MEM_LIMIT = 1024 * 1024 * 1024;
 
+// Root of the local dfs cache. It holds a replica of hdfs://nn:8020/user/cached, see
+// main().
+const string CACHE_ROOT = "/tmp/disk-io-mgr-test-cache";
+
 namespace impala {
 
 class DiskIoMgrTest : public testing::Test {
@@ -914,6 +921,99 @@ TEST_F(DiskIoMgrTest, StressTest) {
   test.Run(2); // In seconds
 }
 
+// Same as SingleReader and StressTest but using the async io backend for the local
+// disks. If the kernel supports neither io_uring nor native AIO, the io mgr falls back
+// to disk threads and this tests the fallback.
+TEST_F(DiskIoMgrTest, AsyncReader) {
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
+  const char* data = "abcdefghijklm";
+  int len = strlen(data);
+  CreateTempFile(tmp_file, data);
+
+  for (int num_disks = 1; num_disks <= 5; num_disks += 2) {
+    for (int num_buffers = 1; num_buffers <= 5; ++num_buffers) {
+      for (int num_read_threads = 1; num_read_threads <= 5; ++num_read_threads) {
+        pool_.reset(new ObjectPool);
+        DiskIoMgr io_mgr(num_disks, 1, 1, 1, DiskIoMgr::IoBackend::ASYNC_AUTO);
+
+        Status status = io_mgr.Init(&mem_tracker);
+        ASSERT_TRUE(status.ok());
+        MemTracker reader_mem_tracker;
+        DiskIoMgr::RequestContext* reader;
+        status = io_mgr.RegisterContext(&reader, &reader_mem_tracker);
+        ASSERT_TRUE(status.ok());
+
+        vector<DiskIoMgr::ScanRange*> ranges;
+        for (int i = 0; i < len; ++i) {
+          int disk_id = i % num_disks;
+          ranges.push_back(InitRange(num_buffers, tmp_file, 0, len, disk_id));
+        }
+        status = io_mgr.AddScanRanges(reader, ranges);
+        ASSERT_TRUE(status.ok());
+
+        AtomicInt<int> num_ranges_processed;
+        thread_group threads;
+        for (int i = 0; i < num_read_threads; ++i) {
+          threads.add_thread(new thread(ScanRangeThread, &io_mgr, reader, data,
+              len, Status::OK, 0, &num_ranges_processed));
+        }
+        threads.join_all();
+
+        EXPECT_EQ(num_ranges_processed, ranges.size());
+        io_mgr.UnregisterContext(reader);
+        EXPECT_EQ(reader_mem_tracker.consumption(), 0);
+      }
+    }
+  }
+  EXPECT_EQ(mem_tracker.consumption(), 0);
+
+  DiskIoMgrStress test(5, 1, 10, true, DiskIoMgr::IoBackend::ASYNC_AUTO);
+  test.Run(2); // In seconds
+}
+
+// Test that ranges are routed to the local or remote queues by where their bytes live.
+// The only file cached locally is hdfs://nn:8020/user/cached.
+TEST_F(DiskIoMgrTest, AssignQueue) {
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  DiskIoMgr io_mgr(3, 1, 1, 10);
+  Status status = io_mgr.Init(&mem_tracker);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(io_mgr.num_local_disks(), 3);
+
+  // Local files and files without a filesystem go to the local disk queues.
+  dfsFS local_fs;
+  local_fs.dfs_type = local;
+  local_fs.valid = true;
+  EXPECT_EQ(io_mgr.AssignQueue(local_fs, "/tmp/a", 1, false), 1);
+  EXPECT_EQ(io_mgr.AssignQueue(FileSystemDescriptor::getNull(), "/tmp/a", 4, false), 1);
+
+  // Uncached HDFS files go to the remote HDFS queue, unless the datanode is local.
+  dfsFS hdfs_fs;
+  hdfs_fs.dfs_type = hdfs;
+  hdfs_fs.host = "nn";
+  hdfs_fs.port = 8020;
+  hdfs_fs.valid = true;
+  EXPECT_EQ(io_mgr.AssignQueue(hdfs_fs, "hdfs://nn:8020/a", 1, false),
+      io_mgr.RemoteHdfsDiskId());
+  EXPECT_EQ(io_mgr.AssignQueue(hdfs_fs, "hdfs://nn:8020/a", 1, true), 1);
+
+  // Files with a replica in the local cache are read from the local disks, wherever
+  // their datanode is.
+  EXPECT_EQ(io_mgr.AssignQueue(hdfs_fs, "hdfs://nn:8020/user/cached", 1, false), 1);
+  EXPECT_EQ(io_mgr.AssignQueue(hdfs_fs, "hdfs://nn:8020/user/cached", 4, false), 1);
+  EXPECT_EQ(io_mgr.AssignQueue(hdfs_fs, "hdfs://nn:8020/user/cached", 1, true), 1);
+
+  // Other remote filesystems share the remote dfs queue, S3A has its own.
+  dfsFS s3n_fs;
+  s3n_fs.dfs_type = s3n;
+  s3n_fs.valid = true;
+  EXPECT_EQ(io_mgr.AssignQueue(s3n_fs, "s3n://bucket/a", 1, false),
+      io_mgr.RemoteDfsDiskId());
+  EXPECT_EQ(io_mgr.AssignQueue(s3n_fs, "s3a://bucket/a", 1, false),
+      io_mgr.RemoteS3DiskId());
+}
+
 TEST_F(DiskIoMgrTest, Buffers) {
   // Test default min/max buffer size
   int min_buffer_size = 1024;
@@ -977,5 +1077,16 @@ int main(int argc, char **argv) {
   impala::CpuInfo::Init();
   impala::DiskInfo::Init();
   impala::InitThreading();
-  return RUN_ALL_TESTS();
+  // Cache a replica of one remote file. Scan ranges of the other tests have no
+  // filesystem, so they do not go through the cache.
+  filesystem::remove_all(CACHE_ROOT);
+  filesystem::create_directories(CACHE_ROOT + "/hdfs/nn:8020/user");
+  {
+    ofstream replica((CACHE_ROOT + "/hdfs/nn:8020/user/cached").c_str());
+    replica << "cached";
+  }
+  impala::cacheInit(0, CACHE_ROOT, posix_time::hours(-1), 1024 * 1024);
+  int result = RUN_ALL_TESTS();
+  filesystem::remove_all(CACHE_ROOT);
+  return result;
 }
@@ -13,7 +13,9 @@
 // limitations under the License.
 
 #include "runtime/disk-io-mgr.h"
+#include "runtime/disk-io-mgr-async-backend.h"
 #include "runtime/disk-io-mgr-internal.h"
+#include "runtime/slab-allocator.h"
 #include "util/hdfs-util.h"
 
 #include <fcntl.h>
@@ -38,6 +40,14 @@ DEFINE_int32(num_threads_per_disk, 0, "number of threads per disk");
 // open to S3 and use of multiple CPU cores since S3 reads are relatively compute
 // expensive (SSL and JNI buffer overheads).
 DEFINE_int32(num_s3_io_threads, 16, "number of S3 I/O threads");
+// Reads of files that are not in the local dfs_cache go to the remote filesystem and
+// are mostly network bound, so they are served by their own pools of threads rather
+// than the local disk threads.
+DEFINE_int32(num_remote_hdfs_io_threads, 8, "number of I/O threads for reads of files "
+    "that are not cached locally and are read from a remote HDFS");
+DEFINE_int32(num_remote_dfs_io_threads, 8, "number of I/O threads for reads of files "
+    "that are not cached locally and are read through other remote filesystem adaptors "
+    "(e.g. s3n, tachyon)");
 // The read size is the size of the reads sent to hdfs/os.
 // There is a trade off of latency and throughout, trying to keep disks busy but
 // not introduce seeks.  The literature seems to agree that with 8 MB reads, random
@@ -49,6 +59,15 @@ DEFINE_int32(min_buffer_size, 1024, "The minimum read buffer size (in bytes)");
 DEFINE_int32(max_free_io_buffers, 128,
     "For each io buffer size, the maximum number of buffers the IoMgr will hold onto");
 
+// With an async backend, one thread per local disk keeps up to async_io_queue_depth
+// requests outstanding instead of running num_threads_per_disk blocking threads.
+DEFINE_string(disk_io_backend, "threads", "How the IoMgr issues IO to local disks: "
+    "'threads' (blocking reads, num_threads_per_disk threads per disk), 'async' "
+    "(io_uring if supported by the kernel, otherwise Linux native AIO), 'io_uring' or "
+    "'libaio'.");
+DEFINE_int32(async_io_queue_depth, 64, "With an async disk_io_backend, the maximum "
+    "number of outstanding IO requests per local disk.");
+
 // Rotational disks should have 1 thread per disk to minimize seeks.  Non-rotational
 // don't have this penalty and benefit from multiple concurrent IO requests.
 static const int THREADS_PER_ROTATIONAL_DISK = 1;
@@ -61,6 +80,16 @@ static const int LOW_MEMORY = 64 * 1024 * 1024;
 
 const int DiskIoMgr::DEFAULT_QUEUE_CAPACITY = 2;
 
+static DiskIoMgr::IoBackend::type ParseIoBackend(const string& backend) {
+  string name = to_lower_copy(backend);
+  if (name == "threads") return DiskIoMgr::IoBackend::THREADS;
+  if (name == "async") return DiskIoMgr::IoBackend::ASYNC_AUTO;
+  if (name == "io_uring") return DiskIoMgr::IoBackend::IO_URING;
+  if (name == "libaio") return DiskIoMgr::IoBackend::LIBAIO;
+  LOG(WARNING) << "Unknown --disk_io_backend '" << backend << "', using 'threads'.";
+  return DiskIoMgr::IoBackend::THREADS;
+}
+
 // This class provides a cache of RequestContext objects.  RequestContexts are recycled.
 // This is good for locality as well as lock contention.  The cache has the property that
 // regardless of how many clients get added/removed, the memory locations for
@@ -221,6 +250,7 @@ DiskIoMgr::DiskIoMgr() :
     num_threads_per_disk_(FLAGS_num_threads_per_disk),
     max_buffer_size_(FLAGS_read_size),
     min_buffer_size_(FLAGS_min_buffer_size),
+    io_backend_(ParseIoBackend(FLAGS_disk_io_backend)),
     cached_read_options_(NULL),
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
@@ -233,10 +263,11 @@ DiskIoMgr::DiskIoMgr() :
 }
 
 DiskIoMgr::DiskIoMgr(int num_local_disks, int threads_per_disk, int min_buffer_size,
-                     int max_buffer_size) :
+                     int max_buffer_size, IoBackend::type io_backend) :
     num_threads_per_disk_(threads_per_disk),
     max_buffer_size_(max_buffer_size),
     min_buffer_size_(min_buffer_size),
+    io_backend_(io_backend),
     cached_read_options_(NULL),
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
@@ -262,6 +293,10 @@ DiskIoMgr::~DiskIoMgr() {
     disk_queues_[i]->work_available.notify_all();
   }
   disk_thread_group_.JoinAll();
+  for (int i = 0; i < async_backends_.size(); ++i) {
+    DCHECK_EQ(async_backends_[i]->num_in_flight(), 0);
+    delete async_backends_[i];
+  }
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     if (disk_queues_[i] == NULL) continue;
@@ -303,9 +338,30 @@ Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     disk_queues_[i] = new DiskQueue(i);
+    if (io_backend_ != IoBackend::THREADS && i < num_local_disks()) {
+      scoped_ptr<AsyncIoBackend> backend;
+      Status status =
+          AsyncIoBackend::Create(io_backend_, FLAGS_async_io_queue_depth, &backend);
+      if (status.ok()) {
+        VLOG_FILE << "Disk " << i << " uses " << backend->name() << " with queue depth "
+                  << backend->queue_depth();
+        async_backends_.push_back(backend.release());
+        stringstream ss;
+        ss << "async-work-loop(Disk: " << i << ")";
+        disk_thread_group_.AddThread(new Thread("disk-io-mgr", ss.str(),
+            &DiskIoMgr::AsyncWorkLoop, this, disk_queues_[i], async_backends_.back()));
+        continue;
+      }
+      LOG(WARNING) << "Could not initialize the async IO backend for disk " << i << ": "
+                   << status.GetDetail() << ". Falling back to blocking disk threads.";
+    }
     int num_threads_per_disk;
     if (i == RemoteS3DiskId()) {
       num_threads_per_disk = FLAGS_num_s3_io_threads;
+    } else if (i == RemoteHdfsDiskId()) {
+      num_threads_per_disk = FLAGS_num_remote_hdfs_io_threads;
+    } else if (i == RemoteDfsDiskId()) {
+      num_threads_per_disk = FLAGS_num_remote_dfs_io_threads;
     } else if (num_threads_per_disk_ != 0) {
       num_threads_per_disk = num_threads_per_disk_;
     } else if (DiskInfo::is_rotational(i)) {
@@ -634,27 +690,34 @@ char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
   // convert to bytes
   *buffer_size = (1 << idx) * min_buffer_size_;
 
-  unique_lock<mutex> lock(free_buffers_lock_);
   char* buffer = NULL;
-  if (free_buffers_[idx].empty()) {
-    ++num_allocated_buffers_;
-    if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
-      ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(1L);
-    }
-    if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
-      ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(*buffer_size);
+  {
+    unique_lock<mutex> lock(free_buffers_lock_);
+    if (!free_buffers_[idx].empty()) {
+      buffer = free_buffers_[idx].front();
+      free_buffers_[idx].pop_front();
     }
-    // Update the process mem usage.  This is checked the next time we start
-    // a read for the next reader (DiskIoMgr::GetNextScanRange)
-    process_mem_tracker_->Consume(*buffer_size);
-    buffer = new char[*buffer_size];
-  } else {
+  }
+  if (buffer != NULL) {
     if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(-1L);
     }
-    buffer = free_buffers_[idx].front();
-    free_buffers_[idx].pop_front();
+    return buffer;
+  }
+
+  // Allocate a new buffer outside of free_buffers_lock_. The slab allocator serves it
+  // from a per-thread cache in the common case.
+  ++num_allocated_buffers_;
+  if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
+    ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(1L);
   }
+  if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
+    ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(*buffer_size);
+  }
+  // Update the process mem usage.  This is checked the next time we start
+  // a read for the next reader (DiskIoMgr::GetNextScanRange)
+  process_mem_tracker_->Consume(*buffer_size);
+  buffer = reinterpret_cast<char*>(SlabAllocator::instance()->Allocate(*buffer_size));
   DCHECK(buffer != NULL);
   return buffer;
 }
@@ -669,7 +732,7 @@ void DiskIoMgr::GcIoBuffers() {
       int64_t buffer_size = (1 << idx) * min_buffer_size_;
       process_mem_tracker_->Release(buffer_size);
       --num_allocated_buffers_;
-      delete[] *iter;
+      SlabAllocator::instance()->Free(reinterpret_cast<uint8_t*>(*iter), buffer_size);
 
       ++buffers_freed;
       bytes_freed += buffer_size;
@@ -700,16 +763,22 @@ void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
   DCHECK_EQ(BitUtil::Ceil(buffer_size, min_buffer_size_) & ~(1 << idx), 0)
       << "buffer_size_ / min_buffer_size_ should be power of 2, got buffer_size = "
       << buffer_size << ", min_buffer_size_ = " << min_buffer_size_;
-  unique_lock<mutex> lock(free_buffers_lock_);
-  if (!FLAGS_disable_mem_pools && free_buffers_[idx].size() < FLAGS_max_free_io_buffers) {
-    free_buffers_[idx].push_back(buffer);
+  {
+    unique_lock<mutex> lock(free_buffers_lock_);
+    if (!FLAGS_disable_mem_pools &&
+        free_buffers_[idx].size() < FLAGS_max_free_io_buffers) {
+      free_buffers_[idx].push_back(buffer);
+      buffer = NULL;
+    }
+  }
+  if (buffer == NULL) {
     if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(1L);
     }
   } else {
     process_mem_tracker_->Release(buffer_size);
     --num_allocated_buffers_;
-    delete[] buffer;
+    SlabAllocator::instance()->Free(reinterpret_cast<uint8_t*>(buffer), buffer_size);
     if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(-1L);
     }
@@ -729,7 +798,7 @@ void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
 //  - A ScanRange with a buffer available, or
 //  - A WriteRange in unstarted_write_ranges_.
 bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
-    RequestContext** request_context) {
+    RequestContext** request_context, bool wait_for_work) {
   int disk_id = disk_queue->disk_id;
   *range = NULL;
 
@@ -741,6 +810,8 @@ bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
       unique_lock<mutex> disk_lock(disk_queue->lock);
 
       while (!shut_down_ && disk_queue->request_contexts.empty()) {
+        // Async disk threads with requests in flight reap completions instead.
+        if (!wait_for_work) return true;
         // wait if there are no readers on the queue
         disk_queue->work_available.wait(disk_lock);
       }
@@ -950,10 +1021,196 @@ void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
   DCHECK(shut_down_);
 }
 
+void DiskIoMgr::AsyncWorkLoop(DiskQueue* disk_queue, AsyncIoBackend* backend) {
+  // This loop has the same structure as WorkLoop(), except that the thread does not
+  // wait for a read or write to finish before picking up the next request range. It
+  // keeps up to the backend's queue depth of requests outstanding and only blocks
+  // waiting for new work when nothing is in flight. On shut down, it stops picking up
+  // new work but completes all outstanding requests before exiting.
+  vector<AsyncRequest> requests(backend->queue_depth());
+  vector<AsyncRequest*> free_requests;
+  for (int i = 0; i < requests.size(); ++i) free_requests.push_back(&requests[i]);
+  vector<AsyncIoBackend::Completion> completions;
+  bool shutting_down = false;
+
+  while (true) {
+    while (!shutting_down && !free_requests.empty()) {
+      RequestContext* worker_context = NULL;
+      RequestRange* range = NULL;
+      if (!GetNextRequestRange(disk_queue, &range, &worker_context,
+              backend->num_in_flight() == 0)) {
+        DCHECK(shut_down_);
+        shutting_down = true;
+        break;
+      }
+      if (range == NULL) break;
+
+      bool issued;
+      if (range->request_type() == RequestType::READ) {
+        issued = IssueAsyncRead(disk_queue, worker_context,
+            static_cast<ScanRange*>(range), backend, free_requests.back());
+      } else {
+        DCHECK(range->request_type() == RequestType::WRITE);
+        issued = IssueAsyncWrite(worker_context, static_cast<WriteRange*>(range),
+            backend, free_requests.back());
+      }
+      if (issued) free_requests.pop_back();
+    }
+    backend->Submit();
+
+    if (backend->num_in_flight() == 0) {
+      if (shutting_down) break;
+      continue;
+    }
+    // Requests that the kernel rejected are returned here as well, so the only way
+    // this can fail is if the backend itself is broken, in which case the outstanding
+    // requests (and their buffers) can't be recovered.
+    completions.clear();
+    EXIT_IF_ERROR(backend->Reap(1, &completions));
+    for (int i = 0; i < completions.size(); ++i) {
+      AsyncRequest* request = reinterpret_cast<AsyncRequest*>(completions[i].cookie);
+      HandleAsyncCompletion(request, completions[i].result);
+      free_requests.push_back(request);
+    }
+  }
+
+  DCHECK(shut_down_);
+  DCHECK_EQ(free_requests.size(), requests.size());
+}
+
+bool DiskIoMgr::IssueAsyncRead(DiskQueue* disk_queue, RequestContext* reader,
+    ScanRange* range, AsyncIoBackend* backend, AsyncRequest* request) {
+  BufferDescriptor* buffer_desc = PrepareReadRange(disk_queue, reader, range);
+  if (buffer_desc == NULL) return false;
+
+  int fd = -1;
+  int64_t file_offset = 0;
+  int64_t bytes_to_read = 0;
+  if (buffer_desc->status_.ok()) {
+    fd = range->GetAsyncReadFd();
+    if (fd != -1) {
+      buffer_desc->status_ = range->PrepareAsyncRead(&file_offset, &bytes_to_read);
+    }
+  }
+  if (fd == -1 || !buffer_desc->status_.ok()) {
+    // The open failed, the range was cancelled or the range is not backed by a local
+    // file. Finish the read on this thread, which handles all of these cases.
+    ReadBuffer(disk_queue, reader, buffer_desc);
+    return false;
+  }
+
+  if (reader->active_read_thread_counter_) {
+    reader->active_read_thread_counter_->Add(1L);
+  }
+  if (reader->disks_accessed_bitmap_) {
+    int64_t disk_bit = 1 << disk_queue->disk_id;
+    reader->disks_accessed_bitmap_->BitOr(disk_bit);
+  }
+  request->disk_queue = disk_queue;
+  request->context = reader;
+  request->range = range;
+  request->buffer_desc = buffer_desc;
+  request->write_fd = -1;
+  request->timer = MonotonicStopWatch();
+  request->timer.Start();
+  backend->PrepareRead(fd, buffer_desc->buffer_, bytes_to_read, file_offset, request);
+  return true;
+}
+
+bool DiskIoMgr::IssueAsyncWrite(RequestContext* writer, WriteRange* write_range,
+    AsyncIoBackend* backend, AsyncRequest* request) {
+  Status status;
+  int fd = open(write_range->file(), O_RDWR);
+  if (fd < 0) {
+    status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("open($0, O_RDWR) failed with errno=$1 description=$2",
+            write_range->file_, errno, GetStrErrMsg())));
+  } else if (write_range->len_ > 0) {
+    // Allocate the disk space up front, as WriteRangeHelper() does.
+    int success = posix_fallocate(fd, write_range->offset(), write_range->len_);
+    if (success != 0) {
+      status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+          Substitute("posix_fallocate($0, $1, $2) failed for file $3"
+              " with returnval=$4 description=$5", fd, write_range->offset(),
+              write_range->len_, write_range->file_, success, GetStrErrMsg())));
+      close(fd);
+    }
+  }
+  if (!status.ok()) {
+    HandleWriteFinished(writer, write_range, status);
+    return false;
+  }
+
+  request->disk_queue = NULL;
+  request->context = writer;
+  request->range = write_range;
+  request->buffer_desc = NULL;
+  request->write_fd = fd;
+  request->timer = MonotonicStopWatch();
+  request->timer.Start();
+  backend->PrepareWrite(fd, reinterpret_cast<const char*>(write_range->data_),
+      write_range->len_, write_range->offset(), request);
+  return true;
+}
+
+void DiskIoMgr::HandleAsyncCompletion(AsyncRequest* request, int64_t result) {
+  request->timer.Stop();
+  if (request->range->request_type() == RequestType::READ) {
+    RequestContext* reader = request->context;
+    ScanRange* range = static_cast<ScanRange*>(request->range);
+    BufferDescriptor* buffer_desc = request->buffer_desc;
+    COUNTER_ADD(&read_timer_, request->timer.ElapsedTime());
+    if (reader->read_timer_ != NULL) {
+      COUNTER_ADD(reader->read_timer_, request->timer.ElapsedTime());
+    }
+
+    buffer_desc->status_ =
+        range->FinishAsyncRead(result, &buffer_desc->len_, &buffer_desc->eosr_);
+    buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
+
+    if (reader->bytes_read_counter_ != NULL) {
+      COUNTER_ADD(reader->bytes_read_counter_, buffer_desc->len_);
+    }
+    COUNTER_ADD(&total_bytes_read_counter_, buffer_desc->len_);
+    if (reader->active_read_thread_counter_) {
+      reader->active_read_thread_counter_->Add(-1L);
+    }
+    HandleReadFinished(request->disk_queue, reader, buffer_desc);
+  } else {
+    DCHECK(request->range->request_type() == RequestType::WRITE);
+    WriteRange* write_range = static_cast<WriteRange*>(request->range);
+    Status status;
+    if (result < 0) {
+      errno = -result;
+      status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+          Substitute("pwrite(buffer, $0, $1) failed for file $2 with errno=$3 "
+              "description=$4", write_range->len_, write_range->offset(),
+              write_range->file_, -result, GetStrErrMsg())));
+    } else if (result < write_range->len_) {
+      status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+          Substitute("pwrite(buffer, $0, $1) wrote only $2 bytes to file $3",
+              write_range->len_, write_range->offset(), result, write_range->file_)));
+    } else if (ImpaladMetrics::IO_MGR_BYTES_WRITTEN != NULL) {
+      ImpaladMetrics::IO_MGR_BYTES_WRITTEN->Increment(write_range->len_);
+    }
+    if (close(request->write_fd) != 0 && status.ok()) {
+      status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+          Substitute("close($0) failed", write_range->file_)));
+    }
+    HandleWriteFinished(request->context, write_range, status);
+  }
+}
+
 // This function reads the specified scan range associated with the
 // specified reader context and disk queue.
 void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     ScanRange* range) {
+  BufferDescriptor* buffer_desc = PrepareReadRange(disk_queue, reader, range);
+  if (buffer_desc != NULL) ReadBuffer(disk_queue, reader, buffer_desc);
+}
+
+DiskIoMgr::BufferDescriptor* DiskIoMgr::PrepareReadRange(DiskQueue* disk_queue,
+    RequestContext* reader, ScanRange* range) {
   char* buffer = NULL;
   int64_t bytes_remaining = range->len_ - range->bytes_read_;
   DCHECK_GT(bytes_remaining, 0);
@@ -978,7 +1235,7 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       state.DecrementRequestThreadAndCheckDone(reader);
       range->Cancel(reader->status_);
       DCHECK(reader->Validate()) << endl << reader->DebugString();
-      return;
+      return NULL;
     }
 
     if (!range->ready_buffers_.empty()) {
@@ -987,7 +1244,7 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       range->blocked_on_queue_ = true;
       reader->blocked_ranges_.Enqueue(range);
       state.DecrementRequestThread();
-      return;
+      return NULL;
     } else {
       // We need to get a buffer anyway since there are none queued. The query
       // is likely to fail due to mem limits but there's nothing we can do about that
@@ -1010,6 +1267,12 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
   // No locks in this section.  Only working on local vars.  We don't want to hold a
   // lock across the read call.
   buffer_desc->status_ = range->Open();
+  return buffer_desc;
+}
+
+void DiskIoMgr::ReadBuffer(DiskQueue* disk_queue, RequestContext* reader,
+    BufferDescriptor* buffer_desc) {
+  ScanRange* range = buffer_desc->scan_range_;
   if (buffer_desc->status_.ok()) {
     // Update counters.
     if (reader->active_read_thread_counter_) {
@@ -1022,7 +1285,8 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     SCOPED_TIMER(&read_timer_);
     SCOPED_TIMER(reader->read_timer_);
 
-    buffer_desc->status_ = range->Read(buffer, &buffer_desc->len_, &buffer_desc->eosr_);
+    buffer_desc->status_ =
+        range->Read(buffer_desc->buffer_, &buffer_desc->len_, &buffer_desc->eosr_);
     buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
 
     if (reader->bytes_read_counter_ != NULL) {
@@ -1114,12 +1378,19 @@ Status DiskIoMgr::AddWriteRange(RequestContext* writer, WriteRange* write_range)
   return Status::OK;
 }
 
-int DiskIoMgr::AssignQueue(const char* file, int disk_id, bool expected_local) {
-  // TODO: add a queue for remote HDFS accesses.
+int DiskIoMgr::AssignQueue(const dfsFS& fs, const char* file, int disk_id,
+    bool expected_local) {
   if (IsS3APath(file)) {
     DCHECK(!expected_local);
     return RemoteS3DiskId();
   }
+  // Files that are not in the local cache will be fetched from the remote filesystem
+  // when they are opened. Unless that is an HDFS with a co-located datanode, keep these
+  // reads off the local disk queues.
+  if (fs.valid && fs.dfs_type != local && !dfsIsFileCached(fs, file)) {
+    if (fs.dfs_type != hdfs) return RemoteDfsDiskId();
+    if (!expected_local) return RemoteHdfsDiskId();
+  }
   if (disk_id == -1) {
     // disk id is unknown, assign it a random one.
     static int next_disk_id = 0;
@@ -37,6 +37,7 @@
 
 namespace impala {
 
+class AsyncIoBackend;
 class MemTracker;
 
 // Manager object that schedules IO for all queries on all disks and remote filesystems
@@ -170,6 +171,27 @@ class MemTracker;
 // intensive than local disk/hdfs because of non-direct I/O and SSL processing, and can
 // be CPU bottlenecked especially if not enough I/O threads for these queues are
 // started.
+// Besides S3, there is a remote queue for remote HDFS and one for the other remote
+// filesystem adaptors. AssignQueue() routes a range by where its bytes live when it is
+// scheduled: files in the local dfs_cache (and HDFS files with a co-located datanode)
+// go to the local disk queues, files that would be fetched from the remote filesystem
+// go to its remote queue. This way a slow remote fetch only holds up one of the remote
+// queue's threads instead of a local disk thread serving hot cached reads. Each queue
+// has its own thread count (--num_remote_hdfs_io_threads, --num_remote_dfs_io_threads,
+// --num_s3_io_threads) and round-robins between the RequestContexts that have work on
+// it, so fairness between queries is kept per queue.
+//
+// Asynchronous IO (--disk_io_backend):
+// By default each local disk queue is served by num_threads_per_disk threads that
+// each block on one read or write at a time, so the queue depth seen by the device
+// equals the number of threads. Fast devices (e.g. NVMe) need a deep queue, which
+// costs many threads and context switches. With an async backend (io_uring, or Linux
+// native AIO as fallback) a single thread per local disk instead keeps up to
+// --async_io_queue_depth requests outstanding: it pulls request ranges off the disk
+// queue with the same scheduling as the blocking threads, submits them in a batch and
+// completes them as the kernel reports them. Remote "disks" and ranges that are not
+// backed by a local file descriptor (e.g. dfs files opened for direct access) are
+// still read synchronously.
 //
 // TODO: IoMgr should be able to request additional scan ranges from the coordinator
 // to help deal with stragglers.
@@ -257,6 +279,20 @@ class DiskIoMgr {
     };
   };
 
+  // The mechanism the disk threads use to issue IO to local disks.
+  struct IoBackend {
+    enum type {
+      // Blocking reads/writes, one per disk thread.
+      THREADS,
+      // Asynchronous submission: io_uring if available, otherwise native AIO.
+      ASYNC_AUTO,
+      // Only io_uring.
+      IO_URING,
+      // Only Linux native AIO (io_submit()).
+      LIBAIO,
+    };
+  };
+
   // Represents a contiguous sequence of bytes in a single file.
   // This is the common base class for read and write IO requests - ScanRange and
   // WriteRange. Each disk thread processes exactly one RequestRange at a time.
@@ -357,6 +393,20 @@ class DiskIoMgr {
     // of bytes read. Updates range to keep track of where in the file we are.
     Status Read(char* buffer, int64_t* bytes_read, bool* eosr);
 
+    // Returns a file descriptor that can be used for positional reads of this range by
+    // an async backend, or -1 if the range can only be read via Read(). The range must
+    // be open.
+    int GetAsyncReadFd();
+
+    // Prepares the next asynchronous read of this range, which will read
+    // *bytes_to_read bytes at *file_offset. Returns CANCELLED if the range has been
+    // cancelled.
+    Status PrepareAsyncRead(int64_t* file_offset, int64_t* bytes_to_read);
+
+    // Updates the range after an asynchronous read has finished. 'result' is the
+    // number of bytes read or -errno. Sets *bytes_read and *eosr as Read() does.
+    Status FinishAsyncRead(int64_t result, int64_t* bytes_read, bool* eosr);
+
     // Reads from the DN cache. On success, sets cached_buffer_ to the DN buffer
     // and *read_succeeded to true.
     // If the data is not cached, returns ok() and *read_succeeded is set to false.
@@ -478,8 +528,10 @@ class DiskIoMgr {
   //    the max queue depth.
   //  - min_buffer_size: minimum io buffer size (in bytes)
   //  - max_buffer_size: maximum io buffer size (in bytes). Also the max read size.
+  //  - io_backend: how local disks are accessed. With an async backend,
+  //    threads_per_disk is ignored for local disks.
   DiskIoMgr(int num_disks, int threads_per_disk, int min_buffer_size,
-      int max_buffer_size);
+      int max_buffer_size, IoBackend::type io_backend = IoBackend::THREADS);
 
   // Create DiskIoMgr with default configs.
   DiskIoMgr();
@@ -550,8 +602,9 @@ class DiskIoMgr {
   // Determine which disk queue this file should be assigned to.  Returns an index into
   // disk_queues_.  The disk_id is the volume ID for the local disk that holds the
   // files, or -1 if unknown.  Flag expected_local is true iff this impalad is
-  // co-located with the datanode for this file.
-  int AssignQueue(const char* file, int disk_id, bool expected_local);
+  // co-located with the datanode for this file. Files of 'fs' that are not currently
+  // in the local dfs_cache are assigned to the remote queue for their filesystem.
+  int AssignQueue(const dfsFS& fs, const char* file, int disk_id, bool expected_local);
 
   // TODO: The functions below can be moved to RequestContext.
   // Returns the current status of the context.
@@ -592,6 +645,13 @@ class DiskIoMgr {
   // The disk ID (and therefore disk_queues_ index) used for S3 accesses.
   int RemoteS3DiskId() const { return num_local_disks() + REMOTE_S3_DISK_OFFSET; }
 
+  // The disk ID used for reads of uncached files from a remote HDFS.
+  int RemoteHdfsDiskId() const { return num_local_disks() + REMOTE_HDFS_DISK_OFFSET; }
+
+  // The disk ID used for reads of uncached files through other remote filesystem
+  // adaptors.
+  int RemoteDfsDiskId() const { return num_local_disks() + REMOTE_DFS_DISK_OFFSET; }
+
   // Returns the number of allocated buffers.
   int num_allocated_buffers() const { return num_allocated_buffers_; }
 
@@ -613,12 +673,15 @@ class DiskIoMgr {
   // disk ID (i.e. disk_queue_ index) of num_local_disks().
   enum {
     REMOTE_S3_DISK_OFFSET = 0,
+    REMOTE_HDFS_DISK_OFFSET,
+    REMOTE_DFS_DISK_OFFSET,
     REMOTE_NUM_DISKS
   };
 
  private:
   friend class BufferDescriptor;
   struct DiskQueue;
+  struct AsyncRequest;
   class RequestContextCache;
 
   friend class DiskIoMgrTest_Buffers_Test;
@@ -639,9 +702,16 @@ class DiskIoMgr {
   // The minimum size of each read buffer.
   const int min_buffer_size_;
 
+  // Backend used for local disks.
+  const IoBackend::type io_backend_;
+
   // Thread group containing all the worker threads.
   ThreadGroup disk_thread_group_;
 
+  // Async backends, one per async disk thread. Owned by the IoMgr and only used by the
+  // thread they were created for.
+  std::vector<AsyncIoBackend*> async_backends_;
+
   // Options object for cached hdfs reads. Set on startup and never modified.
   struct hadoopRzOptions* cached_read_options_;
 
@@ -734,13 +804,21 @@ class DiskIoMgr {
   // There can be multiple threads per disk running this loop.
   void WorkLoop(DiskQueue* queue);
 
+  // Disk worker loop for async backends. There is one such thread per local disk. It
+  // fills the backend up to its queue depth with ranges from GetNextRequestRange(),
+  // submits them and completes them via HandleReadFinished()/HandleWriteFinished()
+  // as the backend reports them.
+  void AsyncWorkLoop(DiskQueue* queue, AsyncIoBackend* backend);
+
   // This is called from the disk thread to get the next range to process. It will
   // wait until a scan range and buffer are available, or a write range is available.
   // This functions returns the range to process.
+  // If 'wait_for_work' is false and there is no work, returns true with *range set to
+  // NULL instead of waiting.
   // Only returns false if the disk thread should be shut down.
   // No locks should be taken before this function call and none are left taken after.
   bool GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
-      RequestContext** request_context);
+      RequestContext** request_context, bool wait_for_work = true);
 
   // Updates disk queue and reader state after a read is complete. The read result
   // is captured in the buffer descriptor.
@@ -770,6 +848,35 @@ class DiskIoMgr {
   // Reads the specified scan range and calls HandleReadFinished when done.
   void ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       ScanRange* range);
+
+  // Gets a buffer for the next read of 'range' and opens the range. Returns NULL if
+  // no read should be issued now (low memory or cancellation); the per disk state
+  // has been updated in that case. Otherwise the returned descriptor's status_ is
+  // the result of opening the range.
+  BufferDescriptor* PrepareReadRange(DiskQueue* disk_queue, RequestContext* reader,
+      ScanRange* range);
+
+  // Synchronously reads into 'buffer_desc', which was returned by PrepareReadRange(),
+  // and calls HandleReadFinished when done.
+  void ReadBuffer(DiskQueue* disk_queue, RequestContext* reader,
+      BufferDescriptor* buffer_desc);
+
+  // Issues the next read of 'range' on 'backend' using 'request' for bookkeeping.
+  // Returns false if no async read was issued (the range could not be read
+  // asynchronously and was read synchronously on the calling thread instead, or it
+  // was deferred or failed), in which case 'request' is unused.
+  bool IssueAsyncRead(DiskQueue* disk_queue, RequestContext* reader, ScanRange* range,
+      AsyncIoBackend* backend, AsyncRequest* request);
+
+  // Opens the file for 'write_range' and issues the write on 'backend'. If the file
+  // can't be prepared, completes the write with the error and returns false, in which
+  // case 'request' is unused.
+  bool IssueAsyncWrite(RequestContext* writer, WriteRange* write_range,
+      AsyncIoBackend* backend, AsyncRequest* request);
+
+  // Finishes the request for an async read or write with the result reported by the
+  // backend (bytes transferred or -errno).
+  void HandleAsyncCompletion(AsyncRequest* request, int64_t result);
 };
 
 }
@@ -20,6 +20,7 @@
 #include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
+#include "codegen/codegen-cache.h"
 #include "common/logging.h"
 #include "resourcebroker/resource-broker.h"
 #include "runtime/client-cache.h"
@@ -29,6 +30,7 @@
 #include "runtime/hdfs-fs-cache.h"
 #include "runtime/lib-cache.h"
 #include "runtime/mem-tracker.h"
+#include "runtime/slab-allocator.h"
 #include "runtime/thread-resource-mgr.h"
 #include "scheduling/request-pool-service.h"
 #include "service/frontend.h"
@@ -65,6 +67,14 @@ DEFINE_int32(state_store_subscriber_port, 23000,
     "port where StatestoreSubscriberService should be exported");
 DEFINE_int32(num_hdfs_worker_threads, 16,
     "(Advanced) The number of threads in the global HDFS operation pool");
+DEFINE_bool(be_service_nonblocking, false, "(Advanced) If true, ImpalaInternalService "
+    "is served by a non-blocking server, which serves all connections from one event "
+    "loop and runs rpcs in --be_service_threads worker threads, instead of one thread "
+    "per connection. Blocked rpcs (e.g. TransmitData() to a full stream) hold a worker, "
+    "so at most --be_service_max_blocked_senders of them block at once, and "
+    "--be_service_threads must exceed that number, or the server does not start. Must "
+    "be set on all impalads, since clients must use framed transport. Not supported "
+    "with SSL or Kerberos.");
 
 DECLARE_int32(state_store_port);
 DECLARE_int32(num_threads_per_core);
@@ -127,7 +137,8 @@ ExecEnv* ExecEnv::exec_env_ = NULL;
 
 ExecEnv::ExecEnv()
   : stream_mgr_(new DataStreamMgr()),
-    impalad_client_cache_(new ImpalaInternalServiceClientCache()),
+    impalad_client_cache_(new ImpalaInternalServiceClientCache(1, 0, 0, 0, "",
+        FLAGS_be_service_nonblocking)),
     catalogd_client_cache_(new CatalogServiceClientCache()),
     htable_factory_(new HBaseTableFactory()),
     disk_io_mgr_(new DiskIoMgr()),
@@ -174,7 +185,8 @@ ExecEnv::ExecEnv()
 ExecEnv::ExecEnv(const string& hostname, int backend_port, int subscriber_port,
                  int webserver_port, const string& statestore_host, int statestore_port)
   : stream_mgr_(new DataStreamMgr()),
-    impalad_client_cache_(new ImpalaInternalServiceClientCache()),
+    impalad_client_cache_(new ImpalaInternalServiceClientCache(1, 0, 0, 0, "",
+        FLAGS_be_service_nonblocking)),
     catalogd_client_cache_(new CatalogServiceClientCache()),
     htable_factory_(new HBaseTableFactory()),
     disk_io_mgr_(new DiskIoMgr()),
@@ -344,6 +356,10 @@ Status ExecEnv::StartServices() {
   mem_tracker_.reset(new MemTracker(TcmallocMetric::PHYSICAL_BYTES_RESERVED,
       bytes_limit > 0 ? bytes_limit : -1, -1, "Process"));
 
+  // Free the buffers cached by the slab allocator first, so that the tcmalloc callback
+  // below can return them to the OS.
+  SlabAllocator::instance()->RegisterGcFunction(mem_tracker_.get());
+
   // Since tcmalloc does not free unused memory, we may exceed the process mem limit even
   // if Impala is not actually using that much memory. Add a callback to free any unused
   // memory if we hit the process limit.
@@ -353,8 +369,10 @@ Status ExecEnv::StartServices() {
   // tcmalloc metrics aren't defined in ASAN builds, just use the default behavior to
   // track process memory usage (sum of all children trackers).
   mem_tracker_.reset(new MemTracker(bytes_limit > 0 ? bytes_limit : -1, -1, "Process"));
+  SlabAllocator::instance()->RegisterGcFunction(mem_tracker_.get());
 #endif
 
+  CodegenCache::instance()->InitMemTracker(mem_tracker_.get());
   mem_tracker_->RegisterMetrics(metrics_.get(), "mem-tracker.process");
 
   if (bytes_limit > MemInfo::physical_mem()) {
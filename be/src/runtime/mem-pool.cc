@@ -14,6 +14,7 @@
 
 #include "runtime/mem-pool.h"
 #include "runtime/mem-tracker.h"
+#include "runtime/slab-allocator.h"
 #include "util/impalad-metrics.h"
 
 #include <algorithm>
@@ -46,7 +47,7 @@ MemPool::MemPool(MemTracker* mem_tracker, int chunk_size)
 
 MemPool::ChunkInfo::ChunkInfo(int size)
   : owns_data(true),
-    data(reinterpret_cast<uint8_t*>(malloc(size))),
+    data(SlabAllocator::instance()->Allocate(size)),
     size(size),
     cumulative_allocated_bytes(0),
     allocated_bytes(0) {
@@ -60,7 +61,7 @@ MemPool::~MemPool() {
   for (size_t i = 0; i < chunks_.size(); ++i) {
     if (!chunks_[i].owns_data) continue;
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    SlabAllocator::instance()->Free(chunks_[i].data, chunks_[i].size);
   }
 
   DCHECK(chunks_.empty()) << "Must call FreeAll() or AcquireData() for this pool";
@@ -74,7 +75,7 @@ void MemPool::FreeAll() {
   for (size_t i = 0; i < chunks_.size(); ++i) {
     if (!chunks_[i].owns_data) continue;
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    SlabAllocator::instance()->Free(chunks_[i].data, chunks_[i].size);
   }
   chunks_.clear();
   current_chunk_idx_ = -1;
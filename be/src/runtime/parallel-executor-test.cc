@@ -16,13 +16,17 @@
 #include <string>
 #include <gtest/gtest.h>
 #include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "runtime/parallel-executor.h"
+#include "util/collection-metrics.h"
 #include "util/thread.h"
 
 using namespace boost;
 using namespace std;
 using namespace impala;
+using namespace rapidjson;
 
 namespace impala {
 
@@ -32,6 +36,12 @@ class ParallelExecutorTest {
     long arg = reinterpret_cast<long>(value);
     EXPECT_FALSE(updates_found_[arg]);
     updates_found_[arg] = true;
+    {
+      lock_guard<mutex> l(lock_);
+      ++num_invocations_;
+      ++num_running_;
+      max_running_ = max(max_running_, num_running_);
+    }
 
     double result = 0;
     // Run something random to keep this cpu a little busy
@@ -41,13 +51,22 @@ class ParallelExecutorTest {
       }
     }
 
+    lock_guard<mutex> l(lock_);
+    --num_running_;
     return Status::OK;
   }
 
-  ParallelExecutorTest(int num_updates) {
+  ParallelExecutorTest(int num_updates)
+    : num_invocations_(0), num_running_(0), max_running_(0) {
     updates_found_.resize(num_updates);
   }
 
+  // Returns the number of calls to UpdateFunction().
+  int num_invocations() const { return num_invocations_; }
+
+  // Returns the maximum number of work items that ran concurrently.
+  int max_running() const { return max_running_; }
+
   void Validate() {
     for (int i = 0; i < updates_found_.size(); ++i) {
       EXPECT_TRUE(updates_found_[i]);
@@ -56,6 +75,12 @@ class ParallelExecutorTest {
 
  private:
   vector<int> updates_found_;
+
+  // Protects num_invocations_, num_running_ and max_running_.
+  mutex lock_;
+  int num_invocations_;
+  int num_running_;
+  int max_running_;
 };
 
 TEST(ParallelExecutorTest, Basic) {
@@ -75,6 +100,33 @@ TEST(ParallelExecutorTest, Basic) {
   test_caller.Validate();
 }
 
+TEST(ParallelExecutorTest, MaxThreads) {
+  int num_work_items = 100;
+  int max_threads = 4;
+  ParallelExecutorTest test_caller(num_work_items);
+
+  vector<long> args;
+  for (int i = 0; i < num_work_items; ++i) {
+    args.push_back(i);
+  }
+
+  StatsMetric<double> latencies("latencies", TUnit::TIME_NS);
+  Status status = ParallelExecutor::Exec(
+      bind<Status>(mem_fn(&ParallelExecutorTest::UpdateFunction), &test_caller, _1),
+      reinterpret_cast<void**>(&args[0]), args.size(), &latencies, max_threads);
+  EXPECT_TRUE(status.ok());
+
+  test_caller.Validate();
+  EXPECT_LE(test_caller.max_running(), max_threads);
+  EXPECT_EQ(test_caller.num_invocations(), num_work_items);
+  // Every work item is timed, not only the first one of each thread.
+  Document document;
+  Value latencies_json;
+  latencies.ToJson(&document, &latencies_json);
+  EXPECT_EQ(latencies_json["count"].GetUint64(),
+      static_cast<uint64_t>(test_caller.num_invocations()));
+}
+
 }
 
 int main(int argc, char **argv) {
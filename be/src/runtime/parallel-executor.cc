@@ -14,6 +14,7 @@
 
 #include "runtime/parallel-executor.h"
 
+#include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 
 #include "util/stopwatch.h"
@@ -24,33 +25,42 @@ using namespace impala;
 using namespace std;
 
 Status ParallelExecutor::Exec(Function function, void** args, int num_args,
-    StatsMetric<double>* latencies) {
+    StatsMetric<double>* latencies, int max_threads) {
   Status status;
   ThreadGroup worker_threads;
   mutex lock;
+  AtomicInt<int> next_arg(0);
 
-  for (int i = 0; i < num_args; ++i) {
+  int num_threads = num_args;
+  if (max_threads > 0 && max_threads < num_threads) num_threads = max_threads;
+  for (int i = 0; i < num_threads; ++i) {
     stringstream ss;
     ss << "worker-thread(" << i << ")";
     worker_threads.AddThread(new Thread("parallel-executor", ss.str(),
-        &ParallelExecutor::Worker, function, args[i], &lock, &status, latencies));
+        bind(&ParallelExecutor::Worker, function, args, num_args, &next_arg, &lock,
+            &status, latencies)));
   }
   worker_threads.JoinAll();
 
   return status;
 }
 
-void ParallelExecutor::Worker(Function function, void* arg, mutex* lock, Status* status,
+void ParallelExecutor::Worker(Function function, void** args, int num_args,
+    AtomicInt<int>* next_arg, mutex* lock, Status* status,
     StatsMetric<double>* latencies) {
-  MonotonicStopWatch sw;
-  if (latencies != NULL) sw.Start();
-  Status local_status = function(arg);
-  if (!local_status.ok()) {
-    unique_lock<mutex> l(*lock);
-    if (status->ok()) *status = local_status;
-  }
+  while (true) {
+    int i = next_arg->UpdateAndFetch(1) - 1;
+    if (i >= num_args) break;
+    MonotonicStopWatch sw;
+    if (latencies != NULL) sw.Start();
+    Status local_status = function(args[i]);
+    if (!local_status.ok()) {
+      unique_lock<mutex> l(*lock);
+      if (status->ok()) *status = local_status;
+    }
 
-  if (latencies != NULL) {
-    latencies->Update(sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
+    if (latencies != NULL) {
+      latencies->Update(sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
+    }
   }
 }
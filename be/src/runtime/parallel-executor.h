@@ -19,6 +19,7 @@
 #include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "util/collection-metrics.h"
 
@@ -41,21 +42,26 @@ class ParallelExecutor {
   // type safe.
   typedef boost::function<Status (void* arg)> Function;
 
-  // Calls function(args[i]) num_args times in parallel using num_args threads.
+  // Calls function(args[i]) num_args times in parallel using num_args threads, or at
+  // most max_threads threads if max_threads > 0. Each thread then calls function() for
+  // one work item after the other until all of them have been started.
   // If any of the work item fails, returns the Status of the first failed work item.
   // Otherwise, returns Status::OK when all work items have been executed.
   //
   // Callers may pass a StatsMetric to gather the latency distribution of task execution.
   static Status Exec(Function function, void** args, int num_args,
-      StatsMetric<double>* latencies = NULL);
+      StatsMetric<double>* latencies = NULL, int max_threads = 0);
 
  private:
-  // Worker thread function which calls function(arg).  This function updates
-  // *status taking *lock to synchronize results from different threads.
+  // Worker thread function which calls function(args[i]) for the next unclaimed i,
+  // taken from *next_arg, until all num_args work items have been claimed. This
+  // function updates *status taking *lock to synchronize results from different
+  // threads.
   //
   // If 'latencies' is not NULL, it is updated with the time elapsed while executing
-  // 'function'.
-  static void Worker(Function function, void* arg, boost::mutex* lock, Status* status,
+  // 'function' for each work item.
+  static void Worker(Function function, void** args, int num_args,
+      AtomicInt<int>* next_arg, boost::mutex* lock, Status* status,
       StatsMetric<double>* latencies);
 };
 
@@ -14,6 +14,7 @@
 
 #include "runtime/plan-fragment-executor.h"
 
+#include <iomanip>
 #include <thrift/protocol/TDebugProtocol.h>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/unordered_map.hpp>
@@ -40,12 +41,31 @@
 #include "util/container-util.h"
 #include "util/parse-util.h"
 #include "util/mem-info.h"
+#include "util/perf-counters.h"
 #include "util/periodic-counter-updater.h"
 #include "util/llama-util.h"
 #include "util/pretty-printer.h"
 
 DEFINE_bool(serialize_batch, false, "serialize and deserialize each returned row batch");
 DEFINE_int32(status_report_interval, 5, "interval between profile reports; in seconds");
+DEFINE_bool(status_report_delta, true, "If true, the periodic profile reports of a "
+    "fragment instance only contain the counters and info strings that changed since "
+    "its previous report. The final report always contains the full profile.");
+DEFINE_bool(status_report_summary_only, false, "If true, the periodic profile reports "
+    "of a fragment instance only contain the counters the coordinator needs to track "
+    "the progress of the query and to compute its exec summary. The final report "
+    "always contains the full profile.");
+DEFINE_bool(enable_tlb_perf_counters, false, "If true, the dTLB loads and misses of the "
+    "thread executing each plan fragment are added to its profile (as DTLBLoads and "
+    "DTLBLoadMisses), e.g. to verify the effect of --use_huge_pages.");
+DEFINE_bool(enable_numa_perf_counters, false, "If true, the local and remote NUMA node "
+    "memory loads of the thread executing each plan fragment are added to its profile "
+    "(as NodeLoads, NodeLoadMisses and RemoteMemoryAccessRatio).");
+DEFINE_bool(async_codegen, false, "If true, plan fragments start executing with the "
+    "interpreted code paths while the codegen'd module is optimized and compiled on a "
+    "background thread, and switch to the JIT'd functions once they are ready. Fragments "
+    "that cannot run without the JIT'd functions (e.g. with IR UDFs) still compile "
+    "before executing.");
 DECLARE_bool(enable_rm);
 
 using namespace std;
@@ -289,6 +309,20 @@ void PlanFragmentExecutor::OptimizeLlvmModule() {
   }
 }
 
+void PlanFragmentExecutor::StartOptimizeLlvmModule() {
+  if (!runtime_state_->codegen_created()) return;
+  LlvmCodeGen* codegen;
+  Status status = runtime_state_->GetCodegen(&codegen, /* initalize */ false);
+  DCHECK(status.ok());
+  DCHECK_NOTNULL(codegen);
+  if (!FLAGS_async_codegen || codegen->needs_sync_finalize()) {
+    OptimizeLlvmModule();
+    return;
+  }
+  codegen_thread_.reset(new Thread("plan-fragment-executor", "codegen",
+      &PlanFragmentExecutor::OptimizeLlvmModule, this));
+}
+
 void PlanFragmentExecutor::PrintVolumeIds(
     const PerNodeScanRanges& per_node_scan_ranges) {
   if (per_node_scan_ranges.empty()) return;
@@ -323,7 +357,7 @@ Status PlanFragmentExecutor::Open() {
     report_thread_active_ = true;
   }
 
-  OptimizeLlvmModule();
+  StartOptimizeLlvmModule();
 
   Status status = OpenInternal();
   if (!status.ok() && !status.IsCancelled() && !status.IsMemLimitExceeded()) {
@@ -337,6 +371,25 @@ Status PlanFragmentExecutor::Open() {
 }
 
 Status PlanFragmentExecutor::OpenInternal() {
+  if (FLAGS_enable_tlb_perf_counters || FLAGS_enable_numa_perf_counters) {
+    hw_counters_.reset(new PerfCounters());
+    // Not all machines (e.g. VMs) expose these hardware counters, skip the missing ones.
+    bool added = false;
+    if (FLAGS_enable_tlb_perf_counters) {
+      added |= hw_counters_->AddCounter(PerfCounters::PERF_COUNTER_HW_DTLB_LOADS);
+      added |= hw_counters_->AddCounter(PerfCounters::PERF_COUNTER_HW_DTLB_LOAD_MISSES);
+    }
+    if (FLAGS_enable_numa_perf_counters) {
+      added |= hw_counters_->AddCounter(PerfCounters::PERF_COUNTER_HW_NODE_LOADS);
+      added |= hw_counters_->AddCounter(PerfCounters::PERF_COUNTER_HW_NODE_LOAD_MISSES);
+    }
+    if (added) {
+      hw_counters_->Snapshot("Open");
+    } else {
+      hw_counters_.reset();
+    }
+  }
+
   {
     SCOPED_TIMER(profile()->total_time_counter());
     RETURN_IF_ERROR(plan_->Open(runtime_state_.get()));
@@ -514,6 +567,20 @@ void PlanFragmentExecutor::FragmentComplete() {
     cpu_time = 0;
   runtime_state_->total_cpu_timer()->Add(cpu_time);
 
+  if (hw_counters_.get() != NULL) {
+    hw_counters_->Snapshot("Complete");
+    hw_counters_->AddToProfile(0, 1, "", profile());
+    hw_counters_.reset();
+    RuntimeProfile::Counter* node_loads = profile()->GetCounter("NodeLoads");
+    RuntimeProfile::Counter* node_load_misses = profile()->GetCounter("NodeLoadMisses");
+    if (node_loads != NULL && node_load_misses != NULL && node_loads->value() > 0) {
+      stringstream ratio;
+      ratio << setprecision(4)
+            << static_cast<double>(node_load_misses->value()) / node_loads->value();
+      profile()->AddInfoString("RemoteMemoryAccessRatio", ratio.str());
+    }
+  }
+
   ReleaseThreadToken();
   StopReportThread();
   if (send_report) SendReport(true);
@@ -571,6 +638,10 @@ void PlanFragmentExecutor::ReleaseThreadToken() {
 
 void PlanFragmentExecutor::Close() {
   if (closed_) return;
+  if (codegen_thread_.get() != NULL) {
+    codegen_thread_->Join();
+    codegen_thread_.reset();
+  }
   row_batch_.reset();
   // Prepare may not have been called, which sets runtime_state_
   if (runtime_state_.get() != NULL) {
@@ -30,6 +30,7 @@ namespace impala {
 
 class HdfsFsCache;
 class ExecNode;
+class PerfCounters;
 class RowDescriptor;
 class RowBatch;
 class DataSink;
@@ -152,6 +153,11 @@ class PlanFragmentExecutor {
   boost::condition_variable report_thread_started_cv_;
   bool report_thread_active_;  // true if we started the thread
 
+  // Runs OptimizeLlvmModule() while the fragment executes, if the module is finalized
+  // in the background (see StartOptimizeLlvmModule()). Joined in Close(), since it
+  // writes the JIT'd function pointers into the plan's nodes and exprs.
+  boost::scoped_ptr<Thread> codegen_thread_;
+
   // true if plan_->GetNext() indicated that it's done
   bool done_;
 
@@ -182,6 +188,12 @@ class PlanFragmentExecutor {
   boost::scoped_ptr<RowBatch> row_batch_;
   boost::scoped_ptr<TRowBatch> thrift_batch_;
 
+  // Hardware counters (dTLB and NUMA node loads) of the thread that runs
+  // OpenInternal(), which drives the whole fragment if it has a sink. Only set with
+  // --enable_tlb_perf_counters or --enable_numa_perf_counters and if the hardware
+  // supports some of them. Added to the profile in FragmentComplete().
+  boost::scoped_ptr<PerfCounters> hw_counters_;
+
   // A counter for the per query, per host peak mem usage. Note that this is not the
   // max of the peak memory of all fragments running on a host since it needs to take
   // into account when they are running concurrently. All fragments for a single query
@@ -239,13 +251,20 @@ class PlanFragmentExecutor {
   void FragmentComplete();
 
   // Optimizes the code-generated functions in runtime_state_->llvm_codegen().
-  // Must be called between plan_->Prepare() and plan_->Open().
+  // Must be called (or started, see StartOptimizeLlvmModule()) between plan_->Prepare()
+  // and plan_->Open().
   // This is somewhat time consuming so we don't want it to do it in
   // PlanFragmentExecutor()::Prepare() to allow starting plan fragments more
   // quickly and in parallel (in a deep plan tree, the fragments are started
   // in level order).
   void OptimizeLlvmModule();
 
+  // Calls OptimizeLlvmModule() on codegen_thread_ if --async_codegen is set and every
+  // codegen'd function has an interpreted fallback, so that the fragment starts
+  // executing with the interpreted code paths and switches to the JIT'd functions once
+  // they are compiled. Otherwise calls OptimizeLlvmModule() directly.
+  void StartOptimizeLlvmModule();
+
   // Executes Open() logic and returns resulting status. Does not set status_.
   // If this plan fragment has no sink, OpenInternal() does nothing.
   // If this plan fragment has a sink and OpenInternal() returns without an
@@ -158,6 +158,11 @@ class RuntimeState {
     root_node_id_ = id;
   }
 
+  // NUMA node that the threads of this fragment instance are pinned to, or -1 if they
+  // are not pinned. Set by the FragmentMgr.
+  int numa_node() const { return numa_node_; }
+  void set_numa_node(int node) { numa_node_ = node; }
+
   // The seed value to use when hashing tuples.
   // See comment on root_node_id_. We add one to prevent having a hash seed of 0.
   uint32_t fragment_hash_seed() const { return root_node_id_ + 1; }
@@ -379,6 +384,9 @@ class RuntimeState {
   // details.
   PlanNodeId root_node_id_;
 
+  // See numa_node().
+  int numa_node_;
+
   // Lock protecting slot_bitmap_filters_
   SpinLock bitmap_lock_;
 
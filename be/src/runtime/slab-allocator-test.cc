@@ -0,0 +1,165 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "runtime/mem-tracker.h"
+#include "runtime/slab-allocator.h"
+
+using namespace boost;
+using namespace std;
+
+DECLARE_bool(use_huge_pages);
+
+namespace impala {
+
+TEST(SlabAllocatorTest, SizeClass) {
+  EXPECT_EQ(SlabAllocator::SizeClass(0), -1);
+  EXPECT_EQ(SlabAllocator::SizeClass(SlabAllocator::MIN_SIZE - 1), -1);
+  EXPECT_EQ(SlabAllocator::SizeClass(SlabAllocator::MIN_SIZE), 0);
+  EXPECT_EQ(SlabAllocator::SizeClass(SlabAllocator::MIN_SIZE + 1), -1);
+  EXPECT_EQ(SlabAllocator::SizeClass(SlabAllocator::MIN_SIZE * 2), 1);
+  EXPECT_EQ(SlabAllocator::SizeClass(3 * SlabAllocator::MIN_SIZE), -1);
+  EXPECT_EQ(SlabAllocator::SizeClass(SlabAllocator::MAX_SIZE),
+      SlabAllocator::NUM_SIZE_CLASSES - 1);
+  EXPECT_EQ(SlabAllocator::SizeClass(SlabAllocator::MAX_SIZE * 2), -1);
+}
+
+TEST(SlabAllocatorTest, Reuse) {
+  SlabAllocator* allocator = SlabAllocator::instance();
+  allocator->ReleaseFreeMemory();
+  EXPECT_EQ(allocator->cached_bytes(), 0);
+
+  // Freed buffers of a size class are handed out again.
+  const int64_t sizes[] = { 1024, 64 * 1024, SlabAllocator::MAX_SIZE };
+  for (int i = 0; i < sizeof(sizes) / sizeof(int64_t); ++i) {
+    uint8_t* buffer = allocator->Allocate(sizes[i]);
+    ASSERT_TRUE(buffer != NULL);
+    memset(buffer, i, sizes[i]);
+    allocator->Free(buffer, sizes[i]);
+    EXPECT_EQ(allocator->cached_bytes(), sizes[i]);
+    EXPECT_EQ(allocator->Allocate(sizes[i]), buffer);
+    EXPECT_EQ(allocator->cached_bytes(), 0);
+    allocator->Free(buffer, sizes[i]);
+  }
+  EXPECT_EQ(allocator->ReleaseFreeMemory(),
+      1024 + 64 * 1024 + SlabAllocator::MAX_SIZE);
+  EXPECT_EQ(allocator->cached_bytes(), 0);
+
+  // Other sizes are not cached.
+  uint8_t* buffer = allocator->Allocate(1000);
+  ASSERT_TRUE(buffer != NULL);
+  allocator->Free(buffer, 1000);
+  EXPECT_EQ(allocator->cached_bytes(), 0);
+}
+
+TEST(SlabAllocatorTest, GcFunction) {
+  SlabAllocator* allocator = SlabAllocator::instance();
+  allocator->ReleaseFreeMemory();
+  MemTracker tracker(1024 * 1024);
+  allocator->RegisterGcFunction(&tracker);
+
+  vector<uint8_t*> buffers;
+  for (int i = 0; i < 8; ++i) buffers.push_back(allocator->Allocate(64 * 1024));
+  for (int i = 0; i < buffers.size(); ++i) allocator->Free(buffers[i], 64 * 1024);
+  EXPECT_EQ(allocator->cached_bytes(), 8 * 64 * 1024);
+
+  // Hitting the limit runs the GcFunction, which frees the cached buffers.
+  tracker.Consume(512 * 1024);
+  EXPECT_FALSE(tracker.TryConsume(768 * 1024));
+  EXPECT_EQ(allocator->cached_bytes(), 0);
+  tracker.Release(512 * 1024);
+}
+
+TEST(SlabAllocatorTest, HugePageFallback) {
+  SlabAllocator* allocator = SlabAllocator::instance();
+  allocator->ReleaseFreeMemory();
+  ASSERT_TRUE(allocator->UseHugePages(SlabAllocator::HUGE_PAGE_SIZE));
+  EXPECT_EQ(allocator->huge_page_bytes(), 0);
+
+  // A size that is not a size class, so that buffers are not cached, and the largest
+  // size class, whose buffers are cached in the central lists.
+  const int64_t sizes[] = { 3 * SlabAllocator::HUGE_PAGE_SIZE, SlabAllocator::MAX_SIZE };
+  for (int i = 0; i < sizeof(sizes) / sizeof(int64_t); ++i) {
+    // Without huge pages the buffers are malloc()ed and must be free()d again.
+    allocator->SetHugePagesFailForTesting(true);
+    uint8_t* malloced = allocator->Allocate(sizes[i]);
+    ASSERT_TRUE(malloced != NULL);
+    memset(malloced, i, sizes[i]);
+    EXPECT_EQ(allocator->huge_page_bytes(), 0);
+
+    allocator->SetHugePagesFailForTesting(false);
+    uint8_t* mapped = allocator->Allocate(sizes[i]);
+    ASSERT_TRUE(mapped != NULL);
+    memset(mapped, i, sizes[i]);
+    EXPECT_EQ(allocator->huge_page_bytes(), sizes[i]);
+
+    // Freeing the malloc()ed buffer does not unmap anything.
+    allocator->Free(malloced, sizes[i]);
+    allocator->ReleaseFreeMemory();
+    EXPECT_EQ(allocator->huge_page_bytes(), sizes[i]);
+    allocator->Free(mapped, sizes[i]);
+    allocator->ReleaseFreeMemory();
+    EXPECT_EQ(allocator->huge_page_bytes(), 0);
+  }
+}
+
+// Allocates and frees buffers of all size classes, holding on to a few of them.
+static void AllocateAndFree(int thread_id, int iters) {
+  SlabAllocator* allocator = SlabAllocator::instance();
+  vector<pair<uint8_t*, int64_t> > held;
+  for (int i = 0; i < iters; ++i) {
+    int64_t len = SlabAllocator::MIN_SIZE << ((i + thread_id) % 12);
+    uint8_t* buffer = allocator->Allocate(len);
+    ASSERT_TRUE(buffer != NULL);
+    buffer[0] = buffer[len - 1] = thread_id;
+    held.push_back(make_pair(buffer, len));
+    if (held.size() > 10) {
+      pair<uint8_t*, int64_t> b = held[i % held.size()];
+      held.erase(held.begin() + i % held.size());
+      EXPECT_EQ(b.first[0], thread_id);
+      EXPECT_EQ(b.first[b.second - 1], thread_id);
+      allocator->Free(b.first, b.second);
+    }
+  }
+  for (int i = 0; i < held.size(); ++i) allocator->Free(held[i].first, held[i].second);
+}
+
+TEST(SlabAllocatorTest, MultiThreaded) {
+  SlabAllocator* allocator = SlabAllocator::instance();
+  thread_group threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.add_thread(new thread(bind(&AllocateAndFree, i, 10000)));
+  }
+  threads.join_all();
+  // The exited threads returned their caches to the central lists.
+  int64_t cached_bytes = allocator->cached_bytes();
+  EXPECT_GT(cached_bytes, 0);
+  EXPECT_EQ(allocator->ReleaseFreeMemory(), cached_bytes);
+  EXPECT_EQ(allocator->cached_bytes(), 0);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  // Must be set before the allocator is created. The other tests work the same with
+  // and without huge pages.
+  FLAGS_use_huge_pages = true;
+  return RUN_ALL_TESTS();
+}
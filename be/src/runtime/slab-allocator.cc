@@ -0,0 +1,335 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/slab-allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+#include <gflags/gflags.h>
+
+#include "common/compiler-util.h"
+#include "common/logging.h"
+#include "runtime/mem-tracker.h"
+#include "util/bit-util.h"
+#include "util/cpu-info.h"
+#include "util/error-util.h"
+
+DECLARE_bool(disable_mem_pools);
+DEFINE_int64(slab_allocator_max_cached_bytes, 512L * 1024L * 1024L,
+    "Maximum number of bytes in free buffers that the slab allocator keeps in its "
+    "central free lists for reuse. Free buffers beyond this are returned to malloc.");
+DEFINE_bool(use_huge_pages, false, "If true, large buffers (hash table buckets, blocks "
+    "and io buffers of 2MB and more) are allocated from explicit huge pages if the "
+    "kernel has some reserved (vm.nr_hugepages) and from transparent huge pages "
+    "otherwise.");
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+const int64_t SlabAllocator::MIN_SIZE;
+const int SlabAllocator::NUM_SIZE_CLASSES;
+const int64_t SlabAllocator::MAX_SIZE;
+const int64_t SlabAllocator::HUGE_PAGE_SIZE;
+const int SlabAllocator::MAX_THREAD_CACHE_BUFFERS;
+const int64_t SlabAllocator::THREAD_CACHE_BYTES_PER_CLASS;
+const int64_t SlabAllocator::MAX_THREAD_CACHED_SIZE;
+const int SlabAllocator::MAX_NUMA_NODES;
+
+__thread SlabAllocator::ThreadCache* SlabAllocator::thread_cache_ = NULL;
+
+// Size of the buffers of 'size_class'.
+static inline int64_t ClassSize(int size_class) {
+  return SlabAllocator::MIN_SIZE << size_class;
+}
+
+static inline int64_t RoundUpToHugePage(int64_t len) {
+  return (len + SlabAllocator::HUGE_PAGE_SIZE - 1) & ~(SlabAllocator::HUGE_PAGE_SIZE - 1);
+}
+
+SlabAllocator::ThreadCache::ThreadCache() : bytes(0) {
+  memset(num_buffers, 0, sizeof(num_buffers));
+}
+
+SlabAllocator* SlabAllocator::instance() {
+  // Never destroyed: buffers may still be freed by other static destructors and by
+  // exiting threads after main() returns.
+  static SlabAllocator* allocator = new SlabAllocator();
+  return allocator;
+}
+
+SlabAllocator::SlabAllocator()
+  : central_bytes_(0),
+    use_huge_pages_(FLAGS_use_huge_pages),
+    huge_page_bytes_(0),
+    huge_pages_fail_for_testing_(false),
+    explicit_huge_pages_available_(true) {
+  int ret = pthread_key_create(&thread_cache_key_, &SlabAllocator::DestroyThreadCache);
+  CHECK_EQ(ret, 0);
+}
+
+int SlabAllocator::SizeClass(int64_t len) {
+  if (len < MIN_SIZE || len > MAX_SIZE || (len & (len - 1)) != 0) return -1;
+  return BitUtil::Log2(len / MIN_SIZE);
+}
+
+int SlabAllocator::ThreadCacheCapacity(int size_class) {
+  int64_t size = ClassSize(size_class);
+  if (size > MAX_THREAD_CACHED_SIZE) return 0;
+  return ::max(1L, ::min(static_cast<int64_t>(MAX_THREAD_CACHE_BUFFERS),
+      THREAD_CACHE_BYTES_PER_CLASS / size));
+}
+
+SlabAllocator::ThreadCache* SlabAllocator::GetThreadCache() {
+  if (LIKELY(thread_cache_ != NULL)) return thread_cache_;
+  ThreadCache* cache = new ThreadCache();
+  {
+    lock_guard<mutex> l(thread_caches_lock_);
+    thread_caches_.insert(cache);
+  }
+  pthread_setspecific(thread_cache_key_, cache);
+  thread_cache_ = cache;
+  return cache;
+}
+
+void SlabAllocator::DestroyThreadCache(void* c) {
+  ThreadCache* cache = reinterpret_cast<ThreadCache*>(c);
+  SlabAllocator* allocator = instance();
+  {
+    lock_guard<mutex> l(allocator->thread_caches_lock_);
+    allocator->thread_caches_.erase(cache);
+  }
+  // The cache is not reachable by ReleaseFreeMemory() anymore, no need to lock it.
+  for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+    if (cache->num_buffers[i] == 0) continue;
+    allocator->ReturnToCentralList(i, cache->buffers[i], cache->num_buffers[i]);
+  }
+  if (thread_cache_ == cache) thread_cache_ = NULL;
+  delete cache;
+}
+
+uint8_t* SlabAllocator::Allocate(int64_t len) {
+  int size_class = SizeClass(len);
+  if (size_class == -1 || FLAGS_disable_mem_pools) return SystemAllocate(len);
+
+  if (ThreadCacheCapacity(size_class) > 0) {
+    ThreadCache* cache = GetThreadCache();
+    ScopedSpinLock l(&cache->lock);
+    if (cache->num_buffers[size_class] == 0) FillThreadCache(cache, size_class);
+    if (cache->num_buffers[size_class] > 0) {
+      cache->bytes -= len;
+      return cache->buffers[size_class][--cache->num_buffers[size_class]];
+    }
+  } else {
+    CentralFreeList* list = GetCentralList(size_class);
+    ScopedSpinLock l(&list->lock);
+    if (!list->buffers.empty()) {
+      uint8_t* buffer = list->buffers.back();
+      list->buffers.pop_back();
+      central_bytes_ -= len;
+      return buffer;
+    }
+  }
+  return SystemAllocate(len);
+}
+
+void SlabAllocator::Free(uint8_t* buffer, int64_t len) {
+  if (buffer == NULL) return;
+  int size_class = SizeClass(len);
+  if (size_class == -1 || FLAGS_disable_mem_pools) {
+    SystemFree(buffer, len);
+    return;
+  }
+
+  int capacity = ThreadCacheCapacity(size_class);
+  if (capacity == 0) {
+    ReturnToCentralList(size_class, &buffer, 1);
+    return;
+  }
+  ThreadCache* cache = GetThreadCache();
+  ScopedSpinLock l(&cache->lock);
+  if (cache->num_buffers[size_class] == capacity) {
+    FlushThreadCache(cache, size_class, ::max(1, capacity / 2));
+  }
+  cache->buffers[size_class][cache->num_buffers[size_class]++] = buffer;
+  cache->bytes += len;
+}
+
+SlabAllocator::CentralFreeList* SlabAllocator::GetCentralList(int size_class) {
+  int node = ::min(CpuInfo::GetCurrentNumaNode(), MAX_NUMA_NODES - 1);
+  return &central_lists_[node][size_class];
+}
+
+void SlabAllocator::FillThreadCache(ThreadCache* cache, int size_class) {
+  DCHECK_EQ(cache->num_buffers[size_class], 0);
+  int64_t size = ClassSize(size_class);
+  int num_to_move = ::max(1, ThreadCacheCapacity(size_class) / 2);
+  CentralFreeList* list = GetCentralList(size_class);
+  ScopedSpinLock l(&list->lock);
+  while (num_to_move > 0 && !list->buffers.empty()) {
+    cache->buffers[size_class][cache->num_buffers[size_class]++] = list->buffers.back();
+    list->buffers.pop_back();
+    cache->bytes += size;
+    central_bytes_ -= size;
+    --num_to_move;
+  }
+}
+
+void SlabAllocator::FlushThreadCache(ThreadCache* cache, int size_class,
+    int num_buffers) {
+  DCHECK_LE(num_buffers, cache->num_buffers[size_class]);
+  cache->num_buffers[size_class] -= num_buffers;
+  cache->bytes -= num_buffers * ClassSize(size_class);
+  ReturnToCentralList(size_class,
+      &cache->buffers[size_class][cache->num_buffers[size_class]], num_buffers);
+}
+
+void SlabAllocator::ReturnToCentralList(int size_class, uint8_t** buffers,
+    int num_buffers) {
+  int64_t size = ClassSize(size_class);
+  int num_cached = 0;
+  {
+    CentralFreeList* list = GetCentralList(size_class);
+    ScopedSpinLock l(&list->lock);
+    while (num_cached < num_buffers &&
+        central_bytes_ + size <= FLAGS_slab_allocator_max_cached_bytes) {
+      list->buffers.push_back(buffers[num_cached++]);
+      central_bytes_ += size;
+    }
+  }
+  // Free the buffers that didn't fit outside of the lock.
+  for (int i = num_cached; i < num_buffers; ++i) {
+    SystemFree(buffers[i], size);
+  }
+}
+
+uint8_t* SlabAllocator::SystemAllocate(int64_t len) {
+  if (UseHugePages(len)) {
+    uint8_t* buffer = MapHugePages(len);
+    if (buffer != NULL) return buffer;
+  }
+  return reinterpret_cast<uint8_t*>(malloc(len));
+}
+
+void SlabAllocator::SystemFree(uint8_t* buffer, int64_t len) {
+  bool mapped = false;
+  if (UseHugePages(len)) {
+    ScopedSpinLock l(&mapped_buffers_lock_);
+    mapped = mapped_buffers_.erase(buffer) > 0;
+  }
+  if (!mapped) {
+    free(buffer);
+    return;
+  }
+  int64_t mapped_len = RoundUpToHugePage(len);
+  int ret = munmap(buffer, mapped_len);
+  DCHECK_EQ(ret, 0) << "munmap() failed: " << GetStrErrMsg();
+  huge_page_bytes_ -= mapped_len;
+}
+
+uint8_t* SlabAllocator::MapHugePages(int64_t len) {
+  if (huge_pages_fail_for_testing_) return NULL;
+  int64_t mapped_len = RoundUpToHugePage(len);
+  void* buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (explicit_huge_pages_available_) {
+    buffer = mmap(NULL, mapped_len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (buffer == MAP_FAILED) {
+      // The reserved huge pages are used up or there are none. Don't retry, the
+      // failing mmap() is not free.
+      LOG(INFO) << "No explicit huge pages available (" << GetStrErrMsg()
+                << "), falling back to transparent huge pages.";
+      explicit_huge_pages_available_ = false;
+    }
+  }
+#endif
+  if (buffer == MAP_FAILED) {
+    // Transparent huge pages are only used for huge page aligned memory. Over allocate
+    // by one huge page and unmap the unaligned head and tail.
+    uint8_t* mapping = reinterpret_cast<uint8_t*>(mmap(NULL, mapped_len + HUGE_PAGE_SIZE,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (mapping == MAP_FAILED) return NULL;
+    uint8_t* aligned = reinterpret_cast<uint8_t*>(
+        RoundUpToHugePage(reinterpret_cast<uintptr_t>(mapping)));
+    int64_t head = aligned - mapping;
+    if (head > 0) munmap(mapping, head);
+    if (HUGE_PAGE_SIZE - head > 0) munmap(aligned + mapped_len, HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, mapped_len, MADV_HUGEPAGE);
+#endif
+    buffer = aligned;
+  }
+  {
+    ScopedSpinLock l(&mapped_buffers_lock_);
+    mapped_buffers_.insert(reinterpret_cast<uint8_t*>(buffer));
+  }
+  huge_page_bytes_ += mapped_len;
+  return reinterpret_cast<uint8_t*>(buffer);
+}
+
+int64_t SlabAllocator::ReleaseFreeMemory() {
+  int64_t bytes_freed = 0;
+  {
+    lock_guard<mutex> l(thread_caches_lock_);
+    for (set<ThreadCache*>::iterator it = thread_caches_.begin();
+         it != thread_caches_.end(); ++it) {
+      ThreadCache* cache = *it;
+      ScopedSpinLock cache_lock(&cache->lock);
+      for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+        for (int j = 0; j < cache->num_buffers[i]; ++j) {
+          SystemFree(cache->buffers[i][j], ClassSize(i));
+        }
+        cache->num_buffers[i] = 0;
+      }
+      bytes_freed += cache->bytes;
+      cache->bytes = 0;
+    }
+  }
+
+  for (int node = 0; node < MAX_NUMA_NODES; ++node) {
+    for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+      vector<uint8_t*> buffers;
+      {
+        ScopedSpinLock l(&central_lists_[node][i].lock);
+        buffers.swap(central_lists_[node][i].buffers);
+        central_bytes_ -= static_cast<int64_t>(buffers.size()) * ClassSize(i);
+      }
+      for (int j = 0; j < buffers.size(); ++j) {
+        SystemFree(buffers[j], ClassSize(i));
+      }
+      bytes_freed += buffers.size() * ClassSize(i);
+    }
+  }
+  VLOG(2) << "SlabAllocator released " << bytes_freed << " bytes";
+  return bytes_freed;
+}
+
+void SlabAllocator::RegisterGcFunction(MemTracker* process_tracker) {
+  process_tracker->AddGcFunction(bind(&SlabAllocator::ReleaseFreeMemory, this));
+}
+
+int64_t SlabAllocator::cached_bytes() {
+  int64_t bytes = central_bytes_;
+  lock_guard<mutex> l(thread_caches_lock_);
+  for (set<ThreadCache*>::iterator it = thread_caches_.begin();
+       it != thread_caches_.end(); ++it) {
+    ScopedSpinLock cache_lock(&(*it)->lock);
+    bytes += (*it)->bytes;
+  }
+  return bytes;
+}
@@ -0,0 +1,207 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_SLAB_ALLOCATOR_H
+#define IMPALA_RUNTIME_SLAB_ALLOCATOR_H
+
+#include <pthread.h>
+#include <set>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include "common/atomic.h"
+#include "util/spinlock.h"
+
+namespace impala {
+
+class MemTracker;
+
+// Process wide allocator for the large buffers that back MemPool chunks, DiskIoMgr io
+// buffers and BufferedBlockMgr blocks. These are all power of two sized, are allocated
+// and freed at a high rate by many threads and are too large for the per thread caches
+// of tcmalloc, so every allocation goes through tcmalloc's central (locked) page heap.
+//
+// Buffers are grouped in size classes, one for each power of two between MIN_SIZE and
+// MAX_SIZE. A freed buffer goes into a small cache of the freeing thread, which needs no
+// synchronization with other threads. When that cache is full, half of it is moved to a
+// central free list for the size class with a single lock acquisition; when it is empty,
+// it is refilled from the central list the same way. Only if both are empty is the buffer
+// malloc()ed. There are separate central lists for each NUMA node, used by the threads
+// running on that node, so that buffers are mostly reused on the node whose memory
+// they are in. Buffers of the largest size classes are not cached per thread, since a few
+// of them would make the per thread caches too large; they only use the central lists.
+// Sizes that are not a size class are passed through to malloc()/free().
+//
+// The allocator does not do any MemTracker accounting for the buffers it hands out, that
+// remains the job of the caller (e.g. MemPool charges its chunks to its tracker). Cached
+// free buffers are untracked process memory, like tcmalloc's free memory, and are freed
+// by ReleaseFreeMemory(), which the process MemTracker calls as a GcFunction when it
+// hits its limit (see RegisterGcFunction()).
+//
+// With --use_huge_pages, buffers of HUGE_PAGE_SIZE and more (including the ones that are
+// not a size class, e.g. large hash table bucket arrays) are mmap()ed instead, backed by
+// explicit huge pages (MAP_HUGETLB) if the kernel has some reserved and by transparent
+// huge pages (MADV_HUGEPAGE) otherwise. This reduces the TLB misses of random accesses
+// to large hash tables and blocks.
+//
+// All functions are thread safe. With --disable_mem_pools, nothing is cached.
+class SlabAllocator {
+ public:
+  // Smallest and largest size class.
+  static const int64_t MIN_SIZE = 1024;
+  static const int NUM_SIZE_CLASSES = 14;
+  static const int64_t MAX_SIZE = MIN_SIZE << (NUM_SIZE_CLASSES - 1);
+
+  // Size of a huge page. Smaller buffers are never backed by huge pages.
+  static const int64_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  // Returns the process wide allocator.
+  static SlabAllocator* instance();
+
+  // Allocates a buffer of 'len' bytes. Returns NULL if the allocation failed.
+  uint8_t* Allocate(int64_t len);
+
+  // Frees 'buffer', which was returned by Allocate(len).
+  void Free(uint8_t* buffer, int64_t len);
+
+  // Frees all cached buffers of all threads. Returns the number of bytes freed.
+  int64_t ReleaseFreeMemory();
+
+  // Adds ReleaseFreeMemory() as a GcFunction to 'process_tracker'.
+  void RegisterGcFunction(MemTracker* process_tracker);
+
+  // Number of bytes in free buffers cached by all threads and the central lists.
+  int64_t cached_bytes();
+
+  // Returns the size class of 'len', or -1 if 'len' is not a size class.
+  static int SizeClass(int64_t len);
+
+  // Returns true if buffers of 'len' bytes are allocated from huge pages.
+  bool UseHugePages(int64_t len) const {
+    return use_huge_pages_ && len >= HUGE_PAGE_SIZE;
+  }
+
+  // Number of bytes in buffers that are currently allocated from huge pages. These are
+  // not allocated by tcmalloc, so they are added to the process memory consumption (see
+  // TcmallocMetric::PHYSICAL_BYTES_RESERVED).
+  int64_t huge_page_bytes() const { return huge_page_bytes_; }
+
+  // If 'fail' is true, allocating huge pages fails, so that buffers that would use them
+  // are malloc()ed instead.
+  void SetHugePagesFailForTesting(bool fail) { huge_pages_fail_for_testing_ = fail; }
+
+ private:
+  // Maximum number of buffers of one size class in a thread cache.
+  static const int MAX_THREAD_CACHE_BUFFERS = 16;
+
+  // A thread caches up to this many bytes of each size class, but at least one buffer.
+  static const int64_t THREAD_CACHE_BYTES_PER_CLASS = 1024 * 1024;
+
+  // Buffers larger than this are not cached per thread.
+  static const int64_t MAX_THREAD_CACHED_SIZE = 1024 * 1024;
+
+  // Number of NUMA nodes with separate central lists. Threads on nodes beyond this
+  // share the lists of the last one.
+  static const int MAX_NUMA_NODES = 8;
+
+  struct ThreadCache {
+    // Protects the members below. Only contended when ReleaseFreeMemory() runs.
+    SpinLock lock;
+    int num_buffers[NUM_SIZE_CLASSES];
+    uint8_t* buffers[NUM_SIZE_CLASSES][MAX_THREAD_CACHE_BUFFERS];
+    int64_t bytes;
+
+    ThreadCache();
+  };
+
+  struct CentralFreeList {
+    SpinLock lock;
+    std::vector<uint8_t*> buffers;
+  };
+
+  SlabAllocator();
+
+  // Returns the calling thread's cache, creating it on first use.
+  ThreadCache* GetThreadCache();
+
+  // Called when a thread exits, returns the thread's cached buffers to the central lists.
+  static void DestroyThreadCache(void* cache);
+
+  // Number of buffers of 'size_class' cached per thread. 0 if it is not cached.
+  static int ThreadCacheCapacity(int size_class);
+
+  // Returns the central list of 'size_class' for the NUMA node of the calling thread.
+  CentralFreeList* GetCentralList(int size_class);
+
+  // Moves up to half of the thread cache capacity of buffers from the central list to
+  // 'cache'. cache->lock must be taken.
+  void FillThreadCache(ThreadCache* cache, int size_class);
+
+  // Moves the 'num_buffers' most recently cached buffers of 'size_class' from 'cache'
+  // to the central list (or frees them if the central lists are full). cache->lock
+  // must be taken.
+  void FlushThreadCache(ThreadCache* cache, int size_class, int num_buffers);
+
+  // Adds 'buffers' to the central list of 'size_class', freeing the ones that don't fit.
+  void ReturnToCentralList(int size_class, uint8_t** buffers, int num_buffers);
+
+  // Allocates and frees uncached buffers, from huge pages if UseHugePages(len) and with
+  // malloc()/free() otherwise. If allocating huge pages fails, the buffer is malloc()ed
+  // as well. SystemFree() frees a buffer the way it was allocated.
+  uint8_t* SystemAllocate(int64_t len);
+  void SystemFree(uint8_t* buffer, int64_t len);
+
+  // mmap()s a 'len' byte, huge page aligned buffer and adds it to mapped_buffers_.
+  // Returns NULL if that failed.
+  uint8_t* MapHugePages(int64_t len);
+
+  // Thread caches of all live threads. Protected by thread_caches_lock_.
+  boost::mutex thread_caches_lock_;
+  std::set<ThreadCache*> thread_caches_;
+
+  // Used to return a thread's cached buffers when it exits.
+  pthread_key_t thread_cache_key_;
+
+  CentralFreeList central_lists_[MAX_NUMA_NODES][NUM_SIZE_CLASSES];
+
+  // Bytes cached in the central lists.
+  AtomicInt<int64_t> central_bytes_;
+
+  // Set from --use_huge_pages when the allocator is created, so that a buffer is always
+  // freed the way it was allocated.
+  const bool use_huge_pages_;
+
+  // Bytes in buffers allocated with MapHugePages().
+  AtomicInt<int64_t> huge_page_bytes_;
+
+  // The buffers allocated with MapHugePages() that have not been freed yet. Only
+  // buffers of HUGE_PAGE_SIZE and more are looked up here, so the lock is rarely taken.
+  SpinLock mapped_buffers_lock_;
+  std::set<uint8_t*> mapped_buffers_;
+
+  // See SetHugePagesFailForTesting().
+  bool huge_pages_fail_for_testing_;
+
+  // Cleared when a MAP_HUGETLB mmap() fails for the first time, after which only
+  // transparent huge pages are used. Racy, but a stale value only costs a failed mmap().
+  bool explicit_huge_pages_available_;
+
+  // The calling thread's cache.
+  static __thread ThreadCache* thread_cache_;
+};
+
+}
+
+#endif
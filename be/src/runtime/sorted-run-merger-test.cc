@@ -0,0 +1,264 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/sorted-run-merger.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+#include "util/runtime-profile.h"
+#include "util/tuple-row-compare.h"
+
+using namespace boost;
+using namespace std;
+
+namespace impala {
+
+// Key value that stands for NULL in the runs below. The row of a NULL key has a NULL
+// tuple.
+static const int32_t NULL_KEY = numeric_limits<int32_t>::min();
+
+// Merges sorted runs of rows with a single nullable INT key with SortedRunMerger, and
+// checks the normalized key prefixes of TupleRowComparator against Compare().
+class SortedRunMergerTest : public testing::Test {
+ protected:
+  SortedRunMergerTest() : mem_pool_(&tracker_) { }
+
+  virtual void SetUp() {
+    vector<bool> nullable_tuples(1, true);
+    vector<TTupleId> tuple_ids(1, static_cast<TTupleId>(0));
+    DescriptorTblBuilder builder(&pool_);
+    builder.DeclareTuple() << TYPE_INT;
+    row_desc_ = pool_.Add(
+        new RowDescriptor(*builder.Build(), tuple_ids, nullable_tuples));
+
+    lhs_ctxs_.push_back(pool_.Add(new ExprContext(pool_.Add(new SlotRef(TYPE_INT, 0)))));
+    rhs_ctxs_.push_back(pool_.Add(new ExprContext(pool_.Add(new SlotRef(TYPE_INT, 0)))));
+    ASSERT_TRUE(Expr::Prepare(lhs_ctxs_, NULL, *row_desc_, &tracker_).ok());
+    ASSERT_TRUE(Expr::Prepare(rhs_ctxs_, NULL, *row_desc_, &tracker_).ok());
+    ASSERT_TRUE(Expr::Open(lhs_ctxs_, NULL).ok());
+    ASSERT_TRUE(Expr::Open(rhs_ctxs_, NULL).ok());
+    srand(0);
+  }
+
+  virtual void TearDown() {
+    Expr::Close(lhs_ctxs_, NULL);
+    Expr::Close(rhs_ctxs_, NULL);
+    mem_pool_.FreeAll();
+  }
+
+  TupleRowComparator MakeComparator(bool is_asc, bool nulls_first) {
+    return TupleRowComparator(lhs_ctxs_, rhs_ctxs_, vector<bool>(1, is_asc),
+        vector<bool>(1, nulls_first));
+  }
+
+  // Adds a row with 'key' to 'batch'. The tuples are allocated from mem_pool_, so they
+  // stay valid when the merger transfers the resources of the batch.
+  void AddRow(int32_t key, RowBatch* batch) {
+    TupleRow* row = batch->GetRow(batch->AddRow());
+    if (key == NULL_KEY) {
+      row->SetTuple(0, NULL);
+    } else {
+      Tuple* tuple = Tuple::Create(sizeof(int32_t), &mem_pool_);
+      *reinterpret_cast<int32_t*>(tuple) = key;
+      row->SetTuple(0, tuple);
+    }
+    batch->CommitLastRow();
+  }
+
+  static int32_t GetKey(TupleRow* row) {
+    Tuple* tuple = row->GetTuple(0);
+    return tuple == NULL ? NULL_KEY : *reinterpret_cast<int32_t*>(tuple);
+  }
+
+  // Returns a row with 'key' that is only used for comparisons.
+  TupleRow* MakeRow(int32_t key) {
+    RowBatch* batch = pool_.Add(new RowBatch(*row_desc_, 1, &tracker_));
+    AddRow(key, batch);
+    return batch->GetRow(0);
+  }
+
+  // A sorted run, supplied in batches of random sizes.
+  struct Run {
+    vector<RowBatch*> batches;
+    int next_batch;
+
+    Run() : next_batch(0) { }
+
+    Status GetNext(RowBatch** batch) {
+      *batch = next_batch < batches.size() ? batches[next_batch++] : NULL;
+      return Status::OK;
+    }
+  };
+
+  // Returns a run of 'keys' sorted by 'comparator'.
+  Run* MakeRun(const TupleRowComparator& comparator, const vector<int32_t>& keys) {
+    vector<TupleRow*> rows;
+    for (int i = 0; i < keys.size(); ++i) rows.push_back(MakeRow(keys[i]));
+    sort(rows.begin(), rows.end(), comparator);
+    Run* run = pool_.Add(new Run());
+    int i = 0;
+    while (i < rows.size()) {
+      int batch_size = min<int>(1 + rand() % 5, rows.size() - i);
+      RowBatch* batch = pool_.Add(new RowBatch(*row_desc_, batch_size, &tracker_));
+      for (int j = 0; j < batch_size; ++j, ++i) AddRow(GetKey(rows[i]), batch);
+      run->batches.push_back(batch);
+    }
+    return run;
+  }
+
+  // Merges 'num_runs' runs of random lengths, some of them empty, in the order given by
+  // 'is_asc' and 'nulls_first', and checks that the output is sorted and contains all
+  // input rows.
+  void TestMerge(int num_runs, bool is_asc, bool nulls_first) {
+    TupleRowComparator comparator = MakeComparator(is_asc, nulls_first);
+    EXPECT_TRUE(comparator.HasNormalizedPrefix());
+    vector<SortedRunMerger::RunBatchSupplier> runs;
+    vector<int32_t> input_keys;
+    for (int i = 0; i < num_runs; ++i) {
+      // The first run has a single row, every third run is empty and the others have
+      // different lengths, so runs are exhausted at different times. Keys are picked
+      // from a small range, so that runs have equal keys, which have equal prefixes.
+      int num_rows = i == 0 ? 1 : (i % 3 == 2 ? 0 : rand() % 40);
+      vector<int32_t> keys;
+      for (int j = 0; j < num_rows; ++j) {
+        int r = rand() % 12;
+        keys.push_back(r == 0 ? NULL_KEY : r - 6);
+      }
+      input_keys.insert(input_keys.end(), keys.begin(), keys.end());
+      runs.push_back(bind(mem_fn(&Run::GetNext), MakeRun(comparator, keys), _1));
+    }
+
+    RuntimeProfile profile(&pool_, "SortedRunMergerTest");
+    SortedRunMerger merger(comparator, row_desc_, &profile, false);
+    ASSERT_TRUE(merger.Prepare(runs).ok());
+    vector<int32_t> output_keys;
+    RowBatch output_batch(*row_desc_, 7, &tracker_);
+    bool eos = false;
+    while (!eos) {
+      ASSERT_TRUE(merger.GetNext(&output_batch, &eos).ok());
+      for (int i = 0; i < output_batch.num_rows(); ++i) {
+        TupleRow* row = output_batch.GetRow(i);
+        if (!output_keys.empty()) {
+          EXPECT_LE(comparator.Compare(MakeRow(output_keys.back()), row), 0)
+              << output_keys.back() << " before " << GetKey(row);
+        }
+        output_keys.push_back(GetKey(row));
+      }
+      output_batch.Reset();
+    }
+
+    sort(input_keys.begin(), input_keys.end());
+    sort(output_keys.begin(), output_keys.end());
+    EXPECT_TRUE(input_keys == output_keys);
+  }
+
+  // Declared before pool_, because the row batches in pool_ release their memory from
+  // it.
+  MemTracker tracker_;
+  ObjectPool pool_;
+  MemPool mem_pool_;
+  RowDescriptor* row_desc_;
+  vector<ExprContext*> lhs_ctxs_;
+  vector<ExprContext*> rhs_ctxs_;
+};
+
+TEST_F(SortedRunMergerTest, Merge) {
+  const int NUM_RUNS[] = {1, 2, 3, 7};
+  for (int i = 0; i < sizeof(NUM_RUNS) / sizeof(int); ++i) {
+    for (int order = 0; order < 4; ++order) {
+      bool is_asc = order & 1;
+      bool nulls_first = order & 2;
+      SCOPED_TRACE(testing::Message() << NUM_RUNS[i] << " runs, is_asc=" << is_asc
+          << " nulls_first=" << nulls_first);
+      TestMerge(NUM_RUNS[i], is_asc, nulls_first);
+    }
+  }
+}
+
+TEST_F(SortedRunMergerTest, EmptyRuns) {
+  TupleRowComparator comparator = MakeComparator(true, true);
+  vector<SortedRunMerger::RunBatchSupplier> runs;
+  for (int i = 0; i < 3; ++i) {
+    runs.push_back(
+        bind(mem_fn(&Run::GetNext), MakeRun(comparator, vector<int32_t>()), _1));
+  }
+  RuntimeProfile profile(&pool_, "SortedRunMergerTest");
+  SortedRunMerger merger(comparator, row_desc_, &profile, false);
+  ASSERT_TRUE(merger.Prepare(runs).ok());
+  RowBatch output_batch(*row_desc_, 7, &tracker_);
+  bool eos = false;
+  ASSERT_TRUE(merger.GetNext(&output_batch, &eos).ok());
+  EXPECT_TRUE(eos);
+  EXPECT_EQ(output_batch.num_rows(), 0);
+}
+
+// Rows with different normalized prefixes must be ordered by their prefixes the same
+// way Compare() orders them.
+TEST_F(SortedRunMergerTest, NormalizedPrefix) {
+  const int32_t KEYS[] = {NULL_KEY, numeric_limits<int32_t>::min() + 1, -1000, -1, 0, 1,
+      1000, numeric_limits<int32_t>::max()};
+  const int NUM_KEYS = sizeof(KEYS) / sizeof(int32_t);
+  for (int order = 0; order < 4; ++order) {
+    bool is_asc = order & 1;
+    bool nulls_first = order & 2;
+    TupleRowComparator comparator = MakeComparator(is_asc, nulls_first);
+    ASSERT_TRUE(comparator.HasNormalizedPrefix());
+    for (int i = 0; i < NUM_KEYS; ++i) {
+      for (int j = 0; j < NUM_KEYS; ++j) {
+        TupleRow* lhs = MakeRow(KEYS[i]);
+        TupleRow* rhs = MakeRow(KEYS[j]);
+        uint64_t lhs_prefix = comparator.GetNormalizedPrefix(lhs);
+        uint64_t rhs_prefix = comparator.GetNormalizedPrefix(rhs);
+        int result = comparator.Compare(lhs, rhs);
+        SCOPED_TRACE(testing::Message() << KEYS[i] << " vs " << KEYS[j] << ", is_asc="
+            << is_asc << " nulls_first=" << nulls_first);
+        if (i == j) {
+          EXPECT_EQ(lhs_prefix, rhs_prefix);
+          EXPECT_EQ(result, 0);
+        } else if (lhs_prefix < rhs_prefix) {
+          EXPECT_LT(result, 0);
+        } else if (lhs_prefix > rhs_prefix) {
+          EXPECT_GT(result, 0);
+        }
+      }
+    }
+    // Non-NULL keys have distinct prefixes.
+    for (int i = 1; i < NUM_KEYS - 1; ++i) {
+      EXPECT_NE(comparator.GetNormalizedPrefix(MakeRow(KEYS[i])),
+          comparator.GetNormalizedPrefix(MakeRow(KEYS[i + 1])));
+    }
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -26,7 +26,7 @@ using namespace std;
 namespace impala {
 
 // BatchedRowSupplier returns individual rows in a batch obtained from a sorted input
-// run (a RunBatchSupplier). Used as the heap element in the min heap maintained by the
+// run (a RunBatchSupplier). Used as the leaf of the loser tree maintained by the
 // merger.
 // Next() advances the row supplier to the next row in the input batch and retrieves
 // the next batch from the input if the current input batch is exhausted. Transfers
@@ -38,6 +38,7 @@ class SortedRunMerger::BatchedRowSupplier {
     : sorted_run_(sorted_run),
       input_row_batch_(NULL),
       input_row_batch_index_(-1),
+      normalized_prefix_(0),
       parent_(parent) {
   }
 
@@ -59,6 +60,7 @@ class SortedRunMerger::BatchedRowSupplier {
     ++input_row_batch_index_;
     if (input_row_batch_index_ < input_row_batch_->num_rows()) {
       *done = false;
+      UpdateNormalizedPrefix();
     } else {
       ScopedTimer<MonotonicStopWatch> timer(parent_->get_next_batch_timer_);
       if (transfer_batch != NULL) {
@@ -69,6 +71,7 @@ class SortedRunMerger::BatchedRowSupplier {
       DCHECK(input_row_batch_ == NULL || input_row_batch_->num_rows() > 0);
       *done = input_row_batch_ == NULL;
       input_row_batch_index_ = 0;
+      if (!*done) UpdateNormalizedPrefix();
     }
     return Status::OK;
   }
@@ -77,6 +80,11 @@ class SortedRunMerger::BatchedRowSupplier {
     return input_row_batch_->GetRow(input_row_batch_index_);
   }
 
+  // Returns true if all rows of the run have been returned.
+  bool exhausted() const { return input_row_batch_ == NULL; }
+
+  uint64_t normalized_prefix() const { return normalized_prefix_; }
+
  private:
   friend class SortedRunMerger;
 
@@ -89,36 +97,57 @@ class SortedRunMerger::BatchedRowSupplier {
   // Index into input_row_batch_ of the current row being processed.
   int input_row_batch_index_;
 
+  // Normalized key prefix of the current row. Only valid if the parent merger uses
+  // normalized prefixes.
+  uint64_t normalized_prefix_;
+
   // The parent merger instance.
   SortedRunMerger* parent_;
+
+  void UpdateNormalizedPrefix() {
+    if (!parent_->use_normalized_prefix_) return;
+    normalized_prefix_ = parent_->compare_less_than_.GetNormalizedPrefix(current_row());
+  }
 };
 
-void SortedRunMerger::Heapify(int parent_index) {
-  int left_index = 2 * parent_index + 1;
-  int right_index = left_index + 1;
-  if (left_index >= min_heap_.size()) return;
-  int least_child;
-  // Find the least child of parent.
-  if (right_index >= min_heap_.size() ||
-      compare_less_than_(min_heap_[left_index]->current_row(),
-          min_heap_[right_index]->current_row())) {
-    least_child = left_index;
-  } else {
-    least_child = right_index;
+bool SortedRunMerger::RunLessThan(int lhs, int rhs) const {
+  const BatchedRowSupplier* lhs_run = runs_[lhs];
+  const BatchedRowSupplier* rhs_run = runs_[rhs];
+  if (lhs_run->exhausted()) return false;
+  if (rhs_run->exhausted()) return true;
+  if (use_normalized_prefix_ &&
+      lhs_run->normalized_prefix() != rhs_run->normalized_prefix()) {
+    return lhs_run->normalized_prefix() < rhs_run->normalized_prefix();
+  }
+  return compare_less_than_(lhs_run->current_row(), rhs_run->current_row());
+}
+
+int SortedRunMerger::BuildLoserTree(int node) {
+  int num_runs = runs_.size();
+  if (node >= num_runs) return node - num_runs;
+  int left_winner = BuildLoserTree(2 * node);
+  int right_winner = BuildLoserTree(2 * node + 1);
+  if (RunLessThan(right_winner, left_winner)) {
+    loser_tree_[node] = left_winner;
+    return right_winner;
   }
+  loser_tree_[node] = right_winner;
+  return left_winner;
+}
 
-  // If the parent is out of place, swap it with the least child and invoke
-  // Heapify recursively.
-  if (compare_less_than_(min_heap_[least_child]->current_row(),
-      min_heap_[parent_index]->current_row())) {
-    iter_swap(min_heap_.begin() + least_child, min_heap_.begin() + parent_index);
-    Heapify(least_child);
+void SortedRunMerger::ReplayLoserTree() {
+  int winner = loser_tree_[0];
+  for (int node = (winner + runs_.size()) / 2; node > 0; node /= 2) {
+    if (RunLessThan(loser_tree_[node], winner)) swap(loser_tree_[node], winner);
   }
+  loser_tree_[0] = winner;
 }
 
 SortedRunMerger::SortedRunMerger(const TupleRowComparator& compare_less_than,
     RowDescriptor* row_desc, RuntimeProfile* profile, bool deep_copy_input)
-  : compare_less_than_(compare_less_than),
+  : num_active_runs_(0),
+    compare_less_than_(compare_less_than),
+    use_normalized_prefix_(compare_less_than.HasNormalizedPrefix()),
     input_row_desc_(row_desc),
     deep_copy_input_(deep_copy_input) {
   get_next_timer_ = ADD_TIMER(profile, "MergeGetNext");
@@ -126,33 +155,33 @@ SortedRunMerger::SortedRunMerger(const TupleRowComparator& compare_less_than,
 }
 
 Status SortedRunMerger::Prepare(const vector<RunBatchSupplier>& input_runs) {
-  DCHECK_EQ(min_heap_.size(), 0);
-  min_heap_.reserve(input_runs.size());
+  DCHECK_EQ(runs_.size(), 0);
+  runs_.reserve(input_runs.size());
   BOOST_FOREACH(const RunBatchSupplier& input_run, input_runs) {
     BatchedRowSupplier* new_elem = pool_.Add(new BatchedRowSupplier(this, input_run));
-    bool empty;
+    bool empty = false;
     RETURN_IF_ERROR(new_elem->Init(&empty));
-    if (!empty) min_heap_.push_back(new_elem);
+    if (!empty) runs_.push_back(new_elem);
   }
+  num_active_runs_ = runs_.size();
 
-  // Construct the min heap from the sorted runs.
-  int last_parent = (min_heap_.size() / 2) - 1;
-  for (int i = last_parent; i >= 0; --i) {
-    Heapify(i);
-  }
+  // Construct the loser tree from the sorted runs.
+  if (runs_.empty()) return Status::OK;
+  loser_tree_.resize(runs_.size());
+  loser_tree_[0] = BuildLoserTree(1);
 
   return Status::OK;
 }
 
 Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
   ScopedTimer<MonotonicStopWatch> timer(get_next_timer_);
-  if (min_heap_.empty()) {
+  if (num_active_runs_ == 0) {
     *eos = true;
     return Status::OK;
   }
 
   while (!output_batch->AtCapacity()) {
-    BatchedRowSupplier* min = min_heap_[0];
+    BatchedRowSupplier* min = runs_[loser_tree_[0]];
     int output_row_index = output_batch->AddRow();
     TupleRow* output_row = output_batch->GetRow(output_row_index);
     if (deep_copy_input_) {
@@ -171,17 +200,12 @@ Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
     // resource ownership if the input batch in min is exhausted.
     RETURN_IF_ERROR(min->Next(deep_copy_input_ ? NULL : output_batch,
         &min_run_complete));
-    if (min_run_complete) {
-      // Remove the element from the heap.
-      iter_swap(min_heap_.begin(), min_heap_.end() - 1);
-      min_heap_.pop_back();
-      if (min_heap_.empty()) break;
-    }
-
-    Heapify(0);
+    // An exhausted run stays in the tree, where it loses all matches.
+    if (min_run_complete && --num_active_runs_ == 0) break;
+    ReplayLoserTree();
   }
 
-  *eos = min_heap_.empty();
+  *eos = num_active_runs_ == 0;
   return Status::OK;
 }
 
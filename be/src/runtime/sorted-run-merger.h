@@ -30,8 +30,11 @@ class RuntimeProfile;
 
 // SortedRunMerger is used to merge multiple sorted runs of tuples. A run is a sorted
 // sequence of row batches, which are fetched from a RunBatchSupplier function object.
-// Merging is implemented using a binary min-heap that maintains the run with the next
-// tuple in sorted order at the top of the heap.
+// Merging is implemented using a loser tree (tournament tree) over the runs, which
+// finds the run with the next tuple in sorted order with one comparison per tree level,
+// where a binary heap needs two. If the comparator supports normalized key prefixes,
+// the prefix of each run's current row is cached, so most comparisons are integer
+// comparisons and the key exprs are evaluated about once per row.
 //
 // Merged batches of rows are retrieved from SortedRunMerger via calls to GetNext().
 // The merger is constructed with a boolean flag deep_copy_input.
@@ -50,8 +53,7 @@ class SortedRunMerger {
       RuntimeProfile* profile, bool deep_copy_input);
 
   // Prepare this merger to merge and return rows from the sorted runs in 'input_runs'
-  // Retrieves the first batch from each run and sets up the binary heap implementing
-  // the priority queue.
+  // Retrieves the first batch from each run and sets up the loser tree.
   Status Prepare(const std::vector<RunBatchSupplier>& input_runs);
 
   // Return the next batch of sorted rows from this merger.
@@ -64,22 +66,39 @@ class SortedRunMerger {
  private:
   class BatchedRowSupplier;
 
-  // Assuming the element at parent_index is the only out of place element in the heap,
-  // restore the heap property (i.e. swap elements so parent <= children).
-  void Heapify(int parent_index);
+  // Returns true if the current row of run 'lhs' is less than the current row of run
+  // 'rhs'. Exhausted runs are greater than all other runs.
+  bool RunLessThan(int lhs, int rhs) const;
 
-  // The binary min-heap used to merge rows from the sorted input runs. Since the heap is
-  // stored in a 0-indexed array, the 0-th element is the minimum element in the heap,
-  // and the children of the element at index i are 2*i+1 and 2*i+2. The heap property is
-  // that row of the parent element is <= the rows of the child elements according to the
-  // comparator compare_less_than_.
-  // The BatchedRowSupplier objects used in the min_heap_ are owned by this
-  // SortedRunMerger instance.
-  std::vector<BatchedRowSupplier*> min_heap_;
+  // Builds the subtree of the loser tree rooted at 'node'. Returns the index of the run
+  // that wins the subtree.
+  int BuildLoserTree(int node);
+
+  // Restores the loser tree after the current row of the winning run changed, by
+  // replaying its matches on the path from its leaf to the root.
+  void ReplayLoserTree();
+
+  // The sorted input runs that have rows. The BatchedRowSupplier objects are owned by
+  // this SortedRunMerger instance.
+  std::vector<BatchedRowSupplier*> runs_;
+
+  // The loser tree used to merge rows from the sorted input runs. With k runs, the tree
+  // has the runs as leaves k..2k-1 and internal nodes 1..k-1, where the children of
+  // node i are 2*i and 2*i+1. Each internal node stores the index of the run that lost
+  // the match at that node, and element 0 stores the index of the overall winner, i.e.
+  // the run with the next row in sorted order.
+  std::vector<int> loser_tree_;
+
+  // Number of runs in runs_ that are not exhausted.
+  int num_active_runs_;
 
   // Row comparator. Returns true if lhs < rhs.
   TupleRowComparator compare_less_than_;
 
+  // True if compare_less_than_ supports normalized key prefixes, which are then cached
+  // for the current row of each run.
+  bool use_normalized_prefix_;
+
   // Descriptor for the rows provided by the input runs. Owned by the exec-node through
   // which this merger was created.
   RowDescriptor* input_row_desc_;
@@ -24,6 +24,7 @@
 #include "statestore/simple-scheduler.h"
 #include "runtime/exec-env.h"
 #include "runtime/mem-tracker.h"
+#include "util/container-util.h"
 #include "util/debug-util.h"
 #include "util/time.h"
 #include "util/runtime-profile.h"
@@ -34,6 +35,22 @@ using namespace strings;
 
 DEFINE_int64(queue_wait_timeout_ms, 60 * 1000, "Maximum amount of time (in "
     "milliseconds) that a request will wait to be admitted before timing out.");
+DEFINE_bool(admission_control_use_observed_mem, false, "If true, admission decisions "
+    "are based on the memory that running queries consume on each backend, plus "
+    "reservations for newly admitted queries, instead of the planner's memory "
+    "estimates. Must be the same for all impalads.");
+DEFINE_int64(admission_query_mem_reservation_bytes, 512L * 1024L * 1024L, "With "
+    "--admission_control_use_observed_mem, the memory reserved on each host for a newly "
+    "admitted query without a MEM_LIMIT query option.");
+DEFINE_int64(admission_mem_reservation_ms, 5000, "With "
+    "--admission_control_use_observed_mem, the time (in milliseconds) after which the "
+    "memory consumption of a newly admitted query is assumed to be visible in the pool "
+    "statistics, which releases its reservation.");
+DEFINE_string(admission_queue_policy, "fifo", "Order in which queued requests are "
+    "admitted: 'fifo' or 'sjf' (smallest planner memory estimate first).");
+DEFINE_int64(admission_sjf_max_wait_ms, 30 * 1000, "With --admission_queue_policy=sjf, "
+    "requests that have been queued for longer than this (in milliseconds) are admitted "
+    "first, in FIFO order.");
 
 namespace impala {
 
@@ -112,6 +129,14 @@ const string QUEUED_NUM_RUNNING = "number of running queries $0 is over limit $1
 // $0 = query estimate, $1 = current pool memory estimate, $2 = pool memory limit
 const string QUEUED_MEM_LIMIT = "query memory estimate $0 plus current pool "
     "memory estimate $1 is over pool memory limit $2";
+// $0 = query reservation, $1 = current pool consumption and reservations,
+// $2 = pool memory limit
+const string QUEUED_OBSERVED_MEM_LIMIT = "query memory reservation $0 plus current pool "
+    "memory consumption and reservations $1 is over pool memory limit $2";
+// $0 = backend, $1 = current backend consumption and reservations,
+// $2 = query reservation per host, $3 = process memory limit
+const string QUEUED_BACKEND_MEM_LIMIT = "memory consumption and reservations $1 of "
+    "backend $0 plus query memory reservation $2 is over process memory limit $3";
 // $0 = queue size
 const string QUEUED_QUEUE_NOT_EMPTY = "queue is not empty (size $0); queued queries are "
     "executed first";
@@ -179,6 +204,8 @@ AdmissionController::AdmissionController(RequestPoolService* request_pool_servic
       metrics_(metrics),
       backend_id_(backend_id),
       thrift_serializer_(false),
+      local_per_host_reservations_(0),
+      remote_reservations_(0),
       done_(false) {
   dequeue_thread_.reset(new Thread("scheduling", "admission-thread",
         &AdmissionController::DequeueLoop, this));
@@ -208,15 +235,144 @@ Status AdmissionController::Init(StatestoreSubscriber* subscriber) {
   return status;
 }
 
+int64_t AdmissionController::GetPerHostAdmissionMem(int64_t per_host_mem_estimate,
+    int64_t query_mem_limit) {
+  if (!FLAGS_admission_control_use_observed_mem) return per_host_mem_estimate;
+  if (query_mem_limit > 0) return query_mem_limit;
+  return FLAGS_admission_query_mem_reservation_bytes;
+}
+
+int64_t AdmissionController::GetPoolMem(const TPoolStats& stats) {
+  // With observed memory, mem_estimate is the memory reserved for queries whose
+  // consumption is not yet included in mem_usage.
+  if (FLAGS_admission_control_use_observed_mem) {
+    return stats.mem_usage + stats.mem_estimate;
+  }
+  return max(stats.mem_usage, stats.mem_estimate);
+}
+
+double AdmissionController::GetPoolShare(const TPoolStats& stats, int64_t max_requests,
+    int64_t mem_limit) {
+  double share = 0;
+  if (max_requests > 0) {
+    share = max(share, static_cast<double>(stats.num_running) / max_requests);
+  }
+  if (mem_limit > 0) {
+    share = max(share, static_cast<double>(GetPoolMem(stats)) / mem_limit);
+  }
+  return share;
+}
+
+int64_t AdmissionController::GetAdmissionMem(const QuerySchedule& schedule) {
+  return GetPerHostAdmissionMem(schedule.GetPerHostMemoryEstimate(),
+      schedule.query_options().mem_limit) * schedule.num_hosts();
+}
+
+void AdmissionController::AddAdmittedRequest(const string& pool_name,
+    const QuerySchedule& schedule) {
+  TPoolStats* total_stats = &cluster_pool_stats_[pool_name];
+  TPoolStats* local_stats = &local_pool_stats_[pool_name];
+  ++total_stats->num_running;
+  ++local_stats->num_running;
+  int64_t mem_estimate = GetAdmissionMem(schedule);
+  local_stats->mem_estimate += mem_estimate;
+  total_stats->mem_estimate += mem_estimate;
+  PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
+  if (pool_metrics != NULL) {
+    pool_metrics->local_mem_estimate->Increment(mem_estimate);
+    pool_metrics->cluster_mem_estimate->Increment(mem_estimate);
+  }
+  if (FLAGS_admission_control_use_observed_mem) {
+    MemReservation* reservation = &mem_reservations_[schedule.query_id()];
+    reservation->pool_name = pool_name;
+    reservation->bytes = mem_estimate;
+    reservation->per_host_bytes = mem_estimate / schedule.num_hosts();
+    reservation->expiration_ms = MonotonicMillis() + FLAGS_admission_mem_reservation_ms;
+    local_per_host_reservations_ += reservation->per_host_bytes;
+  }
+}
+
+int64_t AdmissionController::ReleaseMemReservation(const TUniqueId& query_id) {
+  MemReservationMap::iterator it = mem_reservations_.find(query_id);
+  if (it == mem_reservations_.end()) return 0;
+  const MemReservation& reservation = it->second;
+  const int64_t bytes = reservation.bytes;
+  local_per_host_reservations_ -= reservation.per_host_bytes;
+  DCHECK_GE(local_per_host_reservations_, 0);
+  mem_reservations_.erase(it);
+  return bytes;
+}
+
+void AdmissionController::ExpireMemReservations() {
+  const int64_t now = MonotonicMillis();
+  MemReservationMap::iterator it = mem_reservations_.begin();
+  while (it != mem_reservations_.end()) {
+    if (it->second.expiration_ms > now) {
+      ++it;
+      continue;
+    }
+    const string pool_name = it->second.pool_name;
+    const TUniqueId query_id = (it++)->first;
+    const int64_t bytes = ReleaseMemReservation(query_id);
+    local_pool_stats_[pool_name].mem_estimate -= bytes;
+    cluster_pool_stats_[pool_name].mem_estimate -= bytes;
+    PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
+    if (pool_metrics != NULL) {
+      pool_metrics->local_mem_estimate->Increment(-1 * bytes);
+      pool_metrics->cluster_mem_estimate->Increment(-1 * bytes);
+    }
+    pools_for_updates_.insert(pool_name);
+  }
+}
+
+void AdmissionController::UpdateBackendMemUsage() {
+  backend_mem_usage_.clear();
+  remote_reservations_ = 0;
+  BOOST_FOREACH(const PerBackendPoolStatsMap::value_type& pool,
+      per_backend_pool_stats_map_) {
+    BOOST_FOREACH(const PoolStatsMap::value_type& entry, pool.second) {
+      if (entry.first == backend_id_) continue;
+      backend_mem_usage_[entry.first] += entry.second.mem_usage;
+      remote_reservations_ += entry.second.mem_estimate;
+    }
+  }
+  int64_t* local_usage = &backend_mem_usage_[backend_id_];
+  BOOST_FOREACH(const PoolStatsMap::value_type& entry, local_pool_stats_) {
+    *local_usage += entry.second.mem_usage;
+  }
+}
+
+Status AdmissionController::CanAdmitOnBackends(const QuerySchedule& schedule) {
+  ExecEnv* exec_env = ExecEnv::GetInstance();
+  MemTracker* process_mem_tracker =
+      exec_env == NULL ? NULL : exec_env->process_mem_tracker();
+  if (process_mem_tracker == NULL || !process_mem_tracker->has_limit()) return Status::OK;
+  const int64_t backend_mem_limit = process_mem_tracker->limit();
+  const int64_t query_per_host_mem = GetAdmissionMem(schedule) / schedule.num_hosts();
+  // The reservations of remote coordinators are assumed to be spread evenly over the
+  // backends.
+  const int64_t reserved_per_backend = local_per_host_reservations_ +
+      remote_reservations_ / max<int64_t>(backend_mem_usage_.size(), 1L);
+  BOOST_FOREACH(const BackendMemMap::value_type& backend, backend_mem_usage_) {
+    const int64_t backend_mem = backend.second + reserved_per_backend;
+    if (backend_mem + query_per_host_mem >= backend_mem_limit) {
+      return Status::Expected(Substitute(QUEUED_BACKEND_MEM_LIMIT, backend.first,
+          PrettyPrinter::Print(backend_mem, TUnit::BYTES),
+          PrettyPrinter::Print(query_per_host_mem, TUnit::BYTES),
+          PrettyPrinter::Print(backend_mem_limit, TUnit::BYTES)));
+    }
+  }
+  return Status::OK;
+}
+
 Status AdmissionController::CanAdmitRequest(const string& pool_name,
     const int64_t max_requests, const int64_t mem_limit, const QuerySchedule& schedule,
     bool admit_from_queue) {
   const TPoolStats& total_stats = cluster_pool_stats_[pool_name];
   DCHECK_GE(total_stats.mem_usage, 0);
   DCHECK_GE(total_stats.mem_estimate, 0);
-  const int64_t query_total_estimated_mem = schedule.GetClusterMemoryEstimate();
-  const int64_t current_cluster_estimate_mem =
-      max(total_stats.mem_usage, total_stats.mem_estimate);
+  const int64_t query_total_estimated_mem = GetAdmissionMem(schedule);
+  const int64_t current_cluster_estimate_mem = GetPoolMem(total_stats);
   // The estimated total memory footprint for the query cluster-wise after admitting
   const int64_t cluster_estimated_memory = query_total_estimated_mem +
       current_cluster_estimate_mem;
@@ -230,12 +386,15 @@ Status AdmissionController::CanAdmitRequest(const string& pool_name,
     return Status::Expected(Substitute(QUEUED_NUM_RUNNING, total_stats.num_running,
         max_requests));
   } else if (mem_limit >= 0 && cluster_estimated_memory >= mem_limit) {
-    return Status::Expected(Substitute(QUEUED_MEM_LIMIT,
+    return Status::Expected(Substitute(FLAGS_admission_control_use_observed_mem ?
+        QUEUED_OBSERVED_MEM_LIMIT : QUEUED_MEM_LIMIT,
         PrettyPrinter::Print(query_total_estimated_mem, TUnit::BYTES),
         PrettyPrinter::Print(current_cluster_estimate_mem, TUnit::BYTES),
         PrettyPrinter::Print(mem_limit, TUnit::BYTES)));
   } else if (!admit_from_queue && total_stats.num_queued > 0) {
     return Status::Expected(Substitute(QUEUED_QUEUE_NOT_EMPTY, total_stats.num_queued));
+  } else if (FLAGS_admission_control_use_observed_mem) {
+    return CanAdmitOnBackends(schedule);
   }
   return Status::OK;
 }
@@ -244,7 +403,7 @@ Status AdmissionController::RejectRequest(const string& pool_name,
     const int64_t max_requests, const int64_t mem_limit, const int64_t max_queued,
     const QuerySchedule& schedule) {
   TPoolStats* total_stats = &cluster_pool_stats_[pool_name];
-  const int64_t expected_mem_usage = schedule.GetClusterMemoryEstimate();
+  const int64_t expected_mem_usage = GetAdmissionMem(schedule);
   string reject_reason;
   if (max_requests == 0) {
     reject_reason = REASON_DISABLED_REQUESTS_LIMIT;
@@ -302,16 +461,8 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
       schedule->set_is_admitted(true);
       schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_ADMISSION_RESULT,
           PROFILE_INFO_VAL_ADMIT_IMMEDIATELY);
-      ++total_stats->num_running;
-      ++local_stats->num_running;
-      int64_t mem_estimate = schedule->GetClusterMemoryEstimate();
-      local_stats->mem_estimate += mem_estimate;
-      total_stats->mem_estimate += mem_estimate;
-      if (pool_metrics != NULL) {
-        pool_metrics->local_admitted->Increment(1L);
-        pool_metrics->local_mem_estimate->Increment(mem_estimate);
-        pool_metrics->cluster_mem_estimate->Increment(mem_estimate);
-      }
+      AddAdmittedRequest(pool_name, *schedule);
+      if (pool_metrics != NULL) pool_metrics->local_admitted->Increment(1L);
       VLOG_QUERY << "Admitted query id=" << schedule->query_id();
       VLOG_RPC << "Final: " << DebugPoolStats(pool_name, total_stats, local_stats);
       return Status::OK;
@@ -334,6 +485,7 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
     pools_for_updates_.insert(pool_name);
     ++local_stats->num_queued;
     ++total_stats->num_queued;
+    queue_node.enqueue_time_ms = MonotonicMillis();
     queue->Enqueue(&queue_node);
     if (pool_metrics != NULL) pool_metrics->local_queued->Increment(1L);
   }
@@ -404,7 +556,10 @@ Status AdmissionController::ReleaseQuery(QuerySchedule* schedule) {
     --total_stats->num_running;
     --local_stats->num_running;
 
-    int64_t mem_estimate = schedule->GetClusterMemoryEstimate();
+    // With observed memory, the query's memory is only accounted for in mem_estimate
+    // until its reservation expires.
+    int64_t mem_estimate = FLAGS_admission_control_use_observed_mem ?
+        ReleaseMemReservation(schedule->query_id()) : GetAdmissionMem(*schedule);
     local_stats->mem_estimate -= mem_estimate;
     total_stats->mem_estimate -= mem_estimate;
     PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
@@ -433,6 +588,7 @@ void AdmissionController::UpdatePoolStats(
     BOOST_FOREACH(PoolStatsMap::value_type& entry, local_pool_stats_) {
       UpdateLocalMemUsage(entry.first);
     }
+    if (FLAGS_admission_control_use_observed_mem) ExpireMemReservations();
     AddPoolUpdates(subscriber_topic_updates);
 
     StatestoreSubscriber::TopicDeltaMap::const_iterator topic =
@@ -452,6 +608,7 @@ void AdmissionController::UpdatePoolStats(
     BOOST_FOREACH(PoolStatsMap::value_type& entry, local_pool_stats_) {
       UpdateClusterAggregates(entry.first);
     }
+    if (FLAGS_admission_control_use_observed_mem) UpdateBackendMemUsage();
   }
   dequeue_cv_.notify_one(); // Dequeue and admit queries on the dequeue thread
 }
@@ -597,13 +754,23 @@ void AdmissionController::DequeueLoop() {
     unique_lock<mutex> lock(admission_ctrl_lock_);
     if (done_) break;
     dequeue_cv_.wait(lock);
+    // Visit the pools in increasing order of the share of their limits they use, so that
+    // pools that use less of their share are admitted first when they compete for the
+    // memory of the backends.
+    vector<pair<double, string> > pools;
     BOOST_FOREACH(PoolStatsMap::value_type& entry, local_pool_stats_) {
-      const string& pool_name = entry.first;
-      TPoolStats* local_stats = &entry.second;
-
-      PoolConfigMap::iterator it = pool_config_cache_.find(pool_name);
+      if (entry.second.num_queued == 0) continue;
+      PoolConfigMap::iterator it = pool_config_cache_.find(entry.first);
       if (it == pool_config_cache_.end()) continue; // No local requests in this pool
-      const TPoolConfigResult& pool_config = it->second;
+      pools.push_back(make_pair(GetPoolShare(cluster_pool_stats_[entry.first],
+          it->second.max_requests, it->second.mem_limit), entry.first));
+    }
+    sort(pools.begin(), pools.end());
+    const int64_t now_ms = MonotonicMillis();
+    for (int i = 0; i < pools.size(); ++i) {
+      const string& pool_name = pools[i].second;
+      TPoolStats* local_stats = &local_pool_stats_[pool_name];
+      const TPoolConfigResult& pool_config = pool_config_cache_[pool_name];
 
       const int64_t max_requests = pool_config.max_requests;
       const int64_t mem_limit = pool_config.mem_limit;
@@ -649,7 +816,7 @@ void AdmissionController::DequeueLoop() {
 
       PoolMetrics* pool_metrics = GetPoolMetrics(pool_name);
       while (max_to_dequeue > 0 && !queue.empty()) {
-        QueueNode* queue_node = queue.head();
+        QueueNode* queue_node = GetNextQueued(&queue, now_ms);
         DCHECK(queue_node != NULL);
         DCHECK(!queue_node->is_admitted.IsSet());
         const QuerySchedule& schedule = queue_node->schedule;
@@ -660,19 +827,11 @@ void AdmissionController::DequeueLoop() {
                    << " reason: " << admitStatus.GetDetail();
           break;
         }
-        queue.Dequeue();
+        queue.Remove(queue_node);
         --local_stats->num_queued;
         --total_stats->num_queued;
-        ++local_stats->num_running;
-        ++total_stats->num_running;
-        int64_t mem_estimate = schedule.GetClusterMemoryEstimate();
-        local_stats->mem_estimate += mem_estimate;
-        total_stats->mem_estimate += mem_estimate;
-        if (pool_metrics != NULL) {
-          pool_metrics->local_dequeued->Increment(1L);
-          pool_metrics->local_mem_estimate->Increment(mem_estimate);
-          pool_metrics->cluster_mem_estimate->Increment(mem_estimate);
-        }
+        AddAdmittedRequest(pool_name, schedule);
+        if (pool_metrics != NULL) pool_metrics->local_dequeued->Increment(1L);
         VLOG_ROW << "Dequeuing query id=" << queue_node->schedule.query_id();
         queue_node->is_admitted.Set(true);
         --max_to_dequeue;
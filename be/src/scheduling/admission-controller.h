@@ -24,6 +24,7 @@
 #include <boost/unordered_set.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/logging.h"
 #include "common/status.h"
 #include "scheduling/request-pool-service.h"
 #include "statestore/statestore-subscriber.h"
@@ -31,6 +32,9 @@
 #include "util/internal-queue.h"
 #include "util/thread.h"
 
+DECLARE_string(admission_queue_policy);
+DECLARE_int64(admission_sjf_max_wait_ms);
+
 namespace impala {
 
 class QuerySchedule;
@@ -76,8 +80,31 @@ class ExecEnv;
 // When requests are submitted very quickly and the memory estimates from planning are
 // significantly off this strategy can still result in over or under subscription, but
 // this is not completely unavoidable unless we can produce better estimates.
-// TODO: We can reduce the effect of very high estimates by using a weighted
-//       combination of the estimate and the actual consumption as a function of time.
+//
+// Because the estimates can be off by an order of magnitude in either direction,
+// admission can instead be based on the memory that queries actually consume
+// (--admission_control_use_observed_mem). Each impalad already publishes the current
+// consumption of each pool on its backend in the topic. A newly admitted query has not
+// consumed memory yet, so its coordinator holds a reservation of the query's MEM_LIMIT
+// option (or --admission_query_mem_reservation_bytes if not set) on each of its hosts for
+// --admission_mem_reservation_ms, after which its consumption is visible in the
+// published stats. In this mode TPoolStats.mem_estimate carries the live reservations
+// rather than the planner estimates, so all impalads must use the same mode. A request
+// is admitted if the pool's consumption plus reservations stays below the pool's memory
+// limit and, if the process memory limit is set, if the consumption plus reservations of
+// each backend stays below it. The latter assumes the impalads of a
+// cluster use the same process memory limit. The consumption of a backend is exact, but
+// the reservations of remote coordinators are only known per pool, so they are assumed
+// to be spread evenly over all backends.
+//
+// Queued requests are admitted in FIFO order by default. With
+// --admission_queue_policy=sjf the queued request with the smallest planner memory
+// estimate is admitted first, as the estimate is the best available proxy for the
+// amount of work of a query; requests that have been queued for longer than
+// --admission_sjf_max_wait_ms are admitted first, in FIFO order, so that large requests
+// are not starved. When requests of several pools are queued, the pools are visited in
+// increasing order of the share of their limits that they use, so that pools get a fair
+// share of the cluster's memory.
 class AdmissionController {
  public:
   AdmissionController(RequestPoolService* request_pool_service, MetricGroup* metrics,
@@ -101,13 +128,41 @@ class AdmissionController {
   // Registers with the subscription manager.
   Status Init(StatestoreSubscriber* subscriber);
 
+  // The admission policy, exposed to be shared with the admission simulator
+  // (benchmarks/admission-simulator.cc).
+
+  // Returns the per-host memory that a request with the per-host planner estimate
+  // 'per_host_mem_estimate' and the MEM_LIMIT query option 'query_mem_limit' is
+  // accounted for at admission.
+  static int64_t GetPerHostAdmissionMem(int64_t per_host_mem_estimate,
+      int64_t query_mem_limit);
+
+  // Returns the memory of a pool with 'stats' that is compared against the pool's
+  // memory limit.
+  static int64_t GetPoolMem(const TPoolStats& stats);
+
+  // Returns the share of its limits that a pool with 'stats' uses, i.e. the larger of
+  // the fractions of its request and memory limits.
+  static double GetPoolShare(const TPoolStats& stats, int64_t max_requests,
+      int64_t mem_limit);
+
+  // Returns the request in 'queue' to admit next according to --admission_queue_policy.
+  // 'now_ms' is the current time as returned by MonotonicMillis(). Node must have
+  // members 'mem_estimate' and 'enqueue_time_ms'. 'queue' must not be empty.
+  template <typename Node>
+  static Node* GetNextQueued(InternalQueue<Node>* queue, int64_t now_ms);
+
  private:
   static const std::string IMPALA_REQUEST_QUEUE_TOPIC;
 
   // Structure stored in a QueryQueue representing a request. This struct lives only
   // during the call to AdmitQuery().
   struct QueueNode : public InternalQueue<QueueNode>::Node {
-    QueueNode(const QuerySchedule& query_schedule) : schedule(query_schedule) { }
+    QueueNode(const QuerySchedule& query_schedule)
+      : schedule(query_schedule),
+        mem_estimate(query_schedule.GetClusterMemoryEstimate()),
+        enqueue_time_ms(0) {
+    }
 
     // Set when the request is admitted or rejected by the dequeuing thread. Used
     // by AdmitQuery() to wait for admission or until the timeout is reached.
@@ -120,6 +175,28 @@ class AdmissionController {
     // duration of the the QueueNode, which only lives the duration of the call to
     // AdmitQuery.
     const QuerySchedule& schedule;
+
+    // The planner's cluster memory estimate of the request, which orders the queue with
+    // --admission_queue_policy=sjf.
+    int64_t mem_estimate;
+
+    // Time the request was queued, as returned by MonotonicMillis().
+    int64_t enqueue_time_ms;
+  };
+
+  // Memory reserved by a locally admitted query with --admission_control_use_observed_mem
+  // until its consumption is visible in the pool stats.
+  struct MemReservation {
+    std::string pool_name;
+
+    // Bytes reserved on all hosts.
+    int64_t bytes;
+
+    // Bytes reserved on each host.
+    int64_t per_host_bytes;
+
+    // Time at which the reservation expires, as returned by MonotonicMillis().
+    int64_t expiration_ms;
   };
 
   // Metrics exposed for a pool.
@@ -238,6 +315,26 @@ class AdmissionController {
   typedef boost::unordered_map<std::string, TPoolConfigResult> PoolConfigMap;
   PoolConfigMap pool_config_cache_;
 
+  // Reservations of the locally admitted queries, by query id. Only used with
+  // --admission_control_use_observed_mem.
+  typedef boost::unordered_map<TUniqueId, MemReservation> MemReservationMap;
+  MemReservationMap mem_reservations_;
+
+  // Bytes reserved on each host by mem_reservations_. Requests are assumed to run on all
+  // backends (see QuerySchedule::num_hosts()), so this is the same for all backends.
+  int64_t local_per_host_reservations_;
+
+  // Map from backend id (i.e. the backend part of a topic key) to bytes.
+  typedef boost::unordered_map<std::string, int64_t> BackendMemMap;
+
+  // Consumption of all pools on each backend, as published in the topic. Recomputed in
+  // UpdatePoolStats(). Only used with --admission_control_use_observed_mem.
+  BackendMemMap backend_mem_usage_;
+
+  // Sum of the reservations published by the other coordinators. Recomputed in
+  // UpdatePoolStats().
+  int64_t remote_reservations_;
+
   // Notifies the dequeuing thread that pool stats have changed and it may be
   // possible to dequeue and admit queries.
   boost::condition_variable dequeue_cv_;
@@ -276,6 +373,33 @@ class AdmissionController {
   // Dequeues and admits queued queries when notified by dequeue_cv_.
   void DequeueLoop();
 
+  // Returns the memory that admitting 'schedule' adds to the pool's memory, i.e. its
+  // cluster memory estimate or, with --admission_control_use_observed_mem, its
+  // reservation.
+  int64_t GetAdmissionMem(const QuerySchedule& schedule);
+
+  // Updates the stats and metrics of 'pool_name' for admitting 'schedule', and adds
+  // the request's reservation with --admission_control_use_observed_mem.
+  // Must hold admission_ctrl_lock_.
+  void AddAdmittedRequest(const std::string& pool_name, const QuerySchedule& schedule);
+
+  // Releases the reservation of 'query_id', if it still exists, and returns the number of
+  // bytes released. Must hold admission_ctrl_lock_.
+  int64_t ReleaseMemReservation(const TUniqueId& query_id);
+
+  // Releases the reservations that have expired and updates the pool stats accordingly.
+  // Must hold admission_ctrl_lock_.
+  void ExpireMemReservations();
+
+  // Recomputes backend_mem_usage_ and remote_reservations_ from the per-backend stats.
+  // Must hold admission_ctrl_lock_.
+  void UpdateBackendMemUsage();
+
+  // Returns OK if the consumption and reservations of each backend plus the reservation
+  // of 'schedule' stay below the process memory limit. Otherwise, the error message
+  // specifies the backend that is over the limit. Must hold admission_ctrl_lock_.
+  Status CanAdmitOnBackends(const QuerySchedule& schedule);
+
   // Returns OK if the request can be admitted, i.e. admitting would not go over the
   // limits for this pool. Otherwise, the error message specifies the reason the
   // request can not be admitted immediately.
@@ -293,6 +417,20 @@ class AdmissionController {
   PoolMetrics* GetPoolMetrics(const std::string& pool_name);
 };
 
+template <typename Node>
+Node* AdmissionController::GetNextQueued(InternalQueue<Node>* queue, int64_t now_ms) {
+  Node* head = queue->head();
+  DCHECK(head != NULL);
+  if (FLAGS_admission_queue_policy != "sjf") return head;
+  // Requests that have waited too long are admitted in FIFO order.
+  if (now_ms - head->enqueue_time_ms >= FLAGS_admission_sjf_max_wait_ms) return head;
+  Node* shortest = head;
+  for (Node* node = head->Next(); node != NULL; node = node->Next()) {
+    if (node->mem_estimate < shortest->mem_estimate) shortest = node;
+  }
+  return shortest;
+}
+
 }
 
 #endif // SCHEDULING_ADMISSION_CONTROLLER_H
@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "codegen/llvm-codegen.h"
+#include "exec/scan-node.h"
 #include "rpc/thrift-util.h"
 
 using namespace apache::thrift;
@@ -24,6 +25,23 @@ using namespace boost;
 using namespace impala;
 using namespace std;
 
+DECLARE_bool(status_report_delta);
+DECLARE_bool(status_report_summary_only);
+
+// Returns the names of the counters sent in periodic reports if
+// --status_report_summary_only is set: the scan node counters used to track progress
+// (see Coordinator::CollectScanNodeCounters()) and the counters of the exec summary
+// (see Coordinator::UpdateExecSummary()).
+static set<string> GetSummaryCounterNames() {
+  set<string> names;
+  names.insert(ScanNode::SCAN_RANGES_COMPLETE_COUNTER);
+  names.insert(ScanNode::TOTAL_THROUGHPUT_COUNTER);
+  names.insert("RowsReturned");
+  names.insert("PeakMemoryUsage");
+  names.insert(PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
+  return names;
+}
+
 Status FragmentMgr::FragmentExecState::UpdateStatus(const Status& status) {
   lock_guard<mutex> l(status_lock_);
   if (!status.ok() && exec_status_.ok()) exec_status_ = status;
@@ -77,6 +95,20 @@ void FragmentMgr::FragmentExecState::ReportStatusCb(
   params.__set_done(done);
   profile->ToThrift(&params.profile);
   params.__isset.profile = true;
+  // The coordinator's Update() of the instance profile keeps the values that are not
+  // part of a report, so periodic reports can leave out what it already has. The final
+  // report is always complete.
+  TRuntimeProfileTree reported_profile;
+  if (!done) {
+    if (FLAGS_status_report_summary_only) {
+      static const set<string> summary_counter_names = GetSummaryCounterNames();
+      RuntimeProfile::RetainCounters(summary_counter_names, &params.profile);
+    }
+    if (FLAGS_status_report_delta) {
+      reported_profile = params.profile;
+      RuntimeProfile::RemoveUnchanged(last_reported_profile_, &params.profile);
+    }
+  }
 
   RuntimeState* runtime_state = executor_.runtime_state();
   DCHECK(runtime_state != NULL);
@@ -127,5 +159,7 @@ void FragmentMgr::FragmentExecState::ReportStatusCb(
     // we need to cancel the execution of this fragment
     UpdateStatus(rpc_status);
     executor_.Cancel();
+    return;
   }
+  if (!done && FLAGS_status_report_delta) swap(last_reported_profile_, reported_profile);
 }
@@ -66,6 +66,11 @@ class FragmentMgr::FragmentExecState {
   // Set the execution thread, taking ownership of the object.
   void set_exec_thread(Thread* exec_thread) { exec_thread_.reset(exec_thread); }
 
+  // NUMA node that the fragment's threads run on, -1 if they are not pinned. Must be set
+  // after Prepare().
+  int numa_node() { return executor_.runtime_state()->numa_node(); }
+  void set_numa_node(int node) { executor_.runtime_state()->set_numa_node(node); }
+
  private:
   TPlanFragmentInstanceCtx fragment_instance_ctx_;
   PlanFragmentExecutor executor_;
@@ -82,6 +87,11 @@ class FragmentMgr::FragmentExecState {
   // if set to anything other than OK, execution has terminated w/ an error
   Status exec_status_;
 
+  // The profile as of the last report the coordinator received, before unchanged
+  // values were removed. Periodic reports only send the values that differ from it if
+  // --status_report_delta is set. Only accessed from ReportStatusCb().
+  TRuntimeProfileTree last_reported_profile_;
+
   // Callback for executor; updates exec_status_ if 'status' indicates an error
   // or if there was a thrift error.
   void ReportStatusCb(const Status& status, RuntimeProfile* profile, bool done);
@@ -20,6 +20,7 @@
 
 #include "service/fragment-exec-state.h"
 #include "runtime/exec-env.h"
+#include "util/cpu-info.h"
 #include "util/impalad-metrics.h"
 #include "util/uid-util.h"
 
@@ -31,6 +32,9 @@ using namespace strings;
 // TODO: this logging should go into a per query log.
 DEFINE_int32(log_mem_usage_interval, 0, "If non-zero, impalad will output memory usage "
     "every log_mem_usage_interval'th fragment completion.");
+DEFINE_bool(numa_aware_fragments, false, "If true and the machine has more than one "
+    "NUMA node, the threads of each plan fragment instance are pinned to a single NUMA "
+    "node, balancing the instances across the nodes.");
 
 Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params) {
   VLOG_QUERY << "ExecPlanFragment() instance_id="
@@ -55,6 +59,9 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
     // register exec_state before starting exec thread
     fragment_exec_state_map_.insert(
         make_pair(exec_params.fragment_instance_ctx.fragment_instance_id, exec_state));
+    if (FLAGS_numa_aware_fragments && CpuInfo::num_numa_nodes() > 1) {
+      exec_state->set_numa_node(AssignNumaNode());
+    }
   }
 
   // execute plan fragment in new thread
@@ -65,8 +72,25 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
   return Status::OK;
 }
 
+int FragmentMgr::AssignNumaNode() {
+  if (num_fragments_per_numa_node_.empty()) {
+    num_fragments_per_numa_node_.resize(CpuInfo::num_numa_nodes(), 0);
+  }
+  int node = 0;
+  for (int i = 1; i < num_fragments_per_numa_node_.size(); ++i) {
+    if (num_fragments_per_numa_node_[i] < num_fragments_per_numa_node_[node]) node = i;
+  }
+  ++num_fragments_per_numa_node_[node];
+  return node;
+}
+
 void FragmentMgr::FragmentExecThread(FragmentExecState* exec_state) {
   ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS->Increment(1L);
+  int numa_node = exec_state->numa_node();
+  if (numa_node != -1 && !CpuInfo::PinCurrentThreadToNumaNode(numa_node)) {
+    LOG(WARNING) << "Could not pin fragment instance "
+                 << exec_state->fragment_instance_id() << " to NUMA node " << numa_node;
+  }
   exec_state->Exec();
   // we're done with this plan fragment
 
@@ -82,6 +106,7 @@ void FragmentMgr::FragmentExecThread(FragmentExecState* exec_state) {
     if (i != fragment_exec_state_map_.end()) {
       exec_state_reference = i->second;
       fragment_exec_state_map_.erase(i);
+      if (numa_node != -1) --num_fragments_per_numa_node_[numa_node];
     } else {
       LOG(ERROR) << "missing entry in fragment exec state map: instance_id="
                  << exec_state->fragment_instance_id();
@@ -15,6 +15,7 @@
 #ifndef IMPALA_SERVICE_FRAGMENT_MGR_H
 #define IMPALA_SERVICE_FRAGMENT_MGR_H
 
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
@@ -32,6 +33,10 @@ namespace impala {
 // terminate either by cancellation via CancelPlanFragment(), or when FragmentExecThread()
 // returns.
 //
+// With --numa_aware_fragments, each fragment instance is assigned to the NUMA node that
+// runs the fewest instances. Its execution thread (and the threads that it starts) are
+// pinned to the cores of that node, so that the memory they allocate is local to them.
+//
 // TODO: Remove Thrift args from methods where it would improve readability;
 // ImpalaInternalService can take care of translation to / from Thrift, as it already does
 // for ExecPlanFragment()'s return value.
@@ -59,9 +64,17 @@ class FragmentMgr {
   // the fragment's execution thread.
   void FragmentExecThread(FragmentExecState* exec_state);
 
-  // protects fragment_exec_state_map_
+  // Returns the NUMA node with the fewest running fragment instances and adds one to
+  // its count. fragment_exec_state_map_lock_ must be taken.
+  int AssignNumaNode();
+
+  // protects fragment_exec_state_map_ and num_fragments_per_numa_node_
   boost::mutex fragment_exec_state_map_lock_;
 
+  // Number of running fragment instances that are assigned to each NUMA node. Only
+  // used with --numa_aware_fragments.
+  std::vector<int> num_fragments_per_numa_node_;
+
   // map from fragment id to exec state; FragmentExecState is owned by us and
   // referenced as a shared_ptr to allow asynchronous calls to CancelPlanFragment()
   typedef boost::unordered_map<TUniqueId, boost::shared_ptr<FragmentExecState> >
@@ -84,6 +84,7 @@ using namespace boost::posix_time;
 using namespace strings;
 
 DECLARE_int32(be_port);
+DECLARE_bool(be_service_nonblocking);
 DECLARE_string(nn);
 DECLARE_int32(nn_port);
 DECLARE_string(authorized_proxy_user_config);
@@ -96,6 +97,11 @@ DEFINE_int32(fe_service_threads, 64,
     "number of threads available to serve client requests");
 DEFINE_int32(be_service_threads, 64,
     "(Advanced) number of threads available to serve backend execution requests");
+DEFINE_int32(be_service_max_blocked_senders, 128, "(Advanced) With "
+    "--be_service_nonblocking, the number of TransmitData() rpcs that may be blocked on "
+    "full streams of this impalad at once. Further rpcs to full streams add their batch "
+    "beyond the stream's buffer limit instead of blocking. The backend server fails to "
+    "start unless --be_service_threads is larger.");
 DEFINE_string(default_query_options, "", "key=value pair of default query options for"
     " impalad, separated by ','");
 DEFINE_int32(query_log_size, 25, "Number of queries to retain in the query log. If -1, "
@@ -1714,8 +1720,16 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
         new RpcEventHandler("backend", exec_env->metrics()));
     be_processor->setEventHandler(event_handler);
 
+    ThriftServer::ServerType be_server_type = FLAGS_be_service_nonblocking ?
+        ThriftServer::Nonblocking : ThriftServer::Threaded;
     *be_server = new ThriftServer("backend", be_processor, be_port, NULL,
-        exec_env->metrics(), FLAGS_be_service_threads);
+        exec_env->metrics(), FLAGS_be_service_threads, be_server_type);
+    (*be_server)->SetMaxBlockingRpcs(FLAGS_be_service_max_blocked_senders);
+    // Every connection of the other server types has its own thread, so their rpcs may
+    // block without bound.
+    if (FLAGS_be_service_nonblocking) {
+      exec_env->stream_mgr()->SetMaxBlockedSenders(FLAGS_be_service_max_blocked_senders);
+    }
 
     LOG(INFO) << "ImpalaInternalService listening on " << be_port;
   }
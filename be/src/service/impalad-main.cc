@@ -25,6 +25,7 @@
 #include "exec/hbase-table-writer.h"
 #include "runtime/hbase-table-factory.h"
 #include "codegen/llvm-codegen.h"
+#include "dfs_cache/dfs-cache.h"
 #include "common/status.h"
 #include "runtime/coordinator.h"
 #include "runtime/exec-env.h"
@@ -48,6 +49,9 @@ DECLARE_bool(use_statestore);
 
 DECLARE_string(cache_location);
 DECLARE_int32(cache_mem_percent_of_available);
+DECLARE_bool(cache_write_behind);
+DECLARE_int32(cache_upload_threads);
+DECLARE_int32(cache_upload_part_size_mb);
 
 DECLARE_int32(beeswax_port);
 DECLARE_int32(hs2_port);
@@ -65,6 +69,10 @@ int main(int argc, char** argv) {
 	  LOG (ERROR) << "Cache initialization failed due to reasons. Shutting down....\n";
 	  exit(1);
   }
+  if (FLAGS_cache_write_behind) {
+    cacheConfigureWriteBehind(FLAGS_cache_upload_threads,
+        FLAGS_cache_upload_part_size_mb * 1024L * 1024L);
+  }
 
   EXIT_IF_ERROR(HBaseTableScanner::Init());
   EXIT_IF_ERROR(HBaseTableFactory::Init());
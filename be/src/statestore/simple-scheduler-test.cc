@@ -14,16 +14,27 @@
 
 #include <gtest/gtest.h>
 
+#include <boost/foreach.hpp>
 #include <boost/scoped_ptr.hpp>
 
 #include "common/logging.h"
+#include "rpc/thrift-util.h"
 #include "simple-scheduler.h"
+#include "statestore/query-schedule.h"
+#include "util/cpu-info.h"
+#include "util/network-util.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
 
 using namespace std;
 using namespace boost;
 using namespace impala;
 
 DECLARE_string(pool_conf_file);
+DECLARE_int32(parallel_scan_range_assignment_threshold);
+
+DEFINE_bool(scheduler_benchmark_1m, false, "If true, ScanRangeAssignmentBenchmark also "
+    "assigns 1M scan ranges, which needs a few GB of memory.");
 
 namespace impala {
 
@@ -70,6 +81,158 @@ class SimpleSchedulerTest : public testing::Test {
 
   // This scheduler has 4 backends; 2 on each ipaddresses and has 4 different ports.
   boost::scoped_ptr<SimpleScheduler> local_remote_scheduler_;
+
+  // Assigns 'num_ranges' scan ranges of a single scan node with 3 replicas each, spread
+  // over 'num_data_nodes' data nodes of which the first 'num_backends' run a backend,
+  // and logs the time taken. Checks that all ranges are assigned, balanced over the
+  // backends.
+  void BenchmarkScanRangeAssignment(int num_ranges, int num_backends,
+      int num_data_nodes) {
+    vector<TNetworkAddress> backends(num_backends);
+    vector<TNetworkAddress> host_list(num_data_nodes);
+    for (int i = 0; i < num_data_nodes; ++i) {
+      stringstream ss;
+      ss << "127.0.0." << i + 1;
+      host_list[i].hostname = ss.str();
+      host_list[i].port = 0;
+      if (i < num_backends) {
+        backends[i].hostname = ss.str();
+        backends[i].port = base_port_;
+      }
+    }
+    SimpleScheduler scheduler(backends, NULL, NULL, NULL, NULL);
+
+    const int NUM_REPLICAS = 3;
+    const int64_t RANGE_LEN = 64 * 1024 * 1024;
+    vector<TScanRangeLocations> locations(num_ranges);
+    for (int i = 0; i < num_ranges; ++i) {
+      locations[i].scan_range.__set_hdfs_file_split(THdfsFileSplit());
+      locations[i].scan_range.hdfs_file_split.length = RANGE_LEN;
+      locations[i].locations.resize(NUM_REPLICAS);
+      for (int j = 0; j < NUM_REPLICAS; ++j) {
+        locations[i].locations[j].host_idx = (i + j * 7) % num_data_nodes;
+        locations[i].locations[j].volume_id = j;
+      }
+    }
+
+    TQueryOptions query_options;
+    FragmentScanRangeAssignment assignment;
+    MonotonicStopWatch sw;
+    sw.Start();
+    Status status = scheduler.ComputeScanRangeAssignment(0, locations, host_list, false,
+        query_options, &assignment);
+    sw.Stop();
+    ASSERT_TRUE(status.ok()) << status.GetDetail();
+    LOG(INFO) << "Assigned " << num_ranges << " scan ranges to " << num_backends
+              << " backends in "
+              << PrettyPrinter::Print(sw.ElapsedTime(), TUnit::TIME_NS);
+
+    EXPECT_EQ(num_backends, assignment.size());
+    int num_assigned = 0;
+    BOOST_FOREACH(FragmentScanRangeAssignment::value_type& entry, assignment) {
+      int num_host_ranges = entry.second[0].size();
+      num_assigned += num_host_ranges;
+      // The assignment balances bytes over the hosts, with some slack for the ranges
+      // without a local replica.
+      EXPECT_LT(num_host_ranges, 2 * num_ranges / num_backends);
+    }
+    EXPECT_EQ(num_ranges, num_assigned);
+  }
+
+  typedef SimpleScheduler::BackendConfig BackendConfig;
+
+  static boost::shared_ptr<const BackendConfig> GetBackendConfig(
+      SimpleScheduler* scheduler) {
+    return scheduler->GetBackendConfig();
+  }
+
+  // Applies 'delta' of the membership topic to 'scheduler'.
+  static void UpdateMembership(SimpleScheduler* scheduler, const TTopicDelta& delta) {
+    StatestoreSubscriber::TopicDeltaMap deltas;
+    deltas[SimpleScheduler::IMPALA_MEMBERSHIP_TOPIC] = delta;
+    vector<TTopicDelta> subscriber_topic_updates;
+    scheduler->UpdateMembership(deltas, &subscriber_topic_updates);
+  }
+
+  // Returns a membership topic entry for the backend 'key' at 'ip_address':'port'.
+  static TTopicItem BackendItem(const string& key, const string& ip_address, int port) {
+    TBackendDescriptor be_desc;
+    be_desc.address = MakeNetworkAddress(ip_address, port);
+    be_desc.ip_address = ip_address;
+    TTopicItem item;
+    item.key = key;
+    ThriftSerializer serializer(false);
+    EXPECT_TRUE(serializer.Serialize(&be_desc, &item.value).ok());
+    return item;
+  }
+
+  // Returns the number of backends known to 'scheduler'.
+  static int NumBackends(SimpleScheduler* scheduler) {
+    SimpleScheduler::BackendList backends;
+    scheduler->GetAllKnownBackends(&backends);
+    return backends.size();
+  }
+
+  static bool HasLocalBackend(SimpleScheduler* scheduler, const string& ip_address) {
+    return scheduler->HasLocalBackend(MakeNetworkAddress(ip_address, 0));
+  }
+
+  // Returns a query with 'num_scan_nodes' scan nodes in two partitioned fragments. Each
+  // scan node has 'num_ranges' scan ranges with 3 replicas on 'num_data_nodes' data
+  // nodes 127.0.0.1, 127.0.0.2, etc.
+  static TQueryExecRequest MakeExecRequest(int num_scan_nodes, int num_ranges,
+      int num_data_nodes) {
+    TQueryExecRequest request;
+    request.fragments.resize(2);
+    for (int i = 0; i < request.fragments.size(); ++i) {
+      request.fragments[i].partition.type = TPartitionType::RANDOM;
+    }
+    request.host_list.resize(num_data_nodes);
+    for (int i = 0; i < num_data_nodes; ++i) {
+      stringstream ss;
+      ss << "127.0.0." << i + 1;
+      request.host_list[i] = MakeNetworkAddress(ss.str(), 0);
+    }
+    const int NUM_REPLICAS = 3;
+    for (int node_id = 0; node_id < num_scan_nodes; ++node_id) {
+      TPlanNode node;
+      node.node_id = node_id;
+      request.fragments[node_id % 2].plan.nodes.push_back(node);
+      vector<TScanRangeLocations>* locations = &request.per_node_scan_ranges[node_id];
+      locations->resize(num_ranges);
+      for (int i = 0; i < num_ranges; ++i) {
+        TScanRangeLocations& range = (*locations)[i];
+        range.scan_range.__set_hdfs_file_split(THdfsFileSplit());
+        // Ranges of different sizes, so that the assignment depends on their order.
+        range.scan_range.hdfs_file_split.length = (1 + (i + node_id) % 5) * 1024 * 1024;
+        range.locations.resize(NUM_REPLICAS);
+        for (int j = 0; j < NUM_REPLICAS; ++j) {
+          range.locations[j].host_idx = (i + node_id + j * 3) % num_data_nodes;
+          range.locations[j].volume_id = j;
+        }
+      }
+    }
+    return request;
+  }
+
+  // Assigns the scan ranges of 'request' in 'schedule' with
+  // --parallel_scan_range_assignment_threshold set to 'threshold', and logs the time
+  // taken.
+  static void ComputeScanRangeAssignment(SimpleScheduler* scheduler,
+      const TQueryExecRequest& request, int threshold, QuerySchedule* schedule) {
+    int32_t saved_threshold = FLAGS_parallel_scan_range_assignment_threshold;
+    FLAGS_parallel_scan_range_assignment_threshold = threshold;
+    MonotonicStopWatch sw;
+    sw.Start();
+    Status status = scheduler->ComputeScanRangeAssignment(request, schedule);
+    sw.Stop();
+    FLAGS_parallel_scan_range_assignment_threshold = saved_threshold;
+    ASSERT_TRUE(status.ok()) << status.GetDetail();
+    LOG(INFO) << "Assigned " << schedule->num_scan_ranges() << " scan ranges of "
+              << request.per_node_scan_ranges.size() << " scan nodes with threshold "
+              << threshold << " in "
+              << PrettyPrinter::Print(sw.ElapsedTime(), TUnit::TIME_NS);
+  }
 };
 
 
@@ -147,11 +310,127 @@ TEST_F(SimpleSchedulerTest, NonLocalHost) {
   EXPECT_EQ(backends.at(4).address.port, 1000);
 }
 
+TEST_F(SimpleSchedulerTest, ScanRangeAssignmentBenchmark) {
+  BenchmarkScanRangeAssignment(100000, 20, 30);
+  if (FLAGS_scheduler_benchmark_1m) BenchmarkScanRangeAssignment(1000000, 20, 30);
+}
+
+// The scan nodes of a query are assigned in parallel above the threshold, with the same
+// result as the serial assignment.
+TEST_F(SimpleSchedulerTest, ParallelScanRangeAssignment) {
+  const int NUM_SCAN_NODES = 8;
+  const int NUM_RANGES = 20000;
+  const int NUM_HOSTS = 10;
+  // A single backend on every data node, so that the assignment does not depend on the
+  // round-robin positions, which the scan nodes share.
+  vector<TNetworkAddress> backends(NUM_HOSTS);
+  for (int i = 0; i < NUM_HOSTS; ++i) {
+    stringstream ss;
+    ss << "127.0.0." << i + 1;
+    backends[i] = MakeNetworkAddress(ss.str(), base_port_);
+  }
+  SimpleScheduler scheduler(backends, NULL, NULL, NULL, NULL);
+  TQueryExecRequest request = MakeExecRequest(NUM_SCAN_NODES, NUM_RANGES, NUM_HOSTS);
+
+  TQueryOptions query_options;
+  QuerySchedule serial(TUniqueId(), request, query_options, "", NULL, NULL);
+  ComputeScanRangeAssignment(&scheduler, request, 0, &serial);
+  QuerySchedule parallel(TUniqueId(), request, query_options, "", NULL, NULL);
+  ComputeScanRangeAssignment(&scheduler, request, 1, &parallel);
+
+  EXPECT_EQ(serial.num_scan_ranges(), NUM_SCAN_NODES * NUM_RANGES);
+  EXPECT_EQ(parallel.num_scan_ranges(), NUM_SCAN_NODES * NUM_RANGES);
+  for (int i = 0; i < request.fragments.size(); ++i) {
+    const FragmentScanRangeAssignment& serial_assignment =
+        (*serial.exec_params())[i].scan_range_assignment;
+    const FragmentScanRangeAssignment& parallel_assignment =
+        (*parallel.exec_params())[i].scan_range_assignment;
+    EXPECT_EQ(serial_assignment.size(), NUM_HOSTS);
+    EXPECT_TRUE(serial_assignment == parallel_assignment) << "fragment " << i;
+
+    // Every scan node of the fragment has all its ranges.
+    map<PlanNodeId, int> num_node_ranges;
+    BOOST_FOREACH(const FragmentScanRangeAssignment::value_type& host,
+        parallel_assignment) {
+      BOOST_FOREACH(const PerNodeScanRanges::value_type& node, host.second) {
+        EXPECT_EQ(node.first % 2, i);
+        num_node_ranges[node.first] += node.second.size();
+      }
+    }
+    EXPECT_EQ(num_node_ranges.size(), NUM_SCAN_NODES / 2);
+    for (map<PlanNodeId, int>::iterator it = num_node_ranges.begin();
+        it != num_node_ranges.end(); ++it) {
+      EXPECT_EQ(it->second, NUM_RANGES) << "scan node " << it->first;
+    }
+  }
+}
+
+TEST_F(SimpleSchedulerTest, MembershipUpdates) {
+  vector<TNetworkAddress> backends(1, MakeNetworkAddress("127.0.0.1", base_port_));
+  SimpleScheduler scheduler(backends, NULL, NULL, NULL, NULL);
+  EXPECT_EQ(NumBackends(&scheduler), 1);
+  EXPECT_TRUE(HasLocalBackend(&scheduler, "127.0.0.1"));
+  int64_t version = GetBackendConfig(&scheduler)->version();
+
+  // A non-delta update replaces all backends.
+  TTopicDelta delta;
+  delta.topic_name = SimpleScheduler::IMPALA_MEMBERSHIP_TOPIC;
+  delta.is_delta = false;
+  delta.topic_entries.push_back(BackendItem("a", "10.0.0.1", base_port_));
+  delta.topic_entries.push_back(BackendItem("b", "10.0.0.2", base_port_));
+  delta.topic_entries.push_back(BackendItem("c", "10.0.0.2", base_port_ + 1));
+  UpdateMembership(&scheduler, delta);
+  EXPECT_EQ(NumBackends(&scheduler), 3);
+  EXPECT_FALSE(HasLocalBackend(&scheduler, "127.0.0.1"));
+  EXPECT_TRUE(HasLocalBackend(&scheduler, "10.0.0.1"));
+  EXPECT_TRUE(HasLocalBackend(&scheduler, "10.0.0.2"));
+  EXPECT_EQ(GetBackendConfig(&scheduler)->version(), version + 1);
+
+  // A delta removes a backend of a host with two backends. Readers that took the
+  // previous snapshot keep seeing it unchanged.
+  boost::shared_ptr<const BackendConfig> old_config = GetBackendConfig(&scheduler);
+  delta.is_delta = true;
+  delta.topic_entries.clear();
+  delta.topic_deletions.push_back("b");
+  UpdateMembership(&scheduler, delta);
+  EXPECT_EQ(NumBackends(&scheduler), 2);
+  EXPECT_TRUE(HasLocalBackend(&scheduler, "10.0.0.2"));
+  SimpleScheduler::BackendList old_backends;
+  old_config->GetAllBackends(&old_backends);
+  EXPECT_EQ(old_backends.size(), 3);
+  EXPECT_EQ(GetBackendConfig(&scheduler)->version(), version + 2);
+
+  // Removing the last backend of a host makes its reads remote. Unknown ids are
+  // ignored.
+  delta.topic_deletions.clear();
+  delta.topic_deletions.push_back("c");
+  delta.topic_deletions.push_back("unknown");
+  UpdateMembership(&scheduler, delta);
+  EXPECT_EQ(NumBackends(&scheduler), 1);
+  EXPECT_FALSE(HasLocalBackend(&scheduler, "10.0.0.2"));
+
+  // A delta adds a backend to the existing ones.
+  delta.topic_deletions.clear();
+  delta.topic_entries.push_back(BackendItem("d", "10.0.0.3", base_port_));
+  UpdateMembership(&scheduler, delta);
+  EXPECT_EQ(NumBackends(&scheduler), 2);
+  EXPECT_TRUE(HasLocalBackend(&scheduler, "10.0.0.1"));
+  EXPECT_TRUE(HasLocalBackend(&scheduler, "10.0.0.3"));
+
+  // An empty delta keeps the current snapshot.
+  old_config = GetBackendConfig(&scheduler);
+  delta.topic_entries.clear();
+  UpdateMembership(&scheduler, delta);
+  EXPECT_EQ(GetBackendConfig(&scheduler), old_config);
+  EXPECT_EQ(NumBackends(&scheduler), 2);
+}
+
 }
 
 int main(int argc, char **argv) {
   google::InitGoogleLogging(argv[0]);
   impala::InitThreading();
+  impala::CpuInfo::Init();
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
@@ -36,11 +36,13 @@
 #include "util/network-util.h"
 #include "util/uid-util.h"
 #include "util/container-util.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
 #include "util/llama-util.h"
 #include "util/mem-info.h"
 #include "util/parse-util.h"
+#include "util/thread.h"
 #include "gen-cpp/ResourceBrokerService_types.h"
 
 using namespace std;
@@ -62,6 +64,9 @@ DEFINE_bool(require_username, false, "Requires that a user be provided in order
     "schedule requests. If enabled and a user is not provided, requests will be "
     "rejected, otherwise requests without a username will be submitted with the "
     "username 'default'.");
+DEFINE_int32(parallel_scan_range_assignment_threshold, 100000, "Queries with at least "
+    "this many scan ranges compute the scan range assignments of their scan nodes in "
+    "parallel. If 0, scan range assignment is never parallelized.");
 
 namespace impala {
 
@@ -87,7 +92,8 @@ SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
     const string& backend_id, const TNetworkAddress& backend_address,
     MetricGroup* metrics, Webserver* webserver, ResourceBroker* resource_broker,
     RequestPoolService* request_pool_service)
-  : metrics_(metrics->GetChildGroup("scheduler")),
+  : backend_config_(new BackendConfig()),
+    metrics_(metrics->GetChildGroup("scheduler")),
     webserver_(webserver),
     statestore_subscriber_(subscriber),
     backend_id_(backend_id),
@@ -99,7 +105,6 @@ SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
     resource_broker_(resource_broker),
     request_pool_service_(request_pool_service) {
   backend_descriptor_.address = backend_address;
-  next_nonlocal_backend_entry_ = backend_map_.begin();
   if (FLAGS_disable_admission_control) LOG(INFO) << "Admission control is disabled.";
   if (!FLAGS_disable_admission_control) {
     admission_controller_.reset(
@@ -148,6 +153,7 @@ SimpleScheduler::SimpleScheduler(const vector<TNetworkAddress>& backends,
         new AdmissionController(request_pool_service_, metrics, backend_id_));
   }
 
+  BackendConfig* config = new BackendConfig();
   for (int i = 0; i < backends.size(); ++i) {
     vector<string> ipaddrs;
     Status status = HostnameToIpAddrs(backends[i].hostname, &ipaddrs);
@@ -164,18 +170,77 @@ SimpleScheduler::SimpleScheduler(const vector<TNetworkAddress>& backends,
       VLOG(1) << "Only localhost addresses found for " << backends[i].hostname;
     }
 
-    BackendMap::iterator it = backend_map_.find(ipaddr);
-    if (it == backend_map_.end()) {
-      it = backend_map_.insert(
-          make_pair(ipaddr, list<TBackendDescriptor>())).first;
-      backend_ip_map_[backends[i].hostname] = ipaddr;
-    }
-
     TBackendDescriptor descriptor;
     descriptor.address = MakeNetworkAddress(ipaddr, backends[i].port);
-    it->second.push_back(descriptor);
+    config->AddBackend(backends[i].hostname, ipaddr, descriptor);
+  }
+  config->BuildIndex();
+  backend_config_.reset(config);
+}
+
+void SimpleScheduler::BackendConfig::AddBackend(const string& hostname,
+    const string& ip_address, const TBackendDescriptor& be_desc) {
+  vector<TBackendDescriptor>* be_descs = &backend_map_[ip_address];
+  if (find(be_descs->begin(), be_descs->end(), be_desc) == be_descs->end()) {
+    be_descs->push_back(be_desc);
   }
-  next_nonlocal_backend_entry_ = backend_map_.begin();
+  backend_ip_map_[hostname] = ip_address;
+}
+
+void SimpleScheduler::BackendConfig::RemoveBackend(const TBackendDescriptor& be_desc) {
+  backend_ip_map_.erase(be_desc.address.hostname);
+  BackendMap::iterator entry = backend_map_.find(be_desc.ip_address);
+  if (entry == backend_map_.end()) return;
+  vector<TBackendDescriptor>* be_descs = &entry->second;
+  be_descs->erase(remove(be_descs->begin(), be_descs->end(), be_desc), be_descs->end());
+  if (be_descs->empty()) backend_map_.erase(entry);
+}
+
+void SimpleScheduler::BackendConfig::BuildIndex() {
+  hosts_.clear();
+  host_idx_.clear();
+  BOOST_FOREACH(const BackendMap::value_type& entry, backend_map_) {
+    DCHECK(!entry.second.empty());
+    host_idx_[entry.first] = hosts_.size();
+    hosts_.push_back(&entry.second);
+  }
+  next_nonlocal_host_ = 0;
+  next_backend_.assign(hosts_.size(), AtomicInt<int64_t>(0));
+}
+
+int SimpleScheduler::BackendConfig::LocalHostIdx(const string& ip_address) const {
+  boost::unordered_map<string, int>::const_iterator entry = host_idx_.find(ip_address);
+  return entry == host_idx_.end() ? -1 : entry->second;
+}
+
+int SimpleScheduler::BackendConfig::HostIdx(const string& host) const {
+  int host_idx = LocalHostIdx(host);
+  if (host_idx != -1) return host_idx;
+  // 'host' might be a hostname rather than an IP address.
+  BackendIpAddressMap::const_iterator ip_address = backend_ip_map_.find(host);
+  if (ip_address == backend_ip_map_.end()) return -1;
+  return LocalHostIdx(ip_address->second);
+}
+
+const TBackendDescriptor& SimpleScheduler::BackendConfig::SelectBackend(
+    int host_idx) const {
+  DCHECK(!hosts_.empty());
+  DCHECK_LT(host_idx, static_cast<int>(hosts_.size()));
+  if (host_idx < 0) host_idx = next_nonlocal_host_.FetchAndUpdate(1) % hosts_.size();
+  const vector<TBackendDescriptor>& be_descs = *hosts_[host_idx];
+  return be_descs[next_backend_[host_idx].FetchAndUpdate(1) % be_descs.size()];
+}
+
+void SimpleScheduler::BackendConfig::GetAllBackends(BackendList* backends) const {
+  backends->clear();
+  BOOST_FOREACH(const vector<TBackendDescriptor>* be_descs, hosts_) {
+    backends->insert(backends->end(), be_descs->begin(), be_descs->end());
+  }
+}
+
+shared_ptr<const SimpleScheduler::BackendConfig> SimpleScheduler::GetBackendConfig() {
+  lock_guard<mutex> lock(backend_config_lock_);
+  return backend_config_;
 }
 
 Status SimpleScheduler::Init() {
@@ -204,8 +269,9 @@ Status SimpleScheduler::Init() {
     total_assignments_ = metrics_->AddCounter(ASSIGNMENTS_KEY, 0L);
     total_local_assignments_ = metrics_->AddCounter(LOCAL_ASSIGNMENTS_KEY, 0L);
     initialised_ = metrics_->AddProperty(SCHEDULER_INIT_KEY, true);
-    num_backends_metric_ = metrics_->AddGauge<int64_t>(
-        NUM_BACKENDS_KEY, backend_map_.size());
+    BackendList backends;
+    GetAllKnownBackends(&backends);
+    num_backends_metric_ = metrics_->AddGauge<int64_t>(NUM_BACKENDS_KEY, backends.size());
   }
 
   if (statestore_subscriber_ != NULL) {
@@ -274,18 +340,18 @@ void SimpleScheduler::UpdateMembership(
   if (topic != incoming_topic_deltas.end()) {
     const TTopicDelta& delta = topic->second;
 
-    // This function needs to handle both delta and non-delta updates. For delta
-    // updates, it is desireable to minimize the number of copies to only
-    // the added/removed items. To accomplish this, all updates are processed
-    // under a lock and applied to the shared backend maps (backend_map_ and
-    // backend_ip_map_) in place.
-    {
-      lock_guard<mutex> lock(backend_map_lock_);
-      if (!delta.is_delta) {
-        current_membership_.clear();
-        backend_map_.clear();
-        backend_ip_map_.clear();
-      }
+    // This function needs to handle both delta and non-delta updates. Scheduling works
+    // on immutable snapshots of the backends, so a copy of the current snapshot is
+    // updated and then swapped in. Deltas without changes, which are by far the most
+    // common, leave the current snapshot in place.
+    if (!delta.is_delta || !delta.topic_entries.empty() ||
+        !delta.topic_deletions.empty()) {
+      shared_ptr<const BackendConfig> current_config = GetBackendConfig();
+      BackendConfig* new_config = delta.is_delta ?
+          new BackendConfig(*current_config) : new BackendConfig();
+      shared_ptr<const BackendConfig> new_config_ptr(new_config);
+      new_config->set_version(current_config->version() + 1);
+      if (!delta.is_delta) current_membership_.clear();
 
       // Process new entries to the topic
       BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
@@ -308,31 +374,30 @@ void SimpleScheduler::UpdateMembership(
                                    << be_desc.address;
         }
 
-        list<TBackendDescriptor>* be_descs = &backend_map_[be_desc.ip_address];
-        if (find(be_descs->begin(), be_descs->end(), be_desc) == be_descs->end()) {
-          backend_map_[be_desc.ip_address].push_back(be_desc);
-        }
-        backend_ip_map_[be_desc.address.hostname] = be_desc.ip_address;
+        new_config->AddBackend(be_desc.address.hostname, be_desc.ip_address, be_desc);
         current_membership_.insert(make_pair(item.key, be_desc));
       }
       // Process deletions from the topic
       BOOST_FOREACH(const string& backend_id, delta.topic_deletions) {
-        if (current_membership_.find(backend_id) != current_membership_.end()) {
-          const TBackendDescriptor& be_desc = current_membership_[backend_id];
-          backend_ip_map_.erase(be_desc.address.hostname);
-          list<TBackendDescriptor>* be_descs = &backend_map_[be_desc.ip_address];
-          be_descs->erase(
-              remove(be_descs->begin(), be_descs->end(), be_desc), be_descs->end());
-          if (be_descs->empty()) backend_map_.erase(be_desc.ip_address);
-          current_membership_.erase(backend_id);
+        BackendIdMap::iterator entry = current_membership_.find(backend_id);
+        if (entry != current_membership_.end()) {
+          new_config->RemoveBackend(entry->second);
+          current_membership_.erase(entry);
         }
       }
-      next_nonlocal_backend_entry_ = backend_map_.begin();
+      new_config->BuildIndex();
+      VLOG(2) << "Updated backend configuration to version " << new_config->version();
+
+      lock_guard<mutex> lock(backend_config_lock_);
+      backend_config_.swap(new_config_ptr);
     }
 
     // If this impalad is not in our view of the membership list, we should add it and
     // tell the statestore.
-    bool is_offline = ExecEnv::GetInstance()->impala_server()->IsOffline();
+    // There is no ImpalaServer in unit tests.
+    ExecEnv* exec_env = ExecEnv::GetInstance();
+    bool is_offline = exec_env != NULL && exec_env->impala_server() != NULL &&
+        exec_env->impala_server()->IsOffline();
     if (!is_offline &&
         current_membership_.find(backend_id_) == current_membership_.end()) {
       VLOG(1) << "Registering local backend with statestore";
@@ -375,44 +440,16 @@ Status SimpleScheduler::GetBackends(
 
 Status SimpleScheduler::GetBackend(const TNetworkAddress& data_location,
     TBackendDescriptor* backend) {
-  lock_guard<mutex> lock(backend_map_lock_);
-  if (backend_map_.size() == 0) {
+  shared_ptr<const BackendConfig> config = GetBackendConfig();
+  if (config->empty()) {
     return Status("No backends configured");
   }
-  bool local_assignment = false;
-  BackendMap::iterator entry = backend_map_.find(data_location.hostname);
-
-  if (entry == backend_map_.end()) {
-    // backend_map_ maps ip address to backend but
-    // data_location.hostname might be a hostname.
-    // Find the ip address of the data_location from backend_ip_map_.
-    BackendIpAddressMap::const_iterator itr =
-        backend_ip_map_.find(data_location.hostname);
-    if (itr != backend_ip_map_.end()) {
-      entry = backend_map_.find(itr->second);
-    }
-  }
-
-  if (entry == backend_map_.end()) {
-    // round robin the ipaddress
-    entry = next_nonlocal_backend_entry_;
-    ++next_nonlocal_backend_entry_;
-    if (next_nonlocal_backend_entry_ == backend_map_.end()) {
-      next_nonlocal_backend_entry_ = backend_map_.begin();
-    }
-  } else {
-    local_assignment = true;
-  }
-  DCHECK(!entry->second.empty());
-  // Round-robin between impalads on the same ipaddress.
-  // Pick the first one, then move it to the back of the queue
-  *backend = entry->second.front();
-  entry->second.pop_front();
-  entry->second.push_back(*backend);
+  int host_idx = config->HostIdx(data_location.hostname);
+  *backend = config->SelectBackend(host_idx);
 
   if (metrics_ != NULL) {
     total_assignments_->Increment(1);
-    if (local_assignment) {
+    if (host_idx != -1) {
       total_local_assignments_->Increment(1L);
     }
   }
@@ -426,38 +463,112 @@ Status SimpleScheduler::GetBackend(const TNetworkAddress& data_location,
   return Status::OK;
 }
 
+bool SimpleScheduler::HasLocalBackend(const TNetworkAddress& data_location) {
+  return GetBackendConfig()->LocalHostIdx(data_location.hostname) != -1;
+}
+
 void SimpleScheduler::GetAllKnownBackends(BackendList* backends) {
-  lock_guard<mutex> lock(backend_map_lock_);
-  backends->clear();
-  BOOST_FOREACH(const BackendMap::value_type& backend_list, backend_map_) {
-    backends->insert(backends->end(), backend_list.second.begin(),
-                     backend_list.second.end());
+  GetBackendConfig()->GetAllBackends(backends);
+}
+
+void SimpleScheduler::ResolveDataHosts(const BackendConfig& config,
+    const vector<TNetworkAddress>& host_list, vector<DataHost>* data_hosts) {
+  data_hosts->resize(host_list.size());
+  for (int i = 0; i < host_list.size(); ++i) {
+    (*data_hosts)[i].is_local = config.LocalHostIdx(host_list[i].hostname) != -1;
+    (*data_hosts)[i].backend_host_idx = config.HostIdx(host_list[i].hostname);
   }
 }
 
 Status SimpleScheduler::ComputeScanRangeAssignment(const TQueryExecRequest& exec_request,
     QuerySchedule* schedule) {
+  // All scan nodes of the query are assigned against the same snapshot of the backends,
+  // with the data hosts resolved only once.
+  shared_ptr<const BackendConfig> config = GetBackendConfig();
+  vector<DataHost> data_hosts;
+  ResolveDataHosts(*config, exec_request.host_list, &data_hosts);
+
+  vector<ScanNodeAssignment> nodes(exec_request.per_node_scan_ranges.size());
+  int64_t num_scan_ranges = 0;
   map<TPlanNodeId, vector<TScanRangeLocations> >::const_iterator entry;
+  int i = 0;
   for (entry = exec_request.per_node_scan_ranges.begin();
-      entry != exec_request.per_node_scan_ranges.end(); ++entry) {
+      entry != exec_request.per_node_scan_ranges.end(); ++entry, ++i) {
     int fragment_idx = schedule->GetFragmentIdx(entry->first);
     const TPlanFragment& fragment = exec_request.fragments[fragment_idx];
-    bool exec_at_coord = (fragment.partition.type == TPartitionType::UNPARTITIONED);
+    nodes[i].node_id = entry->first;
+    nodes[i].locations = &entry->second;
+    nodes[i].exec_at_coord = (fragment.partition.type == TPartitionType::UNPARTITIONED);
+    num_scan_ranges += entry->second.size();
+  }
 
+  // The scan nodes are assigned independently of each other, so queries with many scan
+  // ranges assign them in parallel.
+  int num_threads = 1;
+  if (FLAGS_parallel_scan_range_assignment_threshold > 0 &&
+      num_scan_ranges >= FLAGS_parallel_scan_range_assignment_threshold) {
+    num_threads = min<int>(nodes.size(), CpuInfo::num_cores());
+  }
+  if (num_threads <= 1) {
+    ComputeScanNodeAssignments(config.get(), &exec_request.host_list, &data_hosts,
+        &schedule->query_options(), &nodes, 0, 1);
+  } else {
+    ThreadGroup threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.AddThread(new Thread("scheduler", Substitute("scan-range-assignment-$0", t),
+          bind<void>(mem_fn(&SimpleScheduler::ComputeScanNodeAssignments), this,
+              config.get(), &exec_request.host_list, &data_hosts,
+              &schedule->query_options(), &nodes, t, num_threads)));
+    }
+    threads.JoinAll();
+  }
+
+  BOOST_FOREACH(ScanNodeAssignment& node, nodes) {
+    RETURN_IF_ERROR(node.status);
+    int fragment_idx = schedule->GetFragmentIdx(node.node_id);
     FragmentScanRangeAssignment* assignment =
         &(*schedule->exec_params())[fragment_idx].scan_range_assignment;
-    RETURN_IF_ERROR(ComputeScanRangeAssignment(
-        entry->first, entry->second, exec_request.host_list, exec_at_coord,
-        schedule->query_options(), assignment));
-    schedule->AddScanRanges(entry->second.size());
+    BOOST_FOREACH(FragmentScanRangeAssignment::value_type& host, node.assignment) {
+      PerNodeScanRanges* scan_ranges =
+          FindOrInsert(assignment, host.first, PerNodeScanRanges());
+      (*scan_ranges)[node.node_id].swap(host.second[node.node_id]);
+    }
+    schedule->AddScanRanges(node.locations->size());
   }
   return Status::OK;
 }
 
+void SimpleScheduler::ComputeScanNodeAssignments(const BackendConfig* config,
+    const vector<TNetworkAddress>* host_list, const vector<DataHost>* data_hosts,
+    const TQueryOptions* query_options, vector<ScanNodeAssignment>* nodes, int first,
+    int stride) {
+  for (int i = first; i < nodes->size(); i += stride) {
+    ScanNodeAssignment& node = (*nodes)[i];
+    node.status = ComputeScanRangeAssignment(*config, node.node_id, *node.locations,
+        *host_list, *data_hosts, node.exec_at_coord, *query_options, &node.assignment);
+  }
+}
+
 Status SimpleScheduler::ComputeScanRangeAssignment(
     PlanNodeId node_id, const vector<TScanRangeLocations>& locations,
     const vector<TNetworkAddress>& host_list, bool exec_at_coord,
     const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment) {
+  shared_ptr<const BackendConfig> config = GetBackendConfig();
+  vector<DataHost> data_hosts;
+  ResolveDataHosts(*config, host_list, &data_hosts);
+  return ComputeScanRangeAssignment(*config, node_id, locations, host_list, data_hosts,
+      exec_at_coord, query_options, assignment);
+}
+
+Status SimpleScheduler::ComputeScanRangeAssignment(const BackendConfig& config,
+    PlanNodeId node_id, const vector<TScanRangeLocations>& locations,
+    const vector<TNetworkAddress>& host_list, const vector<DataHost>& data_hosts,
+    bool exec_at_coord, const TQueryOptions& query_options,
+    FragmentScanRangeAssignment* assignment) {
+  DCHECK_EQ(host_list.size(), data_hosts.size());
+  if (!exec_at_coord && !locations.empty() && config.empty()) {
+    return Status("No backends configured");
+  }
   // If cached reads are enabled, we will always prefer cached replicas over non-cached
   // replicas. Since it is likely that only one replica is cached, this could generate
   // hotspots which is why this is controllable by a query option.
@@ -467,24 +578,33 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
   // The query option to disable cached reads removes the first group.
   bool schedule_with_caching = !query_options.disable_cached_reads;
 
-  // map from datanode host to total assigned bytes;
-  // If the data node does not have a collocated impalad, the actual assigned bytes is
-  // "total assigned - numeric_limits<int64_t>::max()".
-  unordered_map<TNetworkAddress, uint64_t> assigned_bytes_per_host;
-  unordered_set<TNetworkAddress> remote_hosts;
+  // Total assigned bytes per datanode host, indexed like host_list. Non-collocated data
+  // nodes are deprioritized by a very high initial value, i.e. their actual assigned
+  // bytes are "total assigned - numeric_limits<int64_t>::max()".
+  vector<uint64_t> assigned_bytes_per_host(host_list.size());
+  for (int i = 0; i < data_hosts.size(); ++i) {
+    assigned_bytes_per_host[i] =
+        data_hosts[i].is_local ? 0L : numeric_limits<int64_t>::max();
+  }
+  unordered_set<int> remote_hosts;
   int64_t remote_bytes = 0L;
   int64_t local_bytes = 0L;
   int64_t cached_bytes = 0L;
+  int64_t num_assignments = 0L;
+  int64_t num_local_assignments = 0L;
+  TNetworkAddress coord = MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port);
 
+  vector<const TScanRangeLocation*> cached_locations;
   BOOST_FOREACH(const TScanRangeLocations& scan_range_locations, locations) {
     // assign this scan range to the host w/ the fewest assigned bytes
     uint64_t min_assigned_bytes = numeric_limits<uint64_t>::max();
-    const TNetworkAddress* data_host = NULL;  // data server; not necessarily backend
+    // data server; not necessarily backend
+    int data_host_idx = -1;
     int volume_id = -1;
     bool is_cached = false;
 
     // Separate cached replicas from non-cached replicas
-    vector<const TScanRangeLocation*> cached_locations;
+    cached_locations.clear();
     if (schedule_with_caching) {
       BOOST_FOREACH(const TScanRangeLocation& location, scan_range_locations.locations) {
         // Adjust whether or not this replica should count as being cached based on
@@ -492,7 +612,7 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
         // treat the replica as not cached (network transfer dominates anyway in this
         // case).
         // TODO: measure this in a cluster setup. Are remote reads better with caching?
-        if (location.is_cached && HasLocalBackend(host_list[location.host_idx])) {
+        if (location.is_cached && data_hosts[location.host_idx].is_local) {
           cached_locations.push_back(&location);
         }
       }
@@ -501,16 +621,10 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     if (cached_locations.size() == 0) {
       BOOST_FOREACH(const TScanRangeLocation& location, scan_range_locations.locations) {
         DCHECK_LT(location.host_idx, host_list.size());
-        const TNetworkAddress& replica_host = host_list[location.host_idx];
-        // Deprioritize non-collocated datanodes by assigning a very high initial bytes
-        uint64_t initial_bytes =
-            HasLocalBackend(replica_host) ? 0L : numeric_limits<int64_t>::max();
-        uint64_t* assigned_bytes =
-            FindOrInsert(&assigned_bytes_per_host, replica_host, initial_bytes);
         // Update the assignment if this is a less busy host.
-        if (*assigned_bytes < min_assigned_bytes) {
-          min_assigned_bytes = *assigned_bytes;
-          data_host = &replica_host;
+        if (assigned_bytes_per_host[location.host_idx] < min_assigned_bytes) {
+          min_assigned_bytes = assigned_bytes_per_host[location.host_idx];
+          data_host_idx = location.host_idx;
           volume_id = location.volume_id;
           is_cached = false;
         }
@@ -518,13 +632,12 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     } else {
       // Randomly pick a cached host based on the extracted list of cached local hosts
       size_t rand_host = rand() % cached_locations.size();
-      const TNetworkAddress& replica_host = host_list[cached_locations[rand_host]->host_idx];
-      uint64_t initial_bytes = 0L;
-      min_assigned_bytes = *FindOrInsert(&assigned_bytes_per_host, replica_host, initial_bytes);
-      data_host = &replica_host;
+      data_host_idx = cached_locations[rand_host]->host_idx;
+      min_assigned_bytes = assigned_bytes_per_host[data_host_idx];
       volume_id = cached_locations[rand_host]->volume_id;
       is_cached = true;
     }
+    DCHECK_GE(data_host_idx, 0);
 
     int64_t scan_range_length = 0;
     if (scan_range_locations.scan_range.__isset.hdfs_file_split) {
@@ -533,27 +646,24 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     bool remote_read = min_assigned_bytes >= numeric_limits<int64_t>::max();
     if (remote_read) {
       remote_bytes += scan_range_length;
-      remote_hosts.insert(*data_host);
+      remote_hosts.insert(data_host_idx);
     } else {
       local_bytes += scan_range_length;
       if (is_cached) cached_bytes += scan_range_length;
     }
-    assigned_bytes_per_host[*data_host] += scan_range_length;
+    assigned_bytes_per_host[data_host_idx] += scan_range_length;
 
     // translate data host to backend host
-    DCHECK(data_host != NULL);
-
-    TNetworkAddress exec_hostport;
+    const TNetworkAddress* exec_hostport = &coord;
     if (!exec_at_coord) {
-      TBackendDescriptor backend;
-      RETURN_IF_ERROR(GetBackend(*data_host, &backend));
-      exec_hostport = backend.address;
-    } else {
-      exec_hostport = MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port);
+      int backend_host_idx = data_hosts[data_host_idx].backend_host_idx;
+      exec_hostport = &config.SelectBackend(backend_host_idx).address;
+      ++num_assignments;
+      if (backend_host_idx != -1) ++num_local_assignments;
     }
 
     PerNodeScanRanges* scan_ranges =
-        FindOrInsert(assignment, exec_hostport, PerNodeScanRanges());
+        FindOrInsert(assignment, *exec_hostport, PerNodeScanRanges());
     vector<TScanRangeParams>* scan_range_params_list =
         FindOrInsert(scan_ranges, node_id, vector<TScanRangeParams>());
     // add scan range
@@ -566,6 +676,11 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     scan_range_params_list->push_back(scan_range_params);
   }
 
+  if (metrics_ != NULL && num_assignments > 0) {
+    total_assignments_->Increment(num_assignments);
+    total_local_assignments_->Increment(num_local_assignments);
+  }
+
   if (VLOG_FILE_IS_ON) {
     VLOG_FILE << "Total remote scan volume = " <<
         PrettyPrinter::Print(remote_bytes, TUnit::BYTES);
@@ -576,8 +691,8 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     if (remote_hosts.size() > 0) {
       stringstream remote_node_log;
       remote_node_log << "Remote data node list: ";
-      BOOST_FOREACH(const TNetworkAddress& remote_host, remote_hosts) {
-        remote_node_log << remote_host << " ";
+      BOOST_FOREACH(int remote_host, remote_hosts) {
+        remote_node_log << host_list[remote_host] << " ";
       }
     }
 
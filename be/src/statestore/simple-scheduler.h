@@ -19,9 +19,11 @@
 #include <vector>
 #include <string>
 #include <list>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "statestore/scheduler.h"
 #include "statestore/statestore-subscriber.h"
@@ -42,7 +44,6 @@ class Coordinator;
 // of target data locations.
 //
 // TODO: Notice when there are duplicate statestore registrations (IMPALA-23)
-// TODO: Handle deltas from the statestore
 class SimpleScheduler : public Scheduler {
  public:
   static const std::string IMPALA_MEMBERSHIP_TOPIC;
@@ -78,11 +79,7 @@ class SimpleScheduler : public Scheduler {
 
   virtual void GetAllKnownBackends(BackendList* backends);
 
-  virtual bool HasLocalBackend(const TNetworkAddress& data_location) {
-    boost::lock_guard<boost::mutex> l(backend_map_lock_);
-    BackendMap::iterator entry = backend_map_.find(data_location.hostname);
-    return (entry != backend_map_.end() && entry->second.size() > 0);
-  }
+  virtual bool HasLocalBackend(const TNetworkAddress& data_location);
 
   // Registers with the subscription manager if required
   virtual impala::Status Init();
@@ -94,19 +91,84 @@ class SimpleScheduler : public Scheduler {
   virtual void HandleLostResource(const TUniqueId& client_resource_id);
 
  private:
-  // Protects access to backend_map_ and backend_ip_map_, which might otherwise be updated
-  // asynchronously with respect to reads. Also protects the locality
-  // counters, which are updated in GetBackends.
-  boost::mutex backend_map_lock_;
+  friend class SimpleSchedulerTest;
 
-  // Map from a datanode's IP address to a list of backend addresses running on that node.
-  typedef boost::unordered_map<std::string, std::list<TBackendDescriptor> > BackendMap;
-  BackendMap backend_map_;
+  // Map from a datanode's IP address to the backends running on that node.
+  typedef boost::unordered_map<std::string, std::vector<TBackendDescriptor> > BackendMap;
 
   // Map from a datanode's hostname to its IP address to support both hostname based
   // lookup.
   typedef boost::unordered_map<std::string, std::string> BackendIpAddressMap;
-  BackendIpAddressMap backend_ip_map_;
+
+  // Immutable, versioned snapshot of the known backends. UpdateMembership() builds a new
+  // snapshot for every change of the membership and swaps it in; readers take a
+  // reference to the current snapshot once (see GetBackendConfig()) and then work on it
+  // without locking, so scheduling never waits for a membership update and sees a
+  // consistent set of backends throughout.
+  // The only state that changes after a snapshot is published are the round-robin
+  // positions, which are atomic.
+  class BackendConfig {
+   public:
+    BackendConfig() : version_(0), next_nonlocal_host_(0) { }
+
+    // Adds a backend running on the host with IP address 'ip_address' and hostname
+    // 'hostname'. Only valid before BuildIndex().
+    void AddBackend(const std::string& hostname, const std::string& ip_address,
+        const TBackendDescriptor& be_desc);
+
+    // Removes a backend added with AddBackend(). Only valid before BuildIndex().
+    void RemoveBackend(const TBackendDescriptor& be_desc);
+
+    // Builds the host indices and resets the round-robin positions. Must be called
+    // after the backends have been modified and before the snapshot is published.
+    void BuildIndex();
+
+    // Returns the index of the host with the IP address 'ip_address', or -1 if no backend
+    // runs on it.
+    int LocalHostIdx(const std::string& ip_address) const;
+
+    // Returns the index of the host 'host', which is either an IP address or a hostname,
+    // or -1 if no backend runs on it.
+    int HostIdx(const std::string& host) const;
+
+    // Returns the next backend in round-robin order among the backends on the host with
+    // index 'host_idx', or, if 'host_idx' is -1, among the backends on all hosts in
+    // round-robin order of hosts. The snapshot must not be empty.
+    const TBackendDescriptor& SelectBackend(int host_idx) const;
+
+    // Returns all backends.
+    void GetAllBackends(BackendList* backends) const;
+
+    bool empty() const { return hosts_.empty(); }
+    int64_t version() const { return version_; }
+    void set_version(int64_t version) { version_ = version; }
+
+   private:
+    int64_t version_;
+
+    BackendMap backend_map_;
+    BackendIpAddressMap backend_ip_map_;
+
+    // The backends on each host, in iteration order of backend_map_. Points into
+    // backend_map_.
+    std::vector<const std::vector<TBackendDescriptor>*> hosts_;
+
+    // Map from a host's IP address to its index in hosts_.
+    boost::unordered_map<std::string, int> host_idx_;
+
+    // Round-robin position among all hosts, for data locations without a local
+    // backend.
+    mutable AtomicInt<int64_t> next_nonlocal_host_;
+
+    // Round-robin position among the backends of each host in hosts_.
+    mutable std::vector<AtomicInt<int64_t> > next_backend_;
+  };
+
+  // Protects backend_config_. Only held to copy or swap the pointer.
+  boost::mutex backend_config_lock_;
+
+  // The current snapshot of the known backends. Never NULL.
+  boost::shared_ptr<const BackendConfig> backend_config_;
 
   // Map from unique backend id to TBackendDescriptor. Used to track the known backends
   // from the statestore. It's important to track both the backend ID as well as the
@@ -122,9 +184,6 @@ class SimpleScheduler : public Scheduler {
   // Webserver for /backends. Not owned by us.
   Webserver* webserver_;
 
-  // round robin entry in BackendMap for non-local host assignment
-  BackendMap::iterator next_nonlocal_backend_entry_;
-
   // Pointer to a subscription manager (which we do not own) which is used to register
   // for dynamic updates to the set of available backends. May be NULL if the set of
   // backends is fixed.
@@ -188,6 +247,9 @@ class SimpleScheduler : public Scheduler {
   void RemoveFromActiveResourceMaps(
       const TResourceBrokerReservationResponse& reservation);
 
+  // Returns the current snapshot of the known backends.
+  boost::shared_ptr<const BackendConfig> GetBackendConfig();
+
   // Called asynchronously when an update is received from the subscription manager
   void UpdateMembership(const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
       std::vector<TTopicDelta>* subscriber_topic_updates);
@@ -218,6 +280,48 @@ class SimpleScheduler : public Scheduler {
       const std::vector<TNetworkAddress>& host_list, bool exec_at_coord,
       const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment);
 
+  // A data host of a query (an entry of TQueryExecRequest.host_list), resolved once per
+  // query against a BackendConfig so that the assignment of the individual scan ranges
+  // needs no hostname lookups.
+  struct DataHost {
+    // True if a backend runs on the host, i.e. reads of its replicas are local.
+    bool is_local;
+
+    // Index of the host in the BackendConfig whose backends read the data of this host,
+    // or -1 if its reads are assigned round-robin to all backends.
+    int backend_host_idx;
+  };
+
+  // Resolves all hosts in 'host_list' against 'config'.
+  static void ResolveDataHosts(const BackendConfig& config,
+      const std::vector<TNetworkAddress>& host_list, std::vector<DataHost>* data_hosts);
+
+  // Same as above, but assigns the scan ranges to the backends in 'config', with the
+  // data hosts of 'host_list' resolved in 'data_hosts'.
+  Status ComputeScanRangeAssignment(const BackendConfig& config, PlanNodeId node_id,
+      const std::vector<TScanRangeLocations>& locations,
+      const std::vector<TNetworkAddress>& host_list,
+      const std::vector<DataHost>& data_hosts, bool exec_at_coord,
+      const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment);
+
+  // The scan range assignment of a single scan node, which is computed separately and
+  // merged into the fragment's assignment so that the scan nodes of a query can be
+  // assigned in parallel.
+  struct ScanNodeAssignment {
+    PlanNodeId node_id;
+    const std::vector<TScanRangeLocations>* locations;
+    bool exec_at_coord;
+    FragmentScanRangeAssignment assignment;
+    Status status;
+  };
+
+  // Computes the assignments of every 'stride'-th entry of 'nodes', starting at 'first'.
+  // Run by the threads of the parallel scan range assignment.
+  void ComputeScanNodeAssignments(const BackendConfig* config,
+      const std::vector<TNetworkAddress>* host_list,
+      const std::vector<DataHost>* data_hosts, const TQueryOptions* query_options,
+      std::vector<ScanNodeAssignment>* nodes, int first, int stride);
+
   // Populates fragment_exec_params_ in schedule.
   void ComputeFragmentExecParams(const TQueryExecRequest& exec_request,
       QuerySchedule* schedule);
@@ -14,9 +14,14 @@
 
 #include "testutil/in-process-servers.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 #include <gtest/gtest.h>
 #include "common/init.h"
 #include "util/metrics.h"
+#include "util/time.h"
+#include "statestore/statestore.h"
 #include "statestore/statestore-subscriber.h"
 
 using namespace boost;
@@ -25,6 +30,13 @@ using namespace impala;
 
 DECLARE_int32(webserver_port);
 DECLARE_int32(state_store_port);
+DECLARE_int32(statestore_update_frequency_ms);
+DECLARE_int64(statestore_max_topic_delta_cache_bytes);
+
+DEFINE_int32(scale_test_num_subscribers, 0, "If > 0, ScaleTest starts this many "
+    "in-process subscribers and reports the delays of the topic updates they receive.");
+DEFINE_int32(scale_test_duration_s, 20, "Duration of ScaleTest in seconds.");
+DEFINE_int32(scale_test_first_port, 30000, "First port used by ScaleTest's subscribers.");
 
 namespace impala {
 
@@ -53,6 +65,219 @@ TEST(StatestoreTest, SmokeTest) {
 
 }
 
+// Tests the cache of deltas of Statestore::Topic.
+class TopicDeltaCacheTest : public testing::Test {
+ protected:
+  typedef Statestore::Topic Topic;
+
+  TopicDeltaCacheTest()
+    : key_size_("key-size", TUnit::BYTES, 0L),
+      value_size_("value-size", TUnit::BYTES, 0L),
+      topic_size_("topic-size", TUnit::BYTES, 0L),
+      topic_("test-topic", &key_size_, &value_size_, &topic_size_) { }
+
+  virtual void SetUp() {
+    saved_max_cache_bytes_ = FLAGS_statestore_max_topic_delta_cache_bytes;
+  }
+
+  virtual void TearDown() {
+    FLAGS_statestore_max_topic_delta_cache_bytes = saved_max_cache_bytes_;
+  }
+
+  // Returns the delta from 'from_version' and checks whether it was a cache hit.
+  const TTopicDelta& GetDelta(int64_t from_version, bool expect_hit) {
+    bool cache_hit;
+    last_delta_ = topic_.GetDelta(from_version, &cache_hit);
+    EXPECT_EQ(cache_hit, expect_hit) << "from_version=" << from_version;
+    EXPECT_EQ(last_delta_->delta.topic_name, "test-topic");
+    EXPECT_EQ(last_delta_->delta.to_version,
+        static_cast<int64_t>(topic_.last_version()));
+    return last_delta_->delta;
+  }
+
+  IntGauge key_size_;
+  IntGauge value_size_;
+  IntGauge topic_size_;
+  Topic topic_;
+  boost::shared_ptr<const Topic::Delta> last_delta_;
+  int64_t saved_max_cache_bytes_;
+};
+
+TEST_F(TopicDeltaCacheTest, CacheHits) {
+  // Versions 1 to 4.
+  topic_.Put("a", "1");
+  topic_.Put("b", "2");
+  topic_.Put("c", "3");
+  topic_.Put("d", "4");
+
+  // Up to date subscribers share the empty delta.
+  EXPECT_TRUE(GetDelta(4, false).topic_entries.empty());
+  EXPECT_TRUE(GetDelta(4, true).topic_entries.empty());
+
+  const TTopicDelta& delta = GetDelta(2, false);
+  ASSERT_EQ(delta.topic_entries.size(), 2);
+  EXPECT_EQ(delta.topic_entries[0].key, "c");
+  EXPECT_EQ(delta.topic_entries[1].key, "d");
+  EXPECT_EQ(last_delta_->num_bytes, 4);
+  boost::shared_ptr<const Topic::Delta> first_delta = last_delta_;
+  GetDelta(2, true);
+  EXPECT_EQ(last_delta_, first_delta);
+
+  // The full topic is never cached.
+  EXPECT_EQ(GetDelta(0, false).topic_entries.size(), 4);
+  EXPECT_EQ(GetDelta(0, false).topic_entries.size(), 4);
+
+  // Any change to the topic clears the cache.
+  topic_.Put("a", "5");
+  const TTopicDelta& changed_delta = GetDelta(2, false);
+  ASSERT_EQ(changed_delta.topic_entries.size(), 3);
+  EXPECT_EQ(changed_delta.topic_entries[2].key, "a");
+  EXPECT_EQ(changed_delta.topic_entries[2].value, "5");
+  GetDelta(2, true);
+
+  topic_.DeleteIfVersionsMatch(topic_.last_version(), "a");
+  const TTopicDelta& deleted_delta = GetDelta(2, false);
+  EXPECT_EQ(deleted_delta.topic_entries.size(), 2);
+  ASSERT_EQ(deleted_delta.topic_deletions.size(), 1);
+  EXPECT_EQ(deleted_delta.topic_deletions[0], "a");
+}
+
+// Versions that are no longer in the update log, because their entries were updated
+// again, share the delta from the next version in the log.
+TEST_F(TopicDeltaCacheTest, VersionGaps) {
+  // Versions 1 to 3, then 'a' and 'b' are moved to versions 4 and 5. The update log
+  // contains versions 3, 4 and 5.
+  topic_.Put("a", "1");
+  topic_.Put("b", "2");
+  topic_.Put("c", "3");
+  topic_.Put("a", "4");
+  topic_.Put("b", "5");
+
+  // From versions 1 and 2, the delta contains 'c', 'a' and 'b', the same as from
+  // version 0. It includes the whole update log, so it is not cached.
+  EXPECT_EQ(GetDelta(1, false).topic_entries.size(), 3);
+  EXPECT_EQ(GetDelta(2, false).topic_entries.size(), 3);
+
+  // Versions 3 and 4 are in the log.
+  EXPECT_EQ(GetDelta(3, false).topic_entries.size(), 2);
+  EXPECT_EQ(GetDelta(3, true).topic_entries.size(), 2);
+  EXPECT_EQ(GetDelta(4, false).topic_entries.size(), 1);
+
+  // Version 6 is after the last update: a subscriber can't have processed it, but it
+  // gets the same empty delta as version 5.
+  EXPECT_TRUE(GetDelta(5, false).topic_entries.empty());
+  EXPECT_TRUE(GetDelta(6, true).topic_entries.empty());
+
+  // A gap in the middle of the log: 'a' moves from version 4 to 6, so the log contains
+  // versions 3, 5 and 6, and versions 3 and 4 have the same delta.
+  topic_.Put("a", "6");
+  const TTopicDelta& delta = GetDelta(3, false);
+  ASSERT_EQ(delta.topic_entries.size(), 2);
+  EXPECT_EQ(delta.topic_entries[0].key, "b");
+  EXPECT_EQ(delta.topic_entries[1].key, "a");
+  EXPECT_EQ(GetDelta(4, true).topic_entries.size(), 2);
+}
+
+TEST_F(TopicDeltaCacheTest, Eviction) {
+  // Versions 1 to 4, with keys and values of 10 bytes.
+  topic_.Put("key-000001", "value-0001");
+  topic_.Put("key-000002", "value-0002");
+  topic_.Put("key-000003", "value-0003");
+  topic_.Put("key-000004", "value-0004");
+
+  // Room for the deltas from versions 2 and 3.
+  FLAGS_statestore_max_topic_delta_cache_bytes = 60;
+  EXPECT_EQ(GetDelta(2, false).topic_entries.size(), 2);
+  EXPECT_EQ(last_delta_->num_bytes, 40);
+  EXPECT_EQ(GetDelta(3, false).topic_entries.size(), 1);
+  GetDelta(2, true);
+  GetDelta(3, true);
+
+  // Caching the delta from version 4 evicts the delta from the oldest version, 2.
+  FLAGS_statestore_max_topic_delta_cache_bytes = 40;
+  EXPECT_TRUE(GetDelta(4, false).topic_entries.empty());
+  GetDelta(3, true);
+  GetDelta(4, true);
+  GetDelta(2, false);
+
+  // Caching the delta from version 2 again evicts the delta from version 3, but not the
+  // empty delta.
+  GetDelta(2, true);
+  GetDelta(4, true);
+  GetDelta(3, false);
+
+  // Deltas larger than the limit are not cached.
+  FLAGS_statestore_max_topic_delta_cache_bytes = 10;
+  GetDelta(2, false);
+  GetDelta(2, false);
+  EXPECT_TRUE(GetDelta(4, true).topic_entries.empty());
+}
+
+// Records the times at which a subscriber received topic updates.
+class UpdateRecorder {
+ public:
+  void Update(const StatestoreSubscriber::TopicDeltaMap& deltas,
+      vector<TTopicDelta>* topic_updates) {
+    lock_guard<mutex> l(lock_);
+    update_times_ms_.push_back(UnixMillis());
+  }
+
+  // Appends the delays of the updates after the first one, i.e. by how much the time
+  // between two updates exceeded 'update_frequency_ms', to 'delays_ms'.
+  void GetDelays(int64_t update_frequency_ms, vector<int64_t>* delays_ms) {
+    lock_guard<mutex> l(lock_);
+    for (int i = 1; i < update_times_ms_.size(); ++i) {
+      int64_t interval_ms = update_times_ms_[i] - update_times_ms_[i - 1];
+      delays_ms->push_back(max<int64_t>(0, interval_ms - update_frequency_ms));
+    }
+  }
+
+ private:
+  mutex lock_;
+  vector<int64_t> update_times_ms_;
+};
+
+// Scale mode, enabled with --scale_test_num_subscribers: starts a statestore with many
+// subscribers of one topic, lets it run and prints percentiles of the topic update
+// delays the subscribers observed.
+TEST(StatestoreTest, ScaleTest) {
+  int num_subscribers = FLAGS_scale_test_num_subscribers;
+  if (num_subscribers <= 0) return;
+  FLAGS_statestore_update_frequency_ms = 200;
+
+  int statestore_port = FLAGS_state_store_port + 1;
+  InProcessStatestore* statestore =
+      new InProcessStatestore(statestore_port, FLAGS_webserver_port + 1);
+  ASSERT_TRUE(statestore->Start().ok());
+
+  vector<UpdateRecorder*> recorders;
+  for (int i = 0; i < num_subscribers; ++i) {
+    stringstream subscriber_id;
+    subscriber_id << "scale-test-subscriber-" << i;
+    StatestoreSubscriber* subscriber = new StatestoreSubscriber(subscriber_id.str(),
+        MakeNetworkAddress("localhost", FLAGS_scale_test_first_port + i),
+        MakeNetworkAddress("localhost", statestore_port), new MetricGroup(""));
+    recorders.push_back(new UpdateRecorder());
+    StatestoreSubscriber::UpdateCallback callback =
+        bind<void>(mem_fn(&UpdateRecorder::Update), recorders.back(), _1, _2);
+    ASSERT_TRUE(subscriber->AddTopic("scale-test-topic", false, callback).ok());
+    ASSERT_TRUE(subscriber->Start().ok());
+  }
+  SleepForMs(FLAGS_scale_test_duration_s * 1000L);
+
+  vector<int64_t> delays_ms;
+  for (int i = 0; i < recorders.size(); ++i) {
+    recorders[i]->GetDelays(FLAGS_statestore_update_frequency_ms, &delays_ms);
+  }
+  ASSERT_FALSE(delays_ms.empty());
+  sort(delays_ms.begin(), delays_ms.end());
+  cout << num_subscribers << " subscribers, " << delays_ms.size() << " topic updates, "
+       << "delay p50: " << delays_ms[delays_ms.size() * 50 / 100] << "ms "
+       << "p90: " << delays_ms[delays_ms.size() * 90 / 100] << "ms "
+       << "p99: " << delays_ms[delays_ms.size() * 99 / 100] << "ms "
+       << "max: " << delays_ms.back() << "ms" << endl;
+}
+
 }
 
 int main(int argc, char **argv) {
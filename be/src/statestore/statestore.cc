@@ -70,6 +70,12 @@ DEFINE_int32(statestore_update_tcp_timeout_seconds, 300, "(Advanced) The time af
     "badly hung machines that are not able to respond to the update RPC in short "
     "order.");
 
+DEFINE_int64(statestore_max_topic_delta_cache_bytes, 64L * 1024L * 1024L, "(Advanced) "
+    "Maximum total size in bytes of the keys and values of the topic deltas that are "
+    "cached per topic, so that subscribers at the same version share one delta. The "
+    "deltas from the oldest versions are evicted first. Deltas that include the whole "
+    "topic are never cached.");
+
 // Metric keys
 // TODO: Replace 'backend' with 'subscriber' when we can coordinate a change with CM
 const string STATESTORE_LIVE_SUBSCRIBERS = "statestore.live-backends";
@@ -79,6 +85,10 @@ const string STATESTORE_TOTAL_VALUE_SIZE_BYTES = "statestore.total-value-size-by
 const string STATESTORE_TOTAL_TOPIC_SIZE_BYTES = "statestore.total-topic-size-bytes";
 const string STATESTORE_UPDATE_DURATION = "statestore.topic-update-durations";
 const string STATESTORE_HEARTBEAT_DURATION = "statestore.heartbeat-durations";
+const string STATESTORE_UPDATE_PREPARE_DURATION =
+    "statestore.topic-update-prepare-durations";
+const string STATESTORE_UPDATE_SIZE_BYTES = "statestore.topic-update-size-bytes";
+const string STATESTORE_TOPIC_DELTA_CACHE_HITS = "statestore.topic-delta-cache-hits";
 
 const Statestore::TopicEntry::Value Statestore::TopicEntry::NULL_VALUE = "";
 
@@ -96,6 +106,9 @@ const int32_t STATESTORE_MAX_SUBSCRIBERS = 10000;
 // Updates or heartbeats that miss their deadline by this much are logged.
 const uint32_t DEADLINE_MISS_THRESHOLD_MS = 2000;
 
+// Maximum time the update dispatcher waits before checking the exit flag.
+const int64_t MAX_DISPATCHER_WAIT_MS = 100;
+
 typedef ClientConnection<StatestoreSubscriberClient> StatestoreSubscriberConnection;
 
 class StatestoreThriftIf : public StatestoreServiceIf {
@@ -143,6 +156,7 @@ Statestore::TopicEntry::Version Statestore::Topic::Put(const string& key,
 
   entry_it->second.SetValue(bytes, ++last_version_);
   topic_update_log_.insert(make_pair(entry_it->second.version(), key));
+  ClearDeltaCache();
 
   total_key_size_bytes_ += key_size_delta;
   total_value_size_bytes_ += value_size_delta;
@@ -169,9 +183,78 @@ void Statestore::Topic::DeleteIfVersionsMatch(TopicEntry::Version version,
     value_size_metric_->Increment(entry_it->second.value().size());
     topic_size_metric_->Increment(entry_it->second.value().size());
     entry_it->second.SetValue(Statestore::TopicEntry::NULL_VALUE, last_version_);
+    ClearDeltaCache();
   }
 }
 
+boost::shared_ptr<const Statestore::Topic::Delta> Statestore::Topic::GetDelta(
+    TopicEntry::Version from_version, bool* cache_hit) {
+  // All versions between two updates in the log have the same delta, so deltas are
+  // cached by the version of the first update they include.
+  TopicUpdateLog::const_iterator first_update =
+      topic_update_log_.upper_bound(from_version);
+  TopicEntry::Version cache_key = first_update == topic_update_log_.end() ?
+      last_version_ + 1 : first_update->first;
+  DeltaCache::const_iterator cached_delta = delta_cache_.find(cache_key);
+  if (cached_delta != delta_cache_.end()) {
+    *cache_hit = true;
+    return cached_delta->second;
+  }
+  *cache_hit = false;
+
+  boost::shared_ptr<Delta> delta(new Delta());
+  TTopicDelta& topic_delta = delta->delta;
+  topic_delta.topic_name = topic_id_;
+  delta->num_bytes = 0L;
+  TopicUpdateLog::const_iterator next_update = first_update;
+  for (; next_update != topic_update_log_.end(); ++next_update) {
+    TopicEntryMap::const_iterator itr = entries_.find(next_update->second);
+    DCHECK(itr != entries_.end());
+    const TopicEntry& topic_entry = itr->second;
+    if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
+      topic_delta.topic_deletions.push_back(itr->first);
+    } else {
+      topic_delta.topic_entries.push_back(TTopicItem());
+      TTopicItem& topic_item = topic_delta.topic_entries.back();
+      topic_item.key = itr->first;
+      topic_item.value = topic_entry.value();
+    }
+    delta->num_bytes += itr->first.size() + topic_entry.value().size();
+  }
+
+  if (topic_update_log_.size() > 0) {
+    // The largest version for this topic will be the last item in the version history
+    // map.
+    topic_delta.__set_to_version(topic_update_log_.rbegin()->first);
+  } else {
+    // There are no updates in the version history
+    topic_delta.__set_to_version(Subscriber::TOPIC_INITIAL_VERSION);
+  }
+
+  // A delta that includes the whole update log is a copy of the whole topic, and is only
+  // needed by new subscribers, so it is not worth caching.
+  if (first_update == topic_update_log_.begin() ||
+      delta->num_bytes > FLAGS_statestore_max_topic_delta_cache_bytes) {
+    return delta;
+  }
+  // Evict the deltas from the oldest versions first. They are the largest, and are
+  // needed only by subscribers that are lagging behind.
+  while (delta_cache_bytes_ + delta->num_bytes >
+      FLAGS_statestore_max_topic_delta_cache_bytes) {
+    DCHECK(!delta_cache_.empty());
+    delta_cache_bytes_ -= delta_cache_.begin()->second->num_bytes;
+    delta_cache_.erase(delta_cache_.begin());
+  }
+  delta_cache_[cache_key] = delta;
+  delta_cache_bytes_ += delta->num_bytes;
+  return delta;
+}
+
+void Statestore::Topic::ClearDeltaCache() {
+  delta_cache_.clear();
+  delta_cache_bytes_ = 0L;
+}
+
 Statestore::Subscriber::Subscriber(const SubscriberId& subscriber_id,
     const TUniqueId& registration_id, const TNetworkAddress& network_address,
     const vector<TTopicRegistration>& subscribed_topics)
@@ -245,9 +328,18 @@ Statestore::Statestore(MetricGroup* metrics)
       new StatsMetric<double>(STATESTORE_UPDATE_DURATION, TUnit::TIME_S));
   heartbeat_duration_metric_ = metrics->RegisterMetric(
       new StatsMetric<double>(STATESTORE_HEARTBEAT_DURATION, TUnit::TIME_S));
+  topic_update_prepare_duration_metric_ = metrics->RegisterMetric(
+      new StatsMetric<double>(STATESTORE_UPDATE_PREPARE_DURATION, TUnit::TIME_S));
+  topic_update_size_metric_ = metrics->RegisterMetric(
+      new StatsMetric<double>(STATESTORE_UPDATE_SIZE_BYTES, TUnit::BYTES));
+  topic_delta_cache_hits_metric_ =
+      metrics->AddCounter(STATESTORE_TOPIC_DELTA_CACHE_HITS, 0L);
 
   update_state_client_cache_->InitMetrics(metrics, "subscriber-update-state");
   heartbeat_client_cache_->InitMetrics(metrics, "subscriber-heartbeat");
+
+  update_dispatcher_thread_.reset(new Thread("statestore", "update-dispatcher",
+      &Statestore::DispatchUpdates, this));
 }
 
 void Statestore::RegisterWebpages(Webserver* webserver) {
@@ -333,20 +425,82 @@ void Statestore::SubscribersHandler(const Webserver::ArgumentMap& args,
 }
 
 Status Statestore::OfferUpdate(const ScheduledSubscriberUpdate& update,
-    ThreadPool<ScheduledSubscriberUpdate>* threadpool) {
-  if (threadpool->GetQueueSize() >= STATESTORE_MAX_SUBSCRIBERS
-      || !threadpool->Offer(update)) {
-    stringstream ss;
-    ss << "Maximum subscriber limit reached: " << STATESTORE_MAX_SUBSCRIBERS;
-    lock_guard<mutex> l(subscribers_lock_);
-    SubscriberMap::iterator subscriber_it = subscribers_.find(update.second);
-    DCHECK(subscriber_it != subscribers_.end());
-    subscribers_.erase(subscriber_it);
-    LOG(ERROR) << ss.str();
-    return Status(ss.str());
+    bool is_heartbeat) {
+  {
+    lock_guard<mutex> l(pending_updates_lock_);
+    // There is at most one pending message of each kind per subscriber.
+    if (pending_updates_.size() < 2 * STATESTORE_MAX_SUBSCRIBERS) {
+      bool is_earliest = pending_updates_.empty() ||
+          update.first < pending_updates_.top().update.first;
+      PendingUpdate pending_update;
+      pending_update.update = update;
+      pending_update.is_heartbeat = is_heartbeat;
+      pending_updates_.push(pending_update);
+      if (is_earliest) pending_updates_cv_.notify_one();
+      return Status::OK;
+    }
   }
 
-  return Status::OK;
+  stringstream ss;
+  ss << "Maximum subscriber limit reached: " << STATESTORE_MAX_SUBSCRIBERS;
+  lock_guard<mutex> l(subscribers_lock_);
+  SubscriberMap::iterator subscriber_it = subscribers_.find(update.second);
+  DCHECK(subscriber_it != subscribers_.end());
+  subscribers_.erase(subscriber_it);
+  LOG(ERROR) << ss.str();
+  return Status(ss.str());
+}
+
+void Statestore::DispatchUpdates() {
+  while (!ShouldExit()) {
+    vector<PendingUpdate> due_updates;
+    {
+      unique_lock<mutex> l(pending_updates_lock_);
+      int64_t now = UnixMillis();
+      if (pending_updates_.empty() || pending_updates_.top().update.first > now) {
+        // Wait for the earliest message to become due, or for an earlier one to be
+        // offered.
+        int64_t wait_ms = MAX_DISPATCHER_WAIT_MS;
+        if (!pending_updates_.empty()) {
+          wait_ms = min(wait_ms, pending_updates_.top().update.first - now);
+        }
+        pending_updates_cv_.timed_wait(l, posix_time::milliseconds(wait_ms));
+        continue;
+      }
+      while (!pending_updates_.empty() && pending_updates_.top().update.first <= now) {
+        due_updates.push_back(pending_updates_.top());
+        pending_updates_.pop();
+      }
+    }
+
+    // Hand out all due heartbeats before any topic update.
+    BOOST_FOREACH(const PendingUpdate& pending_update, due_updates) {
+      if (!pending_update.is_heartbeat) continue;
+      subscriber_heartbeat_threadpool_.Offer(pending_update.update);
+    }
+    BOOST_FOREACH(const PendingUpdate& pending_update, due_updates) {
+      if (pending_update.is_heartbeat) continue;
+      FailureDetector::PeerState state;
+      {
+        lock_guard<mutex> l(subscribers_lock_);
+        SubscriberMap::iterator it = subscribers_.find(pending_update.update.second);
+        // The subscriber was unregistered, drop the message.
+        if (it == subscribers_.end()) continue;
+        state = failure_detector_->GetPeerState(PrintId(it->second->registration_id()));
+      }
+      if (state != FailureDetector::SUSPECTED && state != FailureDetector::FAILED) {
+        subscriber_topic_update_threadpool_.Offer(pending_update.update);
+      } else {
+        // The subscriber is missing heartbeats, so the update RPC would likely hold a
+        // worker until it times out. Try again after the next update interval, by which
+        // time the subscriber has either recovered or failed.
+        VLOG(3) << "Postponing topic update for suspected subscriber: "
+                << pending_update.update.second;
+        OfferUpdate(make_pair(UnixMillis() + FLAGS_statestore_update_frequency_ms,
+            pending_update.update.second), false);
+      }
+    }
+  }
 }
 
 Status Statestore::RegisterSubscriber(const SubscriberId& subscriber_id,
@@ -386,10 +540,10 @@ Status Statestore::RegisterSubscriber(const SubscriberId& subscriber_id,
     subscriber_set_metric_->Add(subscriber_id);
   }
 
-  // Add the subscriber to the update queue, with an immediate schedule.
+  // Schedule the first heartbeat and topic update immediately.
   ScheduledSubscriberUpdate update = make_pair(0L, subscriber_id);
-  RETURN_IF_ERROR(OfferUpdate(update, &subscriber_topic_update_threadpool_));
-  RETURN_IF_ERROR(OfferUpdate(update, &subscriber_heartbeat_threadpool_));
+  RETURN_IF_ERROR(OfferUpdate(update, true));
+  RETURN_IF_ERROR(OfferUpdate(update, false));
 
   LOG(INFO) << "Subscriber '" << subscriber_id << "' registered (registration id: "
             << PrintId(*registration_id) << ")";
@@ -483,65 +637,56 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
 
 void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
     TUpdateStateRequest* update_state_request) {
+  MonotonicStopWatch sw;
+  sw.Start();
+
+  // The delta of each subscribed topic, with the version it starts from.
+  typedef pair<TopicEntry::Version, boost::shared_ptr<const Topic::Delta> >
+      VersionedDelta;
+  vector<VersionedDelta> deltas;
   {
     lock_guard<mutex> l(topic_lock_);
     BOOST_FOREACH(const Subscriber::Topics::value_type& subscribed_topic,
         subscriber.subscribed_topics()) {
-      TopicMap::const_iterator topic_it = topics_.find(subscribed_topic.first);
+      TopicMap::iterator topic_it = topics_.find(subscribed_topic.first);
       DCHECK(topic_it != topics_.end());
 
       TopicEntry::Version last_processed_version =
           subscriber.LastTopicVersionProcessed(topic_it->first);
-      const Topic& topic = topic_it->second;
-
-      TTopicDelta& topic_delta =
-          update_state_request->topic_deltas[subscribed_topic.first];
-      topic_delta.topic_name = subscribed_topic.first;
+      Topic& topic = topic_it->second;
 
-      // If the subscriber version is > 0, send this update as a delta. Otherwise, this is
-      // a new subscriber so send them a non-delta update that includes all items in the
-      // topic.
-      topic_delta.is_delta = last_processed_version > Subscriber::TOPIC_INITIAL_VERSION;
-      topic_delta.__set_from_version(last_processed_version);
-
-      if (!topic_delta.is_delta &&
+      if (last_processed_version == Subscriber::TOPIC_INITIAL_VERSION &&
           topic.last_version() > Subscriber::TOPIC_INITIAL_VERSION) {
         int64_t topic_size =
             topic.total_key_size_bytes() + topic.total_value_size_bytes();
-        VLOG_QUERY << "Preparing initial " << topic_delta.topic_name
+        VLOG_QUERY << "Preparing initial " << topic.id()
                    << " topic update for " << subscriber.id() << ". Size = "
                    << PrettyPrinter::Print(topic_size, TUnit::BYTES);
       }
 
-      TopicUpdateLog::const_iterator next_update =
-          topic.topic_update_log().upper_bound(last_processed_version);
-
-      for (; next_update != topic.topic_update_log().end(); ++next_update) {
-        TopicEntryMap::const_iterator itr = topic.entries().find(next_update->second);
-        DCHECK(itr != topic.entries().end());
-        const TopicEntry& topic_entry = itr->second;
-        if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
-          topic_delta.topic_deletions.push_back(itr->first);
-        } else {
-          topic_delta.topic_entries.push_back(TTopicItem());
-          TTopicItem& topic_item = topic_delta.topic_entries.back();
-          topic_item.key = itr->first;
-          // TODO: Does this do a needless copy?
-          topic_item.value = topic_entry.value();
-        }
-      }
-
-      if (topic.topic_update_log().size() > 0) {
-        // The largest version for this topic will be the last item in the version history
-        // map.
-        topic_delta.__set_to_version(topic.topic_update_log().rbegin()->first);
-      } else {
-        // There are no updates in the version history
-        topic_delta.__set_to_version(Subscriber::TOPIC_INITIAL_VERSION);
-      }
+      bool cache_hit;
+      deltas.push_back(make_pair(last_processed_version,
+          topic.GetDelta(last_processed_version, &cache_hit)));
+      if (cache_hit) topic_delta_cache_hits_metric_->Increment(1L);
     }
   }
 
+  // The deltas may be shared with other subscribers, so they are copied into the request
+  // after releasing topic_lock_.
+  int64_t update_size = 0L;
+  BOOST_FOREACH(const VersionedDelta& delta, deltas) {
+    TTopicDelta& topic_delta =
+        update_state_request->topic_deltas[delta.second->delta.topic_name];
+    topic_delta = delta.second->delta;
+    // If the subscriber version is > 0, send this update as a delta. Otherwise, this is
+    // a new subscriber so send them a non-delta update that includes all items in the
+    // topic.
+    topic_delta.is_delta = delta.first > Subscriber::TOPIC_INITIAL_VERSION;
+    topic_delta.__set_from_version(delta.first);
+    update_size += delta.second->num_bytes;
+  }
+  topic_update_size_metric_->Update(update_size);
+
   // Fill in the min subscriber topic version. This must be done after releasing
   // topic_lock_.
   lock_guard<mutex> l(subscribers_lock_);
@@ -551,6 +696,8 @@ void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
     topic_delta.second.__set_min_subscriber_topic_version(
         GetMinSubscriberTopicVersion(topic_delta.first));
   }
+  topic_update_prepare_duration_metric_->Update(
+      sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
 }
 
 const Statestore::TopicEntry::Version Statestore::GetMinSubscriberTopicVersion(
@@ -581,6 +728,7 @@ bool Statestore::ShouldExit() {
 void Statestore::SetExitFlag() {
   lock_guard<mutex> l(exit_flag_lock_);
   exit_flag_ = true;
+  pending_updates_cv_.notify_all();
   subscriber_topic_update_threadpool_.Shutdown();
 }
 
@@ -608,13 +756,9 @@ void Statestore::DoSubscriberUpdate(bool is_heartbeat, int thread_id,
   int64_t update_deadline = update.first;
   const string hb_type = is_heartbeat ? "heartbeat" : "topic update";
   if (update_deadline != 0L) {
-    // Wait until deadline.
-    int64_t diff_ms = update_deadline - UnixMillis();
-    while (diff_ms > 0) {
-      SleepForMs(diff_ms);
-      diff_ms = update_deadline - UnixMillis();
-    }
-    diff_ms = abs(diff_ms);
+    // The dispatcher only hands out messages that are due.
+    int64_t diff_ms = UnixMillis() - update_deadline;
+    DCHECK_GE(diff_ms, 0);
     VLOG(3) << "Sending " << hb_type << " message to: " << update.second
             << " (deadline accuracy: " << diff_ms << "ms)";
 
@@ -705,8 +849,7 @@ void Statestore::DoSubscriberUpdate(bool is_heartbeat, int thread_id,
       // Schedule the next message.
       VLOG(3) << "Next " << (is_heartbeat ? "heartbeat" : "update") << " deadline for: "
               << subscriber->id() << " is in " << deadline_ms << "ms";
-      OfferUpdate(make_pair(deadline_ms, subscriber->id()), is_heartbeat ?
-          &subscriber_heartbeat_threadpool_ : &subscriber_topic_update_threadpool_);
+      OfferUpdate(make_pair(deadline_ms, subscriber->id()), is_heartbeat);
     }
   }
 }
@@ -19,6 +19,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <queue>
 #include <boost/unordered_map.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread/condition_variable.hpp>
@@ -30,6 +31,7 @@
 #include "util/metrics.h"
 #include "util/collection-metrics.h"
 #include "rpc/thrift-client.h"
+#include "util/thread.h"
 #include "util/thread-pool.h"
 #include "util/webserver.h"
 #include "runtime/client-cache.h"
@@ -121,6 +123,8 @@ class Statestore {
   void SetExitFlag();
 
  private:
+  friend class TopicDeltaCacheTest;
+
   // A TopicEntry is a single entry in a topic, and logically is a <string, byte string>
   // pair. If the byte string is NULL, the entry has been deleted, but may be retained to
   // track changes to send to subscribers.
@@ -181,7 +185,26 @@ class Statestore {
         IntGauge* value_size_metric, IntGauge* topic_size_metric)
         : topic_id_(topic_id), last_version_(0L), total_key_size_bytes_(0L),
           total_value_size_bytes_(0L), key_size_metric_(key_size_metric),
-          value_size_metric_(value_size_metric), topic_size_metric_(topic_size_metric) { }
+          value_size_metric_(value_size_metric), topic_size_metric_(topic_size_metric),
+          delta_cache_bytes_(0L) { }
+
+    // The entries of this topic that were updated or deleted after some version, as
+    // sent to subscribers. Only the topic name, entries, deletions and to_version of
+    // 'delta' are set. 'num_bytes' is the total size of the keys and values in 'delta'.
+    struct Delta {
+      TTopicDelta delta;
+      int64_t num_bytes;
+    };
+
+    // Returns the delta from 'from_version' to last_version(). Deltas are cached until
+    // the topic changes, so a delta is built only once for all subscribers that have
+    // processed the same version, e.g. all subscribers that are up to date after a
+    // round of updates. The full topic sent to new subscribers is not cached. Sets
+    // *cache_hit to true if the delta was cached.
+    //
+    // Must be called holding the topic lock
+    boost::shared_ptr<const Delta> GetDelta(TopicEntry::Version from_version,
+        bool* cache_hit);
 
     // Adds an entry with the given key. If bytes == NULL_VALUE, the entry is considered
     // deleted, and may be garbage collected in the future. The entry is assigned a new
@@ -239,6 +262,21 @@ class Statestore {
     IntGauge* key_size_metric_;
     IntGauge* value_size_metric_;
     IntGauge* topic_size_metric_;
+
+    // Deltas to last_version_ by the version of the first update they include, or
+    // last_version_ + 1 for the empty delta. Cleared whenever the topic changes. Deltas
+    // are held in shared_ptrs so that they can be copied into update requests after the
+    // topic lock is released.
+    typedef std::map<TopicEntry::Version, boost::shared_ptr<const Delta> > DeltaCache;
+    DeltaCache delta_cache_;
+
+    // Sum of num_bytes of the deltas in delta_cache_. Bounded by
+    // --statestore_max_topic_delta_cache_bytes; the deltas with the smallest keys are
+    // evicted first.
+    int64_t delta_cache_bytes_;
+
+    // Removes all cached deltas. Must be called whenever an entry changes.
+    void ClearDeltaCache();
   };
 
   // Note on locking: Subscribers and Topics should be accessed under their own coarse
@@ -367,25 +405,26 @@ class Statestore {
   // state, and the other pool sends 'topic update' messages which contain the
   // actual topic data that a subscriber does not yet have.
   //
-  // Each message is scheduled for some time in the future and each worker thread
-  // will sleep until that time has passed to rate-limit messages. Subscribers are
-  // placed back into the queue once they have been processed. A subscriber may have many
-  // entries in a queue, but no more than one for each registration associated with that
-  // subscriber. Since at most one registration is considered 'live' per subscriber, this
-  // guarantees that subscribers_.size() - 1 'live' subscribers ahead of any subscriber in
-  // the queue.
-  //
-  // Messages may be delayed for any number of reasons, including scheduler
-  // interference, lock unfairness when submitting to the thread pool and head-of-line
-  // blocking when threads are occupied sending messages to slow subscribers
-  // (subscribers are not guaranteed to be in the queue in next-update order).
+  // Messages are scheduled for some time in the future in pending_updates_. A single
+  // dispatcher thread (see DispatchUpdates()) hands each message to its pool once it is
+  // due, in deadline order, so worker threads never wait for a deadline and a message
+  // that is due is never queued behind one that is not. Each subscriber has at most one
+  // message of each kind pending or in flight, because the next message is only
+  // scheduled once the previous one completed. A slow or hung subscriber therefore
+  // holds at most one worker of each pool. Heartbeats have their own pool and are
+  // dispatched before topic updates that are due at the same time, so that slow topic
+  // updates do not cause subscribers to be considered failed. Topic updates for
+  // subscribers that are missing heartbeats are postponed rather than sent, since they
+  // are likely to hold a worker until the RPC times out.
   //
-  // Delays for heartbeat messages can result in the subscriber that is kept waiting
-  // assuming that the statestore has failed. Correct configuration of heartbeat message
-  // frequency and subscriber timeout is therefore very important, and depends upon the
-  // cluster size. See --statestore_heartbeat_frequency_ms and
-  // --statestore_subscriber_timeout_seconds. We expect that the provided defaults will
-  // work up to clusters of several hundred nodes.
+  // Messages may still be delayed if all workers of a pool are busy, e.g. sending
+  // topic updates to slow subscribers. Delays for heartbeat messages can result in the
+  // subscriber that is kept waiting assuming that the statestore has failed. Correct
+  // configuration of heartbeat message frequency and subscriber timeout is therefore
+  // very important, and depends upon the cluster size. See
+  // --statestore_heartbeat_frequency_ms and --statestore_subscriber_timeout_seconds. We
+  // expect that the provided defaults will work up to clusters of several hundred
+  // nodes.
   //
   // Subscribers are therefore not processed in lock-step, and one subscriber may have
   // seen many more messages than another during the same interval (if the second
@@ -394,6 +433,30 @@ class Statestore {
 
   ThreadPool<ScheduledSubscriberUpdate> subscriber_heartbeat_threadpool_;
 
+  // A message that is scheduled but not yet handed to a worker pool.
+  struct PendingUpdate {
+    ScheduledSubscriberUpdate update;
+    bool is_heartbeat;
+
+    // Orders messages by deadline, and heartbeats before topic updates with the same
+    // deadline. Since std::priority_queue returns the largest element first, the message
+    // that should be sent first is the largest.
+    bool operator<(const PendingUpdate& other) const {
+      if (update.first != other.update.first) return update.first > other.update.first;
+      return !is_heartbeat && other.is_heartbeat;
+    }
+  };
+
+  // Messages that are not due yet, with the earliest one at the top. Protected by
+  // pending_updates_lock_. pending_updates_cv_ is signalled when a message is added
+  // that is due before all others, and on exit.
+  std::priority_queue<PendingUpdate> pending_updates_;
+  boost::mutex pending_updates_lock_;
+  boost::condition_variable pending_updates_cv_;
+
+  // Runs DispatchUpdates().
+  boost::scoped_ptr<Thread> update_dispatcher_thread_;
+
   // Cache of subscriber clients used for UpdateState() RPCs. Only one client per
   // subscriber should be used, but the cache helps with the client lifecycle on failure.
   boost::scoped_ptr<ClientCache<StatestoreSubscriberClient> > update_state_client_cache_;
@@ -429,15 +492,29 @@ class Statestore {
   // Same as above, but for SendHeartbeat() RPCs.
   StatsMetric<double>* heartbeat_duration_metric_;
 
-  // Utility method to add an update to the given thread pool, and to fail if the thread
-  // pool is already at capacity.
-  Status OfferUpdate(const ScheduledSubscriberUpdate& update,
-      ThreadPool<ScheduledSubscriberUpdate>* thread_pool);
-
-  // Sends either a heartbeat or topic update message to the subscriber in 'update' at the
-  // closest possible time to the first member of 'update'.  If is_heartbeat is true,
-  // sends a heartbeat update, otherwise the set of pending topic updates is sent. Once
-  // complete, the next update is scheduled and added to the appropriate queue.
+  // Tracks the distribution of the time spent in GatherTopicUpdates() preparing the
+  // topic deltas of an update, and of the total size of the keys and values sent in
+  // each update.
+  StatsMetric<double>* topic_update_prepare_duration_metric_;
+  StatsMetric<double>* topic_update_size_metric_;
+
+  // Number of topic deltas that were sent to a subscriber without building them, because
+  // the same delta had been built for another subscriber.
+  IntCounter* topic_delta_cache_hits_metric_;
+
+  // Utility method to schedule a heartbeat or topic update message, and to fail if there
+  // are already too many scheduled messages.
+  Status OfferUpdate(const ScheduledSubscriberUpdate& update, bool is_heartbeat);
+
+  // Main loop of update_dispatcher_thread_. Waits for the earliest message in
+  // pending_updates_ to become due and hands all due messages to their thread pool,
+  // heartbeats first. Returns once the exit flag is set.
+  void DispatchUpdates();
+
+  // Sends either a heartbeat or topic update message to the subscriber in 'update'.
+  // Called by the worker pools once the message is due. If is_heartbeat is true, sends a
+  // heartbeat update, otherwise the set of pending topic updates is sent. Once
+  // complete, the next update is scheduled.
   void DoSubscriberUpdate(bool is_heartbeat, int thread_id,
       const ScheduledSubscriberUpdate& update);
 
@@ -461,9 +538,9 @@ class Statestore {
   // the subscriber map. Callers must hold subscribers_lock_ prior to calling this method.
   void UnregisterSubscriber(Subscriber* subscriber);
 
-  // Populates a TUpdateStateRequest with the update state for this subscriber. Iterates
-  // over all updates in all subscribed topics, populating the given TUpdateStateRequest
-  // object. Takes the topic_lock_ and subscribers_lock_.
+  // Populates a TUpdateStateRequest with the update state for this subscriber, using
+  // the delta of each subscribed topic from the last version the subscriber processed
+  // (see Topic::GetDelta()). Takes the topic_lock_ and subscribers_lock_.
   void GatherTopicUpdates(const Subscriber& subscriber,
       TUpdateStateRequest* update_state_request);
 
@@ -115,6 +115,10 @@ class BitReader {
   template<typename T>
   bool GetAligned(int num_bytes, T* v);
 
+  // Advances the stream by 'num_bits' bits without reading them. Returns false if there
+  // are not enough bits left, in which case the stream is unchanged.
+  bool SkipBits(int64_t num_bits);
+
   // Reads a vlq encoded int from the stream.  The encoded int must start at the
   // beginning of a byte. Return false if there were not enough bytes in the buffer.
   bool GetVlqInt(int32_t* v);
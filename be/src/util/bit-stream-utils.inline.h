@@ -133,6 +133,23 @@ inline bool BitReader::GetAligned(int num_bytes, T* v) {
   return true;
 }
 
+inline bool BitReader::SkipBits(int64_t num_bits) {
+  DCHECK_GE(num_bits, 0);
+  int64_t bit_pos = byte_offset_ * 8L + bit_offset_ + num_bits;
+  if (UNLIKELY(bit_pos > max_bytes_ * 8L)) return false;
+
+  // Move buffered_values_ to the byte that contains the new position.
+  byte_offset_ = bit_pos / 8;
+  bit_offset_ = bit_pos % 8;
+  int bytes_remaining = max_bytes_ - byte_offset_;
+  if (LIKELY(bytes_remaining >= 8)) {
+    memcpy(&buffered_values_, buffer_ + byte_offset_, 8);
+  } else {
+    memcpy(&buffered_values_, buffer_ + byte_offset_, bytes_remaining);
+  }
+  return true;
+}
+
 inline bool BitReader::GetVlqInt(int32_t* v) {
   *v = 0;
   int shift = 0;
@@ -0,0 +1,163 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/compressed-file-index.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <gutil/strings/substitute.h>
+
+#include "common/atomic.h"
+#include "common/logging.h"
+#include "util/error-util.h"
+
+using namespace std;
+using namespace strings;
+
+namespace impala {
+
+// The index is a local file, so values are written in native byte order.
+template <typename T>
+static bool WriteValue(FILE* file, const T& val) {
+  return fwrite(&val, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+static bool ReadValue(FILE* file, T* val) {
+  return fread(val, sizeof(T), 1, file) == 1;
+}
+
+// Used to make the names of temporary files unique within the process.
+static AtomicInt<int> num_temp_files;
+
+CompressedFileIndex::CompressedFileIndex(THdfsCompression::type compression,
+    int64_t file_length)
+  : compression_(compression),
+    file_length_(file_length) {
+}
+
+void CompressedFileIndex::AddAccessPoint(int64_t compressed_offset,
+    int64_t uncompressed_offset, int bits, const uint8_t* window, int window_len) {
+  DCHECK(access_points_.empty() ||
+      access_points_.back().compressed_offset < compressed_offset);
+  DCHECK_LE(compressed_offset, file_length_);
+  DCHECK_GE(bits, 0);
+  DCHECK_LT(bits, 8);
+  DCHECK_LE(window_len, GZIP_WINDOW_SIZE);
+  access_points_.push_back(AccessPoint());
+  AccessPoint& point = access_points_.back();
+  point.compressed_offset = compressed_offset;
+  point.uncompressed_offset = uncompressed_offset;
+  point.bits = bits;
+  if (window_len > 0) {
+    point.window.assign(reinterpret_cast<const char*>(window), window_len);
+  }
+}
+
+int CompressedFileIndex::Find(int64_t offset) const {
+  int lo = 0;
+  int hi = access_points_.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (access_points_[mid].read_offset() < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < access_points_.size() && access_points_[lo].read_offset() == offset) return lo;
+  return -1;
+}
+
+Status CompressedFileIndex::Save(const string& path) const {
+  // The temporary file is in the same directory, so the rename is atomic. Its name ends
+  // with the name of the index file, so it is treated like the index file by anyone
+  // listing the directory.
+  size_t dir_end = path.find_last_of('/');
+  string dir = dir_end == string::npos ? "" : path.substr(0, dir_end + 1);
+  string temp_path = Substitute("$0.tmp-$1-$2-$3", dir, getpid(),
+      num_temp_files.UpdateAndFetch(1), path.substr(dir.size()));
+
+  FILE* file = fopen(temp_path.c_str(), "w");
+  if (file == NULL) {
+    return Status(Substitute("Could not create index file $0: $1", temp_path,
+        GetStrErrMsg()));
+  }
+  bool ok = WriteValue(file, MAGIC) && WriteValue<int32_t>(file, compression_) &&
+      WriteValue(file, file_length_) &&
+      WriteValue<int32_t>(file, access_points_.size());
+  for (int i = 0; ok && i < access_points_.size(); ++i) {
+    const AccessPoint& point = access_points_[i];
+    ok = WriteValue(file, point.compressed_offset) &&
+        WriteValue(file, point.uncompressed_offset) &&
+        WriteValue<int32_t>(file, point.bits) &&
+        WriteValue<int32_t>(file, point.window.size()) &&
+        (point.window.empty() ||
+         fwrite(point.window.data(), point.window.size(), 1, file) == 1);
+  }
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    string error = GetStrErrMsg();
+    unlink(temp_path.c_str());
+    return Status(Substitute("Could not write index file $0: $1", path, error));
+  }
+  return Status::OK;
+}
+
+Status CompressedFileIndex::Load(const string& path) {
+  access_points_.clear();
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == NULL) {
+    return Status(Substitute("Could not open index file $0: $1", path, GetStrErrMsg()));
+  }
+
+  uint32_t magic;
+  int32_t compression;
+  int64_t file_length;
+  int32_t num_access_points;
+  bool ok = ReadValue(file, &magic) && magic == MAGIC &&
+      ReadValue(file, &compression) && compression == compression_ &&
+      ReadValue(file, &file_length) && file_length == file_length_ &&
+      ReadValue(file, &num_access_points) && num_access_points >= 0;
+  vector<char> window(GZIP_WINDOW_SIZE);
+  for (int i = 0; ok && i < num_access_points; ++i) {
+    int64_t compressed_offset;
+    int64_t uncompressed_offset;
+    int32_t bits;
+    int32_t window_len;
+    ok = ReadValue(file, &compressed_offset) && ReadValue(file, &uncompressed_offset) &&
+        ReadValue(file, &bits) && ReadValue(file, &window_len) &&
+        bits >= 0 && bits < 8 && window_len >= 0 && window_len <= GZIP_WINDOW_SIZE &&
+        compressed_offset > 0 && compressed_offset <= file_length_ &&
+        (access_points_.empty() ||
+         (access_points_.back().compressed_offset < compressed_offset &&
+          access_points_.back().uncompressed_offset < uncompressed_offset)) &&
+        (window_len == 0 || fread(&window[0], window_len, 1, file) == 1);
+    if (ok) {
+      AddAccessPoint(compressed_offset, uncompressed_offset, bits,
+          reinterpret_cast<const uint8_t*>(&window[0]), window_len);
+    }
+  }
+  // The index must end after the last access point.
+  ok = ok && fgetc(file) == EOF;
+  fclose(file);
+  if (!ok) {
+    access_points_.clear();
+    return Status(Substitute("Index file $0 is corrupt or does not belong to a $1 "
+        "compressed file of $2 bytes.", path, compression_, file_length_));
+  }
+  return Status::OK;
+}
+
+}
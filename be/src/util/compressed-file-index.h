@@ -0,0 +1,99 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_COMPRESSED_FILE_INDEX_H
+#define IMPALA_UTIL_COMPRESSED_FILE_INDEX_H
+
+#include <string>
+#include <vector>
+
+#include "common/status.h"
+#include "gen-cpp/Descriptors_types.h"
+
+namespace impala {
+
+// Index of the access points of a compressed file, i.e. the points at which
+// decompression can start without decompressing the data before them. Finding them
+// needs a sequential pass over the whole file, so the index is built while a file is
+// decompressed and saved for later scans, which can then decompress the parts of the
+// file between the access points in parallel (see HdfsTextScanner).
+//
+// For block-framed codecs (Hadoop's block compression framing of snappy and lz4) an
+// access point is the start of an outer block. For gzip it is the start of a deflate
+// block. Deflate blocks are not byte aligned and reference up to 32KB of the data
+// decompressed before them, so gzip access points also store the number of bits of the
+// previous byte that belong to the block and the preceding decompressed data (the
+// window).
+class CompressedFileIndex {
+ public:
+  // Maximum size of the deflate window.
+  static const int GZIP_WINDOW_SIZE = 32 * 1024;
+
+  struct AccessPoint {
+    // Offset of the first byte in the compressed file that is entirely part of the
+    // block.
+    int64_t compressed_offset;
+
+    // Offset of the first byte of the block in the decompressed data.
+    int64_t uncompressed_offset;
+
+    // Gzip only: number of bits of the byte before compressed_offset that belong to the
+    // block.
+    int bits;
+
+    // Gzip only: up to GZIP_WINDOW_SIZE bytes of decompressed data before the block.
+    std::string window;
+
+    // Returns the offset in the file at which reading must start to decompress from
+    // this access point.
+    int64_t read_offset() const { return compressed_offset - (bits == 0 ? 0 : 1); }
+  };
+
+  // Creates an empty index of a 'compression'-compressed file of 'file_length' bytes.
+  CompressedFileIndex(THdfsCompression::type compression, int64_t file_length);
+
+  // Appends an access point. Access points must be added in increasing order.
+  void AddAccessPoint(int64_t compressed_offset, int64_t uncompressed_offset,
+      int bits = 0, const uint8_t* window = NULL, int window_len = 0);
+
+  // Returns the index of the access point whose read_offset() is 'offset', or -1 if
+  // there is none.
+  int Find(int64_t offset) const;
+
+  // Writes the index to the local file 'path'. The index is written to a temporary file
+  // that is then renamed, so concurrent readers never see a partially written index.
+  Status Save(const std::string& path) const;
+
+  // Reads the access points from the local file 'path', replacing the current ones.
+  // Returns an error if the file cannot be read, is corrupt or is not an index of a
+  // file with this index' compression and length.
+  Status Load(const std::string& path);
+
+  THdfsCompression::type compression() const { return compression_; }
+  int64_t file_length() const { return file_length_; }
+  const std::vector<AccessPoint>& access_points() const { return access_points_; }
+
+ private:
+  // Identifies index files. Needs to change when the file format changes.
+  static const uint32_t MAGIC = 0x31494643; // "CFI1"
+
+  THdfsCompression::type compression_;
+  int64_t file_length_;
+  std::vector<AccessPoint> access_points_;
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "util/cpu-info.h"
+
+using namespace std;
+
+namespace impala {
+
+// Returns the ids in 'list', parsed by CpuInfo::ParseCpuList().
+static vector<int> ParseCpuList(const string& list) {
+  vector<int> ids;
+  CpuInfo::ParseCpuList(list, &ids);
+  return ids;
+}
+
+// Returns a vector of the ids from 'first' to 'last'.
+static vector<int> Ids(int first, int last) {
+  vector<int> ids;
+  for (int id = first; id <= last; ++id) ids.push_back(id);
+  return ids;
+}
+
+// Returns 'lhs' followed by 'rhs'.
+static vector<int> Concat(vector<int> lhs, const vector<int>& rhs) {
+  lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+  return lhs;
+}
+
+TEST(CpuListTest, Ranges) {
+  EXPECT_EQ(ParseCpuList("0"), Ids(0, 0));
+  EXPECT_EQ(ParseCpuList("0-7"), Ids(0, 7));
+  EXPECT_EQ(ParseCpuList("12-15"), Ids(12, 15));
+  EXPECT_EQ(ParseCpuList("3-3"), Ids(3, 3));
+  EXPECT_TRUE(ParseCpuList("").empty());
+}
+
+TEST(CpuListTest, Commas) {
+  EXPECT_EQ(ParseCpuList("0-3,16-19"), Concat(Ids(0, 3), Ids(16, 19)));
+  vector<int> expected = Concat(Concat(Ids(0, 0), Ids(2, 2)), Ids(4, 4));
+  EXPECT_EQ(ParseCpuList("0,2,4"), expected);
+  // Whitespace and empty elements are ignored.
+  EXPECT_EQ(ParseCpuList(" 0, 2 ,,4 \n"), expected);
+  EXPECT_EQ(ParseCpuList("0-1,5,8 - 9"), Concat(Concat(Ids(0, 1), Ids(5, 5)), Ids(8, 9)));
+
+  // The ids are appended.
+  vector<int> ids(1, 7);
+  CpuInfo::ParseCpuList("1-2", &ids);
+  EXPECT_EQ(ids, Concat(Ids(7, 7), Ids(1, 2)));
+}
+
+TEST(CpuListTest, Malformed) {
+  // Malformed ranges are skipped, the others are kept.
+  EXPECT_TRUE(ParseCpuList("a").empty());
+  EXPECT_TRUE(ParseCpuList("-1").empty());
+  EXPECT_TRUE(ParseCpuList("1-").empty());
+  EXPECT_TRUE(ParseCpuList("3-1").empty());
+  EXPECT_TRUE(ParseCpuList("1-2-3").empty());
+  EXPECT_TRUE(ParseCpuList("2x").empty());
+  EXPECT_EQ(ParseCpuList("x,2,3-1,4-5"), Concat(Ids(2, 2), Ids(4, 5)));
+}
+
+// Reads NUMA topologies from a fake /sys/devices/system/node.
+class NumaTopologyTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    node_dir_ = "/tmp/cpu-info-test";
+    boost::filesystem::remove_all(node_dir_);
+    boost::filesystem::create_directories(node_dir_);
+  }
+
+  virtual void TearDown() {
+    boost::filesystem::remove_all(node_dir_);
+    // Restore the topology of this machine.
+    CpuInfo::Init();
+  }
+
+  // Creates node 'node' with the cores in 'cpulist'.
+  void AddNode(int node, const string& cpulist) {
+    stringstream dir;
+    dir << node_dir_ << "/node" << node;
+    boost::filesystem::create_directories(dir.str());
+    ofstream file((dir.str() + "/cpulist").c_str());
+    file << cpulist << endl;
+  }
+
+  // Writes the list of online nodes.
+  void SetOnlineNodes(const string& nodes) {
+    ofstream file((node_dir_ + "/online").c_str());
+    file << nodes << endl;
+  }
+
+  string node_dir_;
+};
+
+TEST_F(NumaTopologyTest, NoNodes) {
+  // Without NUMA information, all cores are on one node.
+  CpuInfo::InitNumaForTesting(4, node_dir_);
+  ASSERT_EQ(CpuInfo::num_numa_nodes(), 1);
+  EXPECT_EQ(CpuInfo::GetCoresOfNumaNode(0), Ids(0, 3));
+  for (int core = 0; core < 4; ++core) {
+    EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(core), 0);
+  }
+}
+
+TEST_F(NumaTopologyTest, Nodes) {
+  // Interleaved cores, a node without cores and a gap in the node ids.
+  AddNode(0, "0-1,4-5");
+  AddNode(1, "");
+  AddNode(3, "2-3,6-7");
+  CpuInfo::InitNumaForTesting(8, node_dir_);
+  ASSERT_EQ(CpuInfo::num_numa_nodes(), 2);
+  EXPECT_EQ(CpuInfo::GetCoresOfNumaNode(0), Concat(Ids(0, 1), Ids(4, 5)));
+  EXPECT_EQ(CpuInfo::GetCoresOfNumaNode(1), Concat(Ids(2, 3), Ids(6, 7)));
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(0), 0);
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(2), 1);
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(5), 0);
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(7), 1);
+}
+
+TEST_F(NumaTopologyTest, OfflineNodes) {
+  AddNode(0, "0-3");
+  AddNode(1, "4-7");
+  AddNode(2, "8-11");
+  // Node 1 is offline.
+  SetOnlineNodes("0,2");
+  CpuInfo::InitNumaForTesting(12, node_dir_);
+  ASSERT_EQ(CpuInfo::num_numa_nodes(), 2);
+  EXPECT_EQ(CpuInfo::GetCoresOfNumaNode(0), Ids(0, 3));
+  EXPECT_EQ(CpuInfo::GetCoresOfNumaNode(1), Ids(8, 11));
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(9), 1);
+  // Cores of offline nodes are on node 0.
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(5), 0);
+
+  SetOnlineNodes("0-2");
+  CpuInfo::InitNumaForTesting(12, node_dir_);
+  ASSERT_EQ(CpuInfo::num_numa_nodes(), 3);
+  EXPECT_EQ(CpuInfo::GetCoresOfNumaNode(1), Ids(4, 7));
+  EXPECT_EQ(CpuInfo::GetNumaNodeOfCoreForTesting(5), 1);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
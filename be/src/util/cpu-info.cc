@@ -14,10 +14,14 @@
 
 #include "util/cpu-info.h"
 
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
+#include <dirent.h>
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include <mmintrin.h>
+#include <sched.h>
 #include <sstream>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +46,8 @@ long CpuInfo::cache_sizes_[L3_CACHE + 1];
 int64_t CpuInfo::cycles_per_ms_;
 int CpuInfo::num_cores_ = 1;
 string CpuInfo::model_name_ = "unknown";
+vector<vector<int> > CpuInfo::numa_node_cores_;
+vector<int> CpuInfo::core_numa_nodes_;
 
 static struct {
   string name;
@@ -128,9 +134,114 @@ void CpuInfo::Init() {
 
   if (FLAGS_num_cores > 0) num_cores_ = FLAGS_num_cores;
 
+  InitNuma(num_cores > 0 ? num_cores : 1, "/sys/devices/system/node");
+
   initialized_ = true;
 }
 
+// Parses a non-negative integer that makes up all of 'str'. Returns -1 otherwise.
+static int ParseCpuId(const string& str) {
+  if (str.empty()) return -1;
+  char* end;
+  long id = strtol(str.c_str(), &end, 10);
+  if (*end != '\0' || id < 0 || id > numeric_limits<int>::max()) return -1;
+  return id;
+}
+
+void CpuInfo::ParseCpuList(const string& list, vector<int>* ids) {
+  vector<string> ranges;
+  split(ranges, list, is_any_of(","));
+  for (int i = 0; i < ranges.size(); ++i) {
+    string range = trim_copy(ranges[i]);
+    if (range.empty()) continue;
+    size_t dash = range.find('-');
+    int first = ParseCpuId(trim_copy(range.substr(0, dash)));
+    int last = first;
+    if (dash != string::npos) last = ParseCpuId(trim_copy(range.substr(dash + 1)));
+    if (first < 0 || last < first) {
+      LOG(WARNING) << "Ignoring invalid range '" << range << "' in cpu list '" << list
+                   << "'";
+      continue;
+    }
+    for (int id = first; id <= last; ++id) ids->push_back(id);
+  }
+}
+
+void CpuInfo::InitNuma(int num_cores, const string& node_dir) {
+  numa_node_cores_.clear();
+  core_numa_nodes_.assign(num_cores, 0);
+
+  // The 'online' file lists the nodes that are online. If it is missing, all nodes are
+  // considered online.
+  vector<int> online_nodes;
+  ifstream online((node_dir + "/online").c_str(), ios::in);
+  string online_line;
+  bool has_online_list = !getline(online, online_line).fail();
+  if (has_online_list) ParseCpuList(online_line, &online_nodes);
+
+  // Nodes are directories <node_dir>/node<id> with the node's cores in a 'cpulist'
+  // file.
+  DIR* dir = opendir(node_dir.c_str());
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      if (strncmp(entry->d_name, "node", 4) != 0) continue;
+      int node = ParseCpuId(entry->d_name + 4);
+      if (node < 0) continue;
+      if (has_online_list &&
+          find(online_nodes.begin(), online_nodes.end(), node) == online_nodes.end()) {
+        continue;
+      }
+      ifstream cpulist((node_dir + "/" + entry->d_name + "/cpulist").c_str(), ios::in);
+      string line;
+      if (!getline(cpulist, line)) continue;
+      if (node >= numa_node_cores_.size()) numa_node_cores_.resize(node + 1);
+      ParseCpuList(line, &numa_node_cores_[node]);
+    }
+    closedir(dir);
+  }
+
+  // Drop nodes without cores (e.g. memory only nodes, offline nodes or gaps in the node
+  // ids) by compacting the node ids.
+  vector<vector<int> > nodes;
+  for (int i = 0; i < numa_node_cores_.size(); ++i) {
+    if (!numa_node_cores_[i].empty()) nodes.push_back(numa_node_cores_[i]);
+  }
+  numa_node_cores_.swap(nodes);
+  if (numa_node_cores_.empty()) {
+    // Not a NUMA machine, or the topology is not exposed: all cores are on node 0.
+    numa_node_cores_.resize(1);
+    for (int i = 0; i < num_cores; ++i) numa_node_cores_[0].push_back(i);
+    return;
+  }
+  for (int node = 0; node < numa_node_cores_.size(); ++node) {
+    for (int i = 0; i < numa_node_cores_[node].size(); ++i) {
+      int core = numa_node_cores_[node][i];
+      if (core >= core_numa_nodes_.size()) core_numa_nodes_.resize(core + 1, 0);
+      core_numa_nodes_[core] = node;
+    }
+  }
+}
+
+int CpuInfo::GetCurrentNumaNode() {
+  if (core_numa_nodes_.size() == 0 || numa_node_cores_.size() <= 1) return 0;
+  int core = sched_getcpu();
+  if (core < 0 || core >= core_numa_nodes_.size()) return 0;
+  return core_numa_nodes_[core];
+}
+
+bool CpuInfo::PinCurrentThreadToNumaNode(int node) {
+  DCHECK(initialized_);
+  if (node < 0 || node >= numa_node_cores_.size()) return false;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  const vector<int>& cores = numa_node_cores_[node];
+  for (int i = 0; i < cores.size(); ++i) {
+    if (cores[i] < CPU_SETSIZE) CPU_SET(cores[i], &cpu_set);
+  }
+  return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+}
+
 void CpuInfo::VerifyCpuRequirements() {
   if (!CpuInfo::IsSupported(CpuInfo::SSSE3)) {
     LOG(ERROR) << "CPU does not support the Supplemental SSE3 (SSSE3) instruction set, "
@@ -158,6 +269,7 @@ string CpuInfo::DebugString() {
   stream << "Cpu Info:" << endl
          << "  Model: " << model_name_ << endl
          << "  Cores: " << num_cores_ << endl
+         << "  NUMA Nodes: " << numa_node_cores_.size() << endl
          << "  L1 Cache: " << PrettyPrinter::Print(L1, TUnit::BYTES) << endl
          << "  L2 Cache: " << PrettyPrinter::Print(L2, TUnit::BYTES) << endl
          << "  L3 Cache: " << PrettyPrinter::Print(L3, TUnit::BYTES) << endl
@@ -17,6 +17,7 @@
 #define IMPALA_UTIL_CPU_INFO_H
 
 #include <string>
+#include <vector>
 #include <boost/cstdint.hpp>
 
 #include "common/logging.h"
@@ -27,6 +28,8 @@ namespace impala {
 // ask for the sizes of the caches and what hardware features are supported.
 // On Linux, this information is pulled from a couple of sys files (/proc/cpuinfo and 
 // /sys/devices)
+// The NUMA topology is read from /sys/devices/system/node. Machines without NUMA (or
+// where it can't be determined) are treated as a single node with all cores.
 class CpuInfo {
  public:
   static const int64_t SSSE3   = (1 << 1);
@@ -88,8 +91,50 @@ class CpuInfo {
     return model_name_;
   }
 
+  // Returns the number of NUMA nodes on this machine.
+  static int num_numa_nodes() {
+    DCHECK(initialized_);
+    return numa_node_cores_.size();
+  }
+
+  // Returns the cores of NUMA node 'node'.
+  static const std::vector<int>& GetCoresOfNumaNode(int node) {
+    DCHECK(initialized_);
+    DCHECK_GE(node, 0);
+    DCHECK_LT(node, numa_node_cores_.size());
+    return numa_node_cores_[node];
+  }
+
+  // Returns the NUMA node of the core the calling thread currently runs on. Returns 0
+  // if that is unknown or if CpuInfo was not initialized, so it can be used by code
+  // that runs without it (e.g. allocators in tests).
+  static int GetCurrentNumaNode();
+
+  // Restricts the calling thread to the cores of NUMA node 'node'. Threads it creates
+  // afterwards inherit this. With the kernel's default (first touch) memory policy,
+  // memory that the thread touches first is then allocated on that node. Returns false
+  // if that failed.
+  static bool PinCurrentThreadToNumaNode(int node);
+
   static std::string DebugString();
 
+  // Parses a list in the kernel's cpulist format, e.g. "0-7,16-23", and appends the ids
+  // in it to 'ids'. Malformed ranges are skipped.
+  static void ParseCpuList(const std::string& list, std::vector<int>* ids);
+
+  // Reads the NUMA topology from 'node_dir' instead of /sys/devices/system/node, with
+  // 'num_cores' cores. Used only for testing.
+  static void InitNumaForTesting(int num_cores, const std::string& node_dir) {
+    InitNuma(num_cores, node_dir);
+  }
+
+  // Returns the NUMA node of core 'core'. Used only for testing.
+  static int GetNumaNodeOfCoreForTesting(int core) {
+    DCHECK_GE(core, 0);
+    DCHECK_LT(core, core_numa_nodes_.size());
+    return core_numa_nodes_[core];
+  }
+
  private:
   static bool initialized_;
   static int64_t hardware_flags_;
@@ -98,6 +143,14 @@ class CpuInfo {
   static int64_t cycles_per_ms_;
   static int num_cores_;
   static std::string model_name_;
+
+  // Cores of each NUMA node, indexed by node, and NUMA node of each core, indexed by
+  // core.
+  static std::vector<std::vector<int> > numa_node_cores_;
+  static std::vector<int> core_numa_nodes_;
+
+  // Reads the NUMA topology from 'node_dir' into numa_node_cores_ and core_numa_nodes_.
+  static void InitNuma(int num_cores, const std::string& node_dir);
 };
 
 }
@@ -167,6 +167,67 @@ class DecompressorTest : public ::testing::Test {
     EXPECT_EQ(total_output_produced, input_len);
   }
 
+  // Decompresses a gzip compressed 'input' while building an index of it, then
+  // decompresses the data from each of the recorded access points to the end.
+  void CompressAndResumeAtAccessPoints(int64_t input_len, uint8_t* input) {
+    scoped_ptr<Codec> compressor;
+    scoped_ptr<Codec> decompressor;
+    EXPECT_TRUE(Codec::CreateCompressor(
+        &mem_pool_, true, THdfsCompression::GZIP, &compressor).ok());
+    EXPECT_TRUE(Codec::CreateDecompressor(
+        &mem_pool_, true, THdfsCompression::GZIP, &decompressor).ok());
+    uint8_t* compressed;
+    int64_t compressed_length;
+    EXPECT_TRUE(compressor->ProcessBlock(false, input_len,
+        input, &compressed_length, &compressed).ok());
+
+    // Record an access point at every deflate block.
+    CompressedFileIndex index(THdfsCompression::GZIP, compressed_length);
+    static_cast<GzipDecompressor*>(decompressor.get())->set_index(&index, 1);
+    StreamingDecompress(decompressor.get(), compressed_length, compressed, input_len,
+        input);
+    const vector<CompressedFileIndex::AccessPoint>& points = index.access_points();
+    EXPECT_GT(points.size(), 1);
+
+    for (int i = 0; i < points.size(); ++i) {
+      const CompressedFileIndex::AccessPoint& point = points[i];
+      scoped_ptr<Codec> resumed;
+      EXPECT_TRUE(Codec::CreateDecompressor(
+          &mem_pool_, true, THdfsCompression::DEFLATE, &resumed).ok());
+      EXPECT_TRUE(static_cast<GzipDecompressor*>(resumed.get())->ResumeAt(
+          point, compressed[point.compressed_offset - 1]).ok());
+      // The deflate data ends before the gzip trailer.
+      StreamingDecompress(resumed.get(), compressed_length - point.compressed_offset,
+          compressed + point.compressed_offset, input_len - point.uncompressed_offset,
+          input + point.uncompressed_offset, 8);
+      resumed->Close();
+    }
+    compressor->Close();
+    decompressor->Close();
+  }
+
+  void StreamingDecompress(Codec* decompressor, int64_t compressed_length,
+      uint8_t* compressed, int64_t input_len, uint8_t* input,
+      int64_t trailing_bytes = 0) {
+    int64_t total_output_produced = 0;
+    int64_t compressed_bytes_remaining = compressed_length;
+    bool eos = false;
+    while (!eos) {
+      uint8_t* output = NULL;
+      int64_t output_len = 0;
+      int64_t compressed_bytes_read = 0;
+      ASSERT_TRUE(decompressor->ProcessBlockStreaming(compressed_bytes_remaining,
+            compressed, &compressed_bytes_read, &output_len, &output, &eos).ok());
+      ASSERT_LE(total_output_produced + output_len, input_len);
+      EXPECT_EQ(memcmp(input + total_output_produced, output, output_len), 0);
+      total_output_produced += output_len;
+      compressed = compressed + compressed_bytes_read;
+      compressed_bytes_remaining -= compressed_bytes_read;
+    }
+    EXPECT_EQ(trailing_bytes, compressed_bytes_remaining);
+    EXPECT_EQ(total_output_produced, input_len);
+  }
+
   // Only tests compressors and decompressors with allocated output.
   void CompressAndDecompressNoOutputAllocated(Codec* compressor,
       Codec* decompressor, int64_t input_len, uint8_t* input) {
@@ -224,6 +285,57 @@ TEST_F(DecompressorTest, Deflate) {
   RunTestStreaming(THdfsCompression::GZIP);
 }
 
+TEST_F(DecompressorTest, GzipAccessPoints) {
+  CompressAndResumeAtAccessPoints(sizeof(input_streaming_), input_streaming_);
+}
+
+// Access points are only recorded in the first member of a multi-member gzip file.
+TEST_F(DecompressorTest, GzipAccessPointsMultiMember) {
+  scoped_ptr<Codec> compressor;
+  scoped_ptr<Codec> decompressor;
+  EXPECT_TRUE(Codec::CreateCompressor(
+      &mem_pool_, true, THdfsCompression::GZIP, &compressor).ok());
+  EXPECT_TRUE(Codec::CreateDecompressor(
+      &mem_pool_, true, THdfsCompression::GZIP, &decompressor).ok());
+  uint8_t* compressed;
+  int64_t first_member_length;
+  EXPECT_TRUE(compressor->ProcessBlock(false, sizeof(input_streaming_),
+      input_streaming_, &first_member_length, &compressed).ok());
+  vector<uint8_t> file(compressed, compressed + first_member_length);
+  int64_t second_member_length;
+  EXPECT_TRUE(compressor->ProcessBlock(false, sizeof(input_streaming_),
+      input_streaming_, &second_member_length, &compressed).ok());
+  file.insert(file.end(), compressed, compressed + second_member_length);
+
+  CompressedFileIndex index(THdfsCompression::GZIP, file.size());
+  static_cast<GzipDecompressor*>(decompressor.get())->set_index(&index, 1);
+  StreamingDecompress(decompressor.get(), file.size(), &file[0],
+      sizeof(input_streaming_), input_streaming_, second_member_length);
+  int num_points = index.access_points().size();
+  EXPECT_GT(num_points, 1);
+  StreamingDecompress(decompressor.get(), second_member_length,
+      &file[first_member_length], sizeof(input_streaming_), input_streaming_);
+  EXPECT_EQ(index.access_points().size(), num_points);
+
+  // The recorded access points are valid for the first member.
+  for (int i = 0; i < num_points; ++i) {
+    const CompressedFileIndex::AccessPoint& point = index.access_points()[i];
+    ASSERT_LT(point.compressed_offset, first_member_length);
+    scoped_ptr<Codec> resumed;
+    EXPECT_TRUE(Codec::CreateDecompressor(
+        &mem_pool_, true, THdfsCompression::DEFLATE, &resumed).ok());
+    EXPECT_TRUE(static_cast<GzipDecompressor*>(resumed.get())->ResumeAt(
+        point, file[point.compressed_offset - 1]).ok());
+    StreamingDecompress(resumed.get(), file.size() - point.compressed_offset,
+        &file[point.compressed_offset],
+        sizeof(input_streaming_) - point.uncompressed_offset,
+        input_streaming_ + point.uncompressed_offset, 8 + second_member_length);
+    resumed->Close();
+  }
+  compressor->Close();
+  decompressor->Close();
+}
+
 TEST_F(DecompressorTest, Bzip) {
   RunTest(THdfsCompression::BZIP2);
 }
@@ -34,7 +34,10 @@ const int64_t STREAM_GZIP_OUT_BUF_SIZE = 16 * 1024 * 1024;
 
 GzipDecompressor::GzipDecompressor(MemPool* mem_pool, bool reuse_buffer, bool is_deflate)
   : Codec(mem_pool, reuse_buffer),
-    is_deflate_(is_deflate) {
+    is_deflate_(is_deflate),
+    index_(NULL),
+    index_interval_(0),
+    last_access_point_offset_(0) {
   bzero(&stream_, sizeof(stream_));
 }
 
@@ -85,7 +88,29 @@ Status GzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8
   stream_.avail_out = *output_length;
   VLOG_ROW << "ProcessBlockStreaming() stream: " << DebugStreamState();
 
-  int ret = inflate(&stream_, Z_SYNC_FLUSH);
+  int ret;
+  if (index_ == NULL) {
+    ret = inflate(&stream_, Z_SYNC_FLUSH);
+  } else {
+    // Stop at every deflate block boundary to check for an access point. data_type has
+    // bit 128 set at a block boundary and bit 64 set if the block is the last one,
+    // after which there is nothing left to index.
+    do {
+      ret = inflate(&stream_, Z_BLOCK);
+      if (ret == Z_OK && (stream_.data_type & 128) && !(stream_.data_type & 64) &&
+          stream_.total_out > 0 &&
+          static_cast<int64_t>(stream_.total_in) - last_access_point_offset_ >=
+              index_interval_) {
+        AddAccessPoint(*output, *output_length - stream_.avail_out);
+      }
+    } while (ret == Z_OK && stream_.avail_in > 0 && stream_.avail_out > 0);
+    // Z_BUF_ERROR means the last inflate() made no progress, this is only reported to
+    // the caller if this call as a whole made no progress.
+    if (ret == Z_BUF_ERROR &&
+        (stream_.avail_in != input_length || stream_.avail_out != *output_length)) {
+      ret = Z_OK;
+    }
+  }
   if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
     stringstream ss;
     ss << "GzipDecompressor failed, ret=" << ret;
@@ -99,6 +124,7 @@ Status GzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8
   *input_bytes_read = input_length - stream_.avail_in;
   VLOG_ROW << "inflate() ret=" << ret << " consumed=" << *input_bytes_read
            << " produced=" << *output_length << " stream: " << DebugStreamState();
+  if (index_ != NULL) GetWindow(*output, *output_length, &window_);
 
   if (ret == Z_BUF_ERROR) {
     // Z_BUF_ERROR is returned if no progress was made. This should be very unlikely.
@@ -108,6 +134,11 @@ Status GzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8
     DCHECK_EQ(0, *input_bytes_read);
   } else if (ret == Z_STREAM_END) {
     *eos = true;
+    // inflateReset() restarts total_in and total_out at 0, so access points of a
+    // following gzip member would be recorded relative to that member. Only the first
+    // member is indexed.
+    index_ = NULL;
+    window_.clear();
     if (inflateReset(&stream_) != Z_OK) {
       return Status("zlib inflateReset failed: " + string(stream_.msg));
     }
@@ -115,6 +146,47 @@ Status GzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8
   return Status::OK;
 }
 
+void GzipDecompressor::GetWindow(const uint8_t* output, int64_t output_len,
+    string* window) const {
+  int64_t from_output = min<int64_t>(output_len, CompressedFileIndex::GZIP_WINDOW_SIZE);
+  int64_t from_window = min<int64_t>(window_.size(),
+      CompressedFileIndex::GZIP_WINDOW_SIZE - from_output);
+  // 'window' may be window_, so the part of window_ is moved to the front first.
+  string result;
+  result.reserve(from_window + from_output);
+  result.append(window_, window_.size() - from_window, from_window);
+  result.append(reinterpret_cast<const char*>(output) + output_len - from_output,
+      from_output);
+  window->swap(result);
+}
+
+void GzipDecompressor::AddAccessPoint(const uint8_t* output, int64_t output_len) {
+  string window;
+  GetWindow(output, output_len, &window);
+  // The low bits of data_type are the number of bits of the last byte that were not
+  // consumed, i.e. that belong to the next block.
+  index_->AddAccessPoint(stream_.total_in, stream_.total_out, stream_.data_type & 7,
+      reinterpret_cast<const uint8_t*>(window.data()), window.size());
+  last_access_point_offset_ = stream_.total_in;
+}
+
+Status GzipDecompressor::ResumeAt(const CompressedFileIndex::AccessPoint& point,
+    uint8_t prev_byte) {
+  DCHECK(is_deflate_) << "Access points are in the raw deflate data";
+  if (inflateReset(&stream_) != Z_OK) {
+    return Status("zlib inflateReset failed: " + string(stream_.msg));
+  }
+  if (point.bits != 0 &&
+      inflatePrime(&stream_, point.bits, prev_byte >> (8 - point.bits)) != Z_OK) {
+    return Status("zlib inflatePrime failed");
+  }
+  if (!point.window.empty() && inflateSetDictionary(&stream_,
+      reinterpret_cast<const Bytef*>(point.window.data()), point.window.size()) != Z_OK) {
+    return Status("zlib inflateSetDictionary failed");
+  }
+  return Status::OK;
+}
+
 Status GzipDecompressor::ProcessBlock(bool output_preallocated, int64_t input_length,
     const uint8_t* input, int64_t* output_length, uint8_t** output) {
   if (output_preallocated && *output_length == 0) {
@@ -429,10 +501,17 @@ Status SnappyDecompressor::ProcessBlock(bool output_preallocated, int64_t input_
     *output_length = uncompressed_length;
   }
 
+  // Snappy never writes past the uncompressed length, check that it fits the output.
+  int64_t uncompressed_length = MaxOutputLen(input_length, input);
+  if (uncompressed_length < 0) return Status("Snappy: GetUncompressedLength failed");
+  if (uncompressed_length > *output_length) {
+    return Status("Too small a buffer passed to SnappyDecompressor");
+  }
   if (!snappy::RawUncompress(reinterpret_cast<const char*>(input),
            static_cast<size_t>(input_length), reinterpret_cast<char*>(*output))) {
     return Status("Snappy: RawUncompress failed");
   }
+  *output_length = uncompressed_length;
 
   return Status::OK;
 }
@@ -451,10 +530,13 @@ Status Lz4Decompressor::ProcessBlock(bool output_preallocated, int64_t input_len
   DCHECK(output_preallocated) << "Lz4 Codec implementation must have allocated output";
   // LZ4_uncompress will cause a segmentation fault if passed a NULL output.
   if(*output_length == 0) return Status::OK;
-  if (LZ4_uncompress(reinterpret_cast<const char*>(input),
-          reinterpret_cast<char*>(*output), *output_length) != input_length) {
-    return Status("Lz4: uncompress failed");
-  }
+  // The output may be bigger than the uncompressed data (e.g. the rest of a Hadoop
+  // block, see HdfsTextScanner::FillByteBufferBlockFramed()), so the decompressed
+  // length is only known after decompressing.
+  int ret = LZ4_uncompress_unknownOutputSize(reinterpret_cast<const char*>(input),
+      reinterpret_cast<char*>(*output), input_length, *output_length);
+  if (ret < 0) return Status("Lz4: uncompress failed");
+  *output_length = ret;
 
   return Status::OK;
 }
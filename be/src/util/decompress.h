@@ -20,6 +20,7 @@
 #include <zlib.h>
 
 #include "util/codec.h"
+#include "util/compressed-file-index.h"
 #include "exec/hdfs-scanner.h"
 #include "runtime/mem-pool.h"
 
@@ -35,6 +36,22 @@ class GzipDecompressor : public Codec {
       int64_t* input_bytes_read, int64_t* output_length, uint8_t** output, bool* eos);
   virtual std::string file_extension() const { return "gz"; }
 
+  // Records access points in 'index' while decompressing with ProcessBlockStreaming(),
+  // with at least 'interval' compressed bytes between two access points. The input
+  // must start at the beginning of the file. Must be called before the first call to
+  // ProcessBlockStreaming(). Only the first gzip member of the file is indexed, so the
+  // index must not be used to split a file that continues after it.
+  void set_index(CompressedFileIndex* index, int64_t interval) {
+    index_ = index;
+    index_interval_ = interval;
+  }
+
+  // Prepares a deflate decompressor (i.e. created for THdfsCompression::DEFLATE) to
+  // continue decompressing at 'point' of a gzip file. 'prev_byte' is the byte before
+  // point.compressed_offset, it is only used if point.bits is not 0. The input of the
+  // next call to ProcessBlockStreaming() must start at point.compressed_offset.
+  Status ResumeAt(const CompressedFileIndex::AccessPoint& point, uint8_t prev_byte);
+
  private:
   friend class Codec;
   GzipDecompressor(
@@ -42,11 +59,32 @@ class GzipDecompressor : public Codec {
   virtual Status Init();
   std::string DebugStreamState() const;
 
+  // Adds an access point at the current position of stream_ to index_. 'output' is the
+  // data decompressed by the current call to ProcessBlockStreaming() so far.
+  void AddAccessPoint(const uint8_t* output, int64_t output_len);
+
+  // Sets 'window' to the last GZIP_WINDOW_SIZE bytes of window_ followed by 'output',
+  // the data decompressed by the current call to ProcessBlockStreaming() so far.
+  void GetWindow(const uint8_t* output, int64_t output_len, std::string* window) const;
+
   // If set assume deflate format, otherwise zlib or gzip
   bool is_deflate_;
 
   z_stream stream_;
 
+  // If not NULL, ProcessBlockStreaming() records access points in this index.
+  CompressedFileIndex* index_;
+
+  // Minimum number of compressed bytes between two access points.
+  int64_t index_interval_;
+
+  // Compressed offset of the last access point.
+  int64_t last_access_point_offset_;
+
+  // The last GZIP_WINDOW_SIZE bytes decompressed before the current call to
+  // ProcessBlockStreaming(). Only maintained if index_ is set.
+  std::string window_;
+
   // These are magic numbers from zlib.h.  Not clear why they are not defined there.
   const static int WINDOW_BITS = 15;    // Maximum window size
   const static int DETECT_CODEC = 32;   // Determine if this is libz or gzip from header.
@@ -179,6 +179,13 @@ class DictDecoderBase {
 
   virtual int num_entries() const = 0;
 
+  // Skips the next 'num_values' values without looking them up in the dictionary.
+  // Returns false if there are fewer than 'num_values' values left.
+  bool Skip(int num_values) {
+    DCHECK(data_decoder_.get() != NULL);
+    return data_decoder_->Skip(num_values);
+  }
+
  protected:
   boost::scoped_ptr<RleDecoder> data_decoder_;
 };
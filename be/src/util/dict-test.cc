@@ -61,6 +61,77 @@ void ValidateDict(const vector<T>& values, int fixed_buffer_byte_size) {
   pool.FreeAll();
 }
 
+// Decodes the values of two data pages with the same dictionary, skipping the values
+// not in 'selected' with Skip(), and checks that the values read are the same as when
+// all values are read.
+template<typename T>
+void ValidateDictSkip(const vector<T>& values, int fixed_buffer_byte_size,
+    const vector<bool>& selected) {
+  ASSERT_EQ(values.size(), selected.size());
+  MemTracker tracker;
+  MemPool pool(&tracker);
+  DictEncoder<T> encoder(&pool, fixed_buffer_byte_size);
+  int page_size = values.size() / 2;
+  vector<uint8_t> pages[2];
+  for (int page = 0; page < 2; ++page) {
+    int end = page == 0 ? page_size : values.size();
+    for (int i = page * page_size; i < end; ++i) encoder.Put(values[i]);
+    pages[page].resize(encoder.EstimatedDataEncodedSize());
+    int data_len = encoder.WriteData(&pages[page][0], pages[page].size());
+    EXPECT_GT(data_len, 0);
+    pages[page].resize(data_len);
+    encoder.ClearIndices();
+  }
+  vector<uint8_t> dict_buffer(encoder.dict_encoded_size());
+  encoder.WriteDict(&dict_buffer[0]);
+
+  DictDecoder<T> decoder(&dict_buffer[0], dict_buffer.size(), fixed_buffer_byte_size);
+  DictDecoder<T> skip_decoder(&dict_buffer[0], dict_buffer.size(),
+      fixed_buffer_byte_size);
+  for (int page = 0; page < 2; ++page) {
+    decoder.SetData(&pages[page][0], pages[page].size());
+    skip_decoder.SetData(&pages[page][0], pages[page].size());
+    int end = page == 0 ? page_size : values.size();
+    int num_skipped = 0;
+    for (int i = page * page_size; i < end; ++i) {
+      T expected;
+      EXPECT_TRUE(decoder.GetValue(&expected));
+      EXPECT_EQ(values[i], expected);
+      if (!selected[i]) {
+        ++num_skipped;
+        continue;
+      }
+      EXPECT_TRUE(skip_decoder.Skip(num_skipped));
+      num_skipped = 0;
+      T val;
+      EXPECT_TRUE(skip_decoder.GetValue(&val));
+      EXPECT_EQ(expected, val) << "value " << i;
+    }
+    EXPECT_TRUE(skip_decoder.Skip(num_skipped));
+  }
+  pool.FreeAll();
+}
+
+// Checks ValidateDictSkip() for several patterns of selected values.
+template<typename T>
+void ValidateDictSkip(const vector<T>& values, int fixed_buffer_byte_size) {
+  vector<bool> none(values.size(), false);
+  vector<bool> all(values.size(), true);
+  vector<bool> alternating(values.size());
+  vector<bool> sparse(values.size());
+  vector<bool> runs(values.size());
+  for (int i = 0; i < values.size(); ++i) {
+    alternating[i] = i % 2 == 0;
+    sparse[i] = i % 37 == 5;
+    runs[i] = (i / 20) % 3 == 1;
+  }
+  ValidateDictSkip(values, fixed_buffer_byte_size, none);
+  ValidateDictSkip(values, fixed_buffer_byte_size, all);
+  ValidateDictSkip(values, fixed_buffer_byte_size, alternating);
+  ValidateDictSkip(values, fixed_buffer_byte_size, sparse);
+  ValidateDictSkip(values, fixed_buffer_byte_size, runs);
+}
+
 TEST(DictTest, TestStrings) {
   StringValue sv1("hello world");
   StringValue sv2("foo");
@@ -142,6 +213,23 @@ TEST(DictTest, TestNumbers) {
 
 }
 
+// Skipping values must not change the values read after them, both within repeated and
+// literal runs and across pages.
+TEST(DictTest, TestSkip) {
+  vector<int32_t> ints;
+  for (int i = 0; i < 1000; ++i) {
+    // Repeated runs of different lengths mixed with literal runs.
+    ints.push_back(i % 200 < 100 ? (i / 13) % 7 : i % 11);
+  }
+  ValidateDictSkip(ints, ParquetPlainEncoder::ByteSize(ColumnType(TYPE_INT)));
+
+  StringValue strings[] = {
+      StringValue("hello world"), StringValue("foo"), StringValue("bar")};
+  vector<StringValue> svs;
+  for (int i = 0; i < 500; ++i) svs.push_back(strings[(i / (1 + i % 4)) % 3]);
+  ValidateDictSkip(svs, -1);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   impala::InitCommonRuntime(argc, argv, true);
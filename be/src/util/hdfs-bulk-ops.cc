@@ -20,6 +20,7 @@
 #include "util/debug-util.h"
 #include "util/error-util.h"
 #include "util/hdfs-util.h"
+#include "util/stopwatch.h"
 
 using namespace std;
 using namespace impala;
@@ -49,7 +50,14 @@ HdfsOp::HdfsOp(HdfsOpType op, const string& src, short permissions,
 HdfsOp::HdfsOp() { }
 
 void HdfsOp::Execute() const {
-  if (op_set_->ShouldAbort()) return;
+  // Execute() still waits for the skipped ops to be marked done.
+  if (op_set_->ShouldAbort()) {
+    op_set_->MarkOneOpDone(0);
+    return;
+  }
+
+  MonotonicStopWatch sw;
+  sw.Start();
 
   status::StatusInternal status;
   int err = 0;
@@ -112,7 +120,7 @@ void HdfsOp::Execute() const {
     op_set_->AddError(ss.str(), this);
   }
 
-  op_set_->MarkOneOpDone();
+  op_set_->MarkOneOpDone(sw.ElapsedTime());
 }
 
 // Utility method to convert from a thread-pool signature to HdfsOp::Execute
@@ -129,7 +137,8 @@ HdfsOpThreadPool* impala::CreateHdfsOpThreadPool(const string& name, uint32_t nu
 }
 
 HdfsOperationSet::HdfsOperationSet(dfsFS* hdfs_connection)
-    : num_ops_(0L), hdfs_connection_(hdfs_connection) {
+    : num_ops_(0L), hdfs_connection_(hdfs_connection), total_op_time_(0L),
+      max_op_time_(0L) {
 }
 
 bool HdfsOperationSet::Execute(ThreadPool<HdfsOp>* pool,
@@ -165,7 +174,9 @@ void HdfsOperationSet::AddError(const string& err, const HdfsOp* op) {
   errors_.push_back(make_pair(op, err));
 }
 
-void HdfsOperationSet::MarkOneOpDone() {
+void HdfsOperationSet::MarkOneOpDone(int64_t op_time) {
+  total_op_time_ += op_time;
+  max_op_time_.UpdateMax(op_time);
   if (num_ops_.UpdateAndFetch(-1) == 0) {
     promise_.Set(errors().size() == 0);
   }
@@ -118,6 +118,14 @@ class HdfsOperationSet {
   /** reply the dfs operations set size */
   int64_t count() { return num_ops_.Read(); }
 
+  // Returns the number of operations added to this set.
+  int64_t size() const { return ops_.size(); }
+
+  // Total and maximum time (in ns) spent executing single operations. Not valid until
+  // Execute has returned.
+  int64_t total_op_time() const { return total_op_time_; }
+  int64_t max_op_time() const { return max_op_time_; }
+
  private:
   // The set of operations to be submitted to HDFS
   std::vector<HdfsOp> ops_;
@@ -142,11 +150,16 @@ class HdfsOperationSet {
   // True if a single error should cause any subsequent operations to become no-ops.
   bool abort_on_error_;
 
+  // See total_op_time() and max_op_time().
+  AtomicInt<int64_t> total_op_time_;
+  AtomicInt<int64_t> max_op_time_;
+
   friend class HdfsOp;
 
-  // Called by HdfsOp to signal its completion. When the last op has finished, this method
-  // signals Execute() so that it can return.
-  void MarkOneOpDone();
+  // Called by HdfsOp to signal its completion, 'op_time' is the time in ns it took to
+  // execute the op. When the last op has finished, this method signals Execute() so that
+  // it can return.
+  void MarkOneOpDone(int64_t op_time);
 
   // Called by HdfsOp to record an error
   void AddError(const std::string& err, const HdfsOp* op);
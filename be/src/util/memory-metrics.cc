@@ -18,6 +18,7 @@
 #include <boost/foreach.hpp>
 #include <gutil/strings/substitute.h>
 
+#include "runtime/slab-allocator.h"
 #include "util/jni-util.h"
 #include "util/time.h"
 
@@ -32,6 +33,11 @@ TcmallocMetric* TcmallocMetric::TOTAL_BYTES_RESERVED = NULL;
 TcmallocMetric* TcmallocMetric::PAGEHEAP_UNMAPPED_BYTES = NULL;
 TcmallocMetric::PhysicalBytesMetric* TcmallocMetric::PHYSICAL_BYTES_RESERVED = NULL;
 
+void TcmallocMetric::PhysicalBytesMetric::CalculateValue() {
+  value_ = TOTAL_BYTES_RESERVED->value() - PAGEHEAP_UNMAPPED_BYTES->value() +
+      SlabAllocator::instance()->huge_page_bytes();
+}
+
 Status impala::RegisterMemoryMetrics(MetricGroup* metrics, bool register_jvm_metrics) {
 #ifndef ADDRESS_SANITIZER
   TcmallocMetric::BYTES_IN_USE = metrics->RegisterMetric(new TcmallocMetric(
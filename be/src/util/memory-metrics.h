@@ -51,16 +51,15 @@ class TcmallocMetric : public UIntGauge {
 
   // Derived metric computing the amount of physical memory (in bytes) used by the
   // process, including that actually in use and free bytes reserved by tcmalloc. Does not
-  // include the tcmalloc metadata.
+  // include the tcmalloc metadata. Includes the huge pages the SlabAllocator mmap()ed
+  // outside of tcmalloc, so that they count against the process memory limit.
   class PhysicalBytesMetric : public UIntGauge {
    public:
     PhysicalBytesMetric(const std::string& key)
         : UIntGauge(key, TUnit::BYTES) { }
 
    private:
-    virtual void CalculateValue() {
-      value_ = TOTAL_BYTES_RESERVED->value() - PAGEHEAP_UNMAPPED_BYTES->value();
-    }
+    virtual void CalculateValue();
   };
 
   static PhysicalBytesMetric* PHYSICAL_BYTES_RESERVED;
@@ -17,10 +17,13 @@
 
 #include "util/perf-counters.h"
 #include "util/debug-util.h"
+#include "util/pretty-printer.h"
+#include "util/runtime-profile.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <fstream>
 #include <iomanip>
@@ -109,6 +112,26 @@ static bool InitEventAttr(perf_event_attr* attr, PerfCounters::Counter counter)
       attr->type = PERF_TYPE_HARDWARE;
       attr->config = PERF_COUNT_HW_BUS_CYCLES;
       break;
+    case PerfCounters::PERF_COUNTER_HW_DTLB_LOADS:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+      break;
+    case PerfCounters::PERF_COUNTER_HW_DTLB_LOAD_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case PerfCounters::PERF_COUNTER_HW_NODE_LOADS:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+      break;
+    case PerfCounters::PERF_COUNTER_HW_NODE_LOAD_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
     default:
       return false;
   }
@@ -140,6 +163,14 @@ static string GetCounterName(PerfCounters::Counter counter) {
       return "BranchMiss";
     case PerfCounters::PERF_COUNTER_HW_BUS_CYCLES:
       return "BusCycles";
+    case PerfCounters::PERF_COUNTER_HW_DTLB_LOADS:
+      return "DTLBLoads";
+    case PerfCounters::PERF_COUNTER_HW_DTLB_LOAD_MISSES:
+      return "DTLBLoadMisses";
+    case PerfCounters::PERF_COUNTER_HW_NODE_LOADS:
+      return "NodeLoads";
+    case PerfCounters::PERF_COUNTER_HW_NODE_LOAD_MISSES:
+      return "NodeLoadMisses";
     case PerfCounters::PERF_COUNTER_VM_USAGE:
       return "VmUsage";
     case PerfCounters::PERF_COUNTER_VM_PEAK_USAGE:
@@ -168,7 +199,8 @@ bool PerfCounters::InitSysCounter(Counter counter) {
   if (!InitEventAttr(&attr, counter)) {
     return false;
   }
-  int fd = sys_perf_event_open(&attr, getpid(), -1, group_fd_, 0);
+  // Count the calling thread on any cpu.
+  int fd = sys_perf_event_open(&attr, 0, -1, group_fd_, 0);
   if (fd < 0) {
     return false;
   }
@@ -357,6 +389,10 @@ bool PerfCounters::AddCounter(Counter counter) {
     case PerfCounters::PERF_COUNTER_HW_BRANCHES:
     case PerfCounters::PERF_COUNTER_HW_BRANCH_MISSES:
     case PerfCounters::PERF_COUNTER_HW_BUS_CYCLES:
+    case PerfCounters::PERF_COUNTER_HW_DTLB_LOADS:
+    case PerfCounters::PERF_COUNTER_HW_DTLB_LOAD_MISSES:
+    case PerfCounters::PERF_COUNTER_HW_NODE_LOADS:
+    case PerfCounters::PERF_COUNTER_HW_NODE_LOAD_MISSES:
       result = InitSysCounter(counter);
       break;
     case PerfCounters::PERF_COUNTER_BYTES_READ:
@@ -424,5 +460,16 @@ void PerfCounters::PrettyPrint(ostream* s) const {
   stream << endl;
 }
 
+void PerfCounters::AddToProfile(int start, int end, const string& prefix,
+    RuntimeProfile* profile) const {
+  const vector<int64_t>* start_values = counters(start);
+  const vector<int64_t>* end_values = counters(end);
+  if (start_values == NULL || end_values == NULL) return;
+  for (int i = 0; i < counters_.size(); ++i) {
+    RuntimeProfile::Counter* counter =
+        profile->AddCounter(prefix + counter_names_[i], counters_[i].type);
+    counter->Set((*end_values)[i] - (*start_values)[i]);
+  }
 }
 
+}
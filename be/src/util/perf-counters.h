@@ -37,9 +37,14 @@
 //  <do your work>
 //  counters.Snapshot("After Work");
 //  counters.PrettyPrint(cout);
+//
+// The perf counter syscall counters (PERF_COUNTER_SW_* and PERF_COUNTER_HW_*) only count
+// the thread that added them.
 
 namespace impala {
 
+class RuntimeProfile;
+
 class PerfCounters {
  public:
   enum Counter {
@@ -55,6 +60,12 @@ class PerfCounters {
     PERF_COUNTER_HW_BRANCHES,
     PERF_COUNTER_HW_BRANCH_MISSES,
     PERF_COUNTER_HW_BUS_CYCLES,
+    PERF_COUNTER_HW_DTLB_LOADS,
+    PERF_COUNTER_HW_DTLB_LOAD_MISSES,
+    // Loads that reached a NUMA node's memory, and the ones that had to go to the memory
+    // of a remote node.
+    PERF_COUNTER_HW_NODE_LOADS,
+    PERF_COUNTER_HW_NODE_LOAD_MISSES,
 
     PERF_COUNTER_VM_USAGE,
     PERF_COUNTER_VM_PEAK_USAGE,
@@ -88,6 +99,11 @@ class PerfCounters {
   // Prints out the names and results for all snapshots to 'out'
   void PrettyPrint(std::ostream* out) const;
 
+  // Adds a counter to 'profile' for each added counter, set to the difference of its
+  // values in snapshots 'start' and 'end'. The counter names are prefixed with 'prefix'.
+  void AddToProfile(int start, int end, const std::string& prefix,
+      RuntimeProfile* profile) const;
+
   PerfCounters();
   ~PerfCounters();
 
@@ -113,7 +129,7 @@ class PerfCounters {
   struct CounterData {
     Counter counter;
     DataSource source;
-    TUnit::type unit;
+    TUnit::type type;
 
     // DataSource specific data.  This is used to pull the counter values.
     union {
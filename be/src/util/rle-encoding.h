@@ -94,6 +94,11 @@ class RleDecoder {
   template<typename T>
   bool Get(T* val);
 
+  // Skips the next 'num_values' values. Repeated runs are skipped without decoding them
+  // and literal runs by advancing the bit reader. Returns false if there are fewer than
+  // 'num_values' values left.
+  bool Skip(int num_values);
+
  private:
   BitReader bit_reader_;
   int bit_width_;
@@ -259,6 +264,39 @@ inline bool RleDecoder::Get(T* val) {
   return true;
 }
 
+inline bool RleDecoder::Skip(int num_values) {
+  DCHECK_GE(num_values, 0);
+  while (num_values > 0) {
+    if (literal_count_ == 0 && repeat_count_ == 0) {
+      int32_t indicator_value = 0;
+      if (!bit_reader_.GetVlqInt(&indicator_value)) return false;
+      bool is_literal = indicator_value & 1;
+      if (is_literal) {
+        literal_count_ = (indicator_value >> 1) * 8;
+      } else {
+        repeat_count_ = indicator_value >> 1;
+        // The value is read as in Get() since the rest of the run may still be read.
+        bool result = bit_reader_.GetAligned<uint64_t>(
+            BitUtil::Ceil(bit_width_, 8), &current_value_);
+        DCHECK(result);
+      }
+    }
+
+    if (repeat_count_ > 0) {
+      int n = std::min<uint32_t>(num_values, repeat_count_);
+      repeat_count_ -= n;
+      num_values -= n;
+    } else {
+      DCHECK(literal_count_ > 0);
+      int n = std::min<uint32_t>(num_values, literal_count_);
+      if (!bit_reader_.SkipBits(static_cast<int64_t>(n) * bit_width_)) return false;
+      literal_count_ -= n;
+      num_values -= n;
+    }
+  }
+  return true;
+}
+
 // This function buffers input values 8 at a time.  After seeing all 8 values,
 // it decides whether they should be encoded as a literal or repeated run.
 inline bool RleEncoder::Put(uint64_t value) {
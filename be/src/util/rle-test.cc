@@ -356,6 +356,46 @@ TEST(BitRle, RepeatedPattern) {
   ValidateRle(values, 1, NULL, -1);
 }
 
+// Test skipping values in repeated and literal runs, including skips that span runs.
+TEST(BitRle, Skip) {
+  for (int bit_width = 1; bit_width <= MAX_WIDTH; bit_width += 5) {
+    srand(bit_width);
+    vector<int> values;
+    for (int i = 0; i < 100; ++i) {
+      // Alternate between runs of random values and runs of a repeated value.
+      int run_len = rand() % 40 + 1;
+      int repeated = rand() % (1 << min(bit_width, 16));
+      for (int j = 0; j < run_len; ++j) {
+        values.push_back(i % 2 == 0 ? rand() % (1 << min(bit_width, 16)) : repeated);
+      }
+    }
+
+    const int len = 64 * 1024;
+    uint8_t buffer[len];
+    RleEncoder encoder(buffer, len, bit_width);
+    for (int i = 0; i < values.size(); ++i) {
+      ASSERT_TRUE(encoder.Put(values[i]));
+    }
+    int encoded_len = encoder.Flush();
+
+    for (int skip = 0; skip < 70; skip += 7) {
+      RleDecoder decoder(buffer, encoded_len, bit_width);
+      int idx = 0;
+      while (idx + skip < values.size()) {
+        EXPECT_TRUE(decoder.Skip(skip));
+        idx += skip;
+        uint64_t v;
+        EXPECT_TRUE(decoder.Get(&v));
+        EXPECT_EQ(v, static_cast<uint64_t>(values[idx]))
+            << "bit_width=" << bit_width << " idx=" << idx;
+        ++idx;
+      }
+      // The last literal run is padded to a multiple of 8 values.
+      EXPECT_FALSE(decoder.Skip(values.size() - idx + 8));
+    }
+  }
+}
+
 TEST(BitRle, Overflow) {
   for (int bit_width = 1; bit_width < 32; bit_width += 3) {
     const int len = RleEncoder::MinBufferSize(bit_width);
@@ -335,6 +335,90 @@ TEST(CountersTest, InfoStringTest) {
   EXPECT_EQ(*update_dst_profile.GetInfoString("Foo"), "Bar");
 }
 
+TEST(CountersTest, RemoveUnchanged) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+  RuntimeProfile child(&pool, "Child");
+  profile.AddChild(&child);
+  RuntimeProfile::Counter* changed = profile.AddCounter("Changed", TUnit::UNIT);
+  RuntimeProfile::Counter* unchanged = profile.AddCounter("Unchanged", TUnit::UNIT);
+  RuntimeProfile::Counter* child_counter = child.AddCounter("ChildCounter", TUnit::UNIT);
+  changed->Set(1);
+  unchanged->Set(2);
+  child_counter->Set(3);
+  profile.AddInfoString("Key", "Value");
+  child.AddInfoString("ChildKey", "Value");
+
+  TRuntimeProfileTree prev_tprofile;
+  profile.ToThrift(&prev_tprofile);
+  RuntimeProfile dst_profile(&pool, "Profile");
+  dst_profile.Update(prev_tprofile);
+
+  changed->Set(10);
+  RuntimeProfile::Counter* added = profile.AddCounter("Added", TUnit::UNIT);
+  added->Set(20);
+  child.AddInfoString("ChildKey", "NewValue");
+  RuntimeProfile new_child(&pool, "NewChild");
+  new_child.AddCounter("NewChildCounter", TUnit::UNIT)->Set(30);
+  child.AddChild(&new_child);
+
+  TRuntimeProfileTree tprofile;
+  profile.ToThrift(&tprofile);
+  TRuntimeProfileTree full_tprofile = tprofile;
+  RuntimeProfile::RemoveUnchanged(prev_tprofile, &tprofile);
+
+  // The shape of the tree is unchanged, but only the changed values are left.
+  ASSERT_EQ(tprofile.nodes.size(), full_tprofile.nodes.size());
+  EXPECT_EQ(tprofile.nodes.size(), 3);
+  EXPECT_EQ(tprofile.nodes[0].counters.size(), 2);
+  EXPECT_TRUE(tprofile.nodes[0].info_strings.empty());
+  EXPECT_TRUE(tprofile.nodes[1].counters.empty());
+  EXPECT_EQ(tprofile.nodes[1].info_strings.size(), 1);
+  EXPECT_EQ(tprofile.nodes[1].info_strings_display_order.size(), 1);
+  EXPECT_EQ(tprofile.nodes[2].counters.size(),
+      full_tprofile.nodes[2].counters.size());
+
+  // Applying the delta has the same effect as applying the full profile.
+  dst_profile.Update(tprofile);
+  ValidateCounter(&dst_profile, "Changed", 10);
+  ValidateCounter(&dst_profile, "Unchanged", 2);
+  ValidateCounter(&dst_profile, "Added", 20);
+  EXPECT_EQ(*dst_profile.GetInfoString("Key"), "Value");
+  vector<RuntimeProfile*> children;
+  dst_profile.GetAllChildren(&children);
+  ASSERT_EQ(children.size(), 2);
+  ValidateCounter(children[0], "ChildCounter", 3);
+  EXPECT_EQ(*children[0]->GetInfoString("ChildKey"), "NewValue");
+  ValidateCounter(children[1], "NewChildCounter", 30);
+
+  // Without an earlier tree, nothing is removed.
+  tprofile = full_tprofile;
+  RuntimeProfile::RemoveUnchanged(TRuntimeProfileTree(), &tprofile);
+  EXPECT_EQ(tprofile.nodes[0].counters.size(), full_tprofile.nodes[0].counters.size());
+}
+
+TEST(CountersTest, RetainCounters) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+  profile.AddCounter("Retained", TUnit::UNIT)->Set(1);
+  profile.AddCounter("Removed", TUnit::UNIT)->Set(2);
+  profile.AddInfoString("Key", "Value");
+
+  TRuntimeProfileTree tprofile;
+  profile.ToThrift(&tprofile);
+  set<string> counter_names;
+  counter_names.insert("Retained");
+  RuntimeProfile::RetainCounters(counter_names, &tprofile);
+
+  RuntimeProfile dst_profile(&pool, "Profile");
+  dst_profile.Update(tprofile);
+  ValidateCounter(&dst_profile, "Retained", 1);
+  EXPECT_TRUE(dst_profile.GetCounter("Removed") == NULL);
+  EXPECT_TRUE(dst_profile.GetInfoString("Key") == NULL);
+  // The time counters are always retained.
+  EXPECT_TRUE(dst_profile.GetCounter("TotalTime") != NULL);
+}
+
 TEST(CountersTest, RateCounters) {
   ObjectPool pool;
   RuntimeProfile profile(&pool, "Profile");
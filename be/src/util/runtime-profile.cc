@@ -731,6 +731,120 @@ void RuntimeProfile::ToThrift(vector<TRuntimeProfileNode>* nodes) const {
   }
 }
 
+// Appends to 'paths' the path of the node nodes[*idx] and of all nodes in its subtree,
+// in the order of 'nodes'. The path of a node is the path of its parent followed by its
+// name. Advances *idx past the subtree.
+static void GetNodePaths(const vector<TRuntimeProfileNode>& nodes,
+    const string& parent_path, int* idx, vector<string>* paths) {
+  DCHECK_LT(*idx, nodes.size());
+  const TRuntimeProfileNode& node = nodes[*idx];
+  string path = parent_path + '\n' + node.name;
+  paths->push_back(path);
+  ++*idx;
+  for (int i = 0; i < node.num_children; ++i) {
+    GetNodePaths(nodes, path, idx, paths);
+  }
+}
+
+void RuntimeProfile::RemoveUnchanged(const TRuntimeProfileTree& prev_tree,
+    TRuntimeProfileTree* tree) {
+  if (prev_tree.nodes.empty() || tree->nodes.empty()) return;
+  vector<string> prev_paths;
+  int idx = 0;
+  GetNodePaths(prev_tree.nodes, "", &idx, &prev_paths);
+  map<string, int> prev_node_idx;
+  for (int i = 0; i < prev_paths.size(); ++i) {
+    prev_node_idx[prev_paths[i]] = i;
+  }
+  vector<string> paths;
+  idx = 0;
+  GetNodePaths(tree->nodes, "", &idx, &paths);
+
+  for (int i = 0; i < tree->nodes.size(); ++i) {
+    TRuntimeProfileNode& node = tree->nodes[i];
+    node.__isset.event_sequences = false;
+    node.event_sequences.clear();
+    map<string, int>::const_iterator prev_it = prev_node_idx.find(paths[i]);
+    if (prev_it == prev_node_idx.end()) continue;
+    const TRuntimeProfileNode& prev_node = prev_tree.nodes[prev_it->second];
+
+    map<string, const TCounter*> prev_counters;
+    BOOST_FOREACH(const TCounter& counter, prev_node.counters) {
+      prev_counters[counter.name] = &counter;
+    }
+    vector<TCounter> counters;
+    BOOST_FOREACH(const TCounter& counter, node.counters) {
+      map<string, const TCounter*>::const_iterator it = prev_counters.find(counter.name);
+      if (it != prev_counters.end() && it->second->value == counter.value &&
+          it->second->unit == counter.unit) {
+        continue;
+      }
+      counters.push_back(counter);
+    }
+    node.counters.swap(counters);
+
+    ChildCounterMap::iterator child_counters = node.child_counters_map.begin();
+    while (child_counters != node.child_counters_map.end()) {
+      ChildCounterMap::const_iterator it =
+          prev_node.child_counters_map.find(child_counters->first);
+      if (it != prev_node.child_counters_map.end() &&
+          it->second == child_counters->second) {
+        node.child_counters_map.erase(child_counters++);
+      } else {
+        ++child_counters;
+      }
+    }
+
+    vector<string> info_strings_display_order;
+    BOOST_FOREACH(const string& key, node.info_strings_display_order) {
+      InfoStrings::const_iterator it = prev_node.info_strings.find(key);
+      if (it != prev_node.info_strings.end() && it->second == node.info_strings[key]) {
+        node.info_strings.erase(key);
+      } else {
+        info_strings_display_order.push_back(key);
+      }
+    }
+    node.info_strings_display_order.swap(info_strings_display_order);
+
+    vector<TTimeSeriesCounter> time_series_counters;
+    BOOST_FOREACH(const TTimeSeriesCounter& counter, node.time_series_counters) {
+      bool changed = true;
+      BOOST_FOREACH(const TTimeSeriesCounter& prev_counter,
+          prev_node.time_series_counters) {
+        if (prev_counter.name != counter.name) continue;
+        changed = prev_counter.period_ms != counter.period_ms ||
+            prev_counter.values != counter.values;
+        break;
+      }
+      if (changed) time_series_counters.push_back(counter);
+    }
+    node.time_series_counters.swap(time_series_counters);
+  }
+}
+
+void RuntimeProfile::RetainCounters(const set<string>& counter_names,
+    TRuntimeProfileTree* tree) {
+  BOOST_FOREACH(TRuntimeProfileNode& node, tree->nodes) {
+    vector<TCounter> counters;
+    BOOST_FOREACH(const TCounter& counter, node.counters) {
+      if (counter_names.find(counter.name) != counter_names.end() ||
+          counter.name == TOTAL_TIME_COUNTER_NAME ||
+          counter.name == INACTIVE_TIME_COUNTER_NAME ||
+          counter.name == ASYNC_TIME_COUNTER_NAME) {
+        counters.push_back(counter);
+      }
+    }
+    node.counters.swap(counters);
+    node.child_counters_map.clear();
+    node.info_strings.clear();
+    node.info_strings_display_order.clear();
+    node.__isset.event_sequences = false;
+    node.event_sequences.clear();
+    node.__isset.time_series_counters = false;
+    node.time_series_counters.clear();
+  }
+}
+
 int64_t RuntimeProfile::UnitsPerSecond(
     const RuntimeProfile::Counter* total_counter,
     const RuntimeProfile::Counter* timer) {
@@ -21,6 +21,7 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include <iostream>
+#include <set>
 #include <sys/time.h>
 #include <sys/resource.h>
 
@@ -465,6 +466,23 @@ class RuntimeProfile {
   void ToThrift(TRuntimeProfileTree* tree) const;
   void ToThrift(std::vector<TRuntimeProfileNode>* nodes) const;
 
+  // Removes from 'tree', a tree produced by ToThrift(), all counters, child counter
+  // sets, info strings and time series counters that have the same value in
+  // 'prev_tree', an earlier tree of the same profile. Nodes are matched up by the
+  // names of the profiles on their path from the root. Update() with the result has
+  // the same effect as Update() with 'tree' on a profile that has already been updated
+  // with 'prev_tree'. Event sequences are removed as well, because Update() ignores
+  // them. The shape of the tree is not changed.
+  static void RemoveUnchanged(const TRuntimeProfileTree& prev_tree,
+      TRuntimeProfileTree* tree);
+
+  // Removes from 'tree' all counters whose names are not in 'counter_names', apart
+  // from the time counters that local_time() is computed from, and all child counter
+  // sets, info strings, event sequences and time series counters. The shape of the
+  // tree is not changed.
+  static void RetainCounters(const std::set<std::string>& counter_names,
+      TRuntimeProfileTree* tree);
+
   // Serializes the runtime profile to a string.  This first serializes the
   // object using thrift compact binary format, then gzip compresses it and
   // finally encodes it as base64.  This is not a lightweight operation and
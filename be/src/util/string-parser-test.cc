@@ -183,6 +183,35 @@ TEST(StringToInt, InvalidLeadingTrailing) {
   TestIntValue<int8_t>("   ", 0, StringParser::PARSE_FAILURE);
 }
 
+// Tests the strings that are long enough to be parsed 8 digits at a time.
+TEST(StringToInt, EightDigits) {
+  TestIntValue<int32_t>("123456789", 123456789, StringParser::PARSE_SUCCESS);
+  TestIntValue<int32_t>("-987654321", -987654321, StringParser::PARSE_SUCCESS);
+  TestIntValue<int32_t>("000000007", 7, StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("100000000000000001", 100000000000000001LL,
+      StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("-12345678901234567", -12345678901234567LL,
+      StringParser::PARSE_SUCCESS);
+
+  // A non-digit anywhere in the 8 characters.
+  TestIntValue<int32_t>("1234a6789", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("12345678:", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("1/3456789", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int64_t>("12345678901234.67", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int64_t>("1234567890123456\xb7", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("1234 6789", 0, StringParser::PARSE_FAILURE);
+
+  // Every number with 1 to 18 digits of the form 1..k, and one less.
+  int64_t val = 0;
+  for (int i = 1; i <= 18; ++i) {
+    val = val * 10 + i % 10;
+    TestIntValue<int64_t>(lexical_cast<string>(val).c_str(), val,
+        StringParser::PARSE_SUCCESS);
+    TestIntValue<int64_t>(lexical_cast<string>(val - 1).c_str(), val - 1,
+        StringParser::PARSE_SUCCESS);
+  }
+}
+
 TEST(StringToInt, Limit) {
   TestIntValue<int8_t>("127", 127, StringParser::PARSE_SUCCESS);
   TestIntValue<int8_t>("-128", -128, StringParser::PARSE_SUCCESS);
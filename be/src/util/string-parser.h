@@ -16,6 +16,7 @@
 #ifndef IMPALA_UTIL_STRING_PARSER_H
 #define IMPALA_UTIL_STRING_PARSER_H
 
+#include <string.h>
 #include <limits>
 #include <boost/type_traits.hpp>
 #include "common/compiler-util.h"
@@ -44,12 +45,13 @@ namespace impala {
 // for that data type.  This is different from hive, which returns NULL for overflow
 // slots for int types and inf/-inf for float types.
 //
+// Integers are parsed 8 digits at a time while there are at least 8 characters left,
+// with 64 bit integer operations on the 8 characters (see ParseEightDigits()).
+//
 // Things we tried that did not work:
 //  - lookup table for converting character to digit
 // Improvements (TODO):
 //  - Validate input using _sidd_compare_ranges
-//  - Since we know the length, we can parallelize this: i.e. result = 100*s[0] +
-//    10*s[1] + s[2]
 class StringParser {
  public:
   enum ParseResult {
@@ -481,7 +483,13 @@ class StringParser {
       *result = PARSE_FAILURE;
       return 0;
     }
-    for (int i = 1; i < len; ++i) {
+    int i = 1;
+    uint64_t digits;
+    while (len - i >= 8 && ParseEightDigits(s + i, &digits)) {
+      val = static_cast<T>(static_cast<uint64_t>(val) * 100000000 + digits);
+      i += 8;
+    }
+    for (; i < len; ++i) {
       if (LIKELY(s[i] >= '0' && s[i] <= '9')) {
         T digit = s[i] - '0';
         val = val * 10 + digit;
@@ -497,6 +505,31 @@ class StringParser {
     *result = PARSE_SUCCESS;
     return val;
   }
+
+  // If s[0, 8) are all ascii digits, sets *val to the number they represent and returns
+  // true. Otherwise returns false. The 8 characters are loaded into one little endian
+  // 64 bit integer, validated together and then combined into 2, 4 and 8 digit numbers
+  // with three multiplications, instead of one multiplication and one branch per digit.
+  static inline bool ParseEightDigits(const char* s, uint64_t* val) {
+    uint64_t chunk;
+    memcpy(&chunk, s, sizeof(chunk));
+    // A character is a digit iff its high nibble is 3 and adding 6 to it does not carry
+    // into the high nibble.
+    if (((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+         (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+        0x3333333333333333ULL) {
+      return false;
+    }
+    chunk -= 0x3030303030303030ULL;
+    // Every other byte: 10 * s[i] + s[i + 1].
+    chunk = chunk * 10 + (chunk >> 8);
+    // Combine the 2 digit numbers into 4 and then 8 digits. The result ends up in the
+    // upper 32 bits.
+    chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+             (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    *val = chunk;
+    return true;
+  }
 };
 
 template<>
@@ -96,6 +96,58 @@ class TupleRowComparator {
     return (*this)(lhs_row, rhs_row);
   }
 
+  // Returns true if GetNormalizedPrefix() can be used for rows compared by this
+  // comparator, i.e. if the first key is of an integer type.
+  bool HasNormalizedPrefix() const {
+    if (key_expr_ctxs_lhs_.empty()) return false;
+    switch (key_expr_ctxs_lhs_[0]->root()->type().type) {
+      case TYPE_BOOLEAN:
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Returns the first key of 'row' encoded so that comparing the prefixes of two rows
+  // as unsigned integers orders them like Compare() does if the prefixes differ. If the
+  // prefixes are equal, the rows must be compared with Compare(). Evaluates the first
+  // key expr on the lhs, so the prefix of a row can be computed once and cached while
+  // the row is compared repeatedly. Must only be called if HasNormalizedPrefix().
+  uint64_t GetNormalizedPrefix(TupleRow* row) const {
+    DCHECK(HasNormalizedPrefix());
+    void* value = key_expr_ctxs_lhs_[0]->GetValue(row);
+    // NULLs get the smallest or largest prefix, which non-NULL values may share.
+    if (value == NULL) return nulls_first_[0] < 0 ? 0 : ~static_cast<uint64_t>(0);
+    int64_t int_value;
+    switch (key_expr_ctxs_lhs_[0]->root()->type().type) {
+      case TYPE_BOOLEAN:
+        int_value = *reinterpret_cast<bool*>(value);
+        break;
+      case TYPE_TINYINT:
+        int_value = *reinterpret_cast<int8_t*>(value);
+        break;
+      case TYPE_SMALLINT:
+        int_value = *reinterpret_cast<int16_t*>(value);
+        break;
+      case TYPE_INT:
+        int_value = *reinterpret_cast<int32_t*>(value);
+        break;
+      case TYPE_BIGINT:
+        int_value = *reinterpret_cast<int64_t*>(value);
+        break;
+      default:
+        DCHECK(false);
+        return 0;
+    }
+    // Flipping the sign bit maps the signed order onto the unsigned order.
+    uint64_t prefix = static_cast<uint64_t>(int_value) ^ (static_cast<uint64_t>(1) << 63);
+    return is_asc_[0] ? prefix : ~prefix;
+  }
+
  private:
   std::vector<ExprContext*> key_expr_ctxs_lhs_;
   std::vector<ExprContext*> key_expr_ctxs_rhs_;